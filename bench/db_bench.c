@@ -0,0 +1,1372 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * db_bench.c --
+ *
+ *     A benchmark of SplinterDB through its public API, in the style of
+ *     LevelDB's and RocksDB's db_bench.
+ *
+ *     A run opens (or creates) one database and runs the workloads listed
+ *     in --benchmarks on it, in order, each with --threads threads:
+ *
+ *       fillseq          insert --num keys in key order
+ *       fillrandom       insert --num keys in random order
+ *       overwrite        same as fillrandom, meant to run on a full db
+ *       readrandom       look up --reads random keys
+ *       readmissing      look up --reads random keys that do not exist
+ *       seekrandom       seek --reads iterators to random keys, and step
+ *                        each --seek-nexts times
+ *       readwhilewriting readrandom, while one more thread overwrites
+ *       updaterandom     apply --reads updates, through a merge operator
+ *                        that adds to a 64-bit counter in the value
+ *       deleterandom     delete --reads random keys
+ *
+ *     Keys are numbered 0 to --num - 1. A key starts with its number, in
+ *     big-endian, so key order is number order, and is padded out to a
+ *     length drawn from the key size distribution, which is the same every
+ *     time for a given number. Random keys are drawn uniformly, or from a
+ *     scrambled zipfian distribution with --key-dist=zipfian.
+ *
+ *     The results are written as JSON to stdout or --output. Each workload
+ *     reports its throughput and latency percentiles, as measured by the
+ *     calling threads, and the cache hits and misses, I/O and write
+ *     amplification of the database over the time it ran.
+ *
+ *     Run with --help for the options.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "splinterdb/default_data_config.h"
+#include "splinterdb/splinterdb.h"
+
+#define MiB (1024UL * 1024UL)
+
+// Keys start with their number, so they cannot be shorter than that
+#define BENCH_KEY_PREFIX_SIZE sizeof(uint64)
+
+// Appended to a key to make one that is never inserted
+#define BENCH_MISSING_SUFFIX '.'
+
+// Values are cut out of a buffer of random bytes at least this big
+#define BENCH_VALUE_BUFFER_SIZE MiB
+
+#define BENCH_MAX_THREADS 48
+
+/*
+ *-----------------------------------------------------------------------------
+ * Configuration
+ *-----------------------------------------------------------------------------
+ */
+typedef enum bench_size_dist {
+   BENCH_SIZE_FIXED,
+   BENCH_SIZE_UNIFORM,
+   BENCH_SIZE_NORMAL,
+} bench_size_dist;
+
+typedef enum bench_key_dist {
+   BENCH_KEYS_UNIFORM,
+   BENCH_KEYS_ZIPFIAN,
+} bench_key_dist;
+
+// A size drawn from [min, max]
+typedef struct bench_size {
+   bench_size_dist dist;
+   uint64          min;
+   uint64          max;
+} bench_size;
+
+typedef struct bench_config {
+   const char *benchmarks;
+   const char *db;
+   const char *output;
+   _Bool       use_existing_db;
+
+   uint64         num;
+   uint64         reads;
+   uint64         threads;
+   uint64         seek_nexts;
+   uint64         seed;
+   bench_size     key_size;
+   bench_size     value_size;
+   bench_key_dist key_dist;
+   double         zipf_theta;
+
+   uint64                cache_size_mb;
+   uint64                disk_size_mb;
+   uint64                memtable_capacity_mb;
+   uint64                num_memtable_bg_threads;
+   uint64                num_normal_bg_threads;
+   uint64                value_log_threshold;
+   _Bool                 use_log;
+   splinterdb_durability durability;
+   _Bool                 use_stats;
+} bench_config;
+
+static void
+bench_config_init(bench_config *cfg)
+{
+   memset(cfg, 0, sizeof(*cfg));
+   cfg->benchmarks = "fillrandom,readrandom,seekrandom,readmissing,"
+                     "updaterandom,readwhilewriting,deleterandom";
+   cfg->db         = "db_bench.db";
+   cfg->num        = 1000000;
+   cfg->threads    = 1;
+   cfg->seek_nexts = 10;
+   cfg->seed       = 301;
+   cfg->key_size   = (bench_size){BENCH_SIZE_FIXED, 16, 16};
+   cfg->value_size = (bench_size){BENCH_SIZE_FIXED, 100, 100};
+   cfg->key_dist   = BENCH_KEYS_UNIFORM;
+   cfg->zipf_theta = 0.99;
+
+   cfg->cache_size_mb           = 512;
+   cfg->disk_size_mb            = 16 * 1024;
+   cfg->num_memtable_bg_threads = 1;
+   cfg->num_normal_bg_threads   = 2;
+   cfg->durability              = SPLINTERDB_DURABILITY_NONE;
+   cfg->use_stats               = 1;
+}
+
+static const char *const bench_size_dist_names[] = {
+   [BENCH_SIZE_FIXED]   = "fixed",
+   [BENCH_SIZE_UNIFORM] = "uniform",
+   [BENCH_SIZE_NORMAL]  = "normal",
+};
+
+static const char *const bench_key_dist_names[] = {
+   [BENCH_KEYS_UNIFORM] = "uniform",
+   [BENCH_KEYS_ZIPFIAN] = "zipfian",
+};
+
+static const char *const bench_durability_names[] = {
+   [SPLINTERDB_DURABILITY_NONE]     = "none",
+   [SPLINTERDB_DURABILITY_BUFFERED] = "buffered",
+   [SPLINTERDB_DURABILITY_SYNCED]   = "synced",
+};
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+static void
+bench_usage(FILE *out)
+{
+   fprintf(
+      out,
+      "Usage: db_bench [options]\n"
+      "\n"
+      "Workloads:\n"
+      "  --benchmarks=LIST            comma separated workloads to run, of\n"
+      "                               fillseq, fillrandom, overwrite,\n"
+      "                               readrandom, readmissing, seekrandom,\n"
+      "                               readwhilewriting, updaterandom,\n"
+      "                               deleterandom\n"
+      "  --num=N                      number of keys (%lu)\n"
+      "  --reads=N                    operations of the workloads other\n"
+      "                               than fills (--num)\n"
+      "  --threads=N                  threads per workload (1)\n"
+      "  --seek-nexts=N               next() calls per seek (10)\n"
+      "  --key-size=MIN[:MAX]         key size in bytes, at least %lu (16)\n"
+      "  --key-size-dist=DIST         fixed, uniform or normal (fixed)\n"
+      "  --value-size=MIN[:MAX]       value size in bytes (100)\n"
+      "  --value-size-dist=DIST       fixed, uniform or normal (fixed)\n"
+      "  --key-dist=DIST              random keys, uniform or zipfian\n"
+      "  --zipf-theta=THETA           skew of zipfian keys, in (0, 1) (0.99)\n"
+      "  --seed=N                     random seed (301)\n"
+      "\n"
+      "Database:\n"
+      "  --db=PATH                    file or device (db_bench.db)\n"
+      "  --use-existing-db            open --db rather than create it\n"
+      "  --cache-size-mb=N            cache size (512)\n"
+      "  --disk-size-mb=N             device size (16384)\n"
+      "  --memtable-capacity-mb=N     memtable capacity (default)\n"
+      "  --num-memtable-bg-threads=N  (1)\n"
+      "  --num-normal-bg-threads=N    (2)\n"
+      "  --value-log-threshold=N      values longer go to the value log\n"
+      "  --use-log                    write a write-ahead log\n"
+      "  --durability=D               none, buffered or synced (none)\n"
+      "  --no-stats                   do not keep statistics\n"
+      "\n"
+      "Output:\n"
+      "  --output=PATH                write the JSON results here (stdout)\n",
+      1000000UL,
+      BENCH_KEY_PREFIX_SIZE);
+}
+
+static void
+bench_die(const char *fmt, ...)
+   __attribute__((noreturn, format(printf, 1, 2)));
+
+static void
+bench_die(const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   fprintf(stderr, "db_bench: ");
+   vfprintf(stderr, fmt, args);
+   fprintf(stderr, "\n");
+   va_end(args);
+   exit(1);
+}
+
+static uint64
+bench_parse_uint64(const char *option, const char *arg)
+{
+   char *end;
+   errno        = 0;
+   uint64 value = strtoull(arg, &end, 0);
+   if (errno != 0 || end == arg || *end != '\0' || arg[0] == '-') {
+      bench_die("--%s: invalid number '%s'", option, arg);
+   }
+   return value;
+}
+
+static int
+bench_parse_name(const char        *option,
+                 const char        *arg,
+                 const char *const *names,
+                 uint64             num_names)
+{
+   for (uint64 i = 0; i < num_names; i++) {
+      if (strcmp(arg, names[i]) == 0) {
+         return i;
+      }
+   }
+   bench_die("--%s: unknown value '%s'", option, arg);
+}
+
+static bench_size_dist
+bench_parse_size_dist(const char *option, const char *arg)
+{
+   return bench_parse_name(
+      option, arg, bench_size_dist_names, ARRAY_LEN(bench_size_dist_names));
+}
+
+static void
+bench_parse_size(const char *option, const char *arg, bench_size *size)
+{
+   char        min[32];
+   const char *colon = strchr(arg, ':');
+   if (colon == NULL) {
+      size->min = size->max = bench_parse_uint64(option, arg);
+      return;
+   }
+   if (sizeof(min) <= colon - arg) {
+      bench_die("--%s: invalid size '%s'", option, arg);
+   }
+   memcpy(min, arg, colon - arg);
+   min[colon - arg] = '\0';
+   size->min        = bench_parse_uint64(option, min);
+   size->max        = bench_parse_uint64(option, colon + 1);
+   if (size->max < size->min) {
+      bench_die("--%s: max is less than min in '%s'", option, arg);
+   }
+   if (size->dist == BENCH_SIZE_FIXED) {
+      size->dist = BENCH_SIZE_UNIFORM;
+   }
+}
+
+enum {
+   OPT_BENCHMARKS = 256,
+   OPT_NUM,
+   OPT_READS,
+   OPT_THREADS,
+   OPT_SEEK_NEXTS,
+   OPT_KEY_SIZE,
+   OPT_KEY_SIZE_DIST,
+   OPT_VALUE_SIZE,
+   OPT_VALUE_SIZE_DIST,
+   OPT_KEY_DIST,
+   OPT_ZIPF_THETA,
+   OPT_SEED,
+   OPT_DB,
+   OPT_USE_EXISTING_DB,
+   OPT_CACHE_SIZE_MB,
+   OPT_DISK_SIZE_MB,
+   OPT_MEMTABLE_CAPACITY_MB,
+   OPT_NUM_MEMTABLE_BG_THREADS,
+   OPT_NUM_NORMAL_BG_THREADS,
+   OPT_VALUE_LOG_THRESHOLD,
+   OPT_USE_LOG,
+   OPT_DURABILITY,
+   OPT_NO_STATS,
+   OPT_OUTPUT,
+   OPT_HELP,
+};
+
+static const struct option bench_options[] = {
+   {"benchmarks", required_argument, NULL, OPT_BENCHMARKS},
+   {"num", required_argument, NULL, OPT_NUM},
+   {"reads", required_argument, NULL, OPT_READS},
+   {"threads", required_argument, NULL, OPT_THREADS},
+   {"seek-nexts", required_argument, NULL, OPT_SEEK_NEXTS},
+   {"key-size", required_argument, NULL, OPT_KEY_SIZE},
+   {"key-size-dist", required_argument, NULL, OPT_KEY_SIZE_DIST},
+   {"value-size", required_argument, NULL, OPT_VALUE_SIZE},
+   {"value-size-dist", required_argument, NULL, OPT_VALUE_SIZE_DIST},
+   {"key-dist", required_argument, NULL, OPT_KEY_DIST},
+   {"zipf-theta", required_argument, NULL, OPT_ZIPF_THETA},
+   {"seed", required_argument, NULL, OPT_SEED},
+   {"db", required_argument, NULL, OPT_DB},
+   {"use-existing-db", no_argument, NULL, OPT_USE_EXISTING_DB},
+   {"cache-size-mb", required_argument, NULL, OPT_CACHE_SIZE_MB},
+   {"disk-size-mb", required_argument, NULL, OPT_DISK_SIZE_MB},
+   {"memtable-capacity-mb", required_argument, NULL, OPT_MEMTABLE_CAPACITY_MB},
+   {"num-memtable-bg-threads",
+    required_argument,
+    NULL,
+    OPT_NUM_MEMTABLE_BG_THREADS},
+   {"num-normal-bg-threads",
+    required_argument,
+    NULL,
+    OPT_NUM_NORMAL_BG_THREADS},
+   {"value-log-threshold", required_argument, NULL, OPT_VALUE_LOG_THRESHOLD},
+   {"use-log", no_argument, NULL, OPT_USE_LOG},
+   {"durability", required_argument, NULL, OPT_DURABILITY},
+   {"no-stats", no_argument, NULL, OPT_NO_STATS},
+   {"output", required_argument, NULL, OPT_OUTPUT},
+   {"help", no_argument, NULL, OPT_HELP},
+   {NULL, 0, NULL, 0},
+};
+
+static void
+bench_parse_args(int argc, char *argv[], bench_config *cfg)
+{
+   bench_size_dist key_size_dist   = BENCH_SIZE_FIXED;
+   bench_size_dist value_size_dist = BENCH_SIZE_FIXED;
+   _Bool           key_size_dist_set   = 0;
+   _Bool           value_size_dist_set = 0;
+   int             opt;
+
+   while ((opt = getopt_long(argc, argv, "", bench_options, NULL)) != -1) {
+      const char *name = NULL;
+      for (const struct option *o = bench_options; o->name != NULL; o++) {
+         if (o->val == opt) {
+            name = o->name;
+         }
+      }
+      switch (opt) {
+         case OPT_BENCHMARKS:
+            cfg->benchmarks = optarg;
+            break;
+         case OPT_NUM:
+            cfg->num = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_READS:
+            cfg->reads = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_THREADS:
+            cfg->threads = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_SEEK_NEXTS:
+            cfg->seek_nexts = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_KEY_SIZE:
+            bench_parse_size(name, optarg, &cfg->key_size);
+            break;
+         case OPT_KEY_SIZE_DIST:
+            key_size_dist     = bench_parse_size_dist(name, optarg);
+            key_size_dist_set = 1;
+            break;
+         case OPT_VALUE_SIZE:
+            bench_parse_size(name, optarg, &cfg->value_size);
+            break;
+         case OPT_VALUE_SIZE_DIST:
+            value_size_dist     = bench_parse_size_dist(name, optarg);
+            value_size_dist_set = 1;
+            break;
+         case OPT_KEY_DIST:
+            cfg->key_dist = bench_parse_name(name,
+                                             optarg,
+                                             bench_key_dist_names,
+                                             ARRAY_LEN(bench_key_dist_names));
+            break;
+         case OPT_ZIPF_THETA:
+            cfg->zipf_theta = strtod(optarg, NULL);
+            if (!(0 < cfg->zipf_theta && cfg->zipf_theta < 1)) {
+               bench_die("--%s: must be in (0, 1)", name);
+            }
+            break;
+         case OPT_SEED:
+            cfg->seed = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_DB:
+            cfg->db = optarg;
+            break;
+         case OPT_USE_EXISTING_DB:
+            cfg->use_existing_db = 1;
+            break;
+         case OPT_CACHE_SIZE_MB:
+            cfg->cache_size_mb = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_DISK_SIZE_MB:
+            cfg->disk_size_mb = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_MEMTABLE_CAPACITY_MB:
+            cfg->memtable_capacity_mb = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_NUM_MEMTABLE_BG_THREADS:
+            cfg->num_memtable_bg_threads = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_NUM_NORMAL_BG_THREADS:
+            cfg->num_normal_bg_threads = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_VALUE_LOG_THRESHOLD:
+            cfg->value_log_threshold = bench_parse_uint64(name, optarg);
+            break;
+         case OPT_USE_LOG:
+            cfg->use_log = 1;
+            break;
+         case OPT_DURABILITY:
+            cfg->durability =
+               bench_parse_name(name,
+                                optarg,
+                                bench_durability_names,
+                                ARRAY_LEN(bench_durability_names));
+            break;
+         case OPT_NO_STATS:
+            cfg->use_stats = 0;
+            break;
+         case OPT_OUTPUT:
+            cfg->output = optarg;
+            break;
+         case OPT_HELP:
+            bench_usage(stdout);
+            exit(0);
+         default:
+            bench_usage(stderr);
+            exit(1);
+      }
+   }
+   if (optind < argc) {
+      bench_die("unexpected argument '%s'", argv[optind]);
+   }
+
+   // A distribution given on its own applies to the sizes given with it
+   if (key_size_dist_set) {
+      cfg->key_size.dist = key_size_dist;
+   }
+   if (value_size_dist_set) {
+      cfg->value_size.dist = value_size_dist;
+   }
+
+   if (cfg->reads == 0) {
+      cfg->reads = cfg->num;
+   }
+   if (cfg->num == 0) {
+      bench_die("--num must be positive");
+   }
+   if (cfg->threads == 0 || BENCH_MAX_THREADS < cfg->threads) {
+      bench_die("--threads must be from 1 to %d", BENCH_MAX_THREADS);
+   }
+   if (cfg->key_size.min < BENCH_KEY_PREFIX_SIZE) {
+      bench_die("--key-size must be at least %lu", BENCH_KEY_PREFIX_SIZE);
+   }
+   if (cfg->durability != SPLINTERDB_DURABILITY_NONE && !cfg->use_log) {
+      bench_die("--durability needs --use-log");
+   }
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Random numbers
+ *-----------------------------------------------------------------------------
+ */
+
+// splitmix64, also used as a hash of key numbers
+static inline uint64
+bench_mix(uint64 x)
+{
+   x += 0x9e3779b97f4a7c15UL;
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+   return x ^ (x >> 31);
+}
+
+// xorshift64*, one per thread
+static inline uint64
+bench_rand(uint64 *state)
+{
+   uint64 x = *state;
+   x ^= x >> 12;
+   x ^= x << 25;
+   x ^= x >> 27;
+   *state = x;
+   return x * 0x2545f4914f6cdd1dUL;
+}
+
+// Uniform in [0, 1)
+static inline double
+bench_rand_double(uint64 *state)
+{
+   return (bench_rand(state) >> 11) * (1.0 / (1UL << 53));
+}
+
+static uint64
+bench_size_draw(const bench_size *size, uint64 r)
+{
+   uint64 range = size->max - size->min + 1;
+   switch (size->dist) {
+      case BENCH_SIZE_FIXED:
+         return size->min;
+      case BENCH_SIZE_UNIFORM:
+         return size->min + r % range;
+      case BENCH_SIZE_NORMAL:
+      {
+         // Irwin-Hall: the mean of 4 uniforms is close enough to normal, and
+         // bounded to the range, with a standard deviation of range / 7
+         uint64 sum = 0;
+         for (int i = 0; i < 4; i++) {
+            sum += (r >> (16 * i)) & 0xffff;
+         }
+         return size->min + sum * range / (4 * 0x10000);
+      }
+   }
+   return size->min;
+}
+
+/*
+ * Scrambled zipfian keys, as in YCSB: ranks are drawn from a zipfian
+ * distribution, then hashed so the popular keys are spread over the key
+ * space rather than all at its start.
+ */
+typedef struct bench_zipf {
+   uint64 n;
+   double theta;
+   double alpha;
+   double zetan;
+   double eta;
+   double half_pow_theta;
+} bench_zipf;
+
+static void
+bench_zipf_init(bench_zipf *zipf, uint64 n, double theta)
+{
+   double zetan = 0;
+   for (uint64 i = 1; i <= n; i++) {
+      zetan += 1 / pow(i, theta);
+   }
+   double zeta2         = 1 + pow(0.5, theta);
+   zipf->n              = n;
+   zipf->theta          = theta;
+   zipf->alpha          = 1 / (1 - theta);
+   zipf->zetan          = zetan;
+   zipf->eta            = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+   zipf->half_pow_theta = pow(0.5, theta);
+}
+
+static uint64
+bench_zipf_rank(const bench_zipf *zipf, double u)
+{
+   double uz = u * zipf->zetan;
+   if (uz < 1) {
+      return 0;
+   }
+   if (uz < 1 + zipf->half_pow_theta) {
+      return 1;
+   }
+   uint64 rank = zipf->n * pow(zipf->eta * u - zipf->eta + 1, zipf->alpha);
+   return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Latency histograms
+ *
+ * Log-linear, like splinterdb's own: each power of two of nanoseconds is
+ * split into 8 buckets, so a percentile is overestimated by less than 1/8.
+ *-----------------------------------------------------------------------------
+ */
+#define HISTO_SUB_BITS    3
+#define HISTO_SUB_BUCKETS (1 << HISTO_SUB_BITS)
+#define HISTO_MAX_LOG2    40
+#define HISTO_BUCKETS                                                          \
+   ((HISTO_MAX_LOG2 - HISTO_SUB_BITS + 1) * HISTO_SUB_BUCKETS)
+
+typedef struct bench_histo {
+   uint64 num;
+   uint64 total_ns;
+   uint64 max_ns;
+   uint64 count[HISTO_BUCKETS];
+} bench_histo;
+
+static inline uint64
+bench_histo_bucket(uint64 ns)
+{
+   if (ns < HISTO_SUB_BUCKETS) {
+      return ns;
+   }
+   uint64 log2 = 63 - __builtin_clzll(ns);
+   if (HISTO_MAX_LOG2 <= log2) {
+      return HISTO_BUCKETS - 1;
+   }
+   uint64 shift = log2 - HISTO_SUB_BITS;
+   return (shift + 1) * HISTO_SUB_BUCKETS + (ns >> shift) - HISTO_SUB_BUCKETS;
+}
+
+static uint64
+bench_histo_bucket_max(uint64 bucket)
+{
+   if (bucket < HISTO_SUB_BUCKETS) {
+      return bucket;
+   }
+   uint64 shift    = bucket / HISTO_SUB_BUCKETS - 1;
+   uint64 mantissa = bucket % HISTO_SUB_BUCKETS + HISTO_SUB_BUCKETS;
+   return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void
+bench_histo_record(bench_histo *histo, uint64 ns)
+{
+   histo->count[bench_histo_bucket(ns)]++;
+   histo->num++;
+   histo->total_ns += ns;
+   if (histo->max_ns < ns) {
+      histo->max_ns = ns;
+   }
+}
+
+static void
+bench_histo_merge(bench_histo *dest, const bench_histo *src)
+{
+   for (uint64 i = 0; i < HISTO_BUCKETS; i++) {
+      dest->count[i] += src->count[i];
+   }
+   dest->num += src->num;
+   dest->total_ns += src->total_ns;
+   if (dest->max_ns < src->max_ns) {
+      dest->max_ns = src->max_ns;
+   }
+}
+
+static uint64
+bench_histo_percentile(const bench_histo *histo, double percentile)
+{
+   if (histo->num == 0) {
+      return 0;
+   }
+   uint64 rank = ceil(histo->num * percentile / 100);
+   uint64 seen = 0;
+   rank        = rank == 0 ? 1 : rank;
+   for (uint64 i = 0; i < HISTO_BUCKETS; i++) {
+      seen += histo->count[i];
+      if (rank <= seen) {
+         uint64 max = bench_histo_bucket_max(i);
+         return max < histo->max_ns ? max : histo->max_ns;
+      }
+   }
+   return histo->max_ns;
+}
+
+static inline uint64
+bench_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Merge operator
+ *
+ * An update is a 64-bit delta, added to the counter in the first 8 bytes of
+ * the value. An update to a missing key makes a value of just the counter.
+ *-----------------------------------------------------------------------------
+ */
+static int
+bench_merge_tuples(const data_config *cfg,
+                   slice              key,
+                   message            old_message,
+                   merge_accumulator *new_message)
+{
+   uint64 delta;
+   uint64 counter = 0;
+   if (merge_accumulator_length(new_message) != sizeof(delta)) {
+      return EINVAL;
+   }
+   memcpy(&delta, merge_accumulator_data(new_message), sizeof(delta));
+
+   uint64 old_length = message_length(old_message);
+   if (!merge_accumulator_copy_message(new_message, old_message)) {
+      return ENOMEM;
+   }
+   if (old_length < sizeof(counter)) {
+      if (!merge_accumulator_resize(new_message, sizeof(counter))) {
+         return ENOMEM;
+      }
+   }
+   char *data = merge_accumulator_data(new_message);
+   memcpy(&counter,
+          data,
+          old_length < sizeof(counter) ? old_length : sizeof(counter));
+   counter += delta;
+   memcpy(data, &counter, sizeof(counter));
+   return 0;
+}
+
+static int
+bench_merge_tuples_final(const data_config *cfg,
+                         slice              key,
+                         merge_accumulator *oldest_message)
+{
+   merge_accumulator_set_class(oldest_message, MESSAGE_TYPE_INSERT);
+   return 0;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Workloads
+ *-----------------------------------------------------------------------------
+ */
+typedef struct bench_thread bench_thread;
+
+typedef int (*bench_op_fn)(bench_thread *thread, uint64 i);
+
+typedef enum bench_keys {
+   BENCH_KEYS_SEQUENTIAL, // this thread's share of 0 to num - 1, in order
+   BENCH_KEYS_RANDOM,
+} bench_keys;
+
+typedef struct bench_workload {
+   const char *name;
+   bench_op_fn op;
+   bench_keys  keys;
+   _Bool       is_fill;     // --num operations, rather than --reads
+   _Bool       with_writer; // one more thread overwrites while it runs
+} bench_workload;
+
+typedef struct bench {
+   const bench_config *cfg;
+   splinterdb         *kvs;
+   data_config         data_cfg;
+   uint64              max_key_size;
+   char               *value_buffer;
+   uint64              value_buffer_size;
+   bench_zipf          zipf;
+   FILE               *out;
+   uint64              num_results;
+} bench;
+
+struct bench_thread {
+   bench                   *b;
+   const bench_workload    *workload;
+   pthread_t                pthread;
+   uint64                   id;
+   uint64                   rng;
+   uint64                   begin; // operations [begin, end)
+   uint64                   end;
+   _Bool                    is_writer;
+   volatile _Bool          *stop;
+   char                    *key_buffer;
+   splinterdb_lookup_result result;
+
+   uint64      ops;
+   uint64      found;
+   uint64      bytes; // of keys and values written or read
+   int         rc;
+   bench_histo histo;
+};
+
+static uint64
+bench_key_number(bench_thread *thread, uint64 i)
+{
+   if (thread->workload->keys == BENCH_KEYS_SEQUENTIAL) {
+      return i;
+   }
+   const bench_config *cfg = thread->b->cfg;
+   if (cfg->key_dist == BENCH_KEYS_ZIPFIAN) {
+      uint64 rank =
+         bench_zipf_rank(&thread->b->zipf, bench_rand_double(&thread->rng));
+      return bench_mix(rank) % cfg->num;
+   }
+   return bench_rand(&thread->rng) % cfg->num;
+}
+
+// Builds the key numbered n in the thread's key buffer
+static slice
+bench_key(bench_thread *thread, uint64 n)
+{
+   const bench_config *cfg    = thread->b->cfg;
+   uint64              length = bench_size_draw(&cfg->key_size, bench_mix(n));
+   char               *key    = thread->key_buffer;
+   for (int i = 0; i < BENCH_KEY_PREFIX_SIZE; i++) {
+      key[i] = n >> (8 * (BENCH_KEY_PREFIX_SIZE - 1 - i));
+   }
+   memset(key + BENCH_KEY_PREFIX_SIZE, 'k', length - BENCH_KEY_PREFIX_SIZE);
+   return slice_create(length, key);
+}
+
+static slice
+bench_value(bench_thread *thread)
+{
+   const bench_config *cfg = thread->b->cfg;
+   uint64              r   = bench_rand(&thread->rng);
+   uint64 length = bench_size_draw(&cfg->value_size, bench_mix(r));
+   uint64 offset = r % (thread->b->value_buffer_size - length + 1);
+   return slice_create(length, thread->b->value_buffer + offset);
+}
+
+static int
+bench_op_insert(bench_thread *thread, uint64 i)
+{
+   slice key   = bench_key(thread, bench_key_number(thread, i));
+   slice value = bench_value(thread);
+   thread->bytes += slice_length(key) + slice_length(value);
+   return splinterdb_insert(thread->b->kvs, key, value);
+}
+
+static int
+bench_do_lookup(bench_thread *thread, slice key)
+{
+   int rc = splinterdb_lookup(thread->b->kvs, key, &thread->result);
+   if (rc == 0 && splinterdb_lookup_found(&thread->result)) {
+      slice value;
+      rc = splinterdb_lookup_result_value(&thread->result, &value);
+      thread->found++;
+      thread->bytes += slice_length(key) + slice_length(value);
+   }
+   return rc;
+}
+
+static int
+bench_op_lookup(bench_thread *thread, uint64 i)
+{
+   slice key = bench_key(thread, bench_key_number(thread, i));
+   return bench_do_lookup(thread, key);
+}
+
+static int
+bench_op_lookup_missing(bench_thread *thread, uint64 i)
+{
+   slice key = bench_key(thread, bench_key_number(thread, i));
+   thread->key_buffer[slice_length(key)] = BENCH_MISSING_SUFFIX;
+   key = slice_create(slice_length(key) + 1, thread->key_buffer);
+   return bench_do_lookup(thread, key);
+}
+
+static int
+bench_op_seek(bench_thread *thread, uint64 i)
+{
+   splinterdb_iterator *it;
+   slice key = bench_key(thread, bench_key_number(thread, i));
+   int   rc  = splinterdb_iterator_init(thread->b->kvs, &it, key);
+   if (rc != 0) {
+      return rc;
+   }
+   for (uint64 n = 0; n <= thread->b->cfg->seek_nexts; n++) {
+      if (!splinterdb_iterator_valid(it)) {
+         break;
+      }
+      slice value;
+      splinterdb_iterator_get_current(it, &key, &value);
+      thread->found++;
+      thread->bytes += slice_length(key) + slice_length(value);
+      if (n < thread->b->cfg->seek_nexts) {
+         splinterdb_iterator_next(it);
+      }
+   }
+   rc = splinterdb_iterator_status(it);
+   splinterdb_iterator_deinit(it);
+   return rc;
+}
+
+static int
+bench_op_update(bench_thread *thread, uint64 i)
+{
+   uint64 delta = 1;
+   slice  key   = bench_key(thread, bench_key_number(thread, i));
+   thread->bytes += slice_length(key) + sizeof(delta);
+   return splinterdb_update(
+      thread->b->kvs, key, slice_create(sizeof(delta), &delta));
+}
+
+static int
+bench_op_delete(bench_thread *thread, uint64 i)
+{
+   slice key = bench_key(thread, bench_key_number(thread, i));
+   thread->bytes += slice_length(key);
+   return splinterdb_delete(thread->b->kvs, key);
+}
+
+static const bench_workload bench_workloads[] = {
+   {"fillseq", bench_op_insert, BENCH_KEYS_SEQUENTIAL, 1, 0},
+   {"fillrandom", bench_op_insert, BENCH_KEYS_RANDOM, 1, 0},
+   {"overwrite", bench_op_insert, BENCH_KEYS_RANDOM, 1, 0},
+   {"readrandom", bench_op_lookup, BENCH_KEYS_RANDOM, 0, 0},
+   {"readmissing", bench_op_lookup_missing, BENCH_KEYS_RANDOM, 0, 0},
+   {"seekrandom", bench_op_seek, BENCH_KEYS_RANDOM, 0, 0},
+   {"readwhilewriting", bench_op_lookup, BENCH_KEYS_RANDOM, 0, 1},
+   {"updaterandom", bench_op_update, BENCH_KEYS_RANDOM, 0, 0},
+   {"deleterandom", bench_op_delete, BENCH_KEYS_RANDOM, 0, 0},
+};
+
+static const bench_workload bench_writer_workload = {
+   "writer", bench_op_insert, BENCH_KEYS_RANDOM, 1, 0};
+
+static void *
+bench_thread_run(void *arg)
+{
+   bench_thread *thread = arg;
+   bench        *b      = thread->b;
+
+   splinterdb_register_thread(b->kvs);
+   splinterdb_lookup_result_init(b->kvs, &thread->result, 0, NULL);
+
+   for (uint64 i = thread->begin; i < thread->end; i++) {
+      if (thread->is_writer && *thread->stop) {
+         break;
+      }
+      uint64 start = bench_now_ns();
+      int    rc    = thread->workload->op(thread, i);
+      bench_histo_record(&thread->histo, bench_now_ns() - start);
+      if (rc != 0) {
+         thread->rc = rc;
+         break;
+      }
+      thread->ops++;
+   }
+
+   splinterdb_lookup_result_deinit(&thread->result);
+   splinterdb_deregister_thread(b->kvs);
+   return NULL;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Results
+ *-----------------------------------------------------------------------------
+ */
+static void
+bench_json_string(FILE *out, const char *s)
+{
+   fputc('"', out);
+   for (; *s != '\0'; s++) {
+      if (*s == '"' || *s == '\\') {
+         fprintf(out, "\\%c", *s);
+      } else if ((unsigned char)*s < 0x20) {
+         fprintf(out, "\\u%04x", *s);
+      } else {
+         fputc(*s, out);
+      }
+   }
+   fputc('"', out);
+}
+
+static void
+bench_json_size(FILE *out, const char *name, const bench_size *size)
+{
+   fprintf(out,
+           "    \"%s\": {\"dist\": \"%s\", \"min\": %lu, \"max\": %lu},\n",
+           name,
+           bench_size_dist_names[size->dist],
+           size->min,
+           size->max);
+}
+
+static void
+bench_json_config(FILE *out, const char *name, uint64 value)
+{
+   fprintf(out, "    \"%s\": %lu,\n", name, value);
+}
+
+static void
+bench_json_begin(bench *b)
+{
+   const bench_config *cfg = b->cfg;
+   FILE               *out = b->out;
+   fprintf(out, "{\n  \"version\": ");
+   bench_json_string(out, splinterdb_get_version());
+   fprintf(out, ",\n  \"config\": {\n    \"db\": ");
+   bench_json_string(out, cfg->db);
+   fprintf(out,
+           ",\n    \"use_existing_db\": %s,\n",
+           cfg->use_existing_db ? "true" : "false");
+   bench_json_config(out, "num", cfg->num);
+   bench_json_config(out, "reads", cfg->reads);
+   bench_json_config(out, "threads", cfg->threads);
+   bench_json_config(out, "seek_nexts", cfg->seek_nexts);
+   bench_json_config(out, "seed", cfg->seed);
+   bench_json_size(out, "key_size", &cfg->key_size);
+   bench_json_size(out, "value_size", &cfg->value_size);
+   fprintf(out,
+           "    \"key_dist\": \"%s\",\n",
+           bench_key_dist_names[cfg->key_dist]);
+   fprintf(out, "    \"zipf_theta\": %g,\n", cfg->zipf_theta);
+   bench_json_config(out, "cache_size_mb", cfg->cache_size_mb);
+   bench_json_config(out, "disk_size_mb", cfg->disk_size_mb);
+   bench_json_config(out, "memtable_capacity_mb", cfg->memtable_capacity_mb);
+   bench_json_config(
+      out, "num_memtable_bg_threads", cfg->num_memtable_bg_threads);
+   bench_json_config(out, "num_normal_bg_threads", cfg->num_normal_bg_threads);
+   bench_json_config(out, "value_log_threshold", cfg->value_log_threshold);
+   fprintf(out, "    \"use_log\": %s,\n", cfg->use_log ? "true" : "false");
+   fprintf(out,
+           "    \"durability\": \"%s\",\n",
+           bench_durability_names[cfg->durability]);
+   fprintf(out, "    \"use_stats\": %s\n", cfg->use_stats ? "true" : "false");
+   fprintf(out, "  },\n  \"benchmarks\": [");
+}
+
+static void
+bench_json_end(bench *b, const splinterdb_stats *stats)
+{
+   FILE *out = b->out;
+   fprintf(out, "\n  ],\n");
+   fprintf(out, "  \"tree_height\": %lu,\n", stats->tree_height);
+   fprintf(out, "  \"disk_bytes_in_use\": %lu,\n", stats->disk_bytes_in_use);
+   fprintf(out,
+           "  \"write_amplification\": %.3f\n",
+           stats->write_amplification);
+   fprintf(out, "}\n");
+}
+
+static void
+bench_json_latency(FILE *out, const char *name, const bench_histo *histo)
+{
+   fprintf(out,
+           "      \"%s\": {\"count\": %lu, \"mean\": %.3f, \"p50\": %.3f, "
+           "\"p90\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}",
+           name,
+           histo->num,
+           histo->num == 0 ? 0 : histo->total_ns / 1000.0 / histo->num,
+           bench_histo_percentile(histo, 50) / 1000.0,
+           bench_histo_percentile(histo, 90) / 1000.0,
+           bench_histo_percentile(histo, 99) / 1000.0,
+           bench_histo_percentile(histo, 99.9) / 1000.0,
+           histo->max_ns / 1000.0);
+}
+
+#define DIFF(field) (after->field - before->field)
+
+static void
+bench_json_result(bench                  *b,
+                  const bench_workload   *workload,
+                  const bench_thread     *threads,
+                  uint64                  num_threads,
+                  const bench_thread     *writer,
+                  uint64                  elapsed_ns,
+                  const splinterdb_stats *before,
+                  const splinterdb_stats *after)
+{
+   FILE       *out   = b->out;
+   bench_histo histo = {0};
+   uint64      ops   = 0;
+   uint64      found = 0;
+   uint64      bytes = 0;
+   for (uint64 t = 0; t < num_threads; t++) {
+      bench_histo_merge(&histo, &threads[t].histo);
+      ops += threads[t].ops;
+      found += threads[t].found;
+      bytes += threads[t].bytes;
+   }
+   double secs = elapsed_ns / 1e9;
+
+   uint64 cache_hits   = DIFF(cache_hits);
+   uint64 cache_misses = DIFF(cache_misses);
+   uint64 bytes_written = DIFF(memtable_compaction_bytes_written);
+   for (int h = 0; h < SPLINTERDB_STATS_MAX_HEIGHT; h++) {
+      bytes_written += DIFF(compaction_bytes_written[h]);
+   }
+   uint64 user_kv_bytes = DIFF(user_kv_bytes);
+
+   fprintf(out, "%s\n    {\n", b->num_results++ == 0 ? "" : ",");
+   fprintf(out, "      \"name\": \"%s\",\n", workload->name);
+   fprintf(out, "      \"threads\": %lu,\n", num_threads);
+   fprintf(out, "      \"ops\": %lu,\n", ops);
+   fprintf(out, "      \"found\": %lu,\n", found);
+   fprintf(out, "      \"elapsed_sec\": %.3f,\n", secs);
+   fprintf(out, "      \"ops_per_sec\": %.1f,\n", ops / secs);
+   fprintf(out, "      \"mb_per_sec\": %.3f,\n", bytes / secs / MiB);
+   bench_json_latency(out, "latency_us", &histo);
+   fprintf(out, ",\n");
+   if (writer != NULL) {
+      fprintf(out, "      \"writer_ops\": %lu,\n", writer->ops);
+      fprintf(out, "      \"writer_ops_per_sec\": %.1f,\n", writer->ops / secs);
+      bench_json_latency(out, "writer_latency_us", &writer->histo);
+      fprintf(out, ",\n");
+   }
+   fprintf(out,
+           "      \"cache\": {\"hits\": %lu, \"misses\": %lu, "
+           "\"hit_rate\": %.4f, \"miss_time_ns\": %lu},\n",
+           cache_hits,
+           cache_misses,
+           cache_hits + cache_misses == 0
+              ? 0
+              : (double)cache_hits / (cache_hits + cache_misses),
+           DIFF(cache_miss_time_ns));
+   fprintf(out,
+           "      \"io\": {\"read_bytes\": %lu, \"write_bytes\": %lu, "
+           "\"pages_read\": %lu, \"pages_written\": %lu, "
+           "\"syncs\": %lu},\n",
+           DIFF(read_bytes),
+           DIFF(write_bytes),
+           DIFF(pages_read),
+           DIFF(pages_written),
+           DIFF(syncs_issued));
+   fprintf(out,
+           "      \"memtable\": {\"flushes\": %lu, \"stall_us\": %.3f},\n",
+           DIFF(memtable_flushes),
+           DIFF(memtable_flush_wait_time_ns) / 1000.0);
+   fprintf(out, "      \"user_kv_bytes\": %lu,\n", user_kv_bytes);
+   fprintf(out, "      \"compaction_bytes_written\": %lu,\n", bytes_written);
+   fprintf(out,
+           "      \"write_amplification\": %.3f,\n",
+           user_kv_bytes == 0 ? 0 : (double)bytes_written / user_kv_bytes);
+   fprintf(out,
+           "      \"disk_bytes_in_use\": %lu\n    }",
+           after->disk_bytes_in_use);
+   fflush(out);
+}
+
+#undef DIFF
+
+static void
+bench_stats_get(bench *b, splinterdb_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+   stats->version = SPLINTERDB_STATS_VERSION;
+   int rc         = splinterdb_stats_get(b->kvs, stats);
+   if (rc != 0) {
+      bench_die("splinterdb_stats_get: %s", strerror(rc));
+   }
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Running workloads
+ *-----------------------------------------------------------------------------
+ */
+static void
+bench_thread_init(bench_thread         *thread,
+                  bench                *b,
+                  const bench_workload *workload,
+                  uint64                id,
+                  uint64                begin,
+                  uint64                end)
+{
+   memset(thread, 0, sizeof(*thread));
+   thread->b          = b;
+   thread->workload   = workload;
+   thread->id         = id;
+   thread->begin      = begin;
+   thread->end        = end;
+   thread->rng        = bench_mix(b->cfg->seed ^ bench_mix(id)) | 1;
+   thread->key_buffer = malloc(b->max_key_size + 1);
+   if (thread->key_buffer == NULL) {
+      bench_die("out of memory");
+   }
+}
+
+static void
+bench_run(bench *b, const bench_workload *workload, uint64 run)
+{
+   const bench_config *cfg         = b->cfg;
+   uint64              num_threads = cfg->threads;
+   uint64              total_ops   = workload->is_fill ? cfg->num : cfg->reads;
+   volatile _Bool      stop        = 0;
+   bench_thread       *threads;
+   bench_thread        writer;
+   splinterdb_stats    before;
+   splinterdb_stats    after;
+
+   threads = calloc(num_threads, sizeof(*threads));
+   if (threads == NULL) {
+      bench_die("out of memory");
+   }
+   for (uint64 t = 0; t < num_threads; t++) {
+      bench_thread_init(&threads[t],
+                        b,
+                        workload,
+                        run * (BENCH_MAX_THREADS + 1) + t,
+                        total_ops * t / num_threads,
+                        total_ops * (t + 1) / num_threads);
+   }
+   if (workload->with_writer) {
+      bench_thread_init(&writer,
+                        b,
+                        &bench_writer_workload,
+                        run * (BENCH_MAX_THREADS + 1) + BENCH_MAX_THREADS,
+                        0,
+                        UINT64_MAX);
+      writer.is_writer = 1;
+      writer.stop      = &stop;
+   }
+
+   fprintf(stderr, "db_bench: running %s...\n", workload->name);
+   bench_stats_get(b, &before);
+   uint64 start = bench_now_ns();
+
+   if (workload->with_writer) {
+      if (pthread_create(&writer.pthread, NULL, bench_thread_run, &writer)) {
+         bench_die("pthread_create failed");
+      }
+   }
+   for (uint64 t = 0; t < num_threads; t++) {
+      if (pthread_create(
+             &threads[t].pthread, NULL, bench_thread_run, &threads[t])) {
+         bench_die("pthread_create failed");
+      }
+   }
+   for (uint64 t = 0; t < num_threads; t++) {
+      pthread_join(threads[t].pthread, NULL);
+   }
+   uint64 elapsed_ns = bench_now_ns() - start;
+   if (workload->with_writer) {
+      stop = 1;
+      pthread_join(writer.pthread, NULL);
+   }
+
+   bench_stats_get(b, &after);
+   for (uint64 t = 0; t < num_threads; t++) {
+      if (threads[t].rc != 0) {
+         bench_die("%s: thread %lu failed: %s",
+                   workload->name,
+                   t,
+                   strerror(threads[t].rc));
+      }
+   }
+   if (workload->with_writer && writer.rc != 0) {
+      bench_die("%s: writer failed: %s", workload->name, strerror(writer.rc));
+   }
+
+   bench_json_result(b,
+                     workload,
+                     threads,
+                     num_threads,
+                     workload->with_writer ? &writer : NULL,
+                     elapsed_ns,
+                     &before,
+                     &after);
+
+   for (uint64 t = 0; t < num_threads; t++) {
+      free(threads[t].key_buffer);
+   }
+   if (workload->with_writer) {
+      free(writer.key_buffer);
+   }
+   free(threads);
+}
+
+static const bench_workload *
+bench_find_workload(const char *name, uint64 length)
+{
+   for (uint64 i = 0; i < ARRAY_LEN(bench_workloads); i++) {
+      if (strlen(bench_workloads[i].name) == length
+          && strncmp(bench_workloads[i].name, name, length) == 0)
+      {
+         return &bench_workloads[i];
+      }
+   }
+   return NULL;
+}
+
+static void
+bench_open(bench *b)
+{
+   const bench_config *cfg = b->cfg;
+
+   default_data_config_init(b->max_key_size, &b->data_cfg);
+   b->data_cfg.merge_tuples       = bench_merge_tuples;
+   b->data_cfg.merge_tuples_final = bench_merge_tuples_final;
+
+   splinterdb_config kvs_cfg;
+   memset(&kvs_cfg, 0, sizeof(kvs_cfg));
+   kvs_cfg.filename                = cfg->db;
+   kvs_cfg.cache_size              = cfg->cache_size_mb * MiB;
+   kvs_cfg.disk_size               = cfg->disk_size_mb * MiB;
+   kvs_cfg.data_cfg                = &b->data_cfg;
+   kvs_cfg.memtable_capacity       = cfg->memtable_capacity_mb * MiB;
+   kvs_cfg.num_memtable_bg_threads = cfg->num_memtable_bg_threads;
+   kvs_cfg.num_normal_bg_threads   = cfg->num_normal_bg_threads;
+   kvs_cfg.value_log_threshold     = cfg->value_log_threshold;
+   kvs_cfg.use_log                 = cfg->use_log;
+   kvs_cfg.durability              = cfg->durability;
+   kvs_cfg.use_stats               = cfg->use_stats;
+
+   int rc = cfg->use_existing_db ? splinterdb_open(&kvs_cfg, &b->kvs)
+                                 : splinterdb_create(&kvs_cfg, &b->kvs);
+   if (rc != 0) {
+      bench_die("cannot %s %s: %s",
+                cfg->use_existing_db ? "open" : "create",
+                cfg->db,
+                strerror(rc));
+   }
+}
+
+int
+main(int argc, char *argv[])
+{
+   bench_config cfg;
+   bench        b;
+
+   bench_config_init(&cfg);
+   bench_parse_args(argc, argv, &cfg);
+
+   // Check the workload names before spending any time
+   for (const char *name = cfg.benchmarks; *name != '\0';) {
+      uint64 length = strcspn(name, ",");
+      if (length != 0 && bench_find_workload(name, length) == NULL) {
+         bench_die("unknown benchmark '%.*s'", (int)length, name);
+      }
+      name += length + (name[length] == ',');
+   }
+
+   memset(&b, 0, sizeof(b));
+   b.cfg          = &cfg;
+   b.max_key_size = cfg.key_size.max + 1; // room for the missing suffix
+   b.out          = stdout;
+   if (cfg.output != NULL) {
+      b.out = fopen(cfg.output, "w");
+      if (b.out == NULL) {
+         bench_die("cannot open %s: %s", cfg.output, strerror(errno));
+      }
+   }
+
+   b.value_buffer_size = 2 * cfg.value_size.max;
+   if (b.value_buffer_size < BENCH_VALUE_BUFFER_SIZE) {
+      b.value_buffer_size = BENCH_VALUE_BUFFER_SIZE;
+   }
+   b.value_buffer = malloc(b.value_buffer_size);
+   if (b.value_buffer == NULL) {
+      bench_die("out of memory");
+   }
+   uint64 rng = bench_mix(cfg.seed) | 1;
+   for (uint64 i = 0; i < b.value_buffer_size; i++) {
+      b.value_buffer[i] = bench_rand(&rng);
+   }
+
+   if (cfg.key_dist == BENCH_KEYS_ZIPFIAN) {
+      bench_zipf_init(&b.zipf, cfg.num, cfg.zipf_theta);
+   }
+
+   bench_open(&b);
+   bench_json_begin(&b);
+
+   uint64 run = 0;
+   for (const char *name = cfg.benchmarks; *name != '\0';) {
+      uint64 length = strcspn(name, ",");
+      if (length != 0) {
+         bench_run(&b, bench_find_workload(name, length), run++);
+      }
+      name += length + (name[length] == ',');
+   }
+
+   splinterdb_stats stats;
+   bench_stats_get(&b, &stats);
+   bench_json_end(&b, &stats);
+
+   splinterdb_close(&b.kvs);
+   free(b.value_buffer);
+   if (b.out != stdout) {
+      fclose(b.out);
+   }
+   return 0;
+}
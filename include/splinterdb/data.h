@@ -32,6 +32,11 @@ typedef enum message_type {
    MESSAGE_TYPE_UPDATE,
    MESSAGE_TYPE_DELETE,
    MESSAGE_TYPE_MAX_VALID_USER_TYPE = MESSAGE_TYPE_DELETE,
+   // Internal: a range delete in the log, from the tuple's key to the key in
+   // its message
+   MESSAGE_TYPE_RANGE_DELETE,
+   // Internal: an insert whose value is in the value log, see value_log.h
+   MESSAGE_TYPE_INSERT_INDIRECT,
    MESSAGE_TYPE_PIVOT_DATA          = 1000
 } message_type;
 
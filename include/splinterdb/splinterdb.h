@@ -20,6 +20,20 @@
 const char *
 splinterdb_get_version();
 
+// How durable a write is once the call which made it returns
+//
+// Only tables with use_log can make writes durable before they are closed.
+typedef enum splinterdb_durability {
+   // Written to the log when this thread's log page fills
+   SPLINTERDB_DURABILITY_NONE = 0,
+   // Written to the device, where it survives the process crashing but
+   // perhaps not the OS crashing or power failing
+   SPLINTERDB_DURABILITY_BUFFERED,
+   // On stable storage. Threads which write concurrently share syncs of the
+   // device (group commit).
+   SPLINTERDB_DURABILITY_SYNCED,
+} splinterdb_durability;
+
 /*
  * ****************************************************************************
  * Configuration options for SplinterDB:
@@ -97,8 +111,22 @@ typedef struct splinterdb_config {
    uint64 filter_index_size;
 
    // log
+   //
+   // With use_log, every insert is also written to a write-ahead log. If the
+   // process exits without splinterdb_close(), splinterdb_open() replays the
+   // log onto the table as it was last closed. Only writes which were made
+   // durable (see durability below) are sure to be recovered.
+   //
+   // To keep the last closed image intact, disk space freed while a table with
+   // a log is open is not reused until it is closed or checkpointed (see
+   // splinterdb_checkpoint()).
    _Bool use_log;
 
+   // Durability of every insert, delete, update and write batch. Anything
+   // but SPLINTERDB_DURABILITY_NONE requires use_log. Writes may also be made
+   // durable selectively with splinterdb_sync().
+   splinterdb_durability durability;
+
    // splinter
    uint64 memtable_capacity;
    uint64 fanout;
@@ -145,6 +173,21 @@ typedef struct splinterdb_config {
    // work to be performed on foreground threads, increasing tail
    // latencies.
    uint64 queue_scale_percent;
+
+   // value log
+   //
+   // Values longer than value_log_threshold bytes are appended to a value
+   // log, and the table keeps only a small reference to them, so compactions
+   // do not rewrite them. Such values may also be longer than the table
+   // otherwise allows, up to about an extent. The space of overwritten and
+   // deleted values is reclaimed by copying the live values out of extents
+   // that compactions find mostly dead (see also splinterdb_value_log_gc()).
+   // 0, the default, means no value log.
+   //
+   // A value log cannot be combined with use_log, and splinterdb_update()
+   // returns ENOTSUP on a table with one. splinterdb_bulk_load() and
+   // splinterdb_ingest() keep every value in the table itself.
+   uint64 value_log_threshold;
 } splinterdb_config;
 
 // Opaque handle to an opened instance of SplinterDB
@@ -178,6 +221,47 @@ splinterdb_open(const splinterdb_config *cfg, splinterdb **kvs);
 void
 splinterdb_close(splinterdb **kvs);
 
+// Keyspaces
+//
+// A keyspace is a named table kept in the same file as a splinterdb, with its
+// own data_config, tree and memtables, but sharing the splinterdb's cache,
+// allocator and background threads. So many small tables cost one cache and
+// one set of threads, rather than one each.
+//
+// Creating or opening a keyspace returns a splinterdb handle for it, which
+// is passed to the rest of this API like any other: inserts, lookups,
+// iterators, scans and so on apply to the keyspace alone. Threads register
+// once, with any of the handles. Keyspace handles stay valid until the
+// splinterdb they belong to is closed, which closes them; they are not
+// passed to splinterdb_close() themselves. Writes to separate keyspaces are
+// not atomic together.
+//
+// A keyspace is identified by a 64-bit hash of its name. The file has room
+// for 29 of them. Keyspaces are not supported on a splinterdb with use_log,
+// and are persisted when it is closed: splinterdb_checkpoint() returns
+// ENOTSUP once one is open.
+//
+// Create returns EEXIST if the keyspace exists, and ENOSPC if the file has no
+// room left. Open returns ENOENT if it does not exist, and the keyspace's
+// handle if it is already open. Both return EINVAL for an empty name or one
+// longer than SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH. data_cfg must live as long
+// as the splinterdb.
+#define SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH 256
+
+int
+splinterdb_keyspace_create(splinterdb  *kvs,      // IN
+                           const char  *name,     // IN
+                           data_config *data_cfg, // IN
+                           splinterdb **keyspace  // OUT
+);
+
+int
+splinterdb_keyspace_open(splinterdb  *kvs,      // IN
+                         const char  *name,     // IN
+                         data_config *data_cfg, // IN
+                         splinterdb **keyspace  // OUT
+);
+
 // Register the current thread so that it can be used with splinterdb.
 // This causes scratch space to be allocated for the thread.
 //
@@ -211,11 +295,218 @@ splinterdb_insert(const splinterdb *kvsb, slice key, slice value);
 int
 splinterdb_delete(const splinterdb *kvsb, slice key);
 
+// Delete every key in [start_key, end_key)
+//
+// The cost is independent of the number of keys in the range: the range is
+// recorded as a tombstone which hides the older tuples from lookups and
+// iterators, and compactions drop them as they rewrite the data. Trunk
+// pivots that lie wholly inside the range are dropped by the call itself, so
+// their space is given back without waiting for a compaction. Tuples
+// written after the call are unaffected.
+//
+// A range delete is as durable as a delete: logged when the log is enabled,
+// and synced per the configured durability (or by splinterdb_sync()).
+//
+// Range delete tombstones are never reclaimed. Returns ENOSPC once the
+// tombstone list (one extent) is full.
+int
+splinterdb_delete_range(const splinterdb *kvsb, slice start_key, slice end_key);
+
 // Insert a key and value.
 // Relies on data_config->encode_message
 int
 splinterdb_update(const splinterdb *kvsb, slice key, slice delta);
 
+// Write batches
+//
+// A write batch applies many inserts, deletes and updates in one call. This is
+// much cheaper than calling splinterdb_insert() etc. once per tuple, because
+// the memtable locking and the log appends are paid once per group of tuples
+// instead of once per tuple.
+//
+// A write batch is NOT atomic: concurrent readers may observe a prefix of the
+// batch, and if an error is returned a prefix of the batch may have been
+// applied. Writes are applied in order, so a later write to the same key in
+// the batch supersedes (or, for updates, merges onto) an earlier one.
+//
+// With a configured durability, the batch is made durable as a whole, once
+// all of it has been applied.
+
+typedef enum splinterdb_write_op {
+   SPLINTERDB_WRITE_INSERT = 0, // value is the new value
+   SPLINTERDB_WRITE_DELETE,     // value is ignored
+   SPLINTERDB_WRITE_UPDATE,     // value is a delta; relies on merge_tuples
+} splinterdb_write_op;
+
+typedef struct splinterdb_write_batch_entry {
+   splinterdb_write_op op;
+   slice               key;
+   slice               value;
+} splinterdb_write_batch_entry;
+
+// Apply num_entries writes, in order
+//
+// All entries are validated before any is applied: an invalid key, op, or an
+// update without data_config->merge_tuples returns EINVAL with no effect.
+int
+splinterdb_write_batch(const splinterdb                   *kvsb,        // IN
+                       uint64                              num_entries, // IN
+                       const splinterdb_write_batch_entry *entries      // IN
+);
+
+// Make the calling thread's writes so far durable
+//
+// Returns EINVAL for a durability above SPLINTERDB_DURABILITY_NONE if the
+// table has no log.
+int
+splinterdb_sync(const splinterdb *kvsb, splinterdb_durability durability);
+
+// Write a crash-consistent image of the table to disk without closing it
+//
+// If the process later exits without splinterdb_close(), splinterdb_open()
+// recovers the table as of the latest checkpoint, plus, with use_log, the
+// durable writes made since. So a checkpoint bounds the log to be replayed,
+// and is the only way a table without a log can persist writes while open.
+//
+// Blocks until the image is on disk. Other threads may keep reading and
+// writing meanwhile, except that writes stall while the flushes and
+// compactions under way finish, and making writes durable may wait for the
+// checkpoint to finish. Concurrent checkpoints are serialized.
+//
+// After recovering from a checkpoint, some disk space it referenced may not
+// be reclaimed.
+//
+// Returns ENOTSUP if space reclamation (reclaim_threshold) is enabled, or if
+// keyspaces are open (see splinterdb_keyspace_create()).
+int
+splinterdb_checkpoint(const splinterdb *kvs);
+
+// Reclaim the space held by overwritten and deleted values in the value log
+//
+// Copies the live values out of every extent of the value log but the one
+// being appended to. Collection also runs on its own as compactions find
+// extents with enough dead values; this reclaims the rest, such as values
+// overwritten before they left the memtable. Writes stall briefly around
+// each copied value, and extents still referred to by an open iterator or
+// snapshot are freed by a later call or splinterdb_close().
+//
+// Does nothing on a table without a value log.
+int
+splinterdb_value_log_gc(const splinterdb *kvs);
+
+// Compact [start_key, end_key) at one level of the tree, or at all of them
+//
+// Flushes the memtables into the tree first. Level 0 is the leaves, which
+// are rewritten into a single sorted run each, dropping deleted and
+// overwritten tuples; at a higher level, the data the nodes there hold for
+// the range is flushed into their children. With
+// SPLINTERDB_COMPACT_ALL_LEVELS, the levels are compacted from the root down,
+// waiting for the compactions of each level before the next, so the range
+// ends up compacted in the leaves. Whole nodes are compacted, so data just
+// outside the range may be too, and a node whose child is too full to take
+// its data is skipped.
+//
+// A null start_key or end_key leaves that end of the range unbounded.
+// Returns once the compactions of the last level are enqueued; they run on
+// the background threads, if any, and otherwise as part of later writes.
+#define SPLINTERDB_COMPACT_ALL_LEVELS ((uint64)-1)
+
+int
+splinterdb_compact_range(const splinterdb *kvs,       // IN
+                         slice             start_key, // IN
+                         slice             end_key,   // IN
+                         uint64            level      // IN
+);
+
+// Wait until no flush or compaction is queued or running, performing the
+// queued ones on the calling thread meanwhile
+//
+// Under a steady stream of writes, which keep enqueueing compactions, this
+// may not return until the writes pause.
+int
+splinterdb_compact_wait(const splinterdb *kvs);
+
+// Produces the records for splinterdb_bulk_load(), one per call
+//
+// Returns 0 after setting key and value, ENOENT once there are no more
+// records, or any other errno to abort the load. key and value must stay
+// valid until the next call.
+typedef int (*splinterdb_bulk_load_next_fn)(void  *arg,   // IN
+                                            slice *key,   // OUT
+                                            slice *value  // OUT
+);
+
+// Load records, given in strictly increasing key order, into an empty table
+//
+// The records are written straight into the table's on-disk structure,
+// bypassing the memtable, the log and the compactions inserts go through,
+// so each is written once. They all become visible when the call returns.
+//
+// Returns EINVAL if the table is not empty, or if a key is too long or out
+// of order, and the errno of a failed next() call; the table is unchanged
+// on error. Must not be called concurrently with other writes.
+//
+// The records are not logged: they persist with the next
+// splinterdb_checkpoint() or splinterdb_close().
+int
+splinterdb_bulk_load(const splinterdb            *kvsb, // IN
+                     splinterdb_bulk_load_next_fn next, // IN
+                     void                        *arg   // IN
+);
+
+// Ingest files
+//
+// An ingest file holds records in strictly increasing key order. It is built
+// offline with a splinterdb_ingest_writer, without opening any table, and
+// then ingested with splinterdb_ingest().
+
+typedef struct splinterdb_ingest_writer splinterdb_ingest_writer;
+
+// Create a new ingest file at path for tables configured like cfg
+//
+// Only cfg's data_cfg, heap_id and IO settings are used.
+int
+splinterdb_ingest_writer_create(const splinterdb_config   *cfg,   // IN
+                                const char                *path,  // IN
+                                splinterdb_ingest_writer **writer // OUT
+);
+
+// Append a record to an ingest file
+//
+// Returns EINVAL, adding nothing, if key is too long or not greater than the
+// previous key, or if value is too long.
+int
+splinterdb_ingest_writer_add(splinterdb_ingest_writer *writer, // IN
+                             slice                     key,    // IN
+                             slice                     value   // IN
+);
+
+// Complete an ingest file, sync it and free the writer
+//
+// Until this returns 0, splinterdb_ingest() rejects the file.
+int
+splinterdb_ingest_writer_finish(splinterdb_ingest_writer *writer // IN
+);
+
+// Ingest the records of the ingest file at path
+//
+// Into an empty table, the records are loaded as by splinterdb_bulk_load().
+// Otherwise they are cut into memtable-sized runs, and each run is written
+// once as a branch of the trunk's root, bypassing the memtable and the log.
+// The records are newer than every earlier write.
+//
+// Returns EINVAL if path is not a finished ingest file, EIO if it is
+// corrupt, and the errno of a failed read. Into a table that is not empty,
+// ingestion is not atomic: the runs before a failure remain ingested. Must
+// not be called concurrently with other writes.
+//
+// The records are not logged: they persist with the next
+// splinterdb_checkpoint() or splinterdb_close().
+int
+splinterdb_ingest(const splinterdb *kvsb, // IN
+                  const char       *path  // IN
+);
+
 // Lookups
 
 // Size of opaque data required to hold a lookup result
@@ -281,6 +572,97 @@ splinterdb_lookup(const splinterdb         *kvs,   // IN
                   splinterdb_lookup_result *result // IN/OUT
 );
 
+// Async lookups
+//
+// An async lookup runs until it would block on a page read, then issues the
+// read and returns, so that one thread can keep many lookups in flight.
+//
+// Async lookups are issued through a poller, which is owned by a single
+// thread and holds the state of up to max_inflight pending lookups. The
+// thread calls splinterdb_async_poll() to reap completed reads and resume the
+// lookups waiting on them; each lookup that completes during a poll has its
+// callback invoked from within that poll.
+//
+// Sample application code:
+//
+//    splinterdb_async_poller *poller;
+//    splinterdb_async_poller_create(kvs, 0, &poller);
+//
+//    rc = splinterdb_lookup_async(poller, key, &result, lookup_done, arg);
+//    if (rc == 0) {
+//       // result is ready now, lookup_done is not called
+//    } else if (rc == EINPROGRESS) {
+//       // lookup_done(key, &result, arg) is called by a later poll
+//    }
+//    ...
+//    while (splinterdb_async_poll(poller) > 0) { ... do other work ... }
+//    splinterdb_async_poller_destroy(poller);
+
+typedef struct splinterdb_async_poller splinterdb_async_poller;
+
+// Called from splinterdb_async_poll() when a pending async lookup completes
+typedef void (*splinterdb_lookup_async_cb)(slice                     key,
+                                           splinterdb_lookup_result *result,
+                                           void                     *arg);
+
+// Create a poller for async lookups issued by the calling thread
+//
+// If max_inflight is 0, it defaults to the io_async_queue_depth config option
+int
+splinterdb_async_poller_create(const splinterdb         *kvs,          // IN
+                               uint64                    max_inflight, // IN
+                               splinterdb_async_poller **poller        // OUT
+);
+
+// Destroy a poller. It must not have any lookups pending.
+void
+splinterdb_async_poller_destroy(splinterdb_async_poller *poller);
+
+// Start an async lookup of key
+//
+// result must have first been initialized using splinterdb_lookup_result_init
+// The memory of key and result must remain valid until the lookup completes.
+//
+// Returns:
+// - 0 if the lookup completed immediately; cb will not be called
+// - EINPROGRESS if the lookup is pending; cb will be called by a later poll
+// - EAGAIN if max_inflight lookups are already pending; poll and try again
+// - otherwise an errno, and the lookup was not started
+int
+splinterdb_lookup_async(splinterdb_async_poller   *poller, // IN
+                        slice                      key,    // IN
+                        splinterdb_lookup_result  *result, // IN/OUT
+                        splinterdb_lookup_async_cb cb,     // IN
+                        void                      *cb_arg  // IN
+);
+
+// Reap completed reads and resume pending lookups. Never blocks.
+//
+// Returns the number of lookups that are still pending
+uint64
+splinterdb_async_poll(splinterdb_async_poller *poller);
+
+// Lookup the messages for a batch of keys
+//
+// This is equivalent to calling splinterdb_lookup() on each key, except that
+// cache misses of different keys are overlapped: up to io_async_queue_depth
+// lookups are kept in flight at once, instead of waiting on one read at a time.
+//
+// results[i] receives the result for keys[i]; each must have first been
+// initialized using splinterdb_lookup_result_init.
+//
+// If statuses is not NULL, statuses[i] receives the status of the lookup of
+// keys[i]: 0 on success (including key not found), otherwise an errno.
+//
+// Returns 0 if all lookups succeeded, otherwise the first non-zero status.
+int
+splinterdb_lookup_batch(const splinterdb         *kvs,      // IN
+                        uint64                    num_keys, // IN
+                        const slice              *keys,     // IN
+                        splinterdb_lookup_result *results,  // IN/OUT
+                        int                      *statuses  // OUT
+);
+
 
 /*
 Iterator API (range query)
@@ -291,9 +673,9 @@ replacement for most scenarios.
 This documentation is heavily inspired by
   https://github.com/facebook/rocksdb/wiki/Iterator
 
-The biggest difference is that RocksDB's Iterator exposes a Seek(key) method,
-while SplinterDB expects the starting key to be provided at the time the
-iterator is initialized.
+The starting key is provided at the time the iterator is initialized. Like
+RocksDB's Seek(key), splinterdb_iterator_seek() repositions an existing
+iterator, which is cheaper than tearing it down and creating a new one.
 
 Similar to RocksDB, if there is no error, then status()==0.  If status() != 0,
 then valid() == false.  In other words, valid()==true implies status()== 0,
@@ -345,6 +727,22 @@ splinterdb_iterator_init(const splinterdb     *kvs,      // IN
                          slice                 start_key // IN
 );
 
+// Initialize a new iterator over the range [start_key, end_key)
+//
+// Unlike splinterdb_iterator_init, the iterator is confined to the range in
+// both directions: prev() will not move before start_key, and next() stops
+// before end_key. Leaves and branches outside the range are not read, so
+// short bounded scans are much cheaper than stopping an unbounded iterator.
+//
+// If start_key is NULL_SLICE, the range is unbounded below.
+// If end_key is NULL_SLICE, the range is unbounded above.
+int
+splinterdb_iterator_init_bounded(const splinterdb     *kvs,       // IN
+                                 splinterdb_iterator **iter,      // OUT
+                                 slice                 start_key, // IN
+                                 slice                 end_key    // IN
+);
+
 // Deinitialize an iterator
 //
 // Failing to do this may cause hangs.
@@ -387,6 +785,38 @@ splinterdb_iterator_prev(splinterdb_iterator *iter);
 void
 splinterdb_iterator_next(splinterdb_iterator *iter);
 
+// Repositions the iterator at the first key >= key, staying within the
+// bounds the iterator was initialized with.
+//
+// If key is NULL_SLICE, the iterator moves to the start of its range.
+// Seeking within the part of the tree the iterator is already positioned in
+// reuses its internal state; the return value is also reported by status().
+int
+splinterdb_iterator_seek(splinterdb_iterator *iter, // IN
+                         slice                key   // IN
+);
+
+// Copies up to max_tuples items, starting at the current item, into buffer
+// and advances the iterator past them.
+//
+// On return, keys[i] and values[i] for i < *num_tuples point into buffer, so
+// they remain valid after further iterator operations, until buffer is
+// reused. A batch stops early when the next item would not fit in buffer or
+// the iterator is exhausted; *num_tuples == 0 with a 0 return means the end
+// of the range. Returns ENOSPC if buffer cannot hold even the current item.
+//
+// Intended for full scans and exports, where it avoids a valid(),
+// get_current() and next() call per item.
+int
+splinterdb_iterator_next_batch(splinterdb_iterator *iter,        // IN/OUT
+                               uint64               max_tuples,  // IN
+                               slice               *keys,        // OUT
+                               slice               *values,      // OUT
+                               char                *buffer,      // OUT
+                               uint64               buffer_size, // IN
+                               uint64              *num_tuples   // OUT
+);
+
 // Sets *key and *value to the locations of the current item
 // Callers must not modify that memory pointed to by the slice
 //
@@ -404,6 +834,156 @@ splinterdb_iterator_get_current(splinterdb_iterator *iter, // IN
 int
 splinterdb_iterator_status(const splinterdb_iterator *iter);
 
+/*
+ * Scans
+ *
+ * splinterdb_scan() calls func on each tuple in [start_key, end_key), in key
+ * order, from within the merge loop that feeds iterators, so aggregations
+ * such as counts and sums avoid the per-tuple calls of the iterator API.
+ *
+ * If filter is not NULL, tuples whose key it rejects are skipped before their
+ * value is read, which spares reading values kept in the value log. func
+ * returns 0 to continue, and any other value to stop the scan, which
+ * splinterdb_scan() then returns. The key and value passed to func are valid
+ * only during the call.
+ *
+ * A null start_key or end_key leaves that end of the range unbounded. Like an
+ * iterator, a scan sees the tuples of each leaf of the tree as of when it
+ * reaches that leaf.
+ */
+typedef _Bool (*splinterdb_scan_filter_fn)(void *arg, // IN
+                                           slice key  // IN
+);
+
+typedef int (*splinterdb_scan_fn)(void *arg,  // IN
+                                  slice key,  // IN
+                                  slice value // IN
+);
+
+int
+splinterdb_scan(const splinterdb         *kvs,       // IN
+                slice                     start_key, // IN
+                slice                     end_key,   // IN
+                splinterdb_scan_filter_fn filter,    // IN
+                splinterdb_scan_fn        func,      // IN
+                void                     *arg        // IN
+);
+
+// Divide [start_key, end_key) into at most num_parts ranges holding about
+// the same number of tuples, for scanning them in parallel
+//
+// The split keys, at most num_parts - 1 of them in increasing order, are
+// copied into buffer and split_keys[i] pointed at the copies; part i is then
+// [split_keys[i - 1], split_keys[i]), the first and last parts being bounded
+// by start_key and end_key. The split is computed from the statistics of the
+// table's tree (see splinterdb_approximate_size()) and falls on the
+// boundaries of its leaves, so a range spanning few leaves, or with its
+// tuples all in memtables, has fewer parts.
+//
+// Returns ENOSPC if the split keys do not fit in buffer.
+int
+splinterdb_split_range(const splinterdb *kvs,           // IN
+                       slice             start_key,     // IN
+                       slice             end_key,       // IN
+                       uint64            num_parts,     // IN
+                       slice            *split_keys,    // OUT
+                       char             *buffer,        // OUT
+                       uint64            buffer_size,   // IN
+                       uint64           *num_split_keys // OUT
+);
+
+// Scan [start_key, end_key) like splinterdb_scan(), split with
+// splinterdb_split_range() into up to num_threads parts scanned concurrently
+//
+// The calling thread scans the first part, and a thread is created for each
+// of the others. func is called for part i with args[i], so each part can
+// aggregate into its own state; args must have num_threads entries. When func
+// stops a part, the other parts stop too, and the first nonzero result in
+// part order is returned.
+int
+splinterdb_parallel_scan(const splinterdb         *kvs,         // IN
+                         slice                     start_key,   // IN
+                         slice                     end_key,     // IN
+                         uint64                    num_threads, // IN
+                         splinterdb_scan_filter_fn filter,      // IN
+                         splinterdb_scan_fn        func,        // IN
+                         void *const              *args         // IN
+);
+
+/*
+ * Snapshots
+ *
+ * A snapshot is a consistent, read-only view of the database as of the time
+ * it was created. Lookups and iterators opened on a snapshot are unaffected
+ * by later inserts, updates and deletes.
+ *
+ * Creating a snapshot flushes the active memtable into the trunk and shares
+ * the resulting tree with the live database; data it references is kept
+ * until the snapshot is released. Snapshots are not supported when space
+ * reclamation (reclaim_threshold) is enabled, in which case create returns
+ * ENOTSUP.
+ *
+ * All snapshots must be released, and their iterators deinitialized, before
+ * splinterdb_close().
+ */
+typedef struct splinterdb_snapshot splinterdb_snapshot;
+
+int
+splinterdb_snapshot_create(const splinterdb     *kvs,     // IN
+                           splinterdb_snapshot **snapshot // OUT
+);
+
+void
+splinterdb_snapshot_release(splinterdb_snapshot *snapshot);
+
+// Like splinterdb_lookup(), but reads the database as of the snapshot
+int
+splinterdb_snapshot_lookup(const splinterdb_snapshot *snapshot, // IN
+                           slice                      key,      // IN
+                           splinterdb_lookup_result  *result    // IN/OUT
+);
+
+// Like splinterdb_iterator_init_bounded(), but iterates over the database as
+// of the snapshot. The iterator must be deinitialized before the snapshot is
+// released.
+int
+splinterdb_snapshot_iterator_init(const splinterdb_snapshot *snapshot,  // IN
+                                  splinterdb_iterator      **iter,      // OUT
+                                  slice                      start_key, // IN
+                                  slice                      end_key    // IN
+);
+
+/*
+ * Size estimates
+ *
+ * splinterdb_approximate_size() estimates the number of tuples in
+ * [start_key, end_key) and the bytes of their keys and values, without
+ * reading the tuples themselves: it sums statistics the table keeps for each
+ * node of its tree, and counts the tuples of the nodes at the ends of the
+ * range from their indexes. It reads a few pages per node the range spans,
+ * so a short range typically takes microseconds.
+ *
+ * The estimate counts every version of a key and deletes, until compactions
+ * merge them, and values kept in the value log count as the size of their
+ * reference. Data still in memory is left out unless include_memtables is
+ * set, in which case it is counted by iterating over the range in the
+ * memtables, which is about as costly as a scan of that part of them.
+ *
+ * A null start_key or end_key leaves that end of the range unbounded.
+ */
+typedef struct splinterdb_size_estimate {
+   uint64 num_tuples;
+   uint64 num_bytes;
+} splinterdb_size_estimate;
+
+int
+splinterdb_approximate_size(const splinterdb         *kvs,               // IN
+                            slice                     start_key,         // IN
+                            slice                     end_key,           // IN
+                            _Bool                     include_memtables, // IN
+                            splinterdb_size_estimate *estimate           // OUT
+);
+
 /*
  * Statistics Printing
  *
@@ -411,6 +991,10 @@ splinterdb_iterator_status(const splinterdb_iterator *iter);
  *
  * Prints insertion or lookup statistics. Both print cache statistics.
  *
+ * Space use walks the whole tree, and prints the space taken by the branches
+ * at each height, and the space amplification that makes. It does not need
+ * use_stats.
+ *
  * Reset statistics clears all statistics, including cache statistics.
  */
 void
@@ -419,7 +1003,148 @@ splinterdb_stats_print_insertion(const splinterdb *kvs);
 void
 splinterdb_stats_print_lookup(const splinterdb *kvs);
 
+void
+splinterdb_stats_print_space_use(const splinterdb *kvs);
+
 void
 splinterdb_stats_reset(splinterdb *kvs);
 
+// Statistics as numbers, for exporting to a metrics system
+//
+// splinterdb_stats_get() fills in a splinterdb_stats, whose version the
+// caller must set to SPLINTERDB_STATS_VERSION. Fields are only ever added to
+// the end of the struct, with a new version, so a caller built against an
+// older header gets the fields it knows of.
+//
+// Counters are cumulative since the table was opened or since
+// splinterdb_stats_reset(), and are zero unless the use_stats config option
+// is set. They are summed over the per-thread counters without taking any
+// locks, so polling is cheap even under load, but a counter may lag updates
+// being made concurrently by a few.
+//
+// On a keyspace, the operation and tree counters are those of the keyspace,
+// while the cache, I/O, task and space figures are those of the whole
+// splinterdb the keyspaces share.
+#define SPLINTERDB_STATS_VERSION    3
+#define SPLINTERDB_STATS_MAX_HEIGHT 8
+
+// Operations whose latencies are kept, as histograms per thread, since
+// version 2.
+//
+// A memtable stall is the time an insert, update or delete waited for the
+// next memtable to be ready. The foreground task types are the time threads
+// calling into splinterdb spent performing queued background tasks of that
+// type, see queue_scale_percent in splinterdb_config.
+typedef enum splinterdb_latency_type {
+   SPLINTERDB_LATENCY_INSERT,
+   SPLINTERDB_LATENCY_UPDATE,
+   SPLINTERDB_LATENCY_DELETE,
+   SPLINTERDB_LATENCY_MEMTABLE_STALL,
+   SPLINTERDB_LATENCY_LOOKUP,
+   SPLINTERDB_LATENCY_ITERATOR_INIT,
+   SPLINTERDB_LATENCY_ITERATOR_NEXT,
+   SPLINTERDB_LATENCY_FG_MEMTABLE_TASK,
+   SPLINTERDB_LATENCY_FG_NORMAL_TASK,
+   SPLINTERDB_NUM_LATENCY_TYPES
+} splinterdb_latency_type;
+
+// Percentiles are the top of the histogram bucket they fall in, so they
+// overestimate by less than 1/8, but never exceed max_ns.
+typedef struct splinterdb_latency {
+   uint64 count;
+   uint64 mean_ns;
+   uint64 p50_ns;
+   uint64 p90_ns;
+   uint64 p99_ns;
+   uint64 p999_ns;
+   uint64 max_ns;
+} splinterdb_latency;
+
+typedef struct splinterdb_stats {
+   uint64 version; // IN: SPLINTERDB_STATS_VERSION
+   _Bool  stats_enabled;
+
+   // operations
+   uint64 insertions;
+   uint64 updates;
+   uint64 deletions;
+   uint64 lookups_found;
+   uint64 lookups_not_found;
+
+   // memtables
+   uint64 memtable_flushes;
+   uint64 memtable_flush_time_ns;
+   uint64 memtable_flush_wait_time_ns;
+
+   // trunk tree, by height of the node flushed or compacted (0 for leaves)
+   uint64 tree_height;
+   uint64 flushes[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 flush_time_ns[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compactions[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_tuples[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_time_ns[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 filter_lookups[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 filter_false_positives[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 branch_lookups[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 index_splits;
+   uint64 leaf_splits;
+
+   // cache, summed over page types
+   uint64 cache_hits;
+   uint64 cache_misses;
+   uint64 cache_miss_time_ns;
+   uint64 cache_prefetches_issued;
+
+   // I/O
+   uint64 pages_read;
+   uint64 pages_written;
+   uint64 read_bytes;
+   uint64 write_bytes;
+   uint64 writes_issued;
+   uint64 syncs_issued;
+
+   // background tasks, summed over task types
+   uint64 tasks_enqueued;
+   uint64 tasks_run_in_background;
+   uint64 tasks_run_in_foreground;
+   uint64 task_queue_wait_time_ns;
+   uint64 task_queue_wait_time_max_ns;
+
+   // space
+   uint64 disk_bytes_in_use;
+   uint64 disk_capacity_bytes;
+
+   // version 2
+   splinterdb_latency latency[SPLINTERDB_NUM_LATENCY_TYPES];
+
+   // version 3: data volume by height, for write amplification.
+   //
+   // kv bytes are the sizes of keys and messages, bytes written the extents
+   // allocated for the branches that compactions build. Flushes are counted
+   // by the height of the node flushed from, compactions by the height of the
+   // node compacted in; memtable compactions are counted apart. The merge time
+   // includes the I/O wait of compactions.
+   uint64 user_kv_bytes; // inserted, updated and deleted
+   uint64 memtable_compaction_kv_bytes;
+   uint64 memtable_compaction_bytes_written;
+   uint64 flush_tuples[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 flush_kv_bytes[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_input_tuples[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_input_kv_bytes[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_output_kv_bytes[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_bytes_written[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_merge_time_ns[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 compaction_io_wait_ns[SPLINTERDB_STATS_MAX_HEIGHT];
+   uint64 filter_build_time_ns[SPLINTERDB_STATS_MAX_HEIGHT];
+   // All bytes written over user_kv_bytes, or 0 before any were inserted
+   double write_amplification;
+} splinterdb_stats;
+
+// Returns 0 on success, EINVAL if stats->version is not supported (versions
+// 1 through SPLINTERDB_STATS_VERSION are), or ENOMEM.
+int
+splinterdb_stats_get(const splinterdb *kvs,  // IN
+                     splinterdb_stats *stats // IN/OUT
+);
+
 #endif // _SPLINTERDB_H_
@@ -42,6 +42,8 @@ typedef uint64 allocator_root_id;
  * - PAGE_TYPE_LOG        : struct shard_log_hdr{} + computed offsets
  *
  * - PAGE_TYPE_SUPERBLOCK : struct trunk_super_block{}
+ *
+ * - PAGE_TYPE_BLOB       : value log records and directory, see value_log.h
  * ----------------------------------------------------------------------------
  */
 typedef enum page_type {
@@ -53,6 +55,7 @@ typedef enum page_type {
    PAGE_TYPE_FILTER,
    PAGE_TYPE_LOG,
    PAGE_TYPE_SUPERBLOCK,
+   PAGE_TYPE_BLOB,
    PAGE_TYPE_MISC, // Used mainly as a testing hook, for cache access testing.
    NUM_PAGE_TYPES,
 } page_type;
@@ -64,6 +67,7 @@ static const char *const page_type_str[] = {"invalid",
                                             "filter",
                                             "log",
                                             "superblock",
+                                            "blob",
                                             "misc"};
 
 // Ensure that the page-type lookup array is adequately sized.
@@ -122,6 +126,10 @@ typedef platform_status (*alloc_fn)(allocator *al,
                                     uint64    *addr,
                                     page_type  type);
 
+typedef platform_status (*alloc_at_fn)(allocator *al,
+                                       uint64     addr,
+                                       page_type  type);
+
 typedef uint8 (*dec_ref_fn)(allocator *al, uint64 addr, page_type type);
 typedef uint8 (*generic_ref_fn)(allocator *al, uint64 addr);
 
@@ -137,6 +145,7 @@ typedef uint64 (*base_addr_fn)(const allocator *al, uint64 addr);
 
 typedef void (*print_fn)(allocator *al);
 typedef void (*assert_fn)(allocator *al);
+typedef platform_status (*checkpoint_fn)(allocator *al);
 
 /*
  * Define an abstract allocator interface, holding different allocation-related
@@ -145,6 +154,7 @@ typedef void (*assert_fn)(allocator *al);
 typedef struct allocator_ops {
    allocator_get_config_fn get_config;
    alloc_fn                alloc;
+   alloc_at_fn             alloc_at;
 
    generic_ref_fn inc_ref;
    dec_ref_fn     dec_ref;
@@ -159,6 +169,10 @@ typedef struct allocator_ops {
    get_size_fn  get_capacity;
    base_addr_fn extent_base_addr;
 
+   checkpoint_fn checkpoint_capture;
+   checkpoint_fn checkpoint_prepare;
+   checkpoint_fn checkpoint_commit;
+
    assert_fn assert_noleaks;
 
    print_fn print_stats;
@@ -182,6 +196,16 @@ allocator_alloc(allocator *al, uint64 *addr, page_type type)
    return al->ops->alloc(al, addr, type);
 }
 
+/*
+ * Allocate the extent at addr, which must be free. Used to take back extents
+ * which were in use before a crash but are not in the on-disk ref counts.
+ */
+static inline platform_status
+allocator_alloc_at(allocator *al, uint64 addr, page_type type)
+{
+   return al->ops->alloc_at(al, addr, type);
+}
+
 static inline uint8
 allocator_inc_ref(allocator *al, uint64 addr)
 {
@@ -233,6 +257,37 @@ allocator_get_capacity(allocator *al)
    return al->ops->get_capacity(al);
 }
 
+/*
+ * Online checkpoints persist the ref counts in three steps:
+ *
+ * capture: takes an in-memory image of the ref counts, leaving out extents
+ *    which do not survive a crash (memtables and logs). The extents in the
+ *    image are not reused until the next checkpoint commits, even once they
+ *    are freed. The caller must make sure that no such extent is allocated
+ *    concurrently.
+ * prepare: writes ref counts covering both the image and the ref counts
+ *    already on disk, so either super block can be recovered.
+ * commit: once the super block referencing the image is on disk, writes the
+ *    image exactly and releases the extents only the previous image needed.
+ */
+static inline platform_status
+allocator_checkpoint_capture(allocator *al)
+{
+   return al->ops->checkpoint_capture(al);
+}
+
+static inline platform_status
+allocator_checkpoint_prepare(allocator *al)
+{
+   return al->ops->checkpoint_prepare(al);
+}
+
+static inline platform_status
+allocator_checkpoint_commit(allocator *al)
+{
+   return al->ops->checkpoint_commit(al);
+}
+
 static inline void
 allocator_assert_noleaks(allocator *al)
 {
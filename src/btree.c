@@ -2870,25 +2870,44 @@ btree_iterator_seek(iterator *base_itor, key seek_key, comparison seek_type)
       return STATUS_BAD_PARAM;
    }
 
-   // check if seek_key is within our current node
-   key first_key = itor->height
-                      ? btree_get_pivot(itor->cfg, itor->curr.hdr, 0)
+   /*
+    * Check if seek_key is within our current node. Only the entries up to
+    * end_idx belong to the iterator when curr is the end node.
+    */
+   uint64 num_entries = itor->curr.addr == itor->end_addr
+                           ? itor->end_idx
+                           : btree_num_entries(itor->curr.hdr);
+   bool32 in_curr     = FALSE;
+   if (num_entries > 0) {
+      key first_key =
+         itor->height ? btree_get_pivot(itor->cfg, itor->curr.hdr, 0)
                       : btree_get_tuple_key(itor->cfg, itor->curr.hdr, 0);
-   key last_key =
-      itor->height
-         ? btree_get_pivot(itor->cfg, itor->curr.hdr, itor->end_idx - 1)
-         : btree_get_tuple_key(itor->cfg, itor->curr.hdr, itor->end_idx - 1);
+      key last_key =
+         itor->height
+            ? btree_get_pivot(itor->cfg, itor->curr.hdr, num_entries - 1)
+            : btree_get_tuple_key(itor->cfg, itor->curr.hdr, num_entries - 1);
+      in_curr = btree_key_compare(itor->cfg, seek_key, first_key) >= 0
+                && btree_key_compare(itor->cfg, seek_key, last_key) <= 0;
+   }
 
-   if (btree_key_compare(itor->cfg, seek_key, first_key) >= 0
-       && btree_key_compare(itor->cfg, seek_key, last_key) <= 0)
-   {
+   if (in_curr) {
       // seek_key is within our current leaf. So just directly search for it
       bool32 found;
       itor->idx =
          find_key_in_node(itor, itor->curr.hdr, seek_key, seek_type, &found);
-      platform_assert(0 <= itor->idx);
+
+      // we may have landed just past either end of the leaf
+      if (itor->curr.addr != itor->end_addr
+          && itor->idx == btree_num_entries(itor->curr.hdr))
+      {
+         btree_iterator_next_leaf(itor);
+      }
+      if (itor->curr_min_idx == -1 && itor->idx == -1) {
+         btree_iterator_prev_leaf(itor);
+      }
    } else {
       // seek key is not within our current leaf. So find the correct leaf
+      btree_node_unget(itor->cc, itor->cfg, &itor->curr);
       find_btree_node_and_get_idx_bounds(itor, seek_key, seek_type);
    }
 
@@ -3214,6 +3233,8 @@ btree_pack_post_loop(btree_pack_req *req, key last_key)
    btree_node_full_unlock(cc, cfg, &req->edge[req->height][0]);
 
    mini_release(&req->mini, last_key);
+   // Less the extent each batch had ready, which mini_release freed
+   req->num_extents = mini_num_extents(&req->mini) - req->mini.num_batches;
 }
 
 static bool32
@@ -3222,8 +3243,12 @@ btree_pack_can_fit_tuple(btree_pack_req *req, key tuple_key, message data)
    return req->num_tuples < req->max_tuples;
 }
 
+/*
+ * Frees the partial output tree. last_key is the greatest key packed so far,
+ * or any greater key.
+ */
 static void
-btree_pack_abort(btree_pack_req *req)
+btree_pack_abort(btree_pack_req *req, key last_key)
 {
    for (uint16 i = 0; i <= req->height; i++) {
       for (uint16 j = 0; j < req->num_edges[i]; j++) {
@@ -3231,6 +3256,9 @@ btree_pack_abort(btree_pack_req *req)
       }
    }
 
+   // Sets the end keys of the batches, without which no extent is in range
+   mini_release(&req->mini, last_key);
+
    btree_dec_ref_range(req->cc,
                        req->cfg,
                        req->root_addr,
@@ -3265,19 +3293,19 @@ btree_pack(btree_pack_req *req)
                             __func__,
                             req->num_tuples,
                             req->max_tuples);
-         btree_pack_abort(req);
+         btree_pack_abort(req, tuple_key);
          return STATUS_LIMIT_EXCEEDED;
       }
       platform_status rc = btree_pack_loop(req, tuple_key, data);
       if (!SUCCESS(rc)) {
          platform_error_log("%s error status: %d\n", __func__, rc.r);
-         btree_pack_abort(req);
+         btree_pack_abort(req, tuple_key);
          return rc;
       }
       rc = iterator_next(req->itor);
       if (!SUCCESS(rc)) {
          platform_error_log("%s error status: %d\n", __func__, rc.r);
-         btree_pack_abort(req);
+         btree_pack_abort(req, tuple_key);
          return rc;
       }
    }
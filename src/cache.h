@@ -154,6 +154,7 @@ typedef void (*page_sync_fn)(cache       *cc,
 typedef void (*extent_sync_fn)(cache  *cc,
                                uint64  addr,
                                uint64 *pages_outstanding);
+typedef platform_status (*device_sync_fn)(cache *cc);
 typedef void (*page_prefetch_fn)(cache *cc, uint64 addr, page_type type);
 typedef int (*evict_fn)(cache *cc, bool32 ignore_pinned);
 typedef void (*assert_ungot_fn)(cache *cc, uint64 addr);
@@ -166,6 +167,8 @@ typedef void (*enable_sync_get_fn)(cache *cc, bool32 enabled);
 typedef allocator *(*get_allocator_fn)(const cache *cc);
 typedef cache_config *(*cache_config_fn)(const cache *cc);
 typedef void (*cache_print_fn)(platform_log_handle *log_handle, cache *cc);
+typedef void (*cache_stats_fn)(cache *cc, cache_stats *stats);
+typedef void (*thread_stats_fn)(cache *cc, threadid tid, cache_stats *stats);
 
 /*
  * Cache Operations structure:
@@ -189,7 +192,9 @@ typedef struct cache_ops {
    page_generic_fn      page_unpin;
    page_sync_fn         page_sync;
    extent_sync_fn       extent_sync;
+   device_sync_fn       device_sync;
    cache_generic_fn     flush;
+   cache_generic_fn     flush_online;
    evict_fn             evict;
    cache_generic_fn     cleanup;
    assert_ungot_fn      assert_ungot;
@@ -198,6 +203,8 @@ typedef struct cache_ops {
    cache_present_fn     cache_present;
    cache_print_fn       print;
    cache_print_fn       print_stats;
+   cache_stats_fn       get_stats;
+   thread_stats_fn      get_thread_stats;
    io_stats_fn          io_stats;
    cache_generic_fn     reset_stats;
    count_dirty_fn       count_dirty;
@@ -543,6 +550,20 @@ cache_extent_sync(cache *cc, uint64 addr, uint64 *pages_outstanding)
    cc->ops->extent_sync(cc, addr, pages_outstanding);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_device_sync
+ *
+ * Waits until every page whose writeback has completed is on stable storage,
+ * e.g. log pages written with a blocking cache_page_sync.
+ *-----------------------------------------------------------------------------
+ */
+static inline platform_status
+cache_device_sync(cache *cc)
+{
+   return cc->ops->device_sync(cc);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_flush
@@ -558,6 +579,24 @@ cache_flush(cache *cc)
    cc->ops->flush(cc);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_flush_online
+ *
+ * Writes back every page which is dirty when the call starts, other than
+ * memtable and log pages, and waits for the writes to complete.
+ *
+ * Unlike cache_flush, this may run concurrently with other users of the
+ * cache. Write-locked pages are retried until they are unlocked, so the
+ * caller must not hold any write locks.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_flush_online(cache *cc)
+{
+   cc->ops->flush_online(cc);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_evict
@@ -656,6 +695,34 @@ cache_print_stats(platform_log_handle *log_handle, cache *cc)
    return cc->ops->print_stats(log_handle, cc);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * cache_get_stats
+ *
+ * Analysis facility.
+ * Fills in the performance statistics, summed over all threads.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_get_stats(cache *cc, cache_stats *stats)
+{
+   cc->ops->get_stats(cc, stats);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * cache_get_thread_stats
+ *
+ * Analysis facility.
+ * Fills in the performance statistics of a single thread.
+ *-----------------------------------------------------------------------------
+ */
+static inline void
+cache_get_thread_stats(cache *cc, threadid tid, cache_stats *stats)
+{
+   cc->ops->get_thread_stats(cc, tid, stats);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * cache_reset_stats
@@ -191,6 +191,9 @@ clockcache_extent_sync(clockcache *cc, uint64 addr, uint64 *pages_outstanding);
 void
 clockcache_flush(clockcache *cc);
 
+void
+clockcache_flush_online(clockcache *cc);
+
 int
 clockcache_evict_all(clockcache *cc, bool32 ignore_pinned);
 
@@ -218,6 +221,14 @@ clockcache_validate_page(clockcache *cc, page_handle *page, uint64 addr);
 void
 clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc);
 
+void
+clockcache_get_stats(clockcache *cc, cache_stats *stats);
+
+void
+clockcache_get_thread_stats(clockcache  *cc,
+                            threadid     tid,
+                            cache_stats *stats);
+
 void
 clockcache_io_stats(clockcache *cc, uint64 *read_bytes, uint64 *write_bytes);
 
@@ -392,6 +403,13 @@ clockcache_extent_sync_virtual(cache *c, uint64 addr, uint64 *pages_outstanding)
    clockcache_extent_sync(cc, addr, pages_outstanding);
 }
 
+platform_status
+clockcache_device_sync_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   return io_sync(cc->io);
+}
+
 void
 clockcache_flush_virtual(cache *c)
 {
@@ -399,6 +417,13 @@ clockcache_flush_virtual(cache *c)
    clockcache_flush(cc);
 }
 
+void
+clockcache_flush_online_virtual(cache *c)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_flush_online(cc);
+}
+
 int
 clockcache_evict_all_virtual(cache *c, bool32 ignore_pinned)
 {
@@ -448,6 +473,20 @@ clockcache_print_stats_virtual(platform_log_handle *log_handle, cache *c)
    clockcache_print_stats(log_handle, cc);
 }
 
+void
+clockcache_get_stats_virtual(cache *c, cache_stats *stats)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_get_stats(cc, stats);
+}
+
+void
+clockcache_get_thread_stats_virtual(cache *c, threadid tid, cache_stats *stats)
+{
+   clockcache *cc = (clockcache *)c;
+   clockcache_get_thread_stats(cc, tid, stats);
+}
+
 void
 clockcache_io_stats_virtual(cache *c, uint64 *read_bytes, uint64 *write_bytes)
 {
@@ -521,13 +560,17 @@ static cache_ops clockcache_ops = {
    .page_unpin        = clockcache_unpin_virtual,
    .page_sync         = clockcache_page_sync_virtual,
    .extent_sync       = clockcache_extent_sync_virtual,
+   .device_sync       = clockcache_device_sync_virtual,
    .flush             = clockcache_flush_virtual,
+   .flush_online      = clockcache_flush_online_virtual,
    .evict             = clockcache_evict_all_virtual,
    .cleanup           = clockcache_wait_virtual,
    .assert_ungot      = clockcache_assert_ungot_virtual,
    .assert_free       = clockcache_assert_no_locks_held_virtual,
    .print             = clockcache_print_virtual,
    .print_stats       = clockcache_print_stats_virtual,
+   .get_stats         = clockcache_get_stats_virtual,
+   .get_thread_stats  = clockcache_get_thread_stats_virtual,
    .io_stats          = clockcache_io_stats_virtual,
    .reset_stats       = clockcache_reset_stats_virtual,
    .validate_page     = clockcache_validate_page_virtual,
@@ -1295,6 +1338,10 @@ clockcache_write_callback(void           *metadata,
       debug_status = clockcache_clear_flag(cc, entry_number, CC_WRITEBACK);
       debug_assert(debug_status);
    }
+   // The pages of one write are contiguous on disk, addr is the last one
+   platform_trace(clockcache_writeback_done,
+                  addr - clockcache_multiply_by_page_size(cc, count - 1),
+                  count);
 }
 
 /*
@@ -1399,6 +1446,12 @@ clockcache_batch_start_writeback(clockcache *cc, uint64 batch, bool32 is_urgent)
             iovec[i].iov_base = next_entry->page.data;
          }
 
+         platform_trace(clockcache_writeback,
+                        batch,
+                        first_addr,
+                        req_count,
+                        req->bytes,
+                        is_urgent);
          status = io_write_async(
             cc->io, req, clockcache_write_callback, req_count, first_addr);
          platform_assert_status_ok(status);
@@ -1507,6 +1560,7 @@ clockcache_try_evict(clockcache *cc, uint32 entry_number)
    entry->status = CC_FREE_STATUS;
    clockcache_log(
       addr, entry_number, "evict: entry %u addr %lu\n", entry_number, addr);
+   platform_trace(clockcache_evict, addr, entry_number, entry->type);
 
    /* 7. release read lock */
    goto release_ref;
@@ -1545,6 +1599,7 @@ clockcache_evict_batch(clockcache *cc, uint32 batch)
                   batch,
                   start_entry_no,
                   end_entry_no - 1);
+   platform_trace(clockcache_evict_batch, batch, start_entry_no);
 
    for (uint32 entry_no = start_entry_no; entry_no < end_entry_no; entry_no++) {
       clockcache_try_evict(cc, entry_no);
@@ -1706,6 +1761,72 @@ clockcache_flush(clockcache *cc)
    debug_assert(clockcache_assert_clean(cc));
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * clockcache_flush_online --
+ *
+ *      Issues writeback for every dirty page in the cache other than memtable
+ *      and log pages, and waits for it to complete.
+ *
+ *      Unlike clockcache_flush, other threads may keep using the cache.
+ *      Pages that are claimed or write locked are retried until they can be
+ *      written back, so the caller must not hold any claims or write locks.
+ *-----------------------------------------------------------------------------
+ */
+void
+clockcache_flush_online(clockcache *cc)
+{
+   const threadid tid = platform_get_tid();
+
+   for (uint32 entry_number = 0; entry_number < cc->cfg->page_capacity;
+        entry_number++)
+   {
+      clockcache_entry *entry = clockcache_get_entry(cc, entry_number);
+      uint64            wait  = 1;
+      while (TRUE) {
+         // memtables and logs do not need to be in a checkpoint
+         if (entry->type == PAGE_TYPE_MEMTABLE || entry->type == PAGE_TYPE_LOG
+             || clockcache_test_flag(
+                cc, entry_number, CC_FREE | CC_CLEAN | CC_WRITEBACK))
+         {
+            break;
+         }
+         if (clockcache_try_set_writeback(cc, entry_number, TRUE)) {
+            io_async_req *req            = io_get_async_req(cc->io, TRUE);
+            void         *req_metadata   = io_get_metadata(cc->io, req);
+            *(clockcache **)req_metadata = cc;
+            req->bytes                   = clockcache_page_size(cc);
+            struct iovec *iovec          = io_get_iovec(cc->io, req);
+            iovec[0].iov_base            = entry->page.data;
+            platform_status status       = io_write_async(cc->io,
+                                                    req,
+                                                    clockcache_write_callback,
+                                                    1,
+                                                    entry->page.disk_addr);
+            platform_assert_status_ok(status);
+            if (cc->cfg->use_stats) {
+               cc->stats[tid].page_writes[entry->type]++;
+               cc->stats[tid].writes_issued++;
+            }
+            break;
+         }
+         // claimed or write locked, wait for the holder to finish
+         clockcache_wait(cc);
+         platform_sleep_ns(wait);
+         wait = wait > 1024 ? wait : 2 * wait;
+      }
+   }
+
+   // wait for the writes to complete
+   for (uint32 entry_number = 0; entry_number < cc->cfg->page_capacity;
+        entry_number++)
+   {
+      while (clockcache_test_flag(cc, entry_number, CC_WRITEBACK)) {
+         clockcache_wait(cc);
+      }
+   }
+}
+
 /*
  *-----------------------------------------------------------------------------
  * clockcache_evict_all --
@@ -3081,10 +3202,53 @@ clockcache_io_stats(clockcache *cc, uint64 *read_bytes, uint64 *write_bytes)
    *read_bytes  = read_pages * 4 * KiB;
 }
 
+/*
+ * Sums the per-thread stats, without locks, so counters being bumped
+ * concurrently may be off by a few.
+ */
+void
+clockcache_get_stats(clockcache *cc, cache_stats *stats)
+{
+   ZERO_CONTENTS(stats);
+   if (!cc->cfg->use_stats) {
+      return;
+   }
+
+   for (uint64 i = 0; i < MAX_THREADS; i++) {
+      for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+         stats->cache_hits[type] += cc->stats[i].cache_hits[type];
+         stats->cache_misses[type] += cc->stats[i].cache_misses[type];
+         stats->cache_miss_time_ns[type] +=
+            cc->stats[i].cache_miss_time_ns[type];
+         stats->page_writes[type] += cc->stats[i].page_writes[type];
+         stats->page_reads[type] += cc->stats[i].page_reads[type];
+         stats->prefetches_issued[type] +=
+            cc->stats[i].prefetches_issued[type];
+      }
+      stats->writes_issued += cc->stats[i].writes_issued;
+      stats->syncs_issued += cc->stats[i].syncs_issued;
+   }
+}
+
+/*
+ * Copies the stats of thread tid, which are exact when tid is the caller.
+ */
+void
+clockcache_get_thread_stats(clockcache  *cc,
+                            threadid     tid,
+                            cache_stats *stats)
+{
+   debug_assert(tid < MAX_THREADS);
+   if (!cc->cfg->use_stats) {
+      ZERO_CONTENTS(stats);
+      return;
+   }
+   *stats = cc->stats[tid];
+}
+
 void
 clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
 {
-   uint64      i;
    page_type   type;
    cache_stats global_stats;
 
@@ -3092,22 +3256,10 @@ clockcache_print_stats(platform_log_handle *log_handle, clockcache *cc)
       return;
    }
 
+   clockcache_get_stats(cc, &global_stats);
    uint64 page_writes = 0;
-   ZERO_CONTENTS(&global_stats);
-   for (i = 0; i < MAX_THREADS; i++) {
-      for (type = 0; type < NUM_PAGE_TYPES; type++) {
-         global_stats.cache_hits[type] += cc->stats[i].cache_hits[type];
-         global_stats.cache_misses[type] += cc->stats[i].cache_misses[type];
-         global_stats.cache_miss_time_ns[type] +=
-            cc->stats[i].cache_miss_time_ns[type];
-         global_stats.page_writes[type] += cc->stats[i].page_writes[type];
-         page_writes += cc->stats[i].page_writes[type];
-         global_stats.page_reads[type] += cc->stats[i].page_reads[type];
-         global_stats.prefetches_issued[type] +=
-            cc->stats[i].prefetches_issued[type];
-      }
-      global_stats.writes_issued += cc->stats[i].writes_issued;
-      global_stats.syncs_issued += cc->stats[i].syncs_issued;
+   for (type = 0; type < NUM_PAGE_TYPES; type++) {
+      page_writes += global_stats.page_writes[type];
    }
 
    fraction miss_time[NUM_PAGE_TYPES];
@@ -310,6 +310,10 @@ message_type_string(message_type type)
          return "delete";
       case MESSAGE_TYPE_PIVOT_DATA:
          return "pivot_data";
+      case MESSAGE_TYPE_RANGE_DELETE:
+         return "range_delete";
+      case MESSAGE_TYPE_INSERT_INDIRECT:
+         return "insert_indirect";
       case MESSAGE_TYPE_INVALID:
       default:
          debug_assert(FALSE, "Invalid message type=%d", type);
@@ -339,14 +343,17 @@ message_is_null(message msg)
 static inline bool32
 message_is_definitive(message msg)
 {
-   return msg.type == MESSAGE_TYPE_INSERT || msg.type == MESSAGE_TYPE_DELETE;
+   return msg.type == MESSAGE_TYPE_INSERT || msg.type == MESSAGE_TYPE_DELETE
+          || msg.type == MESSAGE_TYPE_INSERT_INDIRECT;
 }
 
+/* Indirect inserts are internal, but are stored in branches like inserts. */
 static inline bool32
 message_is_invalid_user_type(message msg)
 {
    return msg.type == MESSAGE_TYPE_INVALID
-          || msg.type > MESSAGE_TYPE_MAX_VALID_USER_TYPE;
+          || (msg.type > MESSAGE_TYPE_MAX_VALID_USER_TYPE
+              && msg.type != MESSAGE_TYPE_INSERT_INDIRECT);
 }
 
 /* Define an arbitrary ordering on messages.  In practice, all we care
@@ -391,8 +398,8 @@ typedef struct ONDISK ondisk_tuple {
    char                  key_and_message[];
 } ondisk_tuple;
 
-#define ONDISK_MESSAGE_TYPE_BITS (2)
-_Static_assert(MESSAGE_TYPE_MAX_VALID_USER_TYPE
+#define ONDISK_MESSAGE_TYPE_BITS (3)
+_Static_assert(MESSAGE_TYPE_INSERT_INDIRECT
                   < (1ULL << ONDISK_MESSAGE_TYPE_BITS),
                "ONDISK_MESSAGE_TYPE_BITS is too small");
 #define ONDISK_MESSAGE_TYPE_MASK ((0x1 << ONDISK_MESSAGE_TYPE_BITS) - 1)
@@ -497,7 +504,8 @@ merge_accumulator_deinit(merge_accumulator *ma)
 static inline bool32
 merge_accumulator_is_definitive(const merge_accumulator *ma)
 {
-   return ma->type == MESSAGE_TYPE_INSERT || ma->type == MESSAGE_TYPE_DELETE;
+   return ma->type == MESSAGE_TYPE_INSERT || ma->type == MESSAGE_TYPE_DELETE
+          || ma->type == MESSAGE_TYPE_INSERT_INDIRECT;
 }
 
 static inline message
@@ -0,0 +1,395 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * ingest_file.c --
+ *
+ *     This file contains the implementation of ingest files, see
+ *     ingest_file.h.
+ */
+
+#include "ingest_file.h"
+#include "btree.h"
+#include "poison.h"
+
+/*
+ * The header takes the first page; chunk i follows it at
+ * page_size + i * chunk_size, and its last bytes hold its checksum, seeded
+ * with i so that chunks cannot be reordered unnoticed.
+ */
+static inline uint64
+ingest_file_chunk_addr(io_config *io_cfg, uint64 chunk_no)
+{
+   return io_cfg->page_size + chunk_no * io_cfg->extent_size;
+}
+
+static inline uint64
+ingest_file_chunk_payload(io_config *io_cfg)
+{
+   return io_cfg->extent_size - sizeof(checksum64);
+}
+
+static inline checksum64
+ingest_file_header_checksum(ingest_file_header *hdr)
+{
+   return platform_checksum64(hdr, offsetof(ingest_file_header, checksum), 0);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Writer
+ *-----------------------------------------------------------------------------
+ */
+
+platform_status
+ingest_file_writer_init(ingest_file_writer *writer,
+                        const data_config  *data_cfg,
+                        uint64              page_size,
+                        uint64              extent_size,
+                        uint64              async_queue_depth,
+                        const char         *filename,
+                        platform_heap_id    hid)
+{
+   ZERO_CONTENTS(writer);
+   writer->data_cfg       = data_cfg;
+   writer->heap_id        = hid;
+   writer->max_value_size = MAX_INLINE_MESSAGE_SIZE(page_size);
+   io_config_init(&writer->io_cfg,
+                  page_size,
+                  extent_size,
+                  O_RDWR | O_CREAT | O_TRUNC,
+                  0644,
+                  async_queue_depth,
+                  filename);
+
+   writer->ioh = TYPED_ZALLOC(hid, writer->ioh);
+   if (writer->ioh == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   platform_status rc = io_handle_init(writer->ioh, &writer->io_cfg, hid);
+   if (!SUCCESS(rc)) {
+      platform_free(hid, writer->ioh);
+      return rc;
+   }
+   writer->chunk = TYPED_ARRAY_ZALLOC(hid, writer->chunk, extent_size);
+   if (writer->chunk == NULL) {
+      io_handle_deinit(writer->ioh);
+      platform_free(hid, writer->ioh);
+      return STATUS_NO_MEMORY;
+   }
+   key_buffer_init(&writer->prev_key, hid);
+   return STATUS_OK;
+}
+
+static platform_status
+ingest_file_writer_write_chunk(ingest_file_writer *writer)
+{
+   uint64 payload = ingest_file_chunk_payload(&writer->io_cfg);
+   memset(writer->chunk + writer->chunk_offset,
+          0,
+          payload - writer->chunk_offset);
+   checksum64 checksum =
+      platform_checksum64(writer->chunk, payload, writer->num_chunks);
+   memmove(writer->chunk + payload, &checksum, sizeof(checksum));
+
+   platform_status rc =
+      io_write((io_handle *)writer->ioh,
+               writer->chunk,
+               writer->io_cfg.extent_size,
+               ingest_file_chunk_addr(&writer->io_cfg, writer->num_chunks));
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   writer->num_chunks++;
+   writer->chunk_offset = 0;
+   return STATUS_OK;
+}
+
+static platform_status
+ingest_file_writer_append(ingest_file_writer *writer,
+                          uint64              length,
+                          const void         *data)
+{
+   uint64      payload = ingest_file_chunk_payload(&writer->io_cfg);
+   const char *src     = data;
+   while (length > 0) {
+      uint64 bytes = MIN(length, payload - writer->chunk_offset);
+      memmove(writer->chunk + writer->chunk_offset, src, bytes);
+      writer->chunk_offset += bytes;
+      src += bytes;
+      length -= bytes;
+      if (writer->chunk_offset == payload) {
+         platform_status rc = ingest_file_writer_write_chunk(writer);
+         if (!SUCCESS(rc)) {
+            return rc;
+         }
+      }
+   }
+   return STATUS_OK;
+}
+
+/*
+ * Appends a record. Returns STATUS_BAD_PARAM, writing nothing, if the key is
+ * too long or not greater than the previous one, or if the value is too
+ * long to be stored inline.
+ */
+platform_status
+ingest_file_writer_add(ingest_file_writer *writer, slice user_key, slice value)
+{
+   key new_key = key_create_from_slice(user_key);
+   if (writer->data_cfg->max_key_size < slice_length(user_key)
+       || writer->max_value_size < slice_length(value)
+       || (writer->num_records != 0
+           && data_key_compare(
+                 writer->data_cfg, key_buffer_key(&writer->prev_key), new_key)
+                 >= 0))
+   {
+      return STATUS_BAD_PARAM;
+   }
+
+   ingest_file_record_hdr hdr = {
+      .key_length   = slice_length(user_key),
+      .value_length = slice_length(value),
+   };
+   platform_status rc = ingest_file_writer_append(writer, sizeof(hdr), &hdr);
+   if (SUCCESS(rc)) {
+      rc = ingest_file_writer_append(
+         writer, slice_length(user_key), slice_data(user_key));
+   }
+   if (SUCCESS(rc)) {
+      rc = ingest_file_writer_append(
+         writer, slice_length(value), slice_data(value));
+   }
+   if (SUCCESS(rc)) {
+      rc = key_buffer_copy_key(&writer->prev_key, new_key);
+   }
+   if (SUCCESS(rc)) {
+      writer->num_records++;
+   }
+   return rc;
+}
+
+/*
+ * Writes out the last chunk, then the header, and syncs the file.
+ */
+platform_status
+ingest_file_writer_finish(ingest_file_writer *writer)
+{
+   platform_status rc = STATUS_OK;
+   if (writer->chunk_offset != 0) {
+      rc = ingest_file_writer_write_chunk(writer);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+
+   ingest_file_header hdr = {
+      .magic       = INGEST_FILE_MAGIC,
+      .version     = INGEST_FILE_VERSION,
+      .chunk_size  = writer->io_cfg.extent_size,
+      .num_chunks  = writer->num_chunks,
+      .num_records = writer->num_records,
+   };
+   hdr.checksum = ingest_file_header_checksum(&hdr);
+   memset(writer->chunk, 0, writer->io_cfg.page_size);
+   memmove(writer->chunk, &hdr, sizeof(hdr));
+   rc = io_write(
+      (io_handle *)writer->ioh, writer->chunk, writer->io_cfg.page_size, 0);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   return io_sync((io_handle *)writer->ioh);
+}
+
+void
+ingest_file_writer_deinit(ingest_file_writer *writer)
+{
+   key_buffer_deinit(&writer->prev_key);
+   platform_free(writer->heap_id, writer->chunk);
+   io_handle_deinit(writer->ioh);
+   platform_free(writer->heap_id, writer->ioh);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Iterator
+ *-----------------------------------------------------------------------------
+ */
+
+static platform_status
+ingest_file_iterator_load_chunk(ingest_file_iterator *itor)
+{
+   if (itor->chunk_no == itor->hdr.num_chunks) {
+      // The header promised more records than the chunks hold
+      return STATUS_IO_ERROR;
+   }
+   platform_status rc =
+      io_read((io_handle *)itor->ioh,
+              itor->chunk,
+              itor->io_cfg.extent_size,
+              ingest_file_chunk_addr(&itor->io_cfg, itor->chunk_no));
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   uint64     payload = ingest_file_chunk_payload(&itor->io_cfg);
+   checksum64 checksum;
+   memmove(&checksum, itor->chunk + payload, sizeof(checksum));
+   if (checksum != platform_checksum64(itor->chunk, payload, itor->chunk_no)) {
+      platform_error_log("ingest file %s: bad checksum in chunk %lu\n",
+                         itor->io_cfg.filename,
+                         itor->chunk_no);
+      return STATUS_IO_ERROR;
+   }
+   itor->chunk_no++;
+   itor->chunk_offset = 0;
+   return STATUS_OK;
+}
+
+static platform_status
+ingest_file_iterator_read(ingest_file_iterator *itor, uint64 length, void *dst)
+{
+   uint64 payload = ingest_file_chunk_payload(&itor->io_cfg);
+   char  *dst_ptr = dst;
+   while (length > 0) {
+      if (itor->chunk_offset == payload) {
+         platform_status rc = ingest_file_iterator_load_chunk(itor);
+         if (!SUCCESS(rc)) {
+            return rc;
+         }
+      }
+      uint64 bytes = MIN(length, payload - itor->chunk_offset);
+      memmove(dst_ptr, itor->chunk + itor->chunk_offset, bytes);
+      itor->chunk_offset += bytes;
+      dst_ptr += bytes;
+      length -= bytes;
+   }
+   return STATUS_OK;
+}
+
+static void
+ingest_file_iterator_curr(iterator *base_itor, key *curr_key, message *msg)
+{
+   ingest_file_iterator *itor   = (ingest_file_iterator *)base_itor;
+   const char           *data   = writable_buffer_data(&itor->record);
+   uint64                length = writable_buffer_length(&itor->record);
+   slice                 value  = slice_create(length - itor->key_length,
+                                 data + itor->key_length);
+   *curr_key = key_create(itor->key_length, data);
+   *msg      = message_create(MESSAGE_TYPE_INSERT, value);
+}
+
+static bool32
+ingest_file_iterator_can_next(iterator *base_itor)
+{
+   ingest_file_iterator *itor = (ingest_file_iterator *)base_itor;
+   return itor->record_no <= itor->hdr.num_records;
+}
+
+static platform_status
+ingest_file_iterator_next(iterator *base_itor)
+{
+   ingest_file_iterator *itor = (ingest_file_iterator *)base_itor;
+   itor->record_no++;
+   if (itor->hdr.num_records < itor->record_no) {
+      return STATUS_OK;
+   }
+
+   ingest_file_record_hdr hdr;
+   platform_status rc = ingest_file_iterator_read(itor, sizeof(hdr), &hdr);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   rc = writable_buffer_resize(&itor->record,
+                               (uint64)hdr.key_length + hdr.value_length);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   itor->key_length = hdr.key_length;
+   return ingest_file_iterator_read(itor,
+                                    writable_buffer_length(&itor->record),
+                                    writable_buffer_data(&itor->record));
+}
+
+const static iterator_ops ingest_file_iterator_ops = {
+   .curr     = ingest_file_iterator_curr,
+   .can_next = ingest_file_iterator_can_next,
+   .next     = ingest_file_iterator_next,
+};
+
+/*
+ * Opens an ingest file and positions the iterator at its first record.
+ * Returns STATUS_BAD_PARAM if the file is not a finished ingest file written
+ * with this extent size, and STATUS_IO_ERROR if it is corrupt.
+ */
+platform_status
+ingest_file_iterator_init(ingest_file_iterator *itor,
+                          uint64                page_size,
+                          uint64                extent_size,
+                          uint64                async_queue_depth,
+                          const char           *filename,
+                          platform_heap_id      hid)
+{
+   ZERO_CONTENTS(itor);
+   itor->super.ops = &ingest_file_iterator_ops;
+   itor->heap_id   = hid;
+   writable_buffer_init(&itor->record, hid);
+   io_config_init(&itor->io_cfg,
+                  page_size,
+                  extent_size,
+                  O_RDONLY,
+                  0,
+                  async_queue_depth,
+                  filename);
+
+   itor->ioh = TYPED_ZALLOC(hid, itor->ioh);
+   if (itor->ioh == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   platform_status rc = io_handle_init(itor->ioh, &itor->io_cfg, hid);
+   if (!SUCCESS(rc)) {
+      platform_free(hid, itor->ioh);
+      return rc;
+   }
+   itor->chunk = TYPED_ARRAY_MALLOC(hid, itor->chunk, extent_size);
+   if (itor->chunk == NULL) {
+      rc = STATUS_NO_MEMORY;
+      goto deinit;
+   }
+
+   rc = io_read((io_handle *)itor->ioh, itor->chunk, page_size, 0);
+   if (!SUCCESS(rc)) {
+      goto deinit;
+   }
+   memmove(&itor->hdr, itor->chunk, sizeof(itor->hdr));
+   if (itor->hdr.magic != INGEST_FILE_MAGIC
+       || itor->hdr.version != INGEST_FILE_VERSION
+       || itor->hdr.chunk_size != extent_size
+       || itor->hdr.checksum != ingest_file_header_checksum(&itor->hdr))
+   {
+      rc = STATUS_BAD_PARAM;
+      goto deinit;
+   }
+
+   // Start at the end of an empty chunk, so the first read loads chunk 0
+   itor->chunk_offset = ingest_file_chunk_payload(&itor->io_cfg);
+   rc                 = ingest_file_iterator_next(&itor->super);
+   if (!SUCCESS(rc)) {
+      goto deinit;
+   }
+   return STATUS_OK;
+
+deinit:
+   ingest_file_iterator_deinit(itor);
+   return rc;
+}
+
+void
+ingest_file_iterator_deinit(ingest_file_iterator *itor)
+{
+   writable_buffer_deinit(&itor->record);
+   if (itor->chunk != NULL) {
+      platform_free(itor->heap_id, itor->chunk);
+   }
+   io_handle_deinit(itor->ioh);
+   platform_free(itor->heap_id, itor->ioh);
+}
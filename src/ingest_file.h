@@ -0,0 +1,105 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * ingest_file.h --
+ *
+ *     This file contains the interface for ingest files: sorted runs of
+ *     key-value pairs written offline, outside of any splinter instance,
+ *     and later ingested into one with trunk_ingest.
+ *
+ *     An ingest file starts with a one-page header, followed by extent-sized
+ *     chunks holding the records back to back; a record may span chunks.
+ *     Each chunk ends with a checksum of its contents, so a corrupt file is
+ *     caught before its records reach the trunk.
+ */
+
+#pragma once
+
+#include "platform.h"
+#include "io.h"
+#include "iterator.h"
+#include "util.h"
+
+#define INGEST_FILE_MAGIC   (0x5350494e47455354ULL) // "SPINGEST"
+#define INGEST_FILE_VERSION (1)
+
+typedef struct ONDISK ingest_file_header {
+   uint64     magic;
+   uint64     version;
+   uint64     chunk_size;
+   uint64     num_chunks;
+   uint64     num_records;
+   checksum64 checksum; // of the fields above
+} ingest_file_header;
+
+typedef struct ONDISK ingest_file_record_hdr {
+   uint32 key_length;
+   uint32 value_length;
+} ingest_file_record_hdr;
+
+/*
+ * Writes the records given to ingest_file_writer_add, which must come in
+ * strictly increasing key order, to a new ingest file. The header is only
+ * written by ingest_file_writer_finish, so an unfinished file is rejected by
+ * the iterator.
+ */
+typedef struct ingest_file_writer {
+   io_config           io_cfg;
+   platform_io_handle *ioh;
+   const data_config  *data_cfg;
+   platform_heap_id    heap_id;
+   uint64              max_value_size;
+   key_buffer          prev_key;
+   char               *chunk;
+   uint64              chunk_offset; // bytes used in chunk
+   uint64              num_chunks;   // chunks written out
+   uint64              num_records;
+} ingest_file_writer;
+
+platform_status
+ingest_file_writer_init(ingest_file_writer *writer,
+                        const data_config  *data_cfg,
+                        uint64              page_size,
+                        uint64              extent_size,
+                        uint64              async_queue_depth,
+                        const char         *filename,
+                        platform_heap_id    hid);
+
+platform_status
+ingest_file_writer_add(ingest_file_writer *writer, slice user_key, slice value);
+
+platform_status
+ingest_file_writer_finish(ingest_file_writer *writer);
+
+void
+ingest_file_writer_deinit(ingest_file_writer *writer);
+
+/*
+ * Yields the records of an ingest file as insert messages, stepping forward
+ * only.
+ */
+typedef struct ingest_file_iterator {
+   iterator            super;
+   io_config           io_cfg;
+   platform_io_handle *ioh;
+   platform_heap_id    heap_id;
+   ingest_file_header  hdr;
+   char               *chunk;
+   uint64              chunk_no;     // chunks loaded so far
+   uint64              chunk_offset; // bytes consumed from chunk
+   uint64              record_no;    // records read so far, the last in record
+   writable_buffer     record;       // key followed by value
+   uint32              key_length;
+} ingest_file_iterator;
+
+platform_status
+ingest_file_iterator_init(ingest_file_iterator *itor,
+                          uint64                page_size,
+                          uint64                extent_size,
+                          uint64                async_queue_depth,
+                          const char           *filename,
+                          platform_heap_id      hid);
+
+void
+ingest_file_iterator_deinit(ingest_file_iterator *itor);
@@ -58,6 +58,7 @@ typedef platform_status (*io_write_async_fn)(io_handle     *io,
                                              uint64         addr);
 typedef void (*io_cleanup_fn)(io_handle *io, uint64 count);
 typedef void (*io_wait_all_fn)(io_handle *io);
+typedef platform_status (*io_sync_fn)(io_handle *io);
 typedef void (*io_register_thread_fn)(io_handle *io);
 typedef void (*io_deregister_thread_fn)(io_handle *io);
 typedef bool32 (*io_max_latency_elapsed_fn)(io_handle *io, timestamp ts);
@@ -77,6 +78,7 @@ typedef struct io_ops {
    io_write_async_fn         write_async;
    io_cleanup_fn             cleanup;
    io_wait_all_fn            wait_all;
+   io_sync_fn                sync;
    io_register_thread_fn     register_thread;
    io_deregister_thread_fn   deregister_thread;
    io_max_latency_elapsed_fn max_latency_elapsed;
@@ -159,6 +161,13 @@ io_wait_all(io_handle *io)
    return io->ops->wait_all(io);
 }
 
+// Guarantees all completed writes are on stable storage before return
+static inline platform_status
+io_sync(io_handle *io)
+{
+   return io->ops->sync(io);
+}
+
 static inline void
 io_register_thread(io_handle *io)
 {
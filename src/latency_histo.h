@@ -0,0 +1,118 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * latency_histo.h -- Log-linear latency histogram
+ *
+ *     This file contains a fixed-size histogram of latencies in nanoseconds,
+ *     meant to be kept per thread and recorded into without locks or
+ *     allocation. Each power of two is split into LATENCY_HISTO_SUB_BUCKETS
+ *     equal buckets, so a bucket is at most 1/8 of its values wide, whatever
+ *     the magnitude. Per-thread histograms are summed with
+ *     latency_histo_merge before percentiles are read off.
+ */
+
+#pragma once
+
+#include "platform.h"
+
+#define LATENCY_HISTO_SUB_BITS    3
+#define LATENCY_HISTO_SUB_BUCKETS (1 << LATENCY_HISTO_SUB_BITS)
+
+// Latencies of 2^36 ns (about 69 seconds) and more share the last bucket
+#define LATENCY_HISTO_MAX_LOG2 36
+#define LATENCY_HISTO_BUCKETS                                                  \
+   ((LATENCY_HISTO_MAX_LOG2 - LATENCY_HISTO_SUB_BITS + 1)                      \
+    * LATENCY_HISTO_SUB_BUCKETS)
+
+typedef struct latency_histo {
+   uint64 num;
+   uint64 total_ns;
+   uint64 max_ns;
+   uint64 count[LATENCY_HISTO_BUCKETS];
+} latency_histo;
+
+static inline uint64
+latency_histo_bucket(uint64 latency_ns)
+{
+   if (latency_ns < LATENCY_HISTO_SUB_BUCKETS) {
+      return latency_ns;
+   }
+   uint64 log2 = 63 - __builtin_clzll(latency_ns);
+   if (LATENCY_HISTO_MAX_LOG2 <= log2) {
+      return LATENCY_HISTO_BUCKETS - 1;
+   }
+   uint64 shift = log2 - LATENCY_HISTO_SUB_BITS;
+   return (shift + 1) * LATENCY_HISTO_SUB_BUCKETS
+          + (latency_ns >> shift) - LATENCY_HISTO_SUB_BUCKETS;
+}
+
+/*
+ * Returns the largest latency that falls in the bucket.
+ */
+static inline uint64
+latency_histo_bucket_max(uint64 bucket)
+{
+   if (bucket < LATENCY_HISTO_SUB_BUCKETS) {
+      return bucket;
+   }
+   uint64 shift    = bucket / LATENCY_HISTO_SUB_BUCKETS - 1;
+   uint64 mantissa = bucket % LATENCY_HISTO_SUB_BUCKETS
+                     + LATENCY_HISTO_SUB_BUCKETS;
+   return ((mantissa + 1) << shift) - 1;
+}
+
+static inline void
+latency_histo_record(latency_histo *histo, uint64 latency_ns)
+{
+   histo->count[latency_histo_bucket(latency_ns)]++;
+   histo->num++;
+   histo->total_ns += latency_ns;
+   histo->max_ns = MAX(histo->max_ns, latency_ns);
+}
+
+static inline void
+latency_histo_merge(latency_histo *dest, const latency_histo *src)
+{
+   if (src->num == 0) {
+      return;
+   }
+   for (uint64 i = 0; i < LATENCY_HISTO_BUCKETS; i++) {
+      dest->count[i] += src->count[i];
+   }
+   dest->num += src->num;
+   dest->total_ns += src->total_ns;
+   dest->max_ns = MAX(dest->max_ns, src->max_ns);
+}
+
+static inline uint64
+latency_histo_mean(const latency_histo *histo)
+{
+   return histo->num == 0 ? 0 : histo->total_ns / histo->num;
+}
+
+/*
+ * Returns a latency that at least numerator/denominator of the recorded
+ * latencies do not exceed, e.g. the p99.9 for 999/1000. It is the top of
+ * the bucket the percentile falls in, so overestimates by less than 1/8.
+ */
+static inline uint64
+latency_histo_percentile(const latency_histo *histo,
+                         uint64               numerator,
+                         uint64               denominator)
+{
+   debug_assert(numerator <= denominator);
+   if (histo->num == 0) {
+      return 0;
+   }
+   uint64 rank = (histo->num * numerator + denominator - 1) / denominator;
+   rank        = MAX(rank, 1);
+   uint64 seen = 0;
+   for (uint64 i = 0; i < LATENCY_HISTO_BUCKETS; i++) {
+      seen += histo->count[i];
+      if (rank <= seen) {
+         return MIN(latency_histo_bucket_max(i), histo->max_ns);
+      }
+   }
+   return histo->max_ns;
+}
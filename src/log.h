@@ -18,20 +18,40 @@ typedef struct log_handle   log_handle;
 typedef struct log_iterator log_iterator;
 typedef struct log_config   log_config;
 
+/*
+ * How far log_commit() makes the calling thread's earlier log writes
+ * durable.
+ */
+typedef enum log_durability {
+   LOG_DURABILITY_NONE = 0, // written when their log page fills
+   LOG_DURABILITY_BUFFERED, // written to the device, maybe still in OS buffers
+   LOG_DURABILITY_SYNCED,   // on stable storage
+   NUM_LOG_DURABILITY_LEVELS
+} log_durability;
+
 typedef int (*log_write_fn)(log_handle *log,
                             key         tuple_key,
                             message     data,
                             uint64      generation);
+typedef int (*log_write_batch_fn)(log_handle    *log,
+                                  uint64         num_entries,
+                                  const key     *tuple_keys,
+                                  const message *data,
+                                  const uint64  *generations);
+typedef platform_status (*log_commit_fn)(log_handle    *log,
+                                         log_durability durability);
 typedef void (*log_release_fn)(log_handle *log);
 typedef uint64 (*log_addr_fn)(log_handle *log);
 typedef uint64 (*log_magic_fn)(log_handle *log);
 
 typedef struct log_ops {
-   log_write_fn   write;
-   log_release_fn release;
-   log_addr_fn    addr;
-   log_addr_fn    meta_addr;
-   log_magic_fn   magic;
+   log_write_fn       write;
+   log_write_batch_fn write_batch;
+   log_commit_fn      commit;
+   log_release_fn     release;
+   log_addr_fn        addr;
+   log_addr_fn        meta_addr;
+   log_magic_fn       magic;
 } log_ops;
 
 // to sub-class log, make a log_handle your first field
@@ -45,6 +65,32 @@ log_write(log_handle *log, key tuple_key, message data, uint64 generation)
    return log->ops->write(log, tuple_key, data, generation);
 }
 
+/*
+ * Append num_entries entries to the log with a single append, so the
+ * per-append overhead (getting and locking the log page) is paid once
+ * rather than once per entry.
+ */
+static inline int
+log_write_batch(log_handle    *log,
+                uint64         num_entries,
+                const key     *tuple_keys,
+                const message *data,
+                const uint64  *generations)
+{
+   return log->ops->write_batch(
+      log, num_entries, tuple_keys, data, generations);
+}
+
+/*
+ * Make the calling thread's log writes so far durable. Concurrent commits
+ * asking for LOG_DURABILITY_SYNCED share syncs of the device.
+ */
+static inline platform_status
+log_commit(log_handle *log, log_durability durability)
+{
+   return log->ops->commit(log, durability);
+}
+
 static inline void
 log_release(log_handle *log)
 {
@@ -43,7 +43,7 @@ memtable_process(memtable_context *ctxt, uint64 generation)
    ctxt->process(ctxt->process_ctxt, generation);
 }
 
-static inline void
+void
 memtable_begin_insert(memtable_context *ctxt)
 {
    platform_batch_rwlock_get(ctxt->rwlock, MEMTABLE_INSERT_LOCK_IDX);
@@ -87,6 +87,22 @@ memtable_end_raw_rotation(memtable_context *ctxt)
    platform_batch_rwlock_full_unlock(ctxt->rwlock, MEMTABLE_INSERT_LOCK_IDX);
 }
 
+/*
+ * Waits for the inserts in progress and keeps new ones out, e.g. to swap the
+ * log they are written to.
+ */
+void
+memtable_block_inserts(memtable_context *ctxt)
+{
+   memtable_begin_raw_rotation(ctxt);
+}
+
+void
+memtable_unblock_inserts(memtable_context *ctxt)
+{
+   memtable_end_raw_rotation(ctxt);
+}
+
 void
 memtable_begin_lookup(memtable_context *ctxt)
 {
@@ -148,6 +164,10 @@ memtable_maybe_rotate_and_begin_insert(memtable_context *ctxt,
             // We successfully got the lock, so we do the finalization
             memtable_transition(
                current_mt, MEMTABLE_STATE_READY, MEMTABLE_STATE_FINALIZED);
+            platform_trace(memtable_rotate,
+                           current_generation,
+                           current_mt->root_addr,
+                           mini_num_extents(&current_mt->mini));
 
             // Safe to increment non-atomically because we have a lock on
             // the insert lock
@@ -280,6 +300,89 @@ memtable_force_finalize(memtable_context *ctxt)
    return current_generation;
 }
 
+/*
+ * Finalize the current memtable before it is full, if it holds any tuples,
+ * and hand it to the process callback. Unlike memtable_force_finalize, this
+ * is safe to call concurrently with inserts.
+ *
+ * On success, every tuple inserted before the call is in a memtable with a
+ * generation < *generation, none of which accept inserts any more. Returns
+ * STATUS_BUSY if the next memtable is not ready yet.
+ */
+platform_status
+memtable_try_rotate(memtable_context *ctxt, uint64 *generation)
+{
+   memtable_begin_insert(ctxt);
+   uint64 current_generation = ctxt->generation;
+   if (ctxt->is_empty) {
+      memtable_end_insert(ctxt);
+      *generation = current_generation;
+      return STATUS_OK;
+   }
+
+   uint64    current_mt_no   = current_generation % ctxt->cfg.max_memtables;
+   memtable *current_mt      = &ctxt->mt[current_mt_no];
+   uint64    next_generation = current_generation + 1;
+   uint64    next_mt_no      = next_generation % ctxt->cfg.max_memtables;
+   memtable *next_mt         = &ctxt->mt[next_mt_no];
+   if (current_mt->state != MEMTABLE_STATE_READY
+       || next_mt->state != MEMTABLE_STATE_READY
+       || !memtable_try_begin_insert_rotation(ctxt))
+   {
+      memtable_end_insert(ctxt);
+      return STATUS_BUSY;
+   }
+
+   memtable_transition(
+      current_mt, MEMTABLE_STATE_READY, MEMTABLE_STATE_FINALIZED);
+   ctxt->generation++;
+   platform_assert(ctxt->generation - ctxt->generation_retired
+                   <= ctxt->cfg.max_memtables);
+   memtable_mark_empty(ctxt);
+   memtable_end_insert_rotation(ctxt);
+   memtable_end_insert(ctxt);
+   memtable_process(ctxt, current_generation);
+
+   *generation = next_generation;
+   return STATUS_OK;
+}
+
+/*
+ * Like memtable_try_rotate, for a caller which blocks inserts (see
+ * memtable_block_inserts). Inserts stay blocked.
+ */
+platform_status
+memtable_try_rotate_blocked(memtable_context *ctxt, uint64 *generation)
+{
+   uint64 current_generation = ctxt->generation;
+   if (ctxt->is_empty) {
+      *generation = current_generation;
+      return STATUS_OK;
+   }
+
+   uint64    current_mt_no   = current_generation % ctxt->cfg.max_memtables;
+   memtable *current_mt      = &ctxt->mt[current_mt_no];
+   uint64    next_generation = current_generation + 1;
+   uint64    next_mt_no      = next_generation % ctxt->cfg.max_memtables;
+   memtable *next_mt         = &ctxt->mt[next_mt_no];
+   if (current_mt->state != MEMTABLE_STATE_READY
+       || next_mt->state != MEMTABLE_STATE_READY)
+   {
+      return STATUS_BUSY;
+   }
+
+   memtable_transition(
+      current_mt, MEMTABLE_STATE_READY, MEMTABLE_STATE_FINALIZED);
+   ctxt->generation++;
+   platform_assert(ctxt->generation - ctxt->generation_retired
+                   <= ctxt->cfg.max_memtables);
+   memtable_mark_empty(ctxt);
+   memtable_process(ctxt, current_generation);
+
+   *generation = next_generation;
+   return STATUS_OK;
+}
+
 void
 memtable_init(memtable *mt, cache *cc, memtable_config *cfg, uint64 generation)
 {
@@ -143,9 +143,18 @@ platform_status
 memtable_maybe_rotate_and_begin_insert(memtable_context *ctxt,
                                        uint64           *generation);
 
+void
+memtable_begin_insert(memtable_context *ctxt);
+
 void
 memtable_end_insert(memtable_context *ctxt);
 
+void
+memtable_block_inserts(memtable_context *ctxt);
+
+void
+memtable_unblock_inserts(memtable_context *ctxt);
+
 void
 memtable_begin_lookup(memtable_context *ctxt);
 
@@ -166,12 +175,21 @@ memtable_insert(memtable_context *ctxt,
                 message           msg,
                 uint64           *generation);
 
+bool32
+memtable_is_full(const memtable_config *cfg, memtable *mt);
+
 bool32
 memtable_dec_ref_maybe_recycle(memtable_context *ctxt, memtable *mt);
 
 uint64
 memtable_force_finalize(memtable_context *ctxt);
 
+platform_status
+memtable_try_rotate(memtable_context *ctxt, uint64 *generation);
+
+platform_status
+memtable_try_rotate_blocked(memtable_context *ctxt, uint64 *generation);
+
 void
 memtable_init(memtable *mt, cache *cc, memtable_config *cfg, uint64 generation);
 
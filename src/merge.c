@@ -32,12 +32,16 @@ merge_next(iterator *itor);
 platform_status
 merge_prev(iterator *itor);
 
+platform_status
+merge_seek(iterator *itor, key seek_key, comparison seek_type);
+
 static iterator_ops merge_ops = {
    .curr     = merge_curr,
    .can_prev = merge_can_prev,
    .can_next = merge_can_next,
    .next     = merge_next,
    .prev     = merge_prev,
+   .seek     = merge_seek,
 };
 
 /*
@@ -244,10 +248,14 @@ out:
 
 /*
  * In the case where the two minimum iterators of the merge iterator have equal
- * keys, resolve_equal_keys will merge the data as necessary
+ * keys, resolve_equal_keys will merge the data as necessary. The copies from
+ * inputs older than cover_epoch are replaced by a delete; if *covered, the
+ * newest copy already was, and the others are just skipped.
  */
 static platform_status
-merge_resolve_equal_keys(merge_iterator *merge_itor)
+merge_resolve_equal_keys(merge_iterator *merge_itor,
+                         uint64          cover_epoch,
+                         bool32          covered)
 {
    debug_assert(merge_itor->ordered_iterators[0]->next_key_equal);
    debug_assert(message_data(merge_itor->curr_data)
@@ -277,12 +285,32 @@ merge_resolve_equal_keys(merge_iterator *merge_itor)
                            merge_itor->curr_key,
                            merge_itor->ordered_iterators[1]->curr_key));
 
-      if (data_merge_tuples(cfg,
-                            merge_itor->curr_key,
-                            merge_itor->ordered_iterators[1]->curr_data,
-                            &merge_itor->merge_buffer))
-      {
-         return STATUS_NO_MEMORY;
+      ordered_iterator *older = merge_itor->ordered_iterators[1];
+      bool32            dropped;
+      if (covered) {
+         // skip
+         dropped = TRUE;
+      } else if (older->epoch < cover_epoch) {
+         covered = TRUE;
+         dropped = TRUE;
+         if (data_merge_tuples_final(
+                cfg, merge_itor->curr_key, &merge_itor->merge_buffer))
+         {
+            return STATUS_NO_MEMORY;
+         }
+      } else {
+         dropped = merge_accumulator_is_definitive(&merge_itor->merge_buffer);
+         if (data_merge_tuples(cfg,
+                               merge_itor->curr_key,
+                               older->curr_data,
+                               &merge_itor->merge_buffer))
+         {
+            return STATUS_NO_MEMORY;
+         }
+      }
+      if (dropped && merge_itor->drop != NULL) {
+         merge_itor->drop(
+            merge_itor->drop_arg, merge_itor->curr_key, older->curr_data);
       }
 
       /*
@@ -328,7 +356,9 @@ merge_finalize_updates_and_discard_deletes(merge_iterator *merge_itor,
 {
    data_config *cfg   = merge_itor->cfg;
    message_type class = message_class(merge_itor->curr_data);
-   if (class != MESSAGE_TYPE_INSERT && merge_itor->finalize_updates) {
+   if (!message_is_definitive(merge_itor->curr_data)
+       && merge_itor->finalize_updates)
+   {
       if (message_data(merge_itor->curr_data)
           != merge_accumulator_data(&merge_itor->merge_buffer))
       {
@@ -383,13 +413,29 @@ advance_one_loop(merge_iterator *merge_itor, bool32 *retry)
       return STATUS_OK;
    }
 
+   uint64 cover_epoch = 0;
+   if (merge_itor->cover != NULL) {
+      cover_epoch =
+         merge_itor->cover(merge_itor->cover_arg, merge_itor->curr_key);
+   }
+   bool32 covered = merge_itor->ordered_iterators[0]->epoch < cover_epoch;
+   if (covered && merge_itor->drop != NULL) {
+      merge_itor->drop(
+         merge_itor->drop_arg, merge_itor->curr_key, merge_itor->curr_data);
+   }
+
    platform_status rc;
    if (merge_itor->ordered_iterators[0]->next_key_equal) {
-      rc = merge_resolve_equal_keys(merge_itor);
+      rc = merge_resolve_equal_keys(merge_itor, cover_epoch, covered);
       if (!SUCCESS(rc)) {
          return rc;
       }
    }
+   if (covered) {
+      // The newest message for the key is covered by a range delete
+      *retry = TRUE;
+      return STATUS_OK;
+   }
 
    bool32 discarded;
    rc = merge_finalize_updates_and_discard_deletes(merge_itor, &discarded);
@@ -481,17 +527,6 @@ setup_ordered_iterators(merge_iterator *merge_itor)
    }
 
    if (!SUCCESS(rc)) {
-      // destroy the iterator
-      platform_status merge_iterator_rc =
-         merge_iterator_destroy(platform_get_heap_id(), &merge_itor);
-      if (!SUCCESS(merge_iterator_rc)) {
-         platform_error_log(
-            "setup_ordered_iterators: exception while releasing\n");
-         if (SUCCESS(rc)) {
-            platform_error_log("setup_ordered_iterators: clobbering rc\n");
-            rc = merge_iterator_rc;
-         }
-      }
       platform_error_log("setup_ordered_iterators: exception: %s\n",
                          platform_status_to_string(rc));
       return rc;
@@ -524,13 +559,54 @@ merge_iterator_create(platform_heap_id hid,
                       iterator       **itor_arr,
                       merge_behavior   merge_mode,
                       merge_iterator **out_itor)
+{
+   return merge_iterator_create_with_range_deletes(
+      hid,
+      cfg,
+      num_trees,
+      itor_arr,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      NULL,
+      merge_mode,
+      out_itor);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * merge_iterator_create_with_range_deletes --
+ *
+ *      Like merge_iterator_create, where input i has epoch epochs[i] and
+ *      cover gives the range deletes (see merge_cover_fn). With a NULL
+ *      cover, all inputs are live. drop, if not NULL, is told of the
+ *      messages the merge drops (see merge_drop_fn).
+ *
+ * Results:
+ *      0 if successful, error otherwise
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+merge_iterator_create_with_range_deletes(platform_heap_id hid,
+                                         data_config     *cfg,
+                                         int              num_trees,
+                                         iterator       **itor_arr,
+                                         const uint64    *epochs,
+                                         merge_cover_fn   cover,
+                                         void            *cover_arg,
+                                         merge_drop_fn    drop,
+                                         void            *drop_arg,
+                                         merge_behavior   merge_mode,
+                                         merge_iterator **out_itor)
 {
    int             i;
    platform_status rc = STATUS_OK;
    merge_iterator *merge_itor;
 
    if (!out_itor || !itor_arr || !cfg || num_trees < 0
-       || num_trees >= ARRAY_SIZE(merge_itor->ordered_iterator_stored))
+       || num_trees >= ARRAY_SIZE(merge_itor->ordered_iterator_stored)
+       || (cover != NULL && epochs == NULL))
    {
       platform_error_log("merge_iterator_create: bad parameter merge_itor %p"
                          " num_trees %d itor_arr %p cfg %p\n",
@@ -560,14 +636,19 @@ merge_iterator_create(platform_heap_id hid,
    merge_itor->finalize_updates = merge_mode == MERGE_FULL;
    merge_itor->emit_deletes     = merge_mode != MERGE_FULL;
 
-   merge_itor->cfg      = cfg;
-   merge_itor->curr_key = NULL_KEY;
-   merge_itor->forwards = TRUE;
+   merge_itor->cfg       = cfg;
+   merge_itor->curr_key  = NULL_KEY;
+   merge_itor->forwards  = TRUE;
+   merge_itor->cover     = merge_mode != MERGE_RAW ? cover : NULL;
+   merge_itor->cover_arg = cover_arg;
+   merge_itor->drop      = merge_mode != MERGE_RAW ? drop : NULL;
+   merge_itor->drop_arg  = drop_arg;
 
    // index -1 initializes the pad variable
    for (i = -1; i < num_trees; i++) {
       merge_itor->ordered_iterator_stored[i] = (ordered_iterator){
          .seq            = i,
+         .epoch          = i == -1 || epochs == NULL ? 0 : epochs[i],
          .itor           = i == -1 ? NULL : itor_arr[i],
          .curr_key       = NULL_KEY,
          .curr_data      = NULL_MESSAGE,
@@ -579,6 +660,7 @@ merge_iterator_create(platform_heap_id hid,
 
    rc = setup_ordered_iterators(merge_itor);
    if (!SUCCESS(rc)) {
+      merge_iterator_destroy(hid, &merge_itor);
       return rc;
    }
 
@@ -757,6 +839,48 @@ merge_prev(iterator *itor)
    return merge_advance_helper(merge_itor);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * merge_seek --
+ *
+ *      Repositions the merge iterator by seeking every input iterator, both
+ *      alive and dead, to seek_key and then resorting. Seeking with
+ *      greater_than(_or_equal) leaves the merge iterator travelling
+ *      forwards, less_than(_or_equal) leaves it travelling backwards.
+ *
+ * Results:
+ *      0 if successful, error otherwise. STATUS_BAD_PARAM if an input
+ *      iterator cannot seek or seek_key lies outside its bounds.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+merge_seek(iterator *itor, key seek_key, comparison seek_type)
+{
+   merge_iterator *merge_itor = (merge_iterator *)itor;
+   platform_status rc;
+
+   for (int i = 0; i < merge_itor->num_trees; i++) {
+      ordered_iterator *ordered_itor = merge_itor->ordered_iterators[i];
+      if (ordered_itor->itor->ops->seek == NULL) {
+         return STATUS_BAD_PARAM;
+      }
+      rc = iterator_seek(ordered_itor->itor, seek_key, seek_type);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      ordered_itor->curr_key       = NULL_KEY;
+      ordered_itor->curr_data      = NULL_MESSAGE;
+      ordered_itor->next_key_equal = FALSE;
+   }
+
+   merge_itor->forwards  = seek_type >= greater_than;
+   merge_itor->curr_key  = NULL_KEY;
+   merge_itor->curr_data = NULL_MESSAGE;
+
+   // restore iterator invariants
+   return setup_ordered_iterators(merge_itor);
+}
+
 void
 merge_iterator_print(merge_iterator *merge_itor)
 {
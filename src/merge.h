@@ -19,6 +19,7 @@
 typedef struct ordered_iterator {
    iterator *itor;
    int       seq;
+   uint64    epoch;
    key       curr_key;
    message   curr_data;
    bool32    next_key_equal;
@@ -55,6 +56,23 @@ extern struct merge_behavior   merge_full, merge_intermediate, merge_raw;
 #define MERGE_INTERMEDIATE (&merge_intermediate)
 #define MERGE_FULL         (&merge_full)
 
+/*
+ * Range deletes. Each input of a merge iterator may carry an epoch, and
+ * merge_cover_fn returns for a key the epoch of the newest range delete
+ * covering it, 0 if there is none. The messages of inputs with an older
+ * epoch than that were deleted by the range delete: a key whose newest
+ * message is covered is skipped, and the messages newer than the covered
+ * ones are merged as if onto a delete. Inputs must be ordered by epoch as
+ * they are by age. Ignored in RAW mode.
+ */
+typedef uint64 (*merge_cover_fn)(void *arg, key k);
+
+/*
+ * merge_drop_fn is called for each input message a merge iterator drops,
+ * because a newer definitive message or a range delete shadows it.
+ * Ignored in RAW mode.
+ */
+typedef void (*merge_drop_fn)(void *arg, key k, message msg);
 
 typedef struct merge_iterator {
    iterator     super;     // handle for iterator.h API
@@ -70,6 +88,14 @@ typedef struct merge_iterator {
    message      curr_data;     // current data
    bool32       forwards;
 
+   // Range deletes, NULL if the inputs have no epochs
+   merge_cover_fn cover;
+   void          *cover_arg;
+
+   // Called for dropped messages, may be NULL
+   merge_drop_fn drop;
+   void         *drop_arg;
+
    // Padding so ordered_iterators[-1] is valid
    ordered_iterator ordered_iterator_stored_pad;
    ordered_iterator ordered_iterator_stored[MAX_MERGE_ARITY];
@@ -101,6 +127,19 @@ merge_iterator_create(platform_heap_id hid,
                       merge_behavior   merge_mode,
                       merge_iterator **out_itor);
 
+platform_status
+merge_iterator_create_with_range_deletes(platform_heap_id hid,
+                                         data_config     *cfg,
+                                         int              num_trees,
+                                         iterator       **itor_arr,
+                                         const uint64    *epochs,
+                                         merge_cover_fn   cover,
+                                         void            *cover_arg,
+                                         merge_drop_fn    drop,
+                                         void            *drop_arg,
+                                         merge_behavior   merge_mode,
+                                         merge_iterator **out_itor);
+
 platform_status
 merge_iterator_destroy(platform_heap_id hid, merge_iterator **merge_itor);
 
@@ -648,6 +648,82 @@ mini_release(mini_allocator *mini, key end_key)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ * mini_unkeyed_tail_position --
+ *
+ *      Returns the current meta_tail of an unkeyed mini_allocator and the
+ *      number of entries in it. Together they identify the extents the
+ *      mini_allocator had allocated at the time of the call, see
+ *      mini_unkeyed_truncate.
+ *
+ * Results:
+ *      meta_tail and num_entries.
+ *
+ * Side effects:
+ *      Standard cache side effects.
+ *-----------------------------------------------------------------------------
+ */
+void
+mini_unkeyed_tail_position(mini_allocator *mini,        // IN
+                           uint64         *meta_tail,   // OUT
+                           uint64         *num_entries) // OUT
+{
+   debug_assert(!mini->keyed);
+   page_handle *meta_page;
+   uint64       wait = 1;
+   while (1) {
+      uint64 tail = mini->meta_tail;
+      meta_page   = cache_get(mini->cc, tail, TRUE, mini->type);
+      if (tail == mini->meta_tail && cache_try_claim(mini->cc, meta_page)) {
+         break;
+      }
+      cache_unget(mini->cc, meta_page);
+      platform_sleep_ns(wait);
+      wait = wait > 1024 ? wait : 2 * wait;
+   }
+   *meta_tail   = meta_page->disk_addr;
+   *num_entries = mini_num_entries(meta_page);
+   mini_unget_unclaim_meta_page(mini->cc, meta_page);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * mini_unkeyed_truncate --
+ *
+ *      Drops the entries of an unkeyed mini_allocator past the position
+ *      returned by mini_unkeyed_tail_position, so meta_tail is the tail
+ *      again. Used when recovering a mini_allocator whose later entries
+ *      refer to extents which were never persisted as allocated.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Standard cache side effects.
+ *-----------------------------------------------------------------------------
+ */
+void
+mini_unkeyed_truncate(cache    *cc,
+                      page_type type,
+                      uint64    meta_tail,
+                      uint64    num_entries)
+{
+   page_handle *meta_page = mini_get_claim_meta_page(cc, meta_tail, type);
+   cache_lock(cc, meta_page);
+
+   mini_meta_hdr *hdr = (mini_meta_hdr *)meta_page->data;
+   platform_assert(num_entries <= hdr->num_entries);
+   hdr->next_meta_addr = 0;
+   hdr->num_entries    = num_entries;
+   hdr->pos            = offsetof(typeof(*hdr), entry_buffer)
+              + num_entries * sizeof(unkeyed_meta_entry);
+
+   cache_mark_dirty(cc, meta_page);
+   cache_unlock(cc, meta_page);
+   mini_unget_unclaim_meta_page(cc, meta_page);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * mini_deinit --
@@ -61,6 +61,16 @@ mini_init(mini_allocator *mini,
 void
 mini_release(mini_allocator *mini, key end_key);
 
+void
+mini_unkeyed_tail_position(mini_allocator *mini,
+                           uint64         *meta_tail,
+                           uint64         *num_entries);
+void
+mini_unkeyed_truncate(cache    *cc,
+                      page_type type,
+                      uint64    meta_tail,
+                      uint64    num_entries);
+
 /*
  * NOTE: Can only be called on a mini_allocator which has made no allocations.
  */
@@ -64,6 +64,9 @@ laio_cleanup(io_handle *ioh, uint64 count);
 static void
 laio_wait_all(io_handle *ioh);
 
+static platform_status
+laio_sync(io_handle *ioh);
+
 static void
 laio_register_thread(io_handle *ioh);
 
@@ -86,6 +89,7 @@ static io_ops laio_ops = {
    .write_async       = laio_write_async,
    .cleanup           = laio_cleanup,
    .wait_all          = laio_wait_all,
+   .sync              = laio_sync,
    .register_thread   = laio_register_thread,
    .deregister_thread = laio_deregister_thread,
 };
@@ -289,6 +293,19 @@ laio_write(io_handle *ioh, void *buf, uint64 bytes, uint64 addr)
    return STATUS_IO_ERROR;
 }
 
+/*
+ * laio_sync() - Basically a wrapper around fdatasync().
+ */
+static platform_status
+laio_sync(io_handle *ioh)
+{
+   laio_handle *io = (laio_handle *)ioh;
+   if (fdatasync(io->fd) == 0) {
+      return STATUS_OK;
+   }
+   return STATUS_IO_ERROR;
+}
+
 /*
  * Return a ptr to the k'th Async IO request structure, accounting
  * for a nested array of 'async_max_pages' pages of IO vector structures
@@ -393,6 +410,7 @@ laio_callback(io_context_t ctx, struct iocb *iocb, long res, long res2)
 
    platform_assert(res2 == 0);
    req = (io_async_req *)((char *)iocb - offsetof(io_async_req, iocb));
+   platform_trace(laio_complete, req, res);
    req->callback(req->metadata, req->iovec, req->count, status);
    req->ctx_idx = INVALID_TID;
 }
@@ -416,6 +434,7 @@ laio_read_async(io_handle     *ioh,
    req->callback = callback;
    req->count    = count;
    io_set_callback(&req->iocb, laio_callback);
+   platform_trace(laio_submit, req, FALSE, addr, count);
    do {
       // We increment the io_count before submitting the request to avoid
       // having the io_count go negative if another thread calls io_cleanup
@@ -458,6 +477,7 @@ laio_write_async(io_handle     *ioh,
    req->callback = callback;
    req->count    = count;
    io_set_callback(&req->iocb, laio_callback);
+   platform_trace(laio_submit, req, TRUE, addr, count);
 
    do {
       // We increment the io_count before submitting the request to avoid
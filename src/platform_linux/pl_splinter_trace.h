@@ -15,4 +15,48 @@
 #define TRACESplinter(...)
 #define TRACE_DEFINE_TOKEN_BUCKETS(...)
 
+/*
+ * Static tracepoints
+ *
+ * platform_trace(name, args...) marks a USDT probe splinterdb:name, which
+ * perf, bpftrace and systemtap can attach to in a running process, e.g.
+ *
+ *    bpftrace -e 'usdt:libsplinterdb.so:splinterdb:trunk_flush_begin
+ *                 { @start[tid] = nsecs; }
+ *                 usdt:libsplinterdb.so:splinterdb:trunk_flush_end
+ *                 /@start[tid]/
+ *                 { @us = hist((nsecs - @start[tid]) / 1000);
+ *                   delete(@start[tid]); }'
+ *
+ * A probe nobody is attached to is a single nop; its arguments are only
+ * kept where the tracer can find them, so they must be cheap to compute and
+ * free of side effects. At most 12 integer or pointer arguments are allowed.
+ *
+ * Probes are built in when <sys/sdt.h> (systemtap-sdt-dev) is found, unless
+ * SPLINTERDB_NO_TRACEPOINTS is defined; otherwise they compile to nothing,
+ * without evaluating their arguments.
+ */
+#if !defined(SPLINTERDB_NO_TRACEPOINTS) && defined(__has_include)
+#   if __has_include(<sys/sdt.h>)
+#      include <sys/sdt.h>
+#      define PLATFORM_TRACEPOINTS 1
+#   endif
+#endif
+
+#ifdef PLATFORM_TRACEPOINTS
+#   define platform_trace(name, ...) STAP_PROBEV(splinterdb, name, __VA_ARGS__)
+#else
+// Never called, but keeps the arguments type-checked and used
+static inline void
+platform_trace_args(int unused, ...)
+{}
+
+#   define platform_trace(name, ...)                                           \
+      do {                                                                     \
+         if (0) {                                                              \
+            platform_trace_args(0, __VA_ARGS__);                               \
+         }                                                                     \
+      } while (0)
+#endif
+
 #endif /* PL_SPLINTER_TRACE_H */
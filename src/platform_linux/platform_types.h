@@ -15,6 +15,7 @@
 #include <sys/uio.h>
 #include <xxhash.h>
 #include <execinfo.h>
+#include "pl_splinter_trace.h"
 
 // platform status
 typedef typeof(EINVAL) internal_platform_status;
@@ -22,6 +23,7 @@ typedef typeof(EINVAL) internal_platform_status;
 #define STATUS_OK             CONST_STATUS(0)
 #define STATUS_NO_MEMORY      CONST_STATUS(ENOMEM)
 #define STATUS_BUSY           CONST_STATUS(EAGAIN)
+#define STATUS_IN_PROGRESS    CONST_STATUS(EINPROGRESS)
 #define STATUS_LIMIT_EXCEEDED CONST_STATUS(ENOSPC)
 #define STATUS_NO_SPACE       CONST_STATUS(ENOSPC)
 #define STATUS_TIMEDOUT       CONST_STATUS(ETIMEDOUT)
@@ -31,6 +33,7 @@ typedef typeof(EINVAL) internal_platform_status;
 #define STATUS_NOT_FOUND      CONST_STATUS(ENOENT)
 #define STATUS_IO_ERROR       CONST_STATUS(EIO)
 #define STATUS_NOTSUP         CONST_STATUS(ENOTSUP)
+#define STATUS_EXISTS         CONST_STATUS(EEXIST)
 #define STATUS_TEST_FAILED    CONST_STATUS(-1)
 
 // checksums
@@ -62,6 +62,16 @@ rc_allocator_alloc_virtual(allocator *a, uint64 *addr, page_type type)
    return rc_allocator_alloc(al, addr, type);
 }
 
+platform_status
+rc_allocator_alloc_at(rc_allocator *al, uint64 addr, page_type type);
+
+platform_status
+rc_allocator_alloc_at_virtual(allocator *a, uint64 addr, page_type type)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_alloc_at(al, addr, type);
+}
+
 uint8
 rc_allocator_inc_ref(rc_allocator *al, uint64 addr);
 
@@ -160,6 +170,27 @@ rc_allocator_assert_noleaks_virtual(allocator *a)
    rc_allocator_assert_noleaks(al);
 }
 
+platform_status
+rc_allocator_checkpoint_capture_virtual(allocator *a)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_checkpoint_capture(al);
+}
+
+platform_status
+rc_allocator_checkpoint_prepare_virtual(allocator *a)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_checkpoint_prepare(al);
+}
+
+platform_status
+rc_allocator_checkpoint_commit_virtual(allocator *a)
+{
+   rc_allocator *al = (rc_allocator *)a;
+   return rc_allocator_checkpoint_commit(al);
+}
+
 void
 rc_allocator_print_stats(rc_allocator *al);
 
@@ -181,19 +212,23 @@ rc_allocator_print_allocated_virtual(allocator *a)
 }
 
 const static allocator_ops rc_allocator_ops = {
-   .get_config        = rc_allocator_get_config_virtual,
-   .alloc             = rc_allocator_alloc_virtual,
-   .inc_ref           = rc_allocator_inc_ref_virtual,
-   .dec_ref           = rc_allocator_dec_ref_virtual,
-   .get_ref           = rc_allocator_get_ref_virtual,
-   .get_super_addr    = rc_allocator_get_super_addr_virtual,
-   .alloc_super_addr  = rc_allocator_alloc_super_addr_virtual,
-   .remove_super_addr = rc_allocator_remove_super_addr_virtual,
-   .in_use            = rc_allocator_in_use_virtual,
-   .get_capacity      = rc_allocator_get_capacity_virtual,
-   .assert_noleaks    = rc_allocator_assert_noleaks_virtual,
-   .print_stats       = rc_allocator_print_stats_virtual,
-   .print_allocated   = rc_allocator_print_allocated_virtual,
+   .get_config         = rc_allocator_get_config_virtual,
+   .alloc              = rc_allocator_alloc_virtual,
+   .alloc_at           = rc_allocator_alloc_at_virtual,
+   .inc_ref            = rc_allocator_inc_ref_virtual,
+   .dec_ref            = rc_allocator_dec_ref_virtual,
+   .get_ref            = rc_allocator_get_ref_virtual,
+   .get_super_addr     = rc_allocator_get_super_addr_virtual,
+   .alloc_super_addr   = rc_allocator_alloc_super_addr_virtual,
+   .remove_super_addr  = rc_allocator_remove_super_addr_virtual,
+   .in_use             = rc_allocator_in_use_virtual,
+   .get_capacity       = rc_allocator_get_capacity_virtual,
+   .checkpoint_capture = rc_allocator_checkpoint_capture_virtual,
+   .checkpoint_prepare = rc_allocator_checkpoint_prepare_virtual,
+   .checkpoint_commit  = rc_allocator_checkpoint_commit_virtual,
+   .assert_noleaks     = rc_allocator_assert_noleaks_virtual,
+   .print_stats        = rc_allocator_print_stats_virtual,
+   .print_allocated    = rc_allocator_print_allocated_virtual,
 };
 
 /*
@@ -222,6 +257,17 @@ rc_allocator_extent_number(rc_allocator *al, uint64 addr)
    return (addr / al->cfg->io_cfg->extent_size);
 }
 
+/*
+ * Is the extent allocated in the on-disk ref counts, and so, while they are
+ * retained, not to be reused?
+ */
+static inline bool32
+rc_allocator_is_persisted(rc_allocator *al, uint64 extent_no)
+{
+   return al->persisted != NULL
+          && (al->persisted[extent_no / 64] & (1ULL << (extent_no % 64)));
+}
+
 static platform_status
 rc_allocator_init_meta_page(rc_allocator *al)
 {
@@ -362,6 +408,15 @@ rc_allocator_init(rc_allocator      *al,
    }
    al->ref_count = platform_buffer_getaddr(&al->bh);
    memset(al->ref_count, 0, buffer_size);
+   al->extent_type =
+      TYPED_ARRAY_ZALLOC(al->heap_id, al->extent_type, cfg->extent_capacity);
+   if (al->extent_type == NULL) {
+      platform_buffer_deinit(&al->bh);
+      platform_mutex_destroy(&al->lock);
+      platform_free(al->heap_id, al->meta_page);
+      platform_error_log("Failed to create buffer for extent types\n");
+      return STATUS_NO_MEMORY;
+   }
 
    // allocate the super block
    allocator_alloc(&al->super, &addr, PAGE_TYPE_SUPERBLOCK);
@@ -385,6 +440,15 @@ rc_allocator_init(rc_allocator      *al,
 void
 rc_allocator_deinit(rc_allocator *al)
 {
+   if (al->persisted != NULL) {
+      platform_free(al->heap_id, al->persisted);
+      al->persisted = NULL;
+   }
+   if (al->checkpoint_ref_count != NULL) {
+      platform_buffer_deinit(&al->checkpoint_bh);
+      al->checkpoint_ref_count = NULL;
+   }
+   platform_free(al->heap_id, al->extent_type);
    platform_buffer_deinit(&al->bh);
    al->ref_count = NULL;
    platform_mutex_destroy(&al->lock);
@@ -444,6 +508,15 @@ rc_allocator_mount(rc_allocator      *al,
       return STATUS_NO_MEMORY;
    }
    al->ref_count = platform_buffer_getaddr(&al->bh);
+   al->extent_type =
+      TYPED_ARRAY_ZALLOC(al->heap_id, al->extent_type, cfg->extent_capacity);
+   if (al->extent_type == NULL) {
+      platform_buffer_deinit(&al->bh);
+      platform_free(al->heap_id, al->meta_page);
+      platform_mutex_destroy(&al->lock);
+      platform_error_log("Failed to create buffer for extent types\n");
+      return STATUS_NO_MEMORY;
+   }
 
    // load the meta page from disk.
    status = io_read(
@@ -488,6 +561,154 @@ rc_allocator_unmount(rc_allocator *al)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ * rc_allocator_retain_persisted --
+ *
+ *      Stops the extents allocated in the on-disk ref counts from being
+ *      reused until the allocator is unmounted, even once they are freed.
+ *      The on-disk ref counts are only written at unmount, so this keeps
+ *      the last unmounted image of every table intact on disk, which lets a
+ *      table with a write-ahead log be recovered after a crash.
+ *
+ *      Must be called right after mount, before any ref counts change. The
+ *      cost is that space freed since mount is not reused until the next
+ *      unmount.
+ *----------------------------------------------------------------------
+ */
+platform_status
+rc_allocator_retain_persisted(rc_allocator *al)
+{
+   uint64 num_words = (al->cfg->extent_capacity + 63) / 64;
+   al->persisted    = TYPED_ARRAY_ZALLOC(al->heap_id, al->persisted, num_words);
+   if (al->persisted == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   for (uint64 i = 0; i < al->cfg->extent_capacity; i++) {
+      if (al->ref_count[i] != 0) {
+         al->persisted[i / 64] |= 1ULL << (i % 64);
+      }
+   }
+   return STATUS_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ * rc_allocator_checkpoint_{capture,prepare,commit} --
+ *
+ *      Persist the ref counts for an online checkpoint, see allocator.h.
+ *
+ *      The ref counts on disk always cover the image the super block on
+ *      disk refers to. Extents in the captured image are added to the
+ *      retained ones right away, so that neither the previous nor the new
+ *      image is overwritten while the checkpoint is in progress. Commit
+ *      then retains exactly the new image.
+ *----------------------------------------------------------------------
+ */
+platform_status
+rc_allocator_checkpoint_capture(rc_allocator *al)
+{
+   uint64 num_words = (al->cfg->extent_capacity + 63) / 64;
+   if (al->persisted == NULL) {
+      uint64 *persisted = TYPED_ARRAY_ZALLOC(al->heap_id, persisted, num_words);
+      if (persisted == NULL) {
+         return STATUS_NO_MEMORY;
+      }
+      al->persisted = persisted;
+   }
+   if (al->checkpoint_ref_count == NULL) {
+      uint64 buffer_size =
+         ROUNDUP(al->cfg->extent_capacity, al->cfg->io_cfg->page_size);
+      platform_status rc =
+         platform_buffer_init(&al->checkpoint_bh, buffer_size);
+      if (!SUCCESS(rc)) {
+         return STATUS_NO_MEMORY;
+      }
+      al->checkpoint_ref_count = platform_buffer_getaddr(&al->checkpoint_bh);
+      memset(al->checkpoint_ref_count, 0, buffer_size);
+   }
+
+   for (uint64 word = 0; word < num_words; word++) {
+      uint64 bits = 0;
+      uint64 end  = MIN((word + 1) * 64, al->cfg->extent_capacity);
+      for (uint64 i = word * 64; i < end; i++) {
+         uint8 ref_count = al->ref_count[i];
+         // memtables and logs are rebuilt or replayed after a crash
+         if (al->extent_type[i] == PAGE_TYPE_MEMTABLE
+             || al->extent_type[i] == PAGE_TYPE_LOG)
+         {
+            ref_count = 0;
+         }
+         al->checkpoint_ref_count[i] = ref_count;
+         if (ref_count != 0) {
+            bits |= 1ULL << (i % 64);
+         }
+      }
+      if (bits != 0) {
+         __sync_fetch_and_or(&al->persisted[word], bits);
+      }
+   }
+   return STATUS_OK;
+}
+
+platform_status
+rc_allocator_checkpoint_prepare(rc_allocator *al)
+{
+   platform_assert(al->checkpoint_ref_count != NULL);
+
+   uint64 io_size =
+      ROUNDUP(al->cfg->extent_capacity, al->cfg->io_cfg->page_size);
+   buffer_handle   bh;
+   platform_status rc = platform_buffer_init(&bh, io_size);
+   if (!SUCCESS(rc)) {
+      return STATUS_NO_MEMORY;
+   }
+   uint8 *ref_count = platform_buffer_getaddr(&bh);
+
+   rc = io_read(al->io, ref_count, io_size, al->cfg->io_cfg->extent_size);
+   if (SUCCESS(rc)) {
+      for (uint64 i = 0; i < al->cfg->extent_capacity; i++) {
+         ref_count[i] = MAX(ref_count[i], al->checkpoint_ref_count[i]);
+      }
+      rc = io_write(al->io, ref_count, io_size, al->cfg->io_cfg->extent_size);
+   }
+   if (SUCCESS(rc)) {
+      rc = io_sync(al->io);
+   }
+   platform_buffer_deinit(&bh);
+   return rc;
+}
+
+platform_status
+rc_allocator_checkpoint_commit(rc_allocator *al)
+{
+   platform_assert(al->checkpoint_ref_count != NULL);
+
+   uint64 io_size =
+      ROUNDUP(al->cfg->extent_capacity, al->cfg->io_cfg->page_size);
+   platform_status rc = io_write(
+      al->io, al->checkpoint_ref_count, io_size, al->cfg->io_cfg->extent_size);
+   if (SUCCESS(rc)) {
+      rc = io_sync(al->io);
+   }
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   uint64 num_words = (al->cfg->extent_capacity + 63) / 64;
+   for (uint64 word = 0; word < num_words; word++) {
+      uint64 bits = 0;
+      uint64 end  = MIN((word + 1) * 64, al->cfg->extent_capacity);
+      for (uint64 i = word * 64; i < end; i++) {
+         if (al->checkpoint_ref_count[i] != 0) {
+            bits |= 1ULL << (i % 64);
+         }
+      }
+      al->persisted[word] = bits;
+   }
+   return STATUS_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  * rc_allocator_[inc,dec,get]_ref --
@@ -684,6 +905,19 @@ rc_allocator_get_config(rc_allocator *al)
    return al->cfg;
 }
 
+static void
+rc_allocator_record_alloc(rc_allocator *al, page_type type)
+{
+   int64 curr_allocated = __sync_add_and_fetch(&al->stats.curr_allocated, 1);
+   int64 max_allocated  = al->stats.max_allocated;
+   while (curr_allocated > max_allocated) {
+      __sync_bool_compare_and_swap(
+         &al->stats.max_allocated, max_allocated, curr_allocated);
+      max_allocated = al->stats.max_allocated;
+   }
+   __sync_add_and_fetch(&al->stats.extent_allocs[type], 1);
+}
+
 /*
  *----------------------------------------------------------------------
  * rc_allocator_alloc--
@@ -702,7 +936,7 @@ rc_allocator_alloc(rc_allocator *al,   // IN
 
    do {
       hand = __sync_fetch_and_add(&al->hand, 1) % al->cfg->extent_capacity;
-      if (al->ref_count[hand] == 0) {
+      if (al->ref_count[hand] == 0 && !rc_allocator_is_persisted(al, hand)) {
          extent_is_free =
             __sync_bool_compare_and_swap(&al->ref_count[hand], 0, 2);
       }
@@ -720,14 +954,8 @@ rc_allocator_alloc(rc_allocator *al,   // IN
          al->cfg->extent_capacity);
       return STATUS_NO_SPACE;
    }
-   int64 curr_allocated = __sync_add_and_fetch(&al->stats.curr_allocated, 1);
-   int64 max_allocated  = al->stats.max_allocated;
-   while (curr_allocated > max_allocated) {
-      __sync_bool_compare_and_swap(
-         &al->stats.max_allocated, max_allocated, curr_allocated);
-      max_allocated = al->stats.max_allocated;
-   }
-   __sync_add_and_fetch(&al->stats.extent_allocs[type], 1);
+   al->extent_type[hand] = type;
+   rc_allocator_record_alloc(al, type);
    *addr = hand * al->cfg->io_cfg->extent_size;
    if (SHOULD_TRACE(*addr)) {
       platform_default_log(
@@ -737,6 +965,37 @@ rc_allocator_alloc(rc_allocator *al,   // IN
    return STATUS_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ * rc_allocator_alloc_at --
+ *
+ *      Allocate the extent at addr. Returns STATUS_BUSY if it is not free.
+ *----------------------------------------------------------------------
+ */
+platform_status
+rc_allocator_alloc_at(rc_allocator *al,   // IN
+                      uint64        addr, // IN
+                      page_type     type)     // IN
+{
+   debug_assert(rc_allocator_valid_extent_addr(al, addr));
+
+   uint64 extent_no = rc_allocator_extent_number(al, addr);
+   if (extent_no >= al->cfg->extent_capacity
+       || rc_allocator_is_persisted(al, extent_no)
+       || !__sync_bool_compare_and_swap(&al->ref_count[extent_no], 0, 2))
+   {
+      return STATUS_BUSY;
+   }
+
+   al->extent_type[extent_no] = type;
+   rc_allocator_record_alloc(al, type);
+   if (SHOULD_TRACE(addr)) {
+      platform_default_log(
+         "rc_allocator_alloc_at %12lu (%s)\n", addr, page_type_str[type]);
+   }
+   return STATUS_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  * rc_allocator_in_use --
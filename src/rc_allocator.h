@@ -60,6 +60,15 @@ typedef struct rc_allocator {
    allocator_config       *cfg;
    buffer_handle           bh;
    uint8                  *ref_count;
+   // page type each extent was last allocated with, 0 if loaded from disk
+   uint8                  *extent_type;
+   // extents allocated in the on-disk ref counts, see
+   // rc_allocator_retain_persisted()
+   uint64                 *persisted;
+   // ref counts of the checkpoint in progress, see
+   // rc_allocator_checkpoint_capture()
+   buffer_handle           checkpoint_bh;
+   uint8                  *checkpoint_ref_count;
    uint64                  hand;
    io_handle              *io;
    rc_allocator_meta_page *meta_page;
@@ -94,3 +103,15 @@ rc_allocator_mount(rc_allocator      *al,
 
 void
 rc_allocator_unmount(rc_allocator *al);
+
+platform_status
+rc_allocator_retain_persisted(rc_allocator *al);
+
+platform_status
+rc_allocator_checkpoint_capture(rc_allocator *al);
+
+platform_status
+rc_allocator_checkpoint_prepare(rc_allocator *al);
+
+platform_status
+rc_allocator_checkpoint_commit(rc_allocator *al);
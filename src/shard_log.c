@@ -23,6 +23,14 @@ static uint64 shard_log_magic_idx = 0;
 
 int
 shard_log_write(log_handle *log, key tuple_key, message msg, uint64 generation);
+int
+shard_log_write_batch(log_handle    *log,
+                      uint64         num_entries,
+                      const key     *tuple_keys,
+                      const message *msgs,
+                      const uint64  *generations);
+platform_status
+shard_log_commit(log_handle *log, log_durability durability);
 uint64
 shard_log_addr(log_handle *log);
 uint64
@@ -31,10 +39,12 @@ uint64
 shard_log_magic(log_handle *log);
 
 static log_ops shard_log_ops = {
-   .write     = shard_log_write,
-   .addr      = shard_log_addr,
-   .meta_addr = shard_log_meta_addr,
-   .magic     = shard_log_magic,
+   .write       = shard_log_write,
+   .write_batch = shard_log_write_batch,
+   .commit      = shard_log_commit,
+   .addr        = shard_log_addr,
+   .meta_addr   = shard_log_meta_addr,
+   .magic       = shard_log_magic,
 };
 
 void
@@ -67,11 +77,17 @@ shard_log_pages_per_extent(shard_log_config *cfg)
    return cache_config_pages_per_extent(cfg->cache_cfg);
 }
 
+/*
+ * The checksum is seeded with the page's address, so that a log page is not
+ * valid anywhere else, e.g. in a recycled cache buffer that a short read at
+ * another address has left in place.
+ */
 static inline checksum128
 shard_log_checksum(shard_log_config *cfg, page_handle *page)
 {
-   return platform_checksum128(
-      page->data + 16, shard_log_page_size(cfg) - 16, cfg->seed);
+   return platform_checksum128(page->data + 16,
+                               shard_log_page_size(cfg) - 16,
+                               cfg->seed ^ page->disk_addr);
 }
 
 static inline shard_log_thread_data *
@@ -95,11 +111,21 @@ shard_log_init(shard_log *log, cache *cc, shard_log_config *cfg)
    log->cfg       = cfg;
    log->super.ops = &shard_log_ops;
 
-   uint64 magic_idx = __sync_fetch_and_add(&shard_log_magic_idx, 1);
-   log->magic = platform_checksum64(&magic_idx, sizeof(uint64), cfg->seed);
+   // The magic tells this log's pages apart from stale ones left on disk by
+   // earlier logs, including those of earlier runs, which log recovery walks
+   // over.
+   uint64 magic_data[2] = {__sync_fetch_and_add(&shard_log_magic_idx, 1),
+                           platform_get_real_time()};
+   log->magic = platform_checksum64(magic_data, sizeof(magic_data), cfg->seed);
+
+   platform_status rc =
+      platform_condvar_init(&log->commit_cv, platform_get_heap_id());
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
 
-   allocator      *al = cache_get_allocator(cc);
-   platform_status rc = allocator_alloc(al, &log->meta_head, PAGE_TYPE_LOG);
+   allocator *al = cache_get_allocator(cc);
+   rc            = allocator_alloc(al, &log->meta_head, PAGE_TYPE_LOG);
    platform_assert_status_ok(rc);
 
    for (threadid thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
@@ -129,6 +155,8 @@ shard_log_zap(shard_log *log)
 {
    cache *cc = log->cc;
 
+   mini_release(&log->mini, NULL_KEY);
+
    for (threadid i = 0; i < MAX_THREADS; i++) {
       shard_log_thread_data *thread_data = shard_log_get_thread_data(log, i);
       thread_data->addr                  = SHARD_UNMAPPED;
@@ -136,6 +164,7 @@ shard_log_zap(shard_log *log)
    }
 
    mini_unkeyed_dec_ref(cc, log->meta_head, PAGE_TYPE_LOG, FALSE);
+   platform_condvar_destroy(&log->commit_cv);
 }
 
 /*
@@ -216,60 +245,113 @@ get_new_page_for_thread(shard_log             *log,
 int
 shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
 {
-   debug_assert(key_is_user_key(tuple_key));
+   return shard_log_write_batch(logh, 1, &tuple_key, &msg, &generation);
+}
 
+/*
+ * Gets, claims and locks the log page at addr, which only the calling thread
+ * writes to.
+ */
+static page_handle *
+shard_log_get_page(cache *cc, uint64 addr)
+{
+   page_handle *page = cache_get(cc, addr, TRUE, PAGE_TYPE_LOG);
+   uint64       wait = 1;
+   while (!cache_try_claim(cc, page)) {
+      platform_sleep_ns(wait);
+      wait = wait > 1024 ? wait : 2 * wait;
+   }
+   cache_lock(cc, page);
+   return page;
+}
+
+/*
+ * Terminates and checksums this thread's page, then writes it out and
+ * releases it. The write is blocking, so a sealed page is in the device (if
+ * perhaps only in OS buffers) once this returns, as shard_log_commit relies
+ * on. The thread's next entry goes to a new page.
+ */
+static void
+shard_log_seal_page(shard_log             *log,
+                    shard_log_thread_data *thread_data,
+                    page_handle           *page)
+{
+   cache         *cc     = log->cc;
+   shard_log_hdr *hdr    = (shard_log_hdr *)page->data;
+   log_entry     *cursor = (log_entry *)(page->data + thread_data->offset);
+   uint64 free_space = shard_log_page_size(log->cfg) - thread_data->offset;
+   if (sizeof(log_entry) <= free_space) {
+      cursor->generation = INVALID_GENERATION;
+   }
+   hdr->checksum = shard_log_checksum(log->cfg, page);
+
+   cache_unlock(cc, page);
+   cache_unclaim(cc, page);
+   cache_page_sync(cc, page, TRUE, PAGE_TYPE_LOG);
+   cache_unget(cc, page);
+
+   thread_data->addr = SHARD_UNMAPPED;
+}
+
+/*
+ * Appends num_entries entries to this thread's log page, getting and
+ * locking the page once for the whole batch. Moves on to a new page
+ * whenever the current one fills up.
+ */
+int
+shard_log_write_batch(log_handle    *logh,
+                      uint64         num_entries,
+                      const key     *tuple_keys,
+                      const message *msgs,
+                      const uint64  *generations)
+{
    shard_log             *log = (shard_log *)logh;
    cache                 *cc  = log->cc;
    shard_log_thread_data *thread_data =
       shard_log_get_thread_data(log, platform_get_tid());
 
+   if (num_entries == 0) {
+      return 0;
+   }
+
    page_handle *page;
    if (thread_data->addr == SHARD_UNMAPPED) {
       if (get_new_page_for_thread(log, thread_data, &page)) {
          return -1;
       }
    } else {
-      page        = cache_get(cc, thread_data->addr, TRUE, PAGE_TYPE_LOG);
-      uint64 wait = 1;
-      while (!cache_try_claim(cc, page)) {
-         platform_sleep_ns(wait);
-         wait = wait > 1024 ? wait : 2 * wait;
-      }
-      cache_lock(cc, page);
+      page = shard_log_get_page(cc, thread_data->addr);
    }
 
-   shard_log_hdr *hdr    = (shard_log_hdr *)page->data;
-   log_entry     *cursor = (log_entry *)(page->data + thread_data->offset);
-   uint64         new_entry_size = log_entry_required_capacity(tuple_key, msg);
-   uint64 free_space = shard_log_page_size(log->cfg) - thread_data->offset;
-   debug_assert(new_entry_size
-                <= shard_log_page_size(log->cfg) - sizeof(shard_log_hdr));
-
-   if (free_space < new_entry_size) {
-      if (sizeof(log_entry) <= free_space) {
-         cursor->generation = INVALID_GENERATION;
-      }
-      hdr->checksum = shard_log_checksum(log->cfg, page);
-
-      cache_unlock(cc, page);
-      cache_unclaim(cc, page);
-      cache_page_sync(cc, page, FALSE, PAGE_TYPE_LOG);
-      cache_unget(cc, page);
-
-      if (get_new_page_for_thread(log, thread_data, &page)) {
-         return -1;
+   shard_log_hdr *hdr = (shard_log_hdr *)page->data;
+   for (uint64 i = 0; i < num_entries; i++) {
+      key     tuple_key = tuple_keys[i];
+      message msg       = msgs[i];
+      debug_assert(key_is_user_key(tuple_key));
+
+      log_entry *cursor = (log_entry *)(page->data + thread_data->offset);
+      uint64     new_entry_size = log_entry_required_capacity(tuple_key, msg);
+      uint64 free_space = shard_log_page_size(log->cfg) - thread_data->offset;
+      debug_assert(new_entry_size
+                   <= shard_log_page_size(log->cfg) - sizeof(shard_log_hdr));
+
+      if (free_space < new_entry_size) {
+         shard_log_seal_page(log, thread_data, page);
+         if (get_new_page_for_thread(log, thread_data, &page)) {
+            return -1;
+         }
+         cursor = (log_entry *)(page->data + thread_data->offset);
+         hdr    = (shard_log_hdr *)page->data;
       }
-      cursor = (log_entry *)(page->data + thread_data->offset);
-      hdr    = (shard_log_hdr *)page->data;
-   }
 
-   cursor->generation = generation;
-   copy_tuple_to_ondisk_tuple(&cursor->tuple, tuple_key, msg);
+      cursor->generation = generations[i];
+      copy_tuple_to_ondisk_tuple(&cursor->tuple, tuple_key, msg);
 
-   hdr->num_entries++;
+      hdr->num_entries++;
 
-   thread_data->offset += new_entry_size;
-   debug_assert(thread_data->offset <= shard_log_page_size(log->cfg));
+      thread_data->offset += new_entry_size;
+      debug_assert(thread_data->offset <= shard_log_page_size(log->cfg));
+   }
 
    cache_unlock(cc, page);
    cache_unclaim(cc, page);
@@ -278,6 +360,92 @@ shard_log_write(log_handle *logh, key tuple_key, message msg, uint64 generation)
    return 0;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * shard_log_commit --
+ *
+ *      Makes the calling thread's log writes durable: its current page is
+ *      sealed and written and, for LOG_DURABILITY_SYNCED, the device is
+ *      synced. A page is never written again once sealed, so a torn write
+ *      cannot lose entries of an earlier commit.
+ *
+ *      Synced commits are grouped. Each one takes a ticket once its page is
+ *      written. A thread which finds no sync in progress becomes the leader:
+ *      it syncs the device on behalf of every ticket handed out so far, while
+ *      the other threads (followers) wait for a sync covering their ticket.
+ *      So however many threads commit at once, they share a few syncs.
+ *
+ * Results:
+ *      STATUS_OK, or the error of the device sync.
+ *
+ * Side effects:
+ *      Disk writes and syncs.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+shard_log_commit(log_handle *logh, log_durability durability)
+{
+   shard_log             *log = (shard_log *)logh;
+   shard_log_thread_data *thread_data =
+      shard_log_get_thread_data(log, platform_get_tid());
+
+   debug_assert(durability < NUM_LOG_DURABILITY_LEVELS);
+   __sync_fetch_and_add(&log->commit_stats.commits[durability], 1);
+   if (durability == LOG_DURABILITY_NONE) {
+      return STATUS_OK;
+   }
+
+   timestamp start = platform_get_timestamp();
+   if (thread_data->addr != SHARD_UNMAPPED) {
+      page_handle *page = shard_log_get_page(log->cc, thread_data->addr);
+      shard_log_seal_page(log, thread_data, page);
+   }
+   if (durability == LOG_DURABILITY_BUFFERED) {
+      return STATUS_OK;
+   }
+
+   shard_log_commit_stats *stats = &log->commit_stats;
+   platform_status         rc    = STATUS_OK;
+   platform_condvar_lock(&log->commit_cv);
+   uint64 ticket = ++log->commit_requested;
+   while (log->commit_synced < ticket) {
+      if (log->commit_syncing) {
+         platform_condvar_wait(&log->commit_cv);
+         continue;
+      }
+
+      // Lead a sync covering all tickets handed out so far
+      log->commit_syncing = TRUE;
+      uint64 last_ticket  = log->commit_requested;
+      platform_condvar_unlock(&log->commit_cv);
+
+      timestamp sync_start = platform_get_timestamp();
+      rc                   = cache_device_sync(log->cc);
+      uint64 sync_time_ns  = platform_timestamp_elapsed(sync_start);
+
+      platform_condvar_lock(&log->commit_cv);
+      log->commit_syncing = FALSE;
+      if (SUCCESS(rc)) {
+         uint64 batch = last_ticket - log->commit_synced;
+         stats->syncs++;
+         stats->max_batch = MAX(stats->max_batch, batch);
+         stats->sync_time_ns += sync_time_ns;
+         stats->max_sync_time_ns = MAX(stats->max_sync_time_ns, sync_time_ns);
+         log->commit_synced      = last_ticket;
+      }
+      platform_condvar_broadcast(&log->commit_cv);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+   }
+   uint64 commit_time_ns = platform_timestamp_elapsed(start);
+   stats->commit_time_ns += commit_time_ns;
+   stats->max_commit_time_ns = MAX(stats->max_commit_time_ns, commit_time_ns);
+   platform_condvar_unlock(&log->commit_cv);
+
+   return rc;
+}
+
 uint64
 shard_log_addr(log_handle *logh)
 {
@@ -315,12 +483,20 @@ shard_log_next_extent_addr(shard_log_config *cfg, page_handle *page)
    return hdr->next_extent_addr;
 }
 
+/*
+ * Orders entries by generation. Entries are copied out in log order, so ties
+ * are broken by address, which keeps each thread's entries in the order they
+ * were written.
+ */
 int
 shard_log_compare(const void *p1, const void *p2, void *unused)
 {
-   log_entry **le1 = (log_entry **)p1;
-   log_entry **le2 = (log_entry **)p2;
-   return (*le1)->generation - (*le2)->generation;
+   log_entry *le1 = *(log_entry **)p1;
+   log_entry *le2 = *(log_entry **)p2;
+   if (le1->generation != le2->generation) {
+      return le1->generation < le2->generation ? -1 : 1;
+   }
+   return le1 < le2 ? -1 : le1 > le2;
 }
 
 log_handle *
@@ -362,20 +538,18 @@ shard_log_iterator_init(cache              *cc,
       for (i = 0; i < pages_per_extent; i++) {
          page_addr = extent_addr + i * shard_log_page_size(cfg);
          page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
-         if (!shard_log_valid(cfg, page, magic)) {
-            cache_unget(cc, page);
-            goto finished_first_pass;
+         // Threads fill their pages independently, so a page which was
+         // never completed may be followed by valid pages of other threads.
+         if (shard_log_valid(cfg, page, magic)) {
+            num_valid_pages++;
+            itor->num_entries += ((shard_log_hdr *)page->data)->num_entries;
+            next_extent_addr = shard_log_next_extent_addr(cfg, page);
          }
-         num_valid_pages++;
-         itor->num_entries += ((shard_log_hdr *)page->data)->num_entries;
-         next_extent_addr = shard_log_next_extent_addr(cfg, page);
          cache_unget(cc, page);
       }
       extent_addr = next_extent_addr;
    }
 
-finished_first_pass:
-
    itor->contents = TYPED_ARRAY_MALLOC(
       hid, itor->contents, num_valid_pages * shard_log_page_size(cfg));
    itor->entries = TYPED_ARRAY_MALLOC(hid, itor->entries, itor->num_entries);
@@ -392,7 +566,7 @@ finished_first_pass:
          page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
          if (!shard_log_valid(cfg, page, magic)) {
             cache_unget(cc, page);
-            goto finished_second_pass;
+            continue;
          }
          for (log_entry *le = first_log_entry(page->data);
               !terminal_log_entry(cfg, page->data, le);
@@ -413,7 +587,6 @@ finished_first_pass:
 
    // sort by generation
    log_entry *tmp;
-finished_second_pass:
    platform_sort_slow(itor->entries,
                       itor->num_entries,
                       sizeof(log_entry *),
@@ -431,6 +604,12 @@ shard_log_iterator_deinit(platform_heap_id hid, shard_log_iterator *itor)
    platform_free(hid, itor->entries);
 }
 
+uint64
+shard_log_iterator_curr_generation(shard_log_iterator *itor)
+{
+   return itor->entries[itor->pos]->generation;
+}
+
 void
 shard_log_iterator_curr(iterator *itorh, key *curr_key, message *msg)
 {
@@ -461,6 +640,103 @@ shard_log_iterator_next(iterator *itorh)
    return STATUS_OK;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * shard_log_claim_extents --
+ *
+ *      Allocates the extents of the log at addr, following its extent chain
+ *      until an extent with no valid pages.
+ *
+ *      After a crash, the extents of the log that was live are free in the
+ *      on-disk ref counts, which are only written on a clean shutdown.
+ *      Claiming them makes them readable and keeps them from being reused
+ *      until the log has been replayed; shard_log_release_extents() frees
+ *      them again.
+ *
+ * Results:
+ *      The claimed extents, in chain order, in *extents.
+ *
+ * Side effects:
+ *      Disk allocation.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+shard_log_claim_extents(cache            *cc,
+                        shard_log_config *cfg,
+                        platform_heap_id  hid,
+                        uint64            addr,
+                        uint64            magic,
+                        uint64          **extents,
+                        uint64           *num_extents)
+{
+   allocator *al               = cache_get_allocator(cc);
+   uint64     pages_per_extent = shard_log_pages_per_extent(cfg);
+   uint64     capacity         = 0;
+
+   *extents     = NULL;
+   *num_extents = 0;
+
+   uint64 extent_addr = addr;
+   while (extent_addr != 0
+          && SUCCESS(allocator_alloc_at(al, extent_addr, PAGE_TYPE_LOG)))
+   {
+      cache_prefetch(cc, extent_addr, PAGE_TYPE_LOG);
+      uint64 next_extent_addr = 0;
+      bool32 found_valid_page = FALSE;
+      for (uint64 i = 0; i < pages_per_extent; i++) {
+         uint64       page_addr = extent_addr + i * shard_log_page_size(cfg);
+         page_handle *page      = cache_get(cc, page_addr, TRUE, PAGE_TYPE_LOG);
+         if (shard_log_valid(cfg, page, magic)) {
+            found_valid_page = TRUE;
+            next_extent_addr = shard_log_next_extent_addr(cfg, page);
+         }
+         cache_unget(cc, page);
+      }
+
+      if (*num_extents == capacity) {
+         uint64  new_capacity = capacity == 0 ? 64 : 2 * capacity;
+         uint64 *new_extents  = platform_realloc(hid,
+                                                capacity * sizeof(uint64),
+                                                *extents,
+                                                new_capacity * sizeof(uint64));
+         if (new_extents == NULL) {
+            shard_log_release_extents(cc, hid, *extents, *num_extents);
+            *num_extents = 0;
+            return STATUS_NO_MEMORY;
+         }
+         *extents = new_extents;
+         capacity = new_capacity;
+      }
+      (*extents)[(*num_extents)++] = extent_addr;
+
+      if (!found_valid_page) {
+         break;
+      }
+      extent_addr = next_extent_addr;
+   }
+
+   return STATUS_OK;
+}
+
+void
+shard_log_release_extents(cache           *cc,
+                          platform_heap_id hid,
+                          uint64          *extents,
+                          uint64           num_extents)
+{
+   allocator *al = cache_get_allocator(cc);
+   for (uint64 i = 0; i < num_extents; i++) {
+      uint8 ref = allocator_dec_ref(al, extents[i], PAGE_TYPE_LOG);
+      platform_assert(ref == AL_NO_REFS);
+      cache_extent_discard(cc, extents[i], PAGE_TYPE_LOG);
+      ref = allocator_dec_ref(al, extents[i], PAGE_TYPE_LOG);
+      platform_assert(ref == AL_FREE);
+   }
+   if (extents != NULL) {
+      platform_free(hid, extents);
+   }
+}
+
 /*
  *-----------------------------------------------------------------------------
  * shard_log_config_init --
@@ -513,3 +789,27 @@ shard_log_print(shard_log *log)
       extent_addr = next_extent_addr;
    }
 }
+
+// clang-format off
+void
+shard_log_print_commit_stats(platform_log_handle *log_handle, shard_log *log)
+{
+   shard_log_commit_stats *stats  = &log->commit_stats;
+   uint64                  synced = stats->commits[LOG_DURABILITY_SYNCED];
+
+   platform_log(log_handle, "Log Commit Statistics\n");
+   platform_log(log_handle, "------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "| commits, none:          %10lu\n", stats->commits[LOG_DURABILITY_NONE]);
+   platform_log(log_handle, "| commits, buffered:      %10lu\n", stats->commits[LOG_DURABILITY_BUFFERED]);
+   platform_log(log_handle, "| commits, synced:        %10lu\n", synced);
+   platform_log(log_handle, "| device syncs:           %10lu\n", stats->syncs);
+   platform_log(log_handle, "| avg commits / sync:     %10lu\n", stats->syncs == 0 ? 0 : synced / stats->syncs);
+   platform_log(log_handle, "| max commits / sync:     %10lu\n", stats->max_batch);
+   platform_log(log_handle, "| avg sync time (ns):     %10lu\n", stats->syncs == 0 ? 0 : stats->sync_time_ns / stats->syncs);
+   platform_log(log_handle, "| max sync time (ns):     %10lu\n", stats->max_sync_time_ns);
+   platform_log(log_handle, "| avg synced commit (ns): %10lu\n", synced == 0 ? 0 : stats->commit_time_ns / synced);
+   platform_log(log_handle, "| max synced commit (ns): %10lu\n", stats->max_commit_time_ns);
+   platform_log(log_handle, "------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "\n");
+}
+// clang-format on
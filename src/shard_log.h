@@ -30,6 +30,19 @@ typedef struct shard_log_thread_data {
    uint64 offset;
 } PLATFORM_CACHELINE_ALIGNED shard_log_thread_data;
 
+/*
+ * Group commit statistics.
+ */
+typedef struct shard_log_commit_stats {
+   uint64 commits[NUM_LOG_DURABILITY_LEVELS]; // by requested durability
+   uint64 syncs;              // device syncs by group commit leaders
+   uint64 max_batch;          // most synced commits covered by one sync
+   uint64 sync_time_ns;       // total time in device syncs
+   uint64 max_sync_time_ns;   // longest device sync
+   uint64 commit_time_ns;     // total latency of synced commits
+   uint64 max_commit_time_ns; // longest synced commit
+} shard_log_commit_stats;
+
 /*
  * Sharded log context structure.
  */
@@ -42,6 +55,13 @@ typedef struct shard_log {
    uint64                addr;
    uint64                meta_head;
    uint64                magic;
+
+   // group commit, see shard_log_commit()
+   platform_condvar       commit_cv;
+   uint64                 commit_requested; // tickets handed out
+   uint64                 commit_synced;    // tickets on stable storage
+   bool32                 commit_syncing;   // a leader is syncing the device
+   shard_log_commit_stats commit_stats;
 } shard_log;
 
 typedef struct log_entry log_entry;
@@ -85,9 +105,30 @@ shard_log_iterator_init(cache              *cc,
 void
 shard_log_iterator_deinit(platform_heap_id hid, shard_log_iterator *itor);
 
+uint64
+shard_log_iterator_curr_generation(shard_log_iterator *itor);
+
+platform_status
+shard_log_claim_extents(cache            *cc,
+                        shard_log_config *cfg,
+                        platform_heap_id  hid,
+                        uint64            addr,
+                        uint64            magic,
+                        uint64          **extents,
+                        uint64           *num_extents);
+
+void
+shard_log_release_extents(cache           *cc,
+                          platform_heap_id hid,
+                          uint64          *extents,
+                          uint64           num_extents);
+
 void
 shard_log_config_init(shard_log_config *log_cfg,
                       cache_config     *cache_cfg,
                       data_config      *data_cfg);
 void
 shard_log_print(shard_log *log);
+
+void
+shard_log_print_commit_stats(platform_log_handle *log_handle, shard_log *log);
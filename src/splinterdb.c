@@ -20,6 +20,8 @@
 #include "trunk.h"
 #include "btree_private.h"
 #include "shard_log.h"
+#include "ingest_file.h"
+#include "pcq.h"
 #include "splinterdb_tests_private.h"
 #include "poison.h"
 
@@ -51,9 +53,24 @@ typedef struct splinterdb {
    trunk_handle      *spl;
    platform_heap_id   heap_id;
    data_config       *data_cfg;
+   log_durability     durability;
    bool               we_created_heap;
+   splinterdb_config  cfg; // with defaults set, for the configs of keyspaces
+
+   // Keyspaces, see splinterdb_keyspace_create()
+   splinterdb    *parent;        // of a keyspace, otherwise NULL
+   splinterdb    *next_keyspace; // in the parent's list
+   splinterdb    *keyspaces;     // open in this splinterdb
+   platform_mutex keyspace_lock;
 } splinterdb;
 
+_Static_assert((int)SPLINTERDB_DURABILITY_NONE == (int)LOG_DURABILITY_NONE
+                  && (int)SPLINTERDB_DURABILITY_BUFFERED
+                        == (int)LOG_DURABILITY_BUFFERED
+                  && (int)SPLINTERDB_DURABILITY_SYNCED
+                        == (int)LOG_DURABILITY_SYNCED,
+               "mismatched splinterdb_durability and log_durability");
+
 
 /*
  * Extract errno.h -style status int from a platform_status
@@ -124,6 +141,37 @@ splinterdb_validate_app_data_config(const data_config *cfg)
    return STATUS_OK;
 }
 
+/*
+ * Initializes the log and trunk configs of kvs, whose data_cfg is set, from
+ * cfg with its defaults set.
+ */
+static platform_status
+splinterdb_init_trunk_config(const splinterdb_config *cfg,       // IN
+                             clockcache_config       *cache_cfg, // IN
+                             splinterdb              *kvs        // OUT
+)
+{
+   shard_log_config_init(&kvs->log_cfg, &cache_cfg->super, kvs->data_cfg);
+
+   return trunk_config_init(&kvs->trunk_cfg,
+                            &cache_cfg->super,
+                            kvs->data_cfg,
+                            (log_config *)&kvs->log_cfg,
+                            cfg->memtable_capacity,
+                            cfg->fanout,
+                            cfg->max_branches_per_node,
+                            cfg->btree_rough_count_height,
+                            cfg->filter_remainder_size,
+                            cfg->filter_index_size,
+                            cfg->reclaim_threshold,
+                            cfg->queue_scale_percent,
+                            cfg->value_log_threshold,
+                            cfg->use_log,
+                            cfg->use_stats,
+                            FALSE,
+                            NULL);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * splinterdb_init_config --
@@ -161,6 +209,21 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
       return STATUS_BAD_PARAM;
    }
 
+   if (SPLINTERDB_DURABILITY_SYNCED < kvs_cfg->durability
+       || (kvs_cfg->durability != SPLINTERDB_DURABILITY_NONE
+           && !kvs_cfg->use_log))
+   {
+      platform_error_log("Durability %d requires use_log.\n",
+                         kvs_cfg->durability);
+      return STATUS_BAD_PARAM;
+   }
+   kvs->durability = (log_durability)kvs_cfg->durability;
+
+   if (kvs_cfg->value_log_threshold != 0 && kvs_cfg->use_log) {
+      platform_error_log("A value log cannot be used with use_log.\n");
+      return STATUS_BAD_PARAM;
+   }
+
    // mutable local config block, where we can set defaults
    splinterdb_config cfg = {0};
    memcpy(&cfg, kvs_cfg, sizeof(cfg));
@@ -188,8 +251,6 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
                           cfg.cache_logfile,
                           cfg.use_stats);
 
-   shard_log_config_init(&kvs->log_cfg, &kvs->cache_cfg.super, kvs->data_cfg);
-
    uint64 num_bg_threads[NUM_TASK_TYPES] = {0};
    num_bg_threads[TASK_TYPE_MEMTABLE]    = kvs_cfg->num_memtable_bg_threads;
    num_bg_threads[TASK_TYPE_NORMAL]      = kvs_cfg->num_normal_bg_threads;
@@ -200,27 +261,8 @@ splinterdb_init_config(const splinterdb_config *kvs_cfg, // IN
       return rc;
    }
 
-   rc = trunk_config_init(&kvs->trunk_cfg,
-                          &kvs->cache_cfg.super,
-                          kvs->data_cfg,
-                          (log_config *)&kvs->log_cfg,
-                          cfg.memtable_capacity,
-                          cfg.fanout,
-                          cfg.max_branches_per_node,
-                          cfg.btree_rough_count_height,
-                          cfg.filter_remainder_size,
-                          cfg.filter_index_size,
-                          cfg.reclaim_threshold,
-                          cfg.queue_scale_percent,
-                          cfg.use_log,
-                          cfg.use_stats,
-                          FALSE,
-                          NULL);
-   if (!SUCCESS(rc)) {
-      return rc;
-   }
-
-   return STATUS_OK;
+   memcpy(&kvs->cfg, &cfg, sizeof(cfg));
+   return splinterdb_init_trunk_config(&cfg, &kvs->cache_cfg, kvs);
 }
 
 
@@ -306,12 +348,21 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
       goto deinit_iohandle;
    }
 
-   if (open_existing) {
+   bool32 mount_existing = open_existing;
+mount:
+   if (mount_existing) {
       status = rc_allocator_mount(&kvs->allocator_handle,
                                   &kvs->allocator_cfg,
                                   (io_handle *)&kvs->io_handle,
                                   kvs->heap_id,
                                   platform_get_module_id());
+      if (SUCCESS(status) && kvs->trunk_cfg.use_log) {
+         // Keep the on-disk image for log recovery, see trunk_mount()
+         status = rc_allocator_retain_persisted(&kvs->allocator_handle);
+         if (!SUCCESS(status)) {
+            rc_allocator_unmount(&kvs->allocator_handle);
+         }
+      }
    } else {
       status = rc_allocator_init(&kvs->allocator_handle,
                                  &kvs->allocator_cfg,
@@ -340,7 +391,7 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
    }
 
    kvs->trunk_id = 1;
-   if (open_existing) {
+   if (mount_existing) {
       kvs->spl = trunk_mount(&kvs->trunk_cfg,
                              (allocator *)&kvs->allocator_handle,
                              (cache *)&kvs->cache_handle,
@@ -364,6 +415,24 @@ splinterdb_create_or_open(const splinterdb_config *kvs_cfg,      // IN
       goto deinit_cache;
    }
 
+   /*
+    * With a log, a new table is closed and re-opened, which writes it and the
+    * allocator's ref counts to disk. That gives the next crash recovery an
+    * image to replay the log onto. A table just recovered from a checkpoint
+    * and/or its log is likewise written back, so it is clean again.
+    */
+   if ((kvs->trunk_cfg.use_log && !mount_existing) || kvs->spl->recovered) {
+      trunk_unmount(&kvs->spl);
+      clockcache_deinit(&kvs->cache_handle);
+      rc_allocator_unmount(&kvs->allocator_handle);
+      mount_existing = TRUE;
+      goto mount;
+   }
+
+   status = platform_mutex_init(
+      &kvs->keyspace_lock, platform_get_module_id(), kvs->heap_id);
+   platform_assert_status_ok(status);
+
    *kvs_out = kvs;
    return platform_status_to_int(status);
 
@@ -432,6 +501,7 @@ splinterdb_close(splinterdb **kvs_in) // IN
 {
    splinterdb *kvs = *kvs_in;
    platform_assert(kvs != NULL);
+   platform_assert(kvs->parent == NULL, "Keyspaces close with their parent");
 
    // Print stats if shared memory is enabled.
    if (kvs->heap_id) {
@@ -442,6 +512,13 @@ splinterdb_close(splinterdb **kvs_in) // IN
     * order when these sub-systems were init'ed when a Splinter device was
     * created or re-opened. Otherwise, asserts will trip.
     */
+   while (kvs->keyspaces != NULL) {
+      splinterdb *keyspace = kvs->keyspaces;
+      kvs->keyspaces       = keyspace->next_keyspace;
+      trunk_unmount(&keyspace->spl);
+      platform_free(kvs->heap_id, keyspace);
+   }
+   platform_mutex_destroy(&kvs->keyspace_lock);
    trunk_unmount(&kvs->spl);
    clockcache_deinit(&kvs->cache_handle);
    rc_allocator_unmount(&kvs->allocator_handle);
@@ -459,6 +536,170 @@ splinterdb_close(splinterdb **kvs_in) // IN
 }
 
 
+/*
+ * A keyspace is the trunk with the allocator root id hashed from its name,
+ * skipping INVALID_ALLOCATOR_ROOT_ID and the id of the default trunk.
+ */
+static allocator_root_id
+splinterdb_keyspace_id(const char *name, uint64 length)
+{
+   allocator_root_id id = platform_hash64(name, length, HASH_SEED);
+   return id <= 1 ? id + 2 : id;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_keyspace_create_or_open --
+ *
+ *      Create the trunk of the named keyspace in kvs, or mount it, sharing
+ *      the cache, allocator and task system of kvs. A keyspace already open
+ *      is returned as is.
+ *
+ *      The keyspace's super block is reserved before the trunk is created,
+ *      so a file with no super block left fails cleanly.
+ *
+ * Results:
+ *      0 on success. EEXIST if creating a keyspace which exists, ENOENT if
+ *      opening one which does not, ENOSPC if the file holds as many as it
+ *      can, ENOTSUP for a splinterdb with a log.
+ *
+ * Side effects:
+ *      Links the keyspace into kvs, which unmounts it when closed.
+ *-----------------------------------------------------------------------------
+ */
+static int
+splinterdb_keyspace_create_or_open(splinterdb  *kvs,           // IN
+                                   const char  *name,          // IN
+                                   data_config *data_cfg,      // IN
+                                   bool32       open_existing, // IN
+                                   splinterdb **keyspace_out   // OUT
+)
+{
+   platform_assert(kvs != NULL);
+   uint64 length = 0;
+   if (name != NULL) {
+      length = platform_strnlen(name, SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH + 1);
+   }
+   if (kvs->parent != NULL || length == 0
+       || SPLINTERDB_MAX_KEYSPACE_NAME_LENGTH < length)
+   {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+   if (kvs->trunk_cfg.use_log) {
+      return platform_status_to_int(STATUS_NOTSUP);
+   }
+   platform_status rc = splinterdb_validate_app_data_config(data_cfg);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+
+   allocator_root_id id = splinterdb_keyspace_id(name, length);
+   allocator        *al = (allocator *)&kvs->allocator_handle;
+   platform_mutex_lock(&kvs->keyspace_lock);
+
+   splinterdb *keyspace = kvs->keyspaces;
+   while (keyspace != NULL && keyspace->trunk_id != id) {
+      keyspace = keyspace->next_keyspace;
+   }
+   if (keyspace != NULL) {
+      rc = open_existing ? STATUS_OK : STATUS_EXISTS;
+      goto out;
+   }
+
+   uint64 super_addr;
+   bool32 exists = SUCCESS(allocator_get_super_addr(al, id, &super_addr));
+   if (exists != open_existing) {
+      rc = open_existing ? STATUS_NOT_FOUND : STATUS_EXISTS;
+      goto out;
+   }
+   if (!open_existing) {
+      rc = allocator_alloc_super_addr(al, id, &super_addr);
+      if (!SUCCESS(rc)) {
+         rc = STATUS_NO_SPACE;
+         goto out;
+      }
+   }
+
+   keyspace = TYPED_ZALLOC(kvs->heap_id, keyspace);
+   if (keyspace == NULL) {
+      rc = STATUS_NO_MEMORY;
+      goto remove_super_addr;
+   }
+   keyspace->task_sys   = kvs->task_sys;
+   keyspace->io_cfg     = kvs->io_cfg;
+   keyspace->trunk_id   = id;
+   keyspace->heap_id    = kvs->heap_id;
+   keyspace->data_cfg   = data_cfg;
+   keyspace->durability = LOG_DURABILITY_NONE;
+   keyspace->cfg        = kvs->cfg;
+   keyspace->parent     = kvs;
+
+   keyspace->cfg.data_cfg = data_cfg;
+   rc                     = splinterdb_init_trunk_config(
+      &keyspace->cfg, &kvs->cache_cfg, keyspace);
+   if (!SUCCESS(rc)) {
+      goto free_keyspace;
+   }
+
+   if (open_existing) {
+      keyspace->spl = trunk_mount(&keyspace->trunk_cfg,
+                                  al,
+                                  (cache *)&kvs->cache_handle,
+                                  kvs->task_sys,
+                                  id,
+                                  kvs->heap_id);
+   } else {
+      keyspace->spl = trunk_create(&keyspace->trunk_cfg,
+                                   al,
+                                   (cache *)&kvs->cache_handle,
+                                   kvs->task_sys,
+                                   id,
+                                   kvs->heap_id);
+   }
+   if (keyspace->spl == NULL) {
+      rc = STATUS_INVALID_STATE;
+      goto free_keyspace;
+   }
+   keyspace->next_keyspace = kvs->keyspaces;
+   kvs->keyspaces          = keyspace;
+   goto out;
+
+free_keyspace:
+   platform_free(kvs->heap_id, keyspace);
+remove_super_addr:
+   if (!open_existing) {
+      allocator_remove_super_addr(al, id);
+   }
+out:
+   platform_mutex_unlock(&kvs->keyspace_lock);
+   if (SUCCESS(rc)) {
+      *keyspace_out = keyspace;
+   }
+   return platform_status_to_int(rc);
+}
+
+int
+splinterdb_keyspace_create(splinterdb  *kvs,      // IN
+                           const char  *name,     // IN
+                           data_config *data_cfg, // IN
+                           splinterdb **keyspace  // OUT
+)
+{
+   return splinterdb_keyspace_create_or_open(
+      kvs, name, data_cfg, FALSE, keyspace);
+}
+
+int
+splinterdb_keyspace_open(splinterdb  *kvs,      // IN
+                         const char  *name,     // IN
+                         data_config *data_cfg, // IN
+                         splinterdb **keyspace  // OUT
+)
+{
+   return splinterdb_keyspace_create_or_open(
+      kvs, name, data_cfg, TRUE, keyspace);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * splinterdb_register_thread --
@@ -532,6 +773,9 @@ splinterdb_insert_message(const splinterdb *kvs,      // IN
    key tuple_key = key_create_from_slice(user_key);
    platform_assert(kvs != NULL);
    platform_status status = trunk_insert(kvs->spl, tuple_key, msg);
+   if (SUCCESS(status) && kvs->durability != LOG_DURABILITY_NONE) {
+      status = trunk_log_commit(kvs->spl, kvs->durability);
+   }
    return platform_status_to_int(status);
 }
 
@@ -548,9 +792,41 @@ splinterdb_delete(const splinterdb *kvsb, slice user_key)
    return splinterdb_insert_message(kvsb, user_key, DELETE_MESSAGE);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_delete_range --
+ *
+ *      Delete every key in [start_key, end_key).
+ *
+ *      The range is recorded as a tombstone (see trunk_delete_range), so the
+ *      cost does not depend on the number of keys deleted.
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      Rotates the memtable.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_delete_range(const splinterdb *kvsb, slice start_key, slice end_key)
+{
+   platform_assert(kvsb != NULL);
+   platform_status status = trunk_delete_range(kvsb->spl,
+                                               key_create_from_slice(start_key),
+                                               key_create_from_slice(end_key));
+   if (SUCCESS(status) && kvsb->durability != LOG_DURABILITY_NONE) {
+      status = trunk_log_commit(kvsb->spl, kvsb->durability);
+   }
+   return platform_status_to_int(status);
+}
+
 int
 splinterdb_update(const splinterdb *kvsb, slice user_key, slice update)
 {
+   if (kvsb->spl->vlog != NULL) {
+      return platform_status_to_int(STATUS_NOTSUP);
+   }
    message msg = message_create(MESSAGE_TYPE_UPDATE, update);
    platform_assert(kvsb->data_cfg->merge_tuples);
    return splinterdb_insert_message(kvsb, user_key, msg);
@@ -558,218 +834,1525 @@ splinterdb_update(const splinterdb *kvsb, slice user_key, slice update)
 
 /*
  *-----------------------------------------------------------------------------
- * _splinterdb_lookup_result structure --
+ * splinterdb_write_batch --
+ *
+ *      Apply a batch of inserts, deletes and updates.
+ *
+ *      The batch is handed to the trunk in chunks of TRUNK_MAX_INSERT_BATCH
+ *      tuples, each of which is inserted into the memtable under one
+ *      acquisition of the insert lock and logged with one log append.
+ *
+ * Results:
+ *      0 on success, otherwise an errno. All entries are validated up front,
+ *      so EINVAL, or ENOTSUP for an update on a table with a value log,
+ *      means nothing was applied.
+ *
+ * Side effects:
+ *      None.
  *-----------------------------------------------------------------------------
  */
-typedef struct {
-   merge_accumulator value;
-} _splinterdb_lookup_result;
-
-_Static_assert(sizeof(_splinterdb_lookup_result)
-                  <= sizeof(splinterdb_lookup_result),
-               "sizeof(splinterdb_lookup_result) is too small");
-
-_Static_assert(alignof(splinterdb_lookup_result)
-                  == alignof(_splinterdb_lookup_result),
-               "mismatched alignment for splinterdb_lookup_result");
-
-void
-splinterdb_lookup_result_init(const splinterdb         *kvs,        // IN
-                              splinterdb_lookup_result *result,     // IN/OUT
-                              uint64                    buffer_len, // IN
-                              char                     *buffer      // IN
+int
+splinterdb_write_batch(const splinterdb                   *kvsb,        // IN
+                       uint64                              num_entries, // IN
+                       const splinterdb_write_batch_entry *entries      // IN
 )
 {
-   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
-   merge_accumulator_init_with_buffer(&_result->value,
-                                      NULL,
-                                      buffer_len,
-                                      buffer,
-                                      WRITABLE_BUFFER_NULL_LENGTH,
-                                      MESSAGE_TYPE_INVALID);
-}
-
-void
-splinterdb_lookup_result_deinit(splinterdb_lookup_result *result) // IN
-{
-   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
-   merge_accumulator_deinit(&_result->value);
-}
+   platform_assert(kvsb != NULL);
 
-_Bool
-splinterdb_lookup_found(const splinterdb_lookup_result *result) // IN
-{
-   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
-   return trunk_lookup_found(&_result->value);
-}
+   for (uint64 i = 0; i < num_entries; i++) {
+      if (kvsb->data_cfg->max_key_size < slice_length(entries[i].key)) {
+         return platform_status_to_int(STATUS_BAD_PARAM);
+      }
+      switch (entries[i].op) {
+         case SPLINTERDB_WRITE_INSERT:
+         case SPLINTERDB_WRITE_DELETE:
+            break;
+         case SPLINTERDB_WRITE_UPDATE:
+            if (kvsb->data_cfg->merge_tuples == NULL) {
+               return platform_status_to_int(STATUS_BAD_PARAM);
+            }
+            if (kvsb->spl->vlog != NULL) {
+               return platform_status_to_int(STATUS_NOTSUP);
+            }
+            break;
+         default:
+            return platform_status_to_int(STATUS_BAD_PARAM);
+      }
+   }
 
-int
-splinterdb_lookup_result_value(const splinterdb_lookup_result *result, // IN
-                               slice                          *value)
-{
-   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   key     keys[TRUNK_MAX_INSERT_BATCH];
+   message msgs[TRUNK_MAX_INSERT_BATCH];
+   for (uint64 start = 0; start < num_entries; start += TRUNK_MAX_INSERT_BATCH)
+   {
+      uint64 num = MIN(num_entries - start, TRUNK_MAX_INSERT_BATCH);
+      for (uint64 i = 0; i < num; i++) {
+         const splinterdb_write_batch_entry *entry = &entries[start + i];
+         keys[i] = key_create_from_slice(entry->key);
+         switch (entry->op) {
+            case SPLINTERDB_WRITE_INSERT:
+               msgs[i] = message_create(MESSAGE_TYPE_INSERT, entry->value);
+               break;
+            case SPLINTERDB_WRITE_DELETE:
+               msgs[i] = DELETE_MESSAGE;
+               break;
+            case SPLINTERDB_WRITE_UPDATE:
+               msgs[i] = message_create(MESSAGE_TYPE_UPDATE, entry->value);
+               break;
+            default:
+               platform_assert(0);
+         }
+      }
 
-   if (!splinterdb_lookup_found(result)) {
-      return EINVAL;
+      platform_status rc = trunk_insert_batch(kvsb->spl, num, keys, msgs);
+      if (!SUCCESS(rc)) {
+         return platform_status_to_int(rc);
+      }
    }
 
-   *value = merge_accumulator_to_value(&_result->value);
+   // One commit makes the whole batch durable
+   if (kvsb->durability != LOG_DURABILITY_NONE) {
+      return splinterdb_sync(kvsb, (splinterdb_durability)kvsb->durability);
+   }
    return 0;
 }
 
 /*
  *-----------------------------------------------------------------------------
- * splinterdb_lookup --
+ * splinterdb_sync --
  *
- *      Lookup a single tuple
+ *      Make the calling thread's writes so far durable.
  *
- *      result must have been initialized via splinterdb_lookup_result_init()
+ * Results:
+ *      0 on success, otherwise an errno.
  *
- *      Use splinterdb_lookup_result_parse to interpret the result
+ * Side effects:
+ *      Log writes and device syncs.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_sync(const splinterdb *kvsb, splinterdb_durability durability)
+{
+   platform_assert(kvsb != NULL);
+   if (SPLINTERDB_DURABILITY_SYNCED < durability) {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+   platform_status rc =
+      trunk_log_commit(kvsb->spl, (log_durability)durability);
+   return platform_status_to_int(rc);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_checkpoint --
  *
- *      A single result may be used for multiple lookups
+ *      Writes a crash-consistent image of the table to disk while it stays
+ *      open (see trunk_checkpoint).
  *
  * Results:
- *      0 on success (including key not found), otherwise an error number.
- *      Check for not-found via splinterdb_lookup_result_parse
+ *      0 on success, ENOTSUP if space reclamation is enabled or the
+ *      splinterdb has keyspaces open.
  *
  * Side effects:
- *      None.
+ *      Flushes the memtables into the trunk and starts a new log.
  *-----------------------------------------------------------------------------
  */
 int
-splinterdb_lookup(const splinterdb         *kvs, // IN
-                  slice                     user_key,
-                  splinterdb_lookup_result *result) // IN/OUT
+splinterdb_checkpoint(const splinterdb *kvs)
 {
-   platform_status            status;
-   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
-   key                        target  = key_create_from_slice(user_key);
-
    platform_assert(kvs != NULL);
-   status = trunk_lookup(kvs->spl, target, &_result->value);
-   return platform_status_to_int(status);
+   if (kvs->parent != NULL || kvs->keyspaces != NULL) {
+      // The ref counts it captures would not match the keyspaces' trunks
+      return platform_status_to_int(STATUS_NOTSUP);
+   }
+   platform_status rc = trunk_checkpoint(kvs->spl);
+   return platform_status_to_int(rc);
 }
 
-
-struct splinterdb_iterator {
-   trunk_range_iterator sri;
-   platform_status      last_rc;
-   const splinterdb    *parent;
-};
-
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_value_log_gc --
+ *
+ *      Copies the live values out of every extent of the value log but the
+ *      one being appended to (see trunk_value_log_gc).
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      Inserts the copied values again, and frees the extents once no
+ *      iterator or snapshot refers to them.
+ *-----------------------------------------------------------------------------
+ */
 int
-splinterdb_iterator_init(const splinterdb     *kvs,           // IN
-                         splinterdb_iterator **iter,          // OUT
-                         slice                 user_start_key // IN
-)
+splinterdb_value_log_gc(const splinterdb *kvs)
 {
-   splinterdb_iterator *it = TYPED_MALLOC(kvs->spl->heap_id, it);
-   if (it == NULL) {
-      platform_error_log("TYPED_MALLOC error\n");
-      return platform_status_to_int(STATUS_NO_MEMORY);
-   }
-   it->last_rc = STATUS_OK;
-
-   trunk_range_iterator *range_itor = &(it->sri);
-   key                   start_key;
-
-   if (slice_is_null(user_start_key)) {
-      start_key = NEGATIVE_INFINITY_KEY;
-   } else {
-      start_key = key_create_from_slice(user_start_key);
-   }
+   platform_assert(kvs != NULL);
+   platform_status rc = trunk_value_log_gc(kvs->spl, TRUE);
+   return platform_status_to_int(rc);
+}
 
-   platform_status rc = trunk_range_iterator_init(kvs->spl,
-                                                  range_itor,
-                                                  NEGATIVE_INFINITY_KEY,
-                                                  POSITIVE_INFINITY_KEY,
-                                                  start_key,
-                                                  greater_than_or_equal,
-                                                  UINT64_MAX);
-   if (!SUCCESS(rc)) {
-      platform_free(kvs->spl->heap_id, *iter);
-      return platform_status_to_int(rc);
-   }
-   it->parent = kvs;
+/*
+ * Presents the records of a splinterdb_bulk_load_next_fn as an iterator of
+ * insert messages, stepping forward only.
+ */
+typedef struct splinterdb_bulk_load_iterator {
+   iterator                     super;
+   splinterdb_bulk_load_next_fn next;
+   void                        *arg;
+   slice                        key;
+   slice                        value;
+   bool32                       at_end;
+} splinterdb_bulk_load_iterator;
 
-   *iter = it;
-   return EXIT_SUCCESS;
+static void
+splinterdb_bulk_load_iterator_curr(iterator *itor, key *curr_key, message *msg)
+{
+   splinterdb_bulk_load_iterator *load_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   *curr_key = key_create_from_slice(load_itor->key);
+   *msg      = message_create(MESSAGE_TYPE_INSERT, load_itor->value);
 }
 
-void
-splinterdb_iterator_deinit(splinterdb_iterator *iter)
+static bool32
+splinterdb_bulk_load_iterator_can_next(iterator *itor)
 {
-   trunk_range_iterator *range_itor = &(iter->sri);
-   trunk_range_iterator_deinit(range_itor);
-
-   trunk_handle *spl = range_itor->spl;
-   platform_free(spl->heap_id, range_itor);
+   splinterdb_bulk_load_iterator *load_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   return !load_itor->at_end;
 }
 
-_Bool
-splinterdb_iterator_valid(splinterdb_iterator *kvi)
+static platform_status
+splinterdb_bulk_load_iterator_next(iterator *itor)
 {
-   if (!SUCCESS(kvi->last_rc)) {
-      return FALSE;
+   splinterdb_bulk_load_iterator *load_itor =
+      (splinterdb_bulk_load_iterator *)itor;
+   int rc = load_itor->next(load_itor->arg, &load_itor->key, &load_itor->value);
+   if (rc == ENOENT) {
+      load_itor->at_end = TRUE;
+      return STATUS_OK;
    }
-   iterator *itor = &(kvi->sri.super);
+   return CONST_STATUS(rc);
+}
+
+const static iterator_ops splinterdb_bulk_load_iterator_ops = {
+   .curr     = splinterdb_bulk_load_iterator_curr,
+   .can_next = splinterdb_bulk_load_iterator_can_next,
+   .next     = splinterdb_bulk_load_iterator_next,
+};
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_bulk_load --
+ *
+ *      Load records in strictly increasing key order into an empty table,
+ *      building the trunk's leaves directly from them (see trunk_bulk_load).
+ *
+ * Results:
+ *      0 on success, otherwise an errno. The table is unchanged on error.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_bulk_load(const splinterdb            *kvsb, // IN
+                     splinterdb_bulk_load_next_fn next, // IN
+                     void                        *arg   // IN
+)
+{
+   platform_assert(kvsb != NULL);
+   splinterdb_bulk_load_iterator load_itor = {
+      .super = {.ops = &splinterdb_bulk_load_iterator_ops},
+      .next  = next,
+      .arg   = arg,
+   };
+   platform_status rc = splinterdb_bulk_load_iterator_next(&load_itor.super);
+   if (SUCCESS(rc)) {
+      rc = trunk_bulk_load(kvsb->spl, &load_itor.super);
+   }
+   return platform_status_to_int(rc);
+}
+
+struct splinterdb_ingest_writer {
+   ingest_file_writer writer;
+   platform_heap_id   heap_id;
+};
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_ingest_writer_create --
+ *
+ *      Create a new ingest file (see ingest_file.h) for tables configured
+ *      like cfg.
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      Creates or truncates the file at path.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_ingest_writer_create(const splinterdb_config   *kvs_cfg, // IN
+                                const char                *path,    // IN
+                                splinterdb_ingest_writer **writer   // OUT
+)
+{
+   splinterdb_config cfg = {0};
+   memcpy(&cfg, kvs_cfg, sizeof(cfg));
+   splinterdb_config_set_defaults(&cfg);
+
+   splinterdb_ingest_writer *new_writer = TYPED_ZALLOC(cfg.heap_id, new_writer);
+   if (new_writer == NULL) {
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   new_writer->heap_id = cfg.heap_id;
+   platform_status rc  = ingest_file_writer_init(&new_writer->writer,
+                                                cfg.data_cfg,
+                                                cfg.page_size,
+                                                cfg.extent_size,
+                                                cfg.io_async_queue_depth,
+                                                path,
+                                                cfg.heap_id);
+   if (!SUCCESS(rc)) {
+      platform_free(cfg.heap_id, new_writer);
+      return platform_status_to_int(rc);
+   }
+   *writer = new_writer;
+   return 0;
+}
+
+int
+splinterdb_ingest_writer_add(splinterdb_ingest_writer *writer, // IN
+                             slice                     key,    // IN
+                             slice                     value   // IN
+)
+{
+   platform_status rc = ingest_file_writer_add(&writer->writer, key, value);
+   return platform_status_to_int(rc);
+}
+
+int
+splinterdb_ingest_writer_finish(splinterdb_ingest_writer *writer // IN
+)
+{
+   platform_status rc = ingest_file_writer_finish(&writer->writer);
+   ingest_file_writer_deinit(&writer->writer);
+   platform_free(writer->heap_id, writer);
+   return platform_status_to_int(rc);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_ingest --
+ *
+ *      Ingest the records of an ingest file (see trunk_ingest).
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      Incorporates the memtables if the table is not empty.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_ingest(const splinterdb *kvsb, // IN
+                  const char       *path  // IN
+)
+{
+   platform_assert(kvsb != NULL);
+   ingest_file_iterator itor;
+   platform_status      rc = ingest_file_iterator_init(&itor,
+                                                  kvsb->io_cfg.page_size,
+                                                  kvsb->io_cfg.extent_size,
+                                                  kvsb->io_cfg.async_queue_size,
+                                                  path,
+                                                  kvsb->heap_id);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+   rc = trunk_ingest(kvsb->spl, &itor.super);
+   ingest_file_iterator_deinit(&itor);
+   return platform_status_to_int(rc);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * _splinterdb_lookup_result structure --
+ *-----------------------------------------------------------------------------
+ */
+typedef struct {
+   merge_accumulator value;
+} _splinterdb_lookup_result;
+
+_Static_assert(sizeof(_splinterdb_lookup_result)
+                  <= sizeof(splinterdb_lookup_result),
+               "sizeof(splinterdb_lookup_result) is too small");
+
+_Static_assert(alignof(splinterdb_lookup_result)
+                  == alignof(_splinterdb_lookup_result),
+               "mismatched alignment for splinterdb_lookup_result");
+
+void
+splinterdb_lookup_result_init(const splinterdb         *kvs,        // IN
+                              splinterdb_lookup_result *result,     // IN/OUT
+                              uint64                    buffer_len, // IN
+                              char                     *buffer      // IN
+)
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   merge_accumulator_init_with_buffer(&_result->value,
+                                      NULL,
+                                      buffer_len,
+                                      buffer,
+                                      WRITABLE_BUFFER_NULL_LENGTH,
+                                      MESSAGE_TYPE_INVALID);
+}
+
+void
+splinterdb_lookup_result_deinit(splinterdb_lookup_result *result) // IN
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   merge_accumulator_deinit(&_result->value);
+}
+
+_Bool
+splinterdb_lookup_found(const splinterdb_lookup_result *result) // IN
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   return trunk_lookup_found(&_result->value);
+}
+
+int
+splinterdb_lookup_result_value(const splinterdb_lookup_result *result, // IN
+                               slice                          *value)
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+
+   if (!splinterdb_lookup_found(result)) {
+      return EINVAL;
+   }
+
+   *value = merge_accumulator_to_value(&_result->value);
+   return 0;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup --
+ *
+ *      Lookup a single tuple
+ *
+ *      result must have been initialized via splinterdb_lookup_result_init()
+ *
+ *      Use splinterdb_lookup_result_parse to interpret the result
+ *
+ *      A single result may be used for multiple lookups
+ *
+ * Results:
+ *      0 on success (including key not found), otherwise an error number.
+ *      Check for not-found via splinterdb_lookup_result_parse
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup(const splinterdb         *kvs, // IN
+                  slice                     user_key,
+                  splinterdb_lookup_result *result) // IN/OUT
+{
+   platform_status            status;
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   key                        target  = key_create_from_slice(user_key);
+
+   platform_assert(kvs != NULL);
+   status = trunk_lookup(kvs->spl, target, &_result->value);
+   return platform_status_to_int(status);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_async_ctxt --
+ *
+ *      State for one in-flight lookup issued through an async poller. The
+ *      trunk_async_ctxt must be the first member so the IO completion
+ *      callback can recover the enclosing ctxt.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct splinterdb_lookup_async_ctxt {
+   trunk_async_ctxt           ctxt;   // Async lookup state machine
+   splinterdb_async_poller   *poller; // Poller that issued this lookup
+   slice                      key;    // Caller's key; must outlive lookup
+   splinterdb_lookup_result  *result; // Caller's result
+   splinterdb_lookup_async_cb cb;     // Called on (deferred) completion
+   void                      *cb_arg;
+} splinterdb_lookup_async_ctxt;
+
+struct splinterdb_async_poller {
+   const splinterdb              *kvs;
+   pcq                           *ready_q; // Fed from IO completion
+   uint64                         max_inflight;
+   uint64                         num_avail;
+   splinterdb_lookup_async_ctxt **avail; // Stack of free ctxts
+   splinterdb_lookup_async_ctxt   ctxt[];
+};
+
+/*
+ * Callback called when an IO completes on behalf of an async lookup. This
+ * may run on any thread that reaps IO completions, so it only hands the ctxt
+ * back to the issuing thread through its poller's ready queue.
+ */
+static void
+splinterdb_lookup_async_callback(trunk_async_ctxt *spl_ctxt)
+{
+   splinterdb_lookup_async_ctxt *ctxt =
+      container_of(spl_ctxt, splinterdb_lookup_async_ctxt, ctxt);
+   pcq_enqueue(ctxt->poller->ready_q, ctxt);
+}
+
+/*
+ * Advance the lookup state machine of ctxt. Returns TRUE if the lookup is
+ * complete, in which case the ctxt has been returned to the poller.
+ */
+static bool32
+splinterdb_lookup_async_process_one(splinterdb_async_poller      *poller,
+                                    splinterdb_lookup_async_ctxt *ctxt)
+{
+   _splinterdb_lookup_result *_result =
+      (_splinterdb_lookup_result *)ctxt->result;
+   key target = key_create_from_slice(ctxt->key);
+
+   cache_async_result res = trunk_lookup_async(
+      poller->kvs->spl, target, &_result->value, &ctxt->ctxt);
+   switch (res) {
+      case async_locked:
+      case async_no_reqs:
+         // Retry on the next poll
+         pcq_enqueue(poller->ready_q, ctxt);
+         return FALSE;
+      case async_io_started:
+         // The IO completion callback will requeue the ctxt
+         return FALSE;
+      case async_success:
+         poller->avail[poller->num_avail++] = ctxt;
+         return TRUE;
+      default:
+         platform_assert(0);
+   }
+   return FALSE;
+}
+
+int
+splinterdb_async_poller_create(const splinterdb         *kvs,          // IN
+                               uint64                    max_inflight, // IN
+                               splinterdb_async_poller **poller_out    // OUT
+)
+{
+   platform_assert(kvs != NULL);
+   if (max_inflight == 0) {
+      max_inflight = kvs->io_cfg.async_queue_size;
+   }
+
+   platform_heap_id         hid = kvs->spl->heap_id;
+   splinterdb_async_poller *poller =
+      TYPED_FLEXIBLE_STRUCT_ZALLOC(hid, poller, ctxt, max_inflight);
+   if (poller == NULL) {
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   poller->avail   = TYPED_ARRAY_MALLOC(hid, poller->avail, max_inflight);
+   poller->ready_q = pcq_alloc(hid, max_inflight);
+   if (poller->avail == NULL || poller->ready_q == NULL) {
+      if (poller->ready_q != NULL) {
+         pcq_free(hid, poller->ready_q);
+      }
+      if (poller->avail != NULL) {
+         platform_free(hid, poller->avail);
+      }
+      platform_free(hid, poller);
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+
+   poller->kvs          = kvs;
+   poller->max_inflight = max_inflight;
+   poller->num_avail    = max_inflight;
+   for (uint64 i = 0; i < max_inflight; i++) {
+      poller->ctxt[i].poller = poller;
+      poller->avail[i]       = &poller->ctxt[i];
+   }
+
+   *poller_out = poller;
+   return 0;
+}
+
+void
+splinterdb_async_poller_destroy(splinterdb_async_poller *poller)
+{
+   platform_assert(poller->num_avail == poller->max_inflight,
+                   "%lu async lookups still in flight",
+                   poller->max_inflight - poller->num_avail);
+   platform_assert(pcq_is_empty(poller->ready_q));
+
+   platform_heap_id hid = poller->kvs->spl->heap_id;
+   pcq_free(hid, poller->ready_q);
+   platform_free(hid, poller->avail);
+   platform_free(hid, poller);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_async --
+ *
+ *      Start an async lookup of user_key.
+ *
+ *      The lookup runs until it would block on a page read. If it can
+ *      complete without blocking, the result is available on return.
+ *      Otherwise the read is issued and the lookup is resumed by a later
+ *      splinterdb_async_poll(), which calls cb once it completes.
+ *
+ * Results:
+ *      0 if the lookup completed (cb is not called),
+ *      EINPROGRESS if it is pending,
+ *      EAGAIN if the poller already has max_inflight lookups pending,
+ *      otherwise an errno.
+ *
+ * Side effects:
+ *      May issue async IO.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup_async(splinterdb_async_poller   *poller,   // IN
+                        slice                      user_key, // IN
+                        splinterdb_lookup_result  *result,   // IN/OUT
+                        splinterdb_lookup_async_cb cb,       // IN
+                        void                      *cb_arg    // IN
+)
+{
+   if (poller->kvs->data_cfg->max_key_size < slice_length(user_key)) {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+   if (poller->num_avail == 0) {
+      return platform_status_to_int(STATUS_BUSY);
+   }
+
+   splinterdb_lookup_async_ctxt *ctxt = poller->avail[--poller->num_avail];
+   trunk_async_ctxt_init(&ctxt->ctxt, splinterdb_lookup_async_callback);
+   ctxt->key    = user_key;
+   ctxt->result = result;
+   ctxt->cb     = cb;
+   ctxt->cb_arg = cb_arg;
+
+   if (splinterdb_lookup_async_process_one(poller, ctxt)) {
+      return 0;
+   }
+   return platform_status_to_int(STATUS_IN_PROGRESS);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_async_poll --
+ *
+ *      Reap completed IOs and resume the lookups waiting on them, calling
+ *      the callback of each lookup that completes. Never blocks.
+ *
+ * Results:
+ *      Number of lookups of this poller still pending.
+ *
+ * Side effects:
+ *      Calls lookup callbacks. May issue async IO.
+ *-----------------------------------------------------------------------------
+ */
+uint64
+splinterdb_async_poll(splinterdb_async_poller *poller)
+{
+   if (poller->num_avail == poller->max_inflight) {
+      return 0;
+   }
+
+   cache_cleanup(poller->kvs->spl->cc);
+
+   uint32 count = pcq_count(poller->ready_q);
+   while (count-- > 0) {
+      splinterdb_lookup_async_ctxt *ctxt;
+      platform_status rc = pcq_dequeue(poller->ready_q, (void **)&ctxt);
+      if (!SUCCESS(rc)) {
+         // Something is ready, just can't be dequeued yet.
+         break;
+      }
+      if (splinterdb_lookup_async_process_one(poller, ctxt)) {
+         ctxt->cb(ctxt->key, ctxt->result, ctxt->cb_arg);
+      }
+   }
+
+   return poller->max_inflight - poller->num_avail;
+}
+
+/*
+ * Completion callback used by splinterdb_lookup_batch(). Lookups never fail
+ * once issued, so there is nothing to record.
+ */
+static void
+splinterdb_lookup_batch_callback(slice                     key,
+                                 splinterdb_lookup_result *result,
+                                 void                     *arg)
+{}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_lookup_batch --
+ *
+ *      Lookup num_keys tuples, overlapping their cache misses.
+ *
+ *      Up to io_async_queue_depth lookups are driven concurrently through an
+ *      async poller. Whenever a lookup would block on a page read it is
+ *      parked until the IO completes, and the thread moves on to the next
+ *      key instead of waiting.
+ *
+ *      Each of results[] must have been initialized via
+ *      splinterdb_lookup_result_init(). statuses may be NULL.
+ *
+ * Results:
+ *      0 if every lookup succeeded (including keys not found), otherwise the
+ *      first non-zero per-key status. statuses[i], if provided, receives the
+ *      status of the lookup of keys[i].
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_lookup_batch(const splinterdb         *kvs,      // IN
+                        uint64                    num_keys, // IN
+                        const slice              *keys,     // IN
+                        splinterdb_lookup_result *results,  // IN/OUT
+                        int                      *statuses  // OUT
+)
+{
+   platform_assert(kvs != NULL);
+   if (num_keys == 0) {
+      return 0;
+   }
+
+   splinterdb_async_poller *poller;
+   int                      rc = splinterdb_async_poller_create(
+      kvs, MIN(num_keys, kvs->io_cfg.async_queue_size), &poller);
+   if (rc != 0) {
+      return rc;
+   }
+
+   int first_error = 0;
+   for (uint64 i = 0; i < num_keys; i++) {
+      do {
+         rc = splinterdb_lookup_async(poller,
+                                      keys[i],
+                                      &results[i],
+                                      splinterdb_lookup_batch_callback,
+                                      NULL);
+         if (rc == EAGAIN) {
+            // All contexts are busy; wait for one to complete
+            splinterdb_async_poll(poller);
+         }
+      } while (rc == EAGAIN);
+
+      if (rc == EINPROGRESS) {
+         rc = 0;
+      }
+      if (statuses != NULL) {
+         statuses[i] = rc;
+      }
+      if (rc != 0 && first_error == 0) {
+         first_error = rc;
+      }
+   }
+
+   while (splinterdb_async_poll(poller) != 0) {
+      // Drain the remaining in-flight lookups
+   }
+
+   splinterdb_async_poller_destroy(poller);
+   return first_error;
+}
+
+
+// See splinterdb_snapshot_create()
+struct splinterdb_snapshot {
+   const splinterdb *kvs;
+   uint64            root_addr;
+   uint64            num_range_deletes;
+};
+
+struct splinterdb_iterator {
+   trunk_range_iterator sri;
+   platform_status      last_rc;
+   const splinterdb    *parent;
+};
+
+static int
+splinterdb_iterator_init_internal(const splinterdb          *kvs,       // IN
+                                  splinterdb_iterator      **iter,      // OUT
+                                  const splinterdb_snapshot *snapshot,  // IN
+                                  key                        min_key,   // IN
+                                  key                        max_key,   // IN
+                                  key                        start_key) // IN
+{
+   splinterdb_iterator *it = TYPED_MALLOC(kvs->spl->heap_id, it);
+   if (it == NULL) {
+      platform_error_log("TYPED_MALLOC error\n");
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   it->last_rc = STATUS_OK;
+
+   trunk_range_iterator *range_itor = &(it->sri);
+
+   platform_status rc;
+   if (snapshot == NULL) {
+      rc = trunk_range_iterator_init(kvs->spl,
+                                     range_itor,
+                                     min_key,
+                                     max_key,
+                                     start_key,
+                                     greater_than_or_equal,
+                                     UINT64_MAX);
+   } else {
+      rc = trunk_range_iterator_init_snapshot(kvs->spl,
+                                              range_itor,
+                                              snapshot->root_addr,
+                                              snapshot->num_range_deletes,
+                                              min_key,
+                                              max_key,
+                                              start_key,
+                                              greater_than_or_equal,
+                                              UINT64_MAX);
+   }
+   if (!SUCCESS(rc)) {
+      platform_free(kvs->spl->heap_id, it);
+      return platform_status_to_int(rc);
+   }
+   it->parent = kvs;
+
+   *iter = it;
+   return EXIT_SUCCESS;
+}
+
+int
+splinterdb_iterator_init(const splinterdb     *kvs,           // IN
+                         splinterdb_iterator **iter,          // OUT
+                         slice                 user_start_key // IN
+)
+{
+   key start_key;
+
+   if (slice_is_null(user_start_key)) {
+      start_key = NEGATIVE_INFINITY_KEY;
+   } else {
+      start_key = key_create_from_slice(user_start_key);
+   }
+
+   return splinterdb_iterator_init_internal(
+      kvs, iter, NULL, NEGATIVE_INFINITY_KEY, POSITIVE_INFINITY_KEY, start_key);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_iterator_init_bounded --
+ *
+ *      Initialize an iterator over [user_start_key, user_end_key).
+ *
+ *      The bounds are handed down to the trunk range iterator, so btree
+ *      iterators stop at the end key, leaves past it are never visited and
+ *      branches with no tuples in range are left out of the merge.
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_iterator_init_bounded(const splinterdb     *kvs,            // IN
+                                 splinterdb_iterator **iter,           // OUT
+                                 slice                 user_start_key, // IN
+                                 slice                 user_end_key    // IN
+)
+{
+   key min_key;
+   key max_key;
+
+   if (slice_is_null(user_start_key)) {
+      min_key = NEGATIVE_INFINITY_KEY;
+   } else {
+      min_key = key_create_from_slice(user_start_key);
+   }
+   if (slice_is_null(user_end_key)) {
+      max_key = POSITIVE_INFINITY_KEY;
+   } else {
+      max_key = key_create_from_slice(user_end_key);
+   }
+
+   return splinterdb_iterator_init_internal(
+      kvs, iter, NULL, min_key, max_key, min_key);
+}
+
+void
+splinterdb_iterator_deinit(splinterdb_iterator *iter)
+{
+   trunk_range_iterator *range_itor = &(iter->sri);
+   trunk_range_iterator_deinit(range_itor);
+
+   trunk_handle *spl = range_itor->spl;
+   platform_free(spl->heap_id, range_itor);
+}
+
+_Bool
+splinterdb_iterator_valid(splinterdb_iterator *kvi)
+{
+   if (!SUCCESS(kvi->last_rc)) {
+      return FALSE;
+   }
+   iterator *itor = &(kvi->sri.super);
    return iterator_can_curr(itor);
 }
 
-_Bool
-splinterdb_iterator_can_prev(splinterdb_iterator *kvi)
+_Bool
+splinterdb_iterator_can_prev(splinterdb_iterator *kvi)
+{
+   if (!SUCCESS(kvi->last_rc)) {
+      return FALSE;
+   }
+   iterator *itor = &(kvi->sri.super);
+   return iterator_can_prev(itor);
+}
+
+_Bool
+splinterdb_iterator_can_next(splinterdb_iterator *kvi)
+{
+   if (!SUCCESS(kvi->last_rc)) {
+      return FALSE;
+   }
+   iterator *itor = &(kvi->sri.super);
+   return iterator_can_next(itor);
+}
+
+void
+splinterdb_iterator_next(splinterdb_iterator *kvi)
+{
+   iterator *itor = &(kvi->sri.super);
+   kvi->last_rc   = iterator_next(itor);
+}
+
+void
+splinterdb_iterator_prev(splinterdb_iterator *kvi)
+{
+   iterator *itor = &(kvi->sri.super);
+   kvi->last_rc   = iterator_prev(itor);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_iterator_next_batch --
+ *
+ *      Copy up to max_tuples tuples, starting at the iterator's current
+ *      tuple, into buffer and point keys[i]/values[i] at the copies. Stops
+ *      early when the next tuple would not fit in the remaining buffer or
+ *      the iterator is exhausted, and leaves the iterator positioned at the
+ *      first tuple not returned.
+ *
+ *      This replaces a valid()/get_current()/next() round trip per tuple
+ *      with a single call for the whole batch.
+ *
+ * Results:
+ *      0 on success, with the number of tuples copied in *num_tuples (0
+ *      once the iterator is exhausted). ENOSPC if the current tuple alone
+ *      does not fit in buffer. Any other errno reports an iteration error,
+ *      which is also recorded as the iterator's status; tuples copied before
+ *      the error are still returned.
+ *
+ * Side effects:
+ *      Advances the iterator past the returned tuples.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_iterator_next_batch(splinterdb_iterator *iter,        // IN/OUT
+                               uint64               max_tuples,  // IN
+                               slice               *keys,        // OUT
+                               slice               *values,      // OUT
+                               char                *buffer,      // OUT
+                               uint64               buffer_size, // IN
+                               uint64              *num_tuples   // OUT
+)
+{
+   *num_tuples = 0;
+   if (!SUCCESS(iter->last_rc)) {
+      return platform_status_to_int(iter->last_rc);
+   }
+
+   iterator *itor = &(iter->sri.super);
+   uint64    used = 0;
+   uint64    n    = 0;
+   while (n < max_tuples && iterator_can_curr(itor)) {
+      key     curr_key;
+      message msg;
+      iterator_curr(itor, &curr_key, &msg);
+
+      slice  user_key   = key_slice(curr_key);
+      slice  user_value = message_slice(msg);
+      uint64 key_len    = slice_length(user_key);
+      uint64 value_len  = slice_length(user_value);
+      if (buffer_size - used < key_len + value_len) {
+         break;
+      }
+
+      memcpy(buffer + used, slice_data(user_key), key_len);
+      keys[n] = slice_create(key_len, buffer + used);
+      used += key_len;
+      memcpy(buffer + used, slice_data(user_value), value_len);
+      values[n] = slice_create(value_len, buffer + used);
+      used += value_len;
+      n++;
+
+      iter->last_rc = iterator_next(itor);
+      if (!SUCCESS(iter->last_rc)) {
+         break;
+      }
+   }
+
+   *num_tuples = n;
+   if (n == 0 && max_tuples > 0 && iterator_can_curr(itor)
+       && SUCCESS(iter->last_rc))
+   {
+      return ENOSPC;
+   }
+   return platform_status_to_int(iter->last_rc);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_iterator_seek --
+ *
+ *      Reposition an existing iterator at the first key >= user_key, clamped
+ *      to the iterator's bounds.
+ *
+ *      When the target lies in the trunk leaf the iterator is currently
+ *      positioned in, the branch and merge iterators are reused and only
+ *      seeked; otherwise the iterator is rebuilt in place for the new leaf.
+ *
+ * Results:
+ *      0 on success, otherwise an errno. The status is also recorded as the
+ *      iterator's status.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_iterator_seek(splinterdb_iterator *iter,    // IN/OUT
+                         slice                user_key // IN
+)
+{
+   key seek_key;
+
+   if (slice_is_null(user_key)) {
+      seek_key = NEGATIVE_INFINITY_KEY;
+   } else {
+      if (iter->parent->data_cfg->max_key_size < slice_length(user_key)) {
+         return EINVAL;
+      }
+      seek_key = key_create_from_slice(user_key);
+   }
+
+   iterator *itor = &(iter->sri.super);
+   iter->last_rc  = iterator_seek(itor, seek_key, greater_than_or_equal);
+   return platform_status_to_int(iter->last_rc);
+}
+
+int
+splinterdb_iterator_status(const splinterdb_iterator *iter)
+{
+   return platform_status_to_int(iter->last_rc);
+}
+
+void
+splinterdb_iterator_get_current(splinterdb_iterator *iter,   // IN
+                                slice               *outkey, // OUT
+                                slice               *value   // OUT
+)
+{
+   key       result_key;
+   message   msg;
+   iterator *itor = &(iter->sri.super);
+
+   iterator_curr(itor, &result_key, &msg);
+   *value  = message_slice(msg);
+   *outkey = key_slice(result_key);
+}
+
+typedef struct splinterdb_scan_state {
+   splinterdb_scan_filter_fn filter;
+   splinterdb_scan_fn        func;
+   void                     *arg;
+   int                       rc;
+   volatile bool32          *stopped; // shared by the parts of a parallel scan
+} splinterdb_scan_state;
+
+static bool32
+splinterdb_scan_filter(key tuple_key, void *arg)
 {
-   if (!SUCCESS(kvi->last_rc)) {
+   splinterdb_scan_state *state = arg;
+   return state->filter(state->arg, key_slice(tuple_key));
+}
+
+static bool32
+splinterdb_scan_tuple(key tuple_key, message value, void *arg)
+{
+   splinterdb_scan_state *state = arg;
+   if (state->stopped != NULL && *state->stopped) {
       return FALSE;
    }
-   iterator *itor = &(kvi->sri.super);
-   return iterator_can_prev(itor);
+   state->rc =
+      state->func(state->arg, key_slice(tuple_key), message_slice(value));
+   if (state->rc != 0 && state->stopped != NULL) {
+      *state->stopped = TRUE;
+   }
+   return state->rc == 0;
 }
 
-_Bool
-splinterdb_iterator_can_next(splinterdb_iterator *kvi)
+static int
+splinterdb_scan_internal(const splinterdb      *kvs,
+                         key                    min_key,
+                         key                    max_key,
+                         splinterdb_scan_state *state)
 {
-   if (!SUCCESS(kvi->last_rc)) {
-      return FALSE;
+   platform_status rc = trunk_range_scan(kvs->spl,
+                                         min_key,
+                                         max_key,
+                                         state->filter != NULL
+                                            ? splinterdb_scan_filter
+                                            : NULL,
+                                         splinterdb_scan_tuple,
+                                         state);
+   if (!SUCCESS(rc)) {
+      if (state->stopped != NULL) {
+         *state->stopped = TRUE;
+      }
+      return platform_status_to_int(rc);
    }
-   iterator *itor = &(kvi->sri.super);
-   return iterator_can_next(itor);
+   return state->rc;
 }
 
-void
-splinterdb_iterator_next(splinterdb_iterator *kvi)
+/*
+ * Converts the bounds of a scan to keys, a null slice being unbounded.
+ */
+static platform_status
+splinterdb_scan_bounds(const splinterdb *kvs,
+                       slice             start_key,
+                       slice             end_key,
+                       key              *min_key,
+                       key              *max_key)
 {
-   iterator *itor = &(kvi->sri.super);
-   kvi->last_rc   = iterator_next(itor);
+   *min_key = slice_is_null(start_key) ? NEGATIVE_INFINITY_KEY
+                                       : key_create_from_slice(start_key);
+   *max_key = slice_is_null(end_key) ? POSITIVE_INFINITY_KEY
+                                     : key_create_from_slice(end_key);
+   if (kvs->data_cfg->max_key_size < key_length(*min_key)
+       || kvs->data_cfg->max_key_size < key_length(*max_key))
+   {
+      return STATUS_BAD_PARAM;
+   }
+   return STATUS_OK;
 }
 
-void
-splinterdb_iterator_prev(splinterdb_iterator *kvi)
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_scan --
+ *
+ *      Call func on each tuple in [start_key, end_key) whose key filter
+ *      accepts, in key order, see trunk_range_scan. A null start or end key
+ *      leaves that end of the range unbounded.
+ *
+ * Results:
+ *      0 once the range is scanned, the nonzero value returned by func that
+ *      stopped the scan, or the errno of an iteration error.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_scan(const splinterdb         *kvs,       // IN
+                slice                     start_key, // IN
+                slice                     end_key,   // IN
+                splinterdb_scan_filter_fn filter,    // IN
+                splinterdb_scan_fn        func,      // IN
+                void                     *arg        // IN
+)
 {
-   iterator *itor = &(kvi->sri.super);
-   kvi->last_rc   = iterator_prev(itor);
+   platform_assert(kvs != NULL);
+   key             min_key, max_key;
+   platform_status rc =
+      splinterdb_scan_bounds(kvs, start_key, end_key, &min_key, &max_key);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+
+   splinterdb_scan_state state = {.filter = filter, .func = func, .arg = arg};
+   return splinterdb_scan_internal(kvs, min_key, max_key, &state);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_split_range --
+ *
+ *      Divide [start_key, end_key) into at most num_parts ranges of about
+ *      the same number of tuples, see trunk_split_range, copying the keys
+ *      between them into buffer and pointing split_keys[i] at the copies.
+ *
+ * Results:
+ *      0 on success, with the number of split keys, at most num_parts - 1,
+ *      in *num_split_keys. ENOSPC if the keys do not fit in buffer.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_split_range(const splinterdb *kvs,           // IN
+                       slice             start_key,     // IN
+                       slice             end_key,       // IN
+                       uint64            num_parts,     // IN
+                       slice            *split_keys,    // OUT
+                       char             *buffer,        // OUT
+                       uint64            buffer_size,   // IN
+                       uint64           *num_split_keys // OUT
+)
+{
+   platform_assert(kvs != NULL);
+   *num_split_keys = 0;
+   key             min_key, max_key;
+   platform_status rc =
+      splinterdb_scan_bounds(kvs, start_key, end_key, &min_key, &max_key);
+   if (!SUCCESS(rc) || num_parts < 2) {
+      return platform_status_to_int(rc);
+   }
+
+   platform_heap_id hid    = kvs->spl->heap_id;
+   key_buffer      *splits = TYPED_ARRAY_MALLOC(hid, splits, num_parts);
+   if (splits == NULL) {
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   uint64 num_splits;
+   rc = trunk_split_range(
+      kvs->spl, min_key, max_key, num_parts, splits, &num_splits);
+   if (!SUCCESS(rc)) {
+      platform_free(hid, splits);
+      return platform_status_to_int(rc);
+   }
+
+   uint64 used = 0;
+   for (uint64 i = 0; i < num_splits; i++) {
+      slice  split  = key_slice(key_buffer_key(&splits[i]));
+      uint64 length = slice_length(split);
+      if (SUCCESS(rc) && buffer_size - used < length) {
+         rc = STATUS_NO_SPACE;
+      }
+      if (SUCCESS(rc)) {
+         memcpy(buffer + used, slice_data(split), length);
+         split_keys[i] = slice_create(length, buffer + used);
+         used += length;
+      }
+      key_buffer_deinit(&splits[i]);
+   }
+   platform_free(hid, splits);
+   if (SUCCESS(rc)) {
+      *num_split_keys = num_splits;
+   }
+   return platform_status_to_int(rc);
 }
 
+typedef struct splinterdb_scan_part {
+   const splinterdb     *kvs;
+   key                   min_key;
+   key                   max_key;
+   splinterdb_scan_state state;
+   platform_thread       thread;
+   bool32                threaded;
+} splinterdb_scan_part;
+
+static void
+splinterdb_scan_part_worker(void *arg)
+{
+   splinterdb_scan_part *part = arg;
+   part->state.rc         = splinterdb_scan_internal(
+      part->kvs, part->min_key, part->max_key, &part->state);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_parallel_scan --
+ *
+ *      Split [start_key, end_key) into up to num_threads parts with
+ *      trunk_split_range and scan them concurrently, part i calling func with
+ *      args[i]. The calling thread scans the first part, and a thread is
+ *      created for each of the others; a part whose thread cannot be created
+ *      is scanned by the calling thread once it is done with its own.
+ *
+ * Results:
+ *      0 once the range is scanned, otherwise the first nonzero result, in
+ *      part order, of a part that stopped, see splinterdb_scan. A part that
+ *      stops stops the others too.
+ *
+ * Side effects:
+ *      Creates and joins up to num_threads - 1 threads.
+ *-----------------------------------------------------------------------------
+ */
 int
-splinterdb_iterator_status(const splinterdb_iterator *iter)
+splinterdb_parallel_scan(const splinterdb         *kvs,         // IN
+                         slice                     start_key,   // IN
+                         slice                     end_key,     // IN
+                         uint64                    num_threads, // IN
+                         splinterdb_scan_filter_fn filter,      // IN
+                         splinterdb_scan_fn        func,        // IN
+                         void *const              *args         // IN
+)
 {
-   return platform_status_to_int(iter->last_rc);
+   platform_assert(kvs != NULL);
+   key             min_key, max_key;
+   platform_status rc =
+      splinterdb_scan_bounds(kvs, start_key, end_key, &min_key, &max_key);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+   num_threads = MAX(num_threads, 1);
+
+   platform_heap_id      hid    = kvs->spl->heap_id;
+   key_buffer           *splits = TYPED_ARRAY_MALLOC(hid, splits, num_threads);
+   splinterdb_scan_part *parts  = TYPED_ARRAY_ZALLOC(hid, parts, num_threads);
+   if (splits == NULL || parts == NULL) {
+      platform_free(hid, splits);
+      platform_free(hid, parts);
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+   uint64 num_splits;
+   rc = trunk_split_range(
+      kvs->spl, min_key, max_key, num_threads, splits, &num_splits);
+   if (!SUCCESS(rc)) {
+      platform_free(hid, splits);
+      platform_free(hid, parts);
+      return platform_status_to_int(rc);
+   }
+
+   volatile bool32 stopped   = FALSE;
+   uint64          num_parts = num_splits + 1;
+   for (uint64 i = 0; i < num_parts; i++) {
+      splinterdb_scan_part *part = &parts[i];
+      part->kvs                  = kvs;
+      part->min_key = i == 0 ? min_key : key_buffer_key(&splits[i - 1]);
+      part->max_key = i == num_splits ? max_key : key_buffer_key(&splits[i]);
+      part->state.filter  = filter;
+      part->state.func    = func;
+      part->state.arg     = args[i];
+      part->state.stopped = &stopped;
+      if (i != 0) {
+         platform_status thread_rc =
+            task_thread_create("splinterdb_parallel_scan",
+                               splinterdb_scan_part_worker,
+                               part,
+                               trunk_get_scratch_size(),
+                               kvs->task_sys,
+                               hid,
+                               &part->thread);
+         part->threaded = SUCCESS(thread_rc);
+      }
+   }
+
+   for (uint64 i = 0; i < num_parts; i++) {
+      if (!parts[i].threaded) {
+         splinterdb_scan_part_worker(&parts[i]);
+      }
+   }
+   int result = 0;
+   for (uint64 i = 0; i < num_parts; i++) {
+      if (parts[i].threaded) {
+         platform_thread_join(parts[i].thread);
+      }
+      if (result == 0) {
+         result = parts[i].state.rc;
+      }
+   }
+
+   for (uint64 i = 0; i < num_splits; i++) {
+      key_buffer_deinit(&splits[i]);
+   }
+   platform_free(hid, splits);
+   platform_free(hid, parts);
+   return result;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Snapshots
+ *
+ *      A snapshot pins a trunk root (see trunk_snapshot_create) and serves
+ *      lookups and iterators from it, unaffected by later writes.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_snapshot_create(const splinterdb     *kvs,     // IN
+                           splinterdb_snapshot **snapshot // OUT
+)
+{
+   splinterdb_snapshot *snap = TYPED_MALLOC(kvs->spl->heap_id, snap);
+   if (snap == NULL) {
+      platform_error_log("TYPED_MALLOC error\n");
+      return platform_status_to_int(STATUS_NO_MEMORY);
+   }
+
+   platform_status rc = trunk_snapshot_create(
+      kvs->spl, &snap->root_addr, &snap->num_range_deletes);
+   if (!SUCCESS(rc)) {
+      platform_free(kvs->spl->heap_id, snap);
+      return platform_status_to_int(rc);
+   }
+   snap->kvs = kvs;
+
+   *snapshot = snap;
+   return EXIT_SUCCESS;
 }
 
 void
-splinterdb_iterator_get_current(splinterdb_iterator *iter,   // IN
-                                slice               *outkey, // OUT
-                                slice               *value   // OUT
+splinterdb_snapshot_release(splinterdb_snapshot *snapshot)
+{
+   trunk_handle *spl = snapshot->kvs->spl;
+   trunk_snapshot_release(spl, snapshot->root_addr);
+   platform_free(spl->heap_id, snapshot);
+}
+
+int
+splinterdb_snapshot_lookup(const splinterdb_snapshot *snapshot, // IN
+                           slice                      user_key,
+                           splinterdb_lookup_result  *result) // IN/OUT
+{
+   _splinterdb_lookup_result *_result = (_splinterdb_lookup_result *)result;
+   key                        target  = key_create_from_slice(user_key);
+
+   platform_status status = trunk_snapshot_lookup(snapshot->kvs->spl,
+                                                  snapshot->root_addr,
+                                                  snapshot->num_range_deletes,
+                                                  target,
+                                                  &_result->value);
+   return platform_status_to_int(status);
+}
+
+int
+splinterdb_snapshot_iterator_init(const splinterdb_snapshot *snapshot,   // IN
+                                  splinterdb_iterator      **iter,       // OUT
+                                  slice                      start_slice, // IN
+                                  slice                      end_slice    // IN
 )
 {
-   key       result_key;
-   message   msg;
-   iterator *itor = &(iter->sri.super);
+   key min_key;
+   key max_key;
 
-   iterator_curr(itor, &result_key, &msg);
-   *value  = message_slice(msg);
-   *outkey = key_slice(result_key);
+   if (slice_is_null(start_slice)) {
+      min_key = NEGATIVE_INFINITY_KEY;
+   } else {
+      min_key = key_create_from_slice(start_slice);
+   }
+   if (slice_is_null(end_slice)) {
+      max_key = POSITIVE_INFINITY_KEY;
+   } else {
+      max_key = key_create_from_slice(end_slice);
+   }
+
+   return splinterdb_iterator_init_internal(
+      snapshot->kvs, iter, snapshot, min_key, max_key, min_key);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_approximate_size --
+ *
+ *      Estimate the number of tuples in [start_key, end_key) and the bytes
+ *      of their keys and values, see trunk_approximate_size. A null start or
+ *      end key leaves that end of the range unbounded.
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_approximate_size(const splinterdb         *kvs,               // IN
+                            slice                     start_key,         // IN
+                            slice                     end_key,           // IN
+                            _Bool                     include_memtables, // IN
+                            splinterdb_size_estimate *estimate           // OUT
+)
+{
+   platform_assert(kvs != NULL);
+   key min_key = slice_is_null(start_key) ? NEGATIVE_INFINITY_KEY
+                                          : key_create_from_slice(start_key);
+   key max_key = slice_is_null(end_key) ? POSITIVE_INFINITY_KEY
+                                        : key_create_from_slice(end_key);
+   if (trunk_max_key_size(kvs->spl) < key_length(min_key)
+       || trunk_max_key_size(kvs->spl) < key_length(max_key))
+   {
+      return platform_status_to_int(STATUS_BAD_PARAM);
+   }
+
+   trunk_size_estimate trunk_estimate;
+   trunk_approximate_size(
+      kvs->spl, min_key, max_key, include_memtables, &trunk_estimate);
+   estimate->num_tuples = trunk_estimate.num_tuples;
+   estimate->num_bytes  = trunk_estimate.num_kv_bytes;
+   return 0;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_compact_range --
+ *
+ *      Compact [start_key, end_key) at one level of the tree, or at every
+ *      level, see trunk_compact_range. A null start or end key leaves that
+ *      end of the range unbounded.
+ *
+ * Results:
+ *      0 on success, otherwise an errno.
+ *
+ * Side effects:
+ *      Flushes the memtables into the trunk and enqueues compactions.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_compact_range(const splinterdb *kvs,       // IN
+                         slice             start_key, // IN
+                         slice             end_key,   // IN
+                         uint64            level      // IN
+)
+{
+   platform_assert(kvs != NULL);
+   key             min_key, max_key;
+   platform_status rc =
+      splinterdb_scan_bounds(kvs, start_key, end_key, &min_key, &max_key);
+   if (!SUCCESS(rc)) {
+      return platform_status_to_int(rc);
+   }
+   uint64 height = level;
+   if (level == SPLINTERDB_COMPACT_ALL_LEVELS) {
+      height = TRUNK_COMPACT_ALL_HEIGHTS;
+   }
+   rc = trunk_compact_range(kvs->spl, min_key, max_key, height);
+   return platform_status_to_int(rc);
+}
+
+int
+splinterdb_compact_wait(const splinterdb *kvs)
+{
+   platform_assert(kvs != NULL);
+   platform_status rc = trunk_compact_wait(kvs->spl);
+   return platform_status_to_int(rc);
 }
 
 void
@@ -784,12 +2367,201 @@ splinterdb_stats_print_lookup(const splinterdb *kvs)
    trunk_print_lookup_stats(Platform_default_log_handle, kvs->spl);
 }
 
+void
+splinterdb_stats_print_space_use(const splinterdb *kvs)
+{
+   trunk_print_space_use(Platform_default_log_handle, kvs->spl);
+}
+
 void
 splinterdb_stats_reset(splinterdb *kvs)
 {
    trunk_reset_stats(kvs->spl);
 }
 
+_Static_assert(SPLINTERDB_STATS_MAX_HEIGHT == TRUNK_MAX_HEIGHT,
+               "mismatched SPLINTERDB_STATS_MAX_HEIGHT and TRUNK_MAX_HEIGHT");
+_Static_assert((int)SPLINTERDB_LATENCY_INSERT == (int)TRUNK_LATENCY_INSERT
+                  && (int)SPLINTERDB_LATENCY_UPDATE
+                        == (int)TRUNK_LATENCY_UPDATE
+                  && (int)SPLINTERDB_LATENCY_DELETE
+                        == (int)TRUNK_LATENCY_DELETE
+                  && (int)SPLINTERDB_LATENCY_MEMTABLE_STALL
+                        == (int)TRUNK_LATENCY_MEMTABLE_STALL
+                  && (int)SPLINTERDB_LATENCY_LOOKUP
+                        == (int)TRUNK_LATENCY_LOOKUP
+                  && (int)SPLINTERDB_LATENCY_ITERATOR_INIT
+                        == (int)TRUNK_LATENCY_ITERATOR_INIT
+                  && (int)SPLINTERDB_LATENCY_ITERATOR_NEXT
+                        == (int)TRUNK_LATENCY_ITERATOR_NEXT
+                  && (int)SPLINTERDB_LATENCY_FG_MEMTABLE_TASK
+                        == (int)NUM_TRUNK_LATENCY_TYPES,
+               "mismatched splinterdb_latency_type and trunk_latency_type");
+
+// The bytes of splinterdb_stats filled in for each version
+static const uint64 splinterdb_stats_size[SPLINTERDB_STATS_VERSION + 1] = {
+   [1] = offsetof(splinterdb_stats, latency),
+   [2] = offsetof(splinterdb_stats, user_kv_bytes),
+   [3] = sizeof(splinterdb_stats),
+};
+
+static void
+splinterdb_latency_from_histo(splinterdb_latency  *latency,
+                              const latency_histo *histo)
+{
+   latency->count   = histo->num;
+   latency->mean_ns = latency_histo_mean(histo);
+   latency->p50_ns  = latency_histo_percentile(histo, 50, 100);
+   latency->p90_ns  = latency_histo_percentile(histo, 90, 100);
+   latency->p99_ns  = latency_histo_percentile(histo, 99, 100);
+   latency->p999_ns = latency_histo_percentile(histo, 999, 1000);
+   latency->max_ns  = histo->max_ns;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * splinterdb_stats_get --
+ *
+ *      Fills in stats from the trunk, cache, task system and allocator,
+ *      summing their per-thread counters without locks. Only the fields
+ *      of stats->version are written.
+ *
+ * Results:
+ *      0 on success, EINVAL if stats->version is unsupported, ENOMEM.
+ *
+ * Side effects:
+ *      None.
+ *-----------------------------------------------------------------------------
+ */
+int
+splinterdb_stats_get(const splinterdb *kvs, splinterdb_stats *out)
+{
+   platform_assert(kvs != NULL);
+   uint64 version = out->version;
+   if (version < 1 || SPLINTERDB_STATS_VERSION < version) {
+      return EINVAL;
+   }
+
+   // Too big for the stack, with its latency histograms
+   trunk_stats *trunk;
+   trunk = TYPED_MALLOC(kvs->heap_id, trunk);
+   if (trunk == NULL) {
+      return ENOMEM;
+   }
+
+   trunk_handle    *spl = kvs->spl;
+   splinterdb_stats all;
+   cache_stats      cache;
+   trunk_get_stats(spl, trunk);
+   cache_get_stats(spl->cc, &cache);
+
+   splinterdb_stats *stats = &all;
+   ZERO_CONTENTS(stats);
+   stats->version       = version;
+   stats->stats_enabled = spl->cfg.use_stats;
+
+   stats->insertions        = trunk->insertions;
+   stats->updates           = trunk->updates;
+   stats->deletions         = trunk->deletions;
+   stats->lookups_found     = trunk->lookups_found;
+   stats->lookups_not_found = trunk->lookups_not_found;
+
+   stats->memtable_flushes            = trunk->memtable_flushes;
+   stats->memtable_flush_time_ns      = trunk->memtable_flush_time_ns;
+   stats->memtable_flush_wait_time_ns = trunk->memtable_flush_wait_time_ns;
+
+   stats->tree_height = trunk_height(spl);
+   for (uint64 h = 0; h < TRUNK_MAX_HEIGHT; h++) {
+      stats->flushes[h] = trunk->count_flushes[h] + trunk->full_flushes[h];
+
+      stats->flush_time_ns[h]          = trunk->flush_time_ns[h];
+      stats->compactions[h]            = trunk->compactions[h];
+      stats->compaction_tuples[h]      = trunk->compaction_tuples[h];
+      stats->compaction_time_ns[h]     = trunk->compaction_time_ns[h];
+      stats->filter_lookups[h]         = trunk->filter_lookups[h];
+      stats->filter_false_positives[h] = trunk->filter_false_positives[h];
+      stats->branch_lookups[h]         = trunk->branch_lookups[h];
+   }
+   // The root's flushes and compactions are counted apart by the trunk
+   uint64 root = stats->tree_height;
+   if (root < TRUNK_MAX_HEIGHT) {
+      stats->flushes[root] += trunk->root_count_flushes;
+      stats->flushes[root] += trunk->root_full_flushes;
+      stats->flush_time_ns[root] += trunk->root_flush_time_ns;
+      stats->compactions[root] += trunk->root_compactions;
+      stats->compaction_tuples[root] += trunk->root_compaction_tuples;
+      stats->compaction_time_ns[root] += trunk->root_compaction_time_ns;
+   }
+   stats->index_splits = trunk->index_splits;
+   stats->leaf_splits  = trunk->leaf_splits;
+
+   stats->user_kv_bytes                = trunk->user_kv_bytes;
+   stats->memtable_compaction_kv_bytes = trunk->root_compaction_kv_bytes;
+   stats->memtable_compaction_bytes_written =
+      trunk->root_compaction_bytes_written;
+   uint64 bytes_written = trunk->root_compaction_bytes_written;
+   for (uint64 h = 0; h < TRUNK_MAX_HEIGHT; h++) {
+      stats->flush_tuples[h]   = trunk->flush_tuples[h];
+      stats->flush_kv_bytes[h] = trunk->flush_kv_bytes[h];
+
+      stats->compaction_input_tuples[h]   = trunk->compaction_input_tuples[h];
+      stats->compaction_input_kv_bytes[h] = trunk->compaction_input_kv_bytes[h];
+      stats->compaction_output_kv_bytes[h] =
+         trunk->compaction_output_kv_bytes[h];
+      stats->compaction_bytes_written[h] = trunk->compaction_bytes_written[h];
+      stats->compaction_merge_time_ns[h] = trunk->compaction_pack_time_ns[h];
+      stats->compaction_io_wait_ns[h]    = trunk->compaction_io_wait_ns[h];
+      stats->filter_build_time_ns[h]     = trunk->filter_time_ns[h];
+      bytes_written += trunk->compaction_bytes_written[h];
+   }
+   if (trunk->user_kv_bytes != 0) {
+      stats->write_amplification =
+         (double)bytes_written / (double)trunk->user_kv_bytes;
+   }
+
+   for (uint64 i = 0; i < NUM_TRUNK_LATENCY_TYPES; i++) {
+      splinterdb_latency_from_histo(&stats->latency[i], &trunk->latency[i]);
+   }
+   platform_free(kvs->heap_id, trunk);
+
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      stats->cache_hits += cache.cache_hits[type];
+      stats->cache_misses += cache.cache_misses[type];
+      stats->cache_miss_time_ns += cache.cache_miss_time_ns[type];
+      stats->cache_prefetches_issued += cache.prefetches_issued[type];
+      stats->pages_read += cache.page_reads[type];
+      stats->pages_written += cache.page_writes[type];
+   }
+   stats->read_bytes    = stats->pages_read * kvs->cfg.page_size;
+   stats->write_bytes   = stats->pages_written * kvs->cfg.page_size;
+   stats->writes_issued = cache.writes_issued;
+   stats->syncs_issued  = cache.syncs_issued;
+
+   for (task_type type = TASK_TYPE_FIRST; type < NUM_TASK_TYPES; type++) {
+      task_stats task;
+      task_get_stats(kvs->task_sys, type, &task);
+      stats->tasks_enqueued += task.total_tasks_enqueued;
+      stats->tasks_run_in_background += task.total_bg_task_executions;
+      stats->tasks_run_in_foreground += task.total_fg_task_executions;
+      stats->task_queue_wait_time_ns += task.total_queue_wait_time_ns;
+      stats->task_queue_wait_time_max_ns =
+         MAX(stats->task_queue_wait_time_max_ns, task.max_queue_wait_time_ns);
+
+      splinterdb_latency_type latency_type =
+         type == TASK_TYPE_MEMTABLE ? SPLINTERDB_LATENCY_FG_MEMTABLE_TASK
+                                    : SPLINTERDB_LATENCY_FG_NORMAL_TASK;
+      splinterdb_latency_from_histo(&stats->latency[latency_type],
+                                    &task.fg_task_latency);
+   }
+
+   uint64 extents_in_use      = allocator_in_use(spl->al);
+   stats->disk_bytes_in_use   = extents_in_use * kvs->cfg.extent_size;
+   stats->disk_capacity_bytes = allocator_get_capacity(spl->al);
+
+   memmove(out, &all, splinterdb_stats_size[version]);
+   return 0;
+}
+
 static void
 splinterdb_close_print_stats(splinterdb *kvs)
 {
@@ -824,19 +2596,22 @@ splinterdb_get_task_system_handle(const splinterdb *kvs)
 const platform_io_handle *
 splinterdb_get_io_handle(const splinterdb *kvs)
 {
+   if (kvs->parent != NULL) {
+      kvs = kvs->parent;
+   }
    return &kvs->io_handle;
 }
 
 const allocator *
 splinterdb_get_allocator_handle(const splinterdb *kvs)
 {
-   return (allocator *)&kvs->allocator_handle;
+   return kvs->spl->al;
 }
 
 const cache *
 splinterdb_get_cache_handle(const splinterdb *kvs)
 {
-   return (cache *)&kvs->cache_handle;
+   return kvs->spl->cc;
 }
 
 const trunk_handle *
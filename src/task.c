@@ -718,8 +718,16 @@ task_group_perform_one(task_group *group, uint64 queue_scale_percent)
 
    if (assigned_task) {
       const threadid tid = platform_get_tid();
+      timestamp      start = 0;
+      if (group->use_stats) {
+         start = platform_get_timestamp();
+      }
       group->stats[tid].total_fg_task_executions++;
       task_group_run_task(group, assigned_task);
+      if (group->use_stats) {
+         latency_histo_record(&group->stats[tid].fg_task_latency,
+                              platform_timestamp_elapsed(start));
+      }
       __sync_fetch_and_sub(&group->current_executing_tasks, 1);
       platform_free(group->ts->heap_id, assigned_task);
    } else {
@@ -970,36 +978,50 @@ task_wait_for_completion(task_system *ts)
    }
 }
 
+/*
+ * Sums the per-thread stats of the group, without locks.
+ */
 static void
-task_group_print_stats(task_group *group, task_type type)
+task_group_get_stats(task_group *group, task_stats *global)
 {
-   if (!group->use_stats) {
-      platform_default_log("no stats\n");
-      return;
-   }
-
-   task_stats global = {0};
-
+   ZERO_CONTENTS(global);
    for (threadid i = 0; i < MAX_THREADS; i++) {
-      global.total_bg_task_executions +=
+      global->total_bg_task_executions +=
          group->stats[i].total_bg_task_executions;
-      global.total_fg_task_executions +=
+      global->total_fg_task_executions +=
          group->stats[i].total_fg_task_executions;
-      global.total_queue_wait_time_ns +=
+      global->total_queue_wait_time_ns +=
          group->stats[i].total_queue_wait_time_ns;
-      if (group->stats[i].max_runtime_ns > global.max_runtime_ns) {
-         global.max_runtime_ns   = group->stats[i].max_runtime_ns;
-         global.max_runtime_func = group->stats[i].max_runtime_func;
+      if (group->stats[i].max_runtime_ns > global->max_runtime_ns) {
+         global->max_runtime_ns   = group->stats[i].max_runtime_ns;
+         global->max_runtime_func = group->stats[i].max_runtime_func;
       }
       if (group->stats[i].max_queue_wait_time_ns
-          > global.max_queue_wait_time_ns) {
-         global.max_queue_wait_time_ns = group->stats[i].max_queue_wait_time_ns;
+          > global->max_queue_wait_time_ns)
+      {
+         global->max_queue_wait_time_ns =
+            group->stats[i].max_queue_wait_time_ns;
       }
-      global.max_outstanding_tasks = MAX(global.max_outstanding_tasks,
-                                         group->stats[i].max_outstanding_tasks);
-      global.total_tasks_enqueued += group->stats[i].total_tasks_enqueued;
+      global->max_outstanding_tasks =
+         MAX(global->max_outstanding_tasks,
+             group->stats[i].max_outstanding_tasks);
+      global->total_tasks_enqueued += group->stats[i].total_tasks_enqueued;
+      latency_histo_merge(&global->fg_task_latency,
+                          &group->stats[i].fg_task_latency);
+   }
+}
+
+static void
+task_group_print_stats(task_group *group, task_type type)
+{
+   if (!group->use_stats) {
+      platform_default_log("no stats\n");
+      return;
    }
 
+   task_stats global;
+   task_group_get_stats(group, &global);
+
    switch (type) {
       case TASK_TYPE_NORMAL:
          platform_default_log("\nMain Task Group Statistics\n");
@@ -1032,6 +1054,9 @@ task_group_print_stats(task_group *group, task_type type)
                         global.total_bg_task_executions);
    platform_default_log("| total fg tasks run      : %10lu\n",
                         global.total_fg_task_executions);
+   platform_default_log("| fg task time p99 (ns)   : %10lu\n",
+                        latency_histo_percentile(
+                           &global.fg_task_latency, 99, 100));
    platform_default_log("| current waiting tasks : %lu\n",
                         group->current_waiting_tasks);
    platform_default_log("| max outstanding tasks : %lu\n",
@@ -1039,6 +1064,12 @@ task_group_print_stats(task_group *group, task_type type)
    platform_default_log("\n");
 }
 
+void
+task_get_stats(task_system *ts, task_type type, task_stats *stats)
+{
+   task_group_get_stats(&ts->group[type], stats);
+}
+
 void
 task_print_stats(task_system *ts)
 {
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "platform.h"
+#include "latency_histo.h"
 
 typedef struct task_system task_system;
 
@@ -31,6 +32,9 @@ typedef struct {
    uint64    total_bg_task_executions;
    uint64    total_fg_task_executions;
    uint64    total_tasks_enqueued;
+
+   // Time foreground threads spent running tasks
+   latency_histo fg_task_latency;
 } PLATFORM_CACHELINE_ALIGNED task_stats;
 
 typedef struct task_queue {
@@ -273,5 +277,8 @@ task_get_max_tid(task_system *ts);
 uint64
 task_active_tasks_mask(task_system *ts);
 
+void
+task_get_stats(task_system *ts, task_type type, task_stats *stats);
+
 void
 task_print_stats(task_system *ts);
@@ -21,26 +21,6 @@
 
 #include "poison.h"
 
-#define LATENCYHISTO_SIZE 15
-
-static const int64 latency_histo_buckets[LATENCYHISTO_SIZE] = {
-   1,          // 1   ns
-   10,         // 10  ns
-   100,        // 100 ns
-   500,        // 500 ns
-   1000,       // 1   us
-   5000,       // 5   us
-   10000,      // 10  us
-   100000,     // 100 us
-   500000,     // 500 us
-   1000000,    // 1   ms
-   5000000,    // 5   ms
-   10000000,   // 10  ms
-   100000000,  // 100 ms
-   1000000000, // 1   s
-   10000000000 // 10  s
-};
-
 /*
  * At any time, one Memtable is "active" for inserts / updates.
  * At any time, the most # of Memtables that can be active or in one of these
@@ -81,6 +61,33 @@ static const int64 latency_histo_buckets[LATENCYHISTO_SIZE] = {
 /* Some randomly chosen Splinter super-block checksum seed. */
 #define TRUNK_SUPER_CSUM_SEED (42)
 
+/*
+ * Number of threads replaying the log when a table is mounted after a crash.
+ * Log entries are partitioned among them by key hash.
+ */
+#define TRUNK_LOG_REPLAY_THREADS (8)
+
+/*
+ * The generation of a log entry holds the generation of the memtable it was
+ * inserted into in its upper bits, so replay can skip the memtables already
+ * in the trunk. The lower bits hold the generation of the memtable leaf,
+ * which orders the messages for any one key within a memtable.
+ */
+#define TRUNK_LOG_LEAF_GENERATION_BITS (32)
+
+static inline uint64
+trunk_log_generation(uint64 mt_generation, uint64 leaf_generation)
+{
+   return (mt_generation << TRUNK_LOG_LEAF_GENERATION_BITS)
+          | (leaf_generation & ((1ULL << TRUNK_LOG_LEAF_GENERATION_BITS) - 1));
+}
+
+static inline uint64
+trunk_log_memtable_generation(uint64 log_generation)
+{
+   return log_generation >> TRUNK_LOG_LEAF_GENERATION_BITS;
+}
+
 /*
  * When a leaf becomes full, Splinter estimates the amount of data in the leaf.
  * If the 'estimated' amount of data is > this threshold, Splinter will split
@@ -94,6 +101,11 @@ static const int64 latency_histo_buckets[LATENCYHISTO_SIZE] = {
  */
 #define TRUNK_ROOT_LOCK_IDX 0
 
+/*
+ * Index of the value_log_lock batch rwlock used.
+ */
+#define TRUNK_VALUE_LOG_LOCK_IDX 0
+
 /*
  * During Splinter configuration, the fanout parameter is provided by the user.
  * SplinterDB defers internal node splitting in order to use hand-over-hand
@@ -450,8 +462,19 @@ typedef struct ONDISK trunk_super_block {
    uint64 root_addr; // Address of the root of the trunk for the instance
                      // referenced by this superblock.
    uint64      meta_tail;
+   // Entries of the trunk mini allocator at meta_tail referring to extents
+   // allocated in the ref counts on disk
+   uint64      meta_tail_num_entries;
    uint64      log_addr;
    uint64      log_meta_addr;
+   uint64      log_magic;
+   // Log entries of older memtable generations are already in root_addr
+   uint64      log_replay_generation;
+   // Range deletes, see trunk_delete_range()
+   uint64      range_delete_addr;
+   uint64      num_range_deletes;
+   // Value log, see trunk_value_log_gc()
+   value_log_super value_log;
    uint64      timestamp;
    bool32      checkpointed;
    bool32      unmounted;
@@ -744,6 +767,7 @@ typedef bool32 (*node_fn)(trunk_handle *spl, uint64 addr, void *arg);
 typedef struct {
    trunk_btree_skiperator skip_itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
    iterator              *itor_arr[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   uint64                 epoch_arr[TRUNK_RANGE_ITOR_MAX_BRANCHES];
    uint64                 num_saved_pivot_keys;
    key_buffer             saved_pivot_keys[TRUNK_MAX_PIVOTS];
 } compact_bundle_scratch;
@@ -899,11 +923,29 @@ trunk_tree_height(trunk_handle *spl)
  * Super block functions
  *-----------------------------------------------------------------------------
  */
+
+/*
+ * The state of the trunk a checkpoint persists, captured while inserts are
+ * blocked, see trunk_checkpoint().
+ */
+typedef struct trunk_checkpoint_state {
+   uint64          root_addr;
+   uint64          meta_tail;
+   uint64          meta_tail_num_entries;
+   uint64          log_replay_generation;
+   uint64          num_range_deletes;
+   value_log_super value_log;
+} trunk_checkpoint_state;
+
+/*
+ * Writes the super block. A checkpoint passes the state it captured,
+ * otherwise the current state of the trunk is used.
+ */
 void
-trunk_set_super_block(trunk_handle *spl,
-                      bool32        is_checkpoint,
-                      bool32        is_unmount,
-                      bool32        is_create)
+trunk_set_super_block(trunk_handle                 *spl,
+                      const trunk_checkpoint_state *checkpoint,
+                      bool32                        is_unmount,
+                      bool32                        is_create)
 {
    uint64             super_addr;
    page_handle       *super_page;
@@ -911,10 +953,10 @@ trunk_set_super_block(trunk_handle *spl,
    uint64             wait = 1;
    platform_status    rc;
 
-   if (is_create) {
+   rc = allocator_get_super_addr(spl->al, spl->id, &super_addr);
+   if (is_create && !SUCCESS(rc)) {
+      // Unless the caller reserved it, see splinterdb_keyspace_create()
       rc = allocator_alloc_super_addr(spl->al, spl->id, &super_addr);
-   } else {
-      rc = allocator_get_super_addr(spl->al, spl->id, &super_addr);
    }
    platform_assert_status_ok(rc);
    super_page = cache_get(spl->cc, super_addr, TRUE, PAGE_TYPE_SUPERBLOCK);
@@ -925,20 +967,47 @@ trunk_set_super_block(trunk_handle *spl,
    wait = 1;
    cache_lock(spl->cc, super_page);
 
-   super            = (trunk_super_block *)super_page->data;
-   super->root_addr = spl->root_addr;
-   super->meta_tail = mini_meta_tail(&spl->mini);
+   super = (trunk_super_block *)super_page->data;
+   if (checkpoint != NULL) {
+      super->root_addr             = checkpoint->root_addr;
+      super->meta_tail             = checkpoint->meta_tail;
+      super->meta_tail_num_entries = checkpoint->meta_tail_num_entries;
+      super->num_range_deletes     = checkpoint->num_range_deletes;
+   } else {
+      uint64 meta_tail, meta_tail_num_entries;
+      mini_unkeyed_tail_position(
+         &spl->mini, &meta_tail, &meta_tail_num_entries);
+      super->root_addr             = spl->root_addr;
+      super->meta_tail             = meta_tail;
+      super->meta_tail_num_entries = meta_tail_num_entries;
+      super->num_range_deletes     = spl->num_range_deletes;
+   }
+   super->range_delete_addr = spl->range_delete_addr;
+   if (checkpoint != NULL) {
+      super->value_log = checkpoint->value_log;
+   } else if (spl->vlog != NULL) {
+      value_log_get_super(spl->vlog, &super->value_log);
+   } else {
+      ZERO_STRUCT(super->value_log);
+   }
    if (spl->cfg.use_log) {
       if (spl->log) {
          super->log_addr      = log_addr(spl->log);
          super->log_meta_addr = log_meta_addr(spl->log);
+         super->log_magic     = log_magic(spl->log);
+         super->log_replay_generation =
+            checkpoint != NULL
+               ? checkpoint->log_replay_generation
+               : memtable_generation_retired(spl->mt_ctxt) + 1;
       } else {
-         super->log_addr      = 0;
-         super->log_meta_addr = 0;
+         super->log_addr              = 0;
+         super->log_meta_addr         = 0;
+         super->log_magic             = 0;
+         super->log_replay_generation = 0;
       }
    }
    super->timestamp    = platform_get_real_time();
-   super->checkpointed = is_checkpoint;
+   super->checkpointed = checkpoint != NULL;
    super->unmounted    = is_unmount;
    super->checksum =
       platform_checksum128(super,
@@ -983,6 +1052,346 @@ trunk_release_super_block(trunk_handle *spl, page_handle *super_page)
    cache_unget(spl->cc, super_page);
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * Range deletes
+ *
+ *      trunk_delete_range deletes every key in [start_key, end_key). Range
+ *      deletes are not messages in the branches. They are kept in a list, in
+ *      memory and in an extent on disk, and the epoch of a range delete is
+ *      its position in the list plus one.
+ *
+ *      Each branch carries the number of range deletes made before any
+ *      message in it: a memtable, and the branch it is compacted into, the
+ *      number made before its first insert; a compaction the greatest epoch
+ *      of its inputs. A range delete thus deletes the messages for the keys
+ *      it covers in the branches with an older epoch than its own. Lookups
+ *      and range iterators take those messages as deleted, and compactions
+ *      drop them.
+ *
+ *      The list only grows, and holds as many range deletes as fit in one
+ *      extent.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct ONDISK trunk_range_delete_hdr {
+   uint16 start_length;
+   uint16 end_length;
+   // followed by the start key and the end key, each in max_key_size bytes
+} trunk_range_delete_hdr;
+
+static inline uint64
+trunk_range_delete_size(trunk_handle *spl)
+{
+   return sizeof(trunk_range_delete_hdr) + 2 * trunk_max_key_size(spl);
+}
+
+static inline uint64
+trunk_range_deletes_per_page(trunk_handle *spl)
+{
+   return trunk_page_size(&spl->cfg) / trunk_range_delete_size(spl);
+}
+
+static inline trunk_range_delete_hdr *
+trunk_get_range_delete(trunk_handle *spl, uint64 idx)
+{
+   uint64 per_page = trunk_range_deletes_per_page(spl);
+   return (trunk_range_delete_hdr *)(spl->range_deletes
+                                     + idx / per_page
+                                          * trunk_page_size(&spl->cfg)
+                                     + idx % per_page
+                                          * trunk_range_delete_size(spl));
+}
+
+static inline key
+trunk_range_delete_start(trunk_range_delete_hdr *hdr)
+{
+   return key_create(hdr->start_length, (char *)(hdr + 1));
+}
+
+static inline key
+trunk_range_delete_end(trunk_handle *spl, trunk_range_delete_hdr *hdr)
+{
+   return key_create(hdr->end_length,
+                     (char *)(hdr + 1) + trunk_max_key_size(spl));
+}
+
+static inline uint64
+trunk_num_range_deletes(trunk_handle *spl)
+{
+   return __atomic_load_n(&spl->num_range_deletes, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Returns the epoch of the newest of the first num_range_deletes range
+ * deletes to cover target, 0 if none does.
+ */
+static inline uint64
+trunk_range_delete_cover(trunk_handle *spl,
+                         key           target,
+                         uint64        num_range_deletes)
+{
+   for (uint64 epoch = num_range_deletes; epoch > 0; epoch--) {
+      trunk_range_delete_hdr *hdr = trunk_get_range_delete(spl, epoch - 1);
+      if (trunk_key_compare(spl, trunk_range_delete_start(hdr), target) <= 0
+          && trunk_key_compare(spl, target, trunk_range_delete_end(spl, hdr))
+                < 0)
+      {
+         return epoch;
+      }
+   }
+   return 0;
+}
+
+/*
+ * merge_cover_fn for compactions, which drop the messages deleted by every
+ * range delete made so far.
+ */
+static uint64
+trunk_range_delete_cover_virtual(void *arg, key target)
+{
+   trunk_handle *spl = (trunk_handle *)arg;
+   return trunk_range_delete_cover(spl, target, trunk_num_range_deletes(spl));
+}
+
+/*
+ * The epoch of the memtable with the given generation.
+ */
+static inline uint64
+trunk_memtable_epoch(trunk_handle *spl, uint64 generation)
+{
+   uint64 epoch = trunk_num_range_deletes(spl);
+   while (epoch > 0 && spl->range_delete_generation[epoch - 1] > generation) {
+      epoch--;
+   }
+   return epoch;
+}
+
+/*
+ * Merges a delete under the messages for target in data, for the messages
+ * older than it are deleted by a range delete. Leaves data definitive.
+ */
+static inline void
+trunk_merge_range_delete(trunk_handle      *spl,
+                         key                target,
+                         merge_accumulator *data)
+{
+   if (merge_accumulator_is_null(data)) {
+      bool32 success = merge_accumulator_copy_message(data, DELETE_MESSAGE);
+      platform_assert(success);
+   } else {
+      data_merge_tuples_final(spl->cfg.data_cfg, target, data);
+   }
+}
+
+/*
+ * Writes the page of the extent holding range delete idx.
+ */
+static void
+trunk_range_delete_write(trunk_handle *spl, uint64 idx)
+{
+   uint64 per_page  = trunk_range_deletes_per_page(spl);
+   uint64 page_size = trunk_page_size(&spl->cfg);
+   uint64 page_no   = idx / per_page;
+   uint64 addr      = spl->range_delete_addr + page_no * page_size;
+
+   page_handle *page;
+   if (idx % per_page == 0) {
+      page = cache_alloc(spl->cc, addr, PAGE_TYPE_TRUNK);
+   } else {
+      uint64 wait = 1;
+      page        = cache_get(spl->cc, addr, TRUE, PAGE_TYPE_TRUNK);
+      while (!cache_try_claim(spl->cc, page)) {
+         platform_sleep_ns(wait);
+         wait = wait > 2048 ? wait : 2 * wait;
+      }
+      cache_lock(spl->cc, page);
+   }
+   memmove(page->data, spl->range_deletes + page_no * page_size, page_size);
+   cache_mark_dirty(spl->cc, page);
+   cache_unlock(spl->cc, page);
+   cache_unclaim(spl->cc, page);
+   cache_unget(spl->cc, page);
+}
+
+/*
+ * Sets up the range deletes of a new table (addr == 0), or reads those of an
+ * existing one.
+ */
+static platform_status
+trunk_range_deletes_init(trunk_handle *spl, uint64 addr, uint64 num)
+{
+   uint64 page_size = trunk_page_size(&spl->cfg);
+   spl->max_range_deletes =
+      trunk_range_deletes_per_page(spl) * trunk_pages_per_extent(&spl->cfg);
+   if (num > spl->max_range_deletes) {
+      return STATUS_INVALID_STATE;
+   }
+
+   spl->range_deletes = TYPED_ARRAY_ZALLOC(
+      spl->heap_id, spl->range_deletes, trunk_extent_size(&spl->cfg));
+   spl->range_delete_generation = TYPED_ARRAY_ZALLOC(
+      spl->heap_id, spl->range_delete_generation, spl->max_range_deletes);
+   if (spl->range_deletes == NULL || spl->range_delete_generation == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+
+   if (addr == 0) {
+      platform_status rc = allocator_alloc(spl->al, &addr, PAGE_TYPE_TRUNK);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+   spl->range_delete_addr = addr;
+
+   // Loaded range deletes apply to every memtable
+   uint64 per_page = trunk_range_deletes_per_page(spl);
+   for (uint64 page_no = 0; page_no * per_page < num; page_no++) {
+      page_handle *page = cache_get(
+         spl->cc, addr + page_no * page_size, TRUE, PAGE_TYPE_TRUNK);
+      memmove(spl->range_deletes + page_no * page_size, page->data, page_size);
+      cache_unget(spl->cc, page);
+   }
+   spl->num_range_deletes = num;
+
+   return platform_mutex_init(
+      &spl->range_delete_lock, platform_get_module_id(), spl->heap_id);
+}
+
+/*
+ * Releases the memory of the range deletes, and with destroy their extent.
+ */
+static void
+trunk_range_deletes_deinit(trunk_handle *spl, bool32 destroy)
+{
+   if (destroy) {
+      uint8 ref =
+         allocator_dec_ref(spl->al, spl->range_delete_addr, PAGE_TYPE_TRUNK);
+      platform_assert(ref == AL_NO_REFS);
+      cache_extent_discard(spl->cc, spl->range_delete_addr, PAGE_TYPE_TRUNK);
+      ref = allocator_dec_ref(spl->al, spl->range_delete_addr, PAGE_TYPE_TRUNK);
+      platform_assert(ref == AL_FREE);
+   }
+   platform_mutex_destroy(&spl->range_delete_lock);
+   platform_free(spl->heap_id, spl->range_deletes);
+   platform_free(spl->heap_id, spl->range_delete_generation);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Value log
+ *
+ *      With a value log, inserts of values longer than the threshold store
+ *      the value in it, and a MESSAGE_TYPE_INSERT_INDIRECT message holding
+ *      its value_log_ref in the trunk. Lookups and range iterators resolve
+ *      those messages into inserts again. Compactions tell the value log of
+ *      the refs they drop, and trunk_value_log_gc() copies the values still
+ *      referred to out of the extents with enough of them dropped.
+ *
+ *      Updates are not supported, for merging one would need the value, and
+ *      neither is the log, for a replay could not trust the refs it holds.
+ *-----------------------------------------------------------------------------
+ */
+/*
+ * Values that do not fit in a branch always go to the value log. A table
+ * with a value log mounted without a threshold only reads from it.
+ */
+static inline uint64
+trunk_value_log_threshold(const trunk_config *cfg)
+{
+   if (cfg->value_log_threshold == 0) {
+      return UINT64_MAX;
+   }
+   return MIN(cfg->value_log_threshold,
+              MAX_INLINE_MESSAGE_SIZE(trunk_page_size(cfg)));
+}
+
+/*
+ * Writers hold the value log lock shared, and the garbage collector holds
+ * it exclusively while it copies a value, so that it copies none over a
+ * newer insert or across a range delete.
+ */
+static inline void
+trunk_value_log_get(trunk_handle *spl)
+{
+   if (spl->vlog != NULL) {
+      platform_batch_rwlock_get(&spl->value_log_lock, TRUNK_VALUE_LOG_LOCK_IDX);
+   }
+}
+
+static inline void
+trunk_value_log_unget(trunk_handle *spl)
+{
+   if (spl->vlog != NULL) {
+      platform_batch_rwlock_unget(&spl->value_log_lock,
+                                  TRUNK_VALUE_LOG_LOCK_IDX);
+   }
+}
+
+/*
+ * Moves the value of an insert longer than the threshold to the value log,
+ * replacing *msg with the indirect message for *ref. *msg is kept if the
+ * value log is full and the value fits in a branch.
+ */
+static platform_status
+trunk_value_log_separate(trunk_handle  *spl,
+                         key            tuple_key,
+                         message       *msg,
+                         value_log_ref *ref)
+{
+   if (spl->vlog == NULL || message_class(*msg) != MESSAGE_TYPE_INSERT
+       || !value_log_should_separate(spl->vlog, message_length(*msg)))
+   {
+      return STATUS_OK;
+   }
+   platform_status rc = value_log_append(
+      spl->vlog,
+      tuple_key,
+      slice_create(message_length(*msg), message_data(*msg)),
+      ref);
+   if (STATUS_IS_EQ(rc, STATUS_NO_SPACE)
+       && message_length(*msg)
+             <= MAX_INLINE_MESSAGE_SIZE(trunk_page_size(&spl->cfg)))
+   {
+      return STATUS_OK;
+   }
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   *msg = message_create(MESSAGE_TYPE_INSERT_INDIRECT,
+                         slice_create(sizeof(*ref), ref));
+   return STATUS_OK;
+}
+
+/*
+ * Replaces an indirect message in result with the insert of its value. The
+ * caller must be a reader of the value log.
+ */
+static platform_status
+trunk_value_log_resolve(trunk_handle *spl, merge_accumulator *result)
+{
+   if (merge_accumulator_is_null(result)
+       || merge_accumulator_message_class(result)
+             != MESSAGE_TYPE_INSERT_INDIRECT)
+   {
+      return STATUS_OK;
+   }
+   value_log_ref ref =
+      value_log_message_ref(merge_accumulator_to_message(result));
+   merge_accumulator_set_class(result, MESSAGE_TYPE_INSERT);
+   return value_log_read(spl->vlog, &ref, &result->data);
+}
+
+/*
+ * merge_drop_fn for compactions, which count the values they drop as
+ * garbage.
+ */
+static void
+trunk_value_log_drop_virtual(void *arg, key tuple_key, message msg)
+{
+   trunk_handle *spl = (trunk_handle *)arg;
+   value_log_note_garbage(spl->vlog, tuple_key, msg);
+}
+
 /*
  *-----------------------------------------------------------------------------
  * Higher-level Branch and Bundle Functions
@@ -2671,6 +3080,35 @@ trunk_tuples_in_bundle(trunk_handle *spl,
    }
 }
 
+/*
+ * Sums the tuples and kv bytes of the bundle in the pivots it is still live
+ * for, i.e. the input of its compaction.
+ */
+static inline void
+trunk_bundle_live_tuple_counts(trunk_handle *spl,
+                               trunk_node   *node,
+                               uint16        bundle_no,
+                               uint64       *num_tuples,
+                               uint64       *num_kv_bytes)
+{
+   uint64        pivot_tuple_count[TRUNK_MAX_PIVOTS];
+   uint64        pivot_kv_byte_count[TRUNK_MAX_PIVOTS];
+   trunk_bundle *bundle = trunk_get_bundle(spl, node, bundle_no);
+   trunk_tuples_in_bundle(
+      spl, node, bundle, pivot_tuple_count, pivot_kv_byte_count);
+
+   *num_tuples   = 0;
+   *num_kv_bytes = 0;
+
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      if (trunk_bundle_live_for_pivot(spl, node, bundle_no, pivot_no)) {
+         *num_tuples += pivot_tuple_count[pivot_no];
+         *num_kv_bytes += pivot_kv_byte_count[pivot_no];
+      }
+   }
+}
+
 static inline void
 trunk_pivot_add_bundle_tuple_counts(
    trunk_handle *spl,
@@ -3367,6 +3805,57 @@ trunk_memtable_iterator_deinit(trunk_handle   *spl,
    }
 }
 
+static inline void
+trunk_record_latency(trunk_handle *spl, trunk_latency_type type, timestamp ts)
+{
+   if (spl->cfg.use_stats) {
+      const threadid tid = platform_get_tid();
+      latency_histo_record(&spl->stats[tid].latency[type],
+                           platform_timestamp_elapsed(ts));
+   }
+}
+
+/*
+ * Time the calling thread has spent waiting on cache misses, so far. Zero
+ * unless the cache keeps stats.
+ */
+static inline uint64
+trunk_io_wait_ns(trunk_handle *spl, threadid tid)
+{
+   cache_stats stats;
+   cache_get_thread_stats(spl->cc, tid, &stats);
+   uint64 wait_ns = 0;
+   for (page_type type = 0; type < NUM_PAGE_TYPES; type++) {
+      wait_ns += stats.cache_miss_time_ns[type];
+   }
+   return wait_ns;
+}
+
+/*
+ * Begins an insert into the current memtable. If it is full and the next
+ * one is not ready, performs tasks until it is, and records how long the
+ * insert stalled.
+ */
+static platform_status
+trunk_memtable_begin_insert(trunk_handle *spl, uint64 *generation)
+{
+   platform_status rc =
+      memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, generation);
+   if (!STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      return rc;
+   }
+
+   timestamp stall_start = platform_get_timestamp();
+   while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      // Memtable isn't ready, do a task if available; may be required to
+      // incorporate memtable that we're waiting on
+      task_perform_one_if_needed(spl->ts, 0);
+      rc = memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, generation);
+   }
+   trunk_record_latency(spl, TRUNK_LATENCY_MEMTABLE_STALL, stall_start);
+   return rc;
+}
+
 /*
  * Attempts to insert (key, data) into the current memtable.
  *
@@ -3379,16 +3868,8 @@ trunk_memtable_iterator_deinit(trunk_handle   *spl,
 platform_status
 trunk_memtable_insert(trunk_handle *spl, key tuple_key, message msg)
 {
-   uint64 generation;
-
-   platform_status rc =
-      memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
-   while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
-      // Memtable isn't ready, do a task if available; may be required to
-      // incorporate memtable that we're waiting on
-      task_perform_one_if_needed(spl->ts, 0);
-      rc = memtable_maybe_rotate_and_begin_insert(spl->mt_ctxt, &generation);
-   }
+   uint64          generation;
+   platform_status rc = trunk_memtable_begin_insert(spl, &generation);
    if (!SUCCESS(rc)) {
       goto out;
    }
@@ -3403,7 +3884,11 @@ trunk_memtable_insert(trunk_handle *spl, key tuple_key, message msg)
    }
 
    if (spl->cfg.use_log) {
-      int crappy_rc = log_write(spl->log, tuple_key, msg, leaf_generation);
+      int crappy_rc =
+         log_write(spl->log,
+                   tuple_key,
+                   msg,
+                   trunk_log_generation(generation, leaf_generation));
       if (crappy_rc != 0) {
          goto unlock_insert_lock;
       }
@@ -3416,25 +3901,90 @@ out:
 }
 
 /*
- * Compacts the memtable with generation generation and builds its filter.
- * Returns a pointer to the memtable.
+ * Inserts a batch of tuples into the current memtable, holding the memtable
+ * insert lock across as many tuples as the memtable will take and writing
+ * their log entries with a single log append.
+ *
+ * If the memtable fills up partway through, the lock is dropped so that it
+ * can be rotated, and the rest of the batch goes to the next memtable.
  */
-static memtable *
-trunk_memtable_compact_and_build_filter(trunk_handle  *spl,
-                                        uint64         generation,
-                                        const threadid tid)
+static platform_status
+trunk_memtable_insert_batch(trunk_handle  *spl,
+                            uint64         num_tuples,
+                            const key     *tuple_keys,
+                            const message *msgs)
 {
-   timestamp comp_start = platform_get_timestamp();
+   uint64          log_generations[TRUNK_MAX_INSERT_BATCH];
+   platform_status rc = STATUS_OK;
 
-   memtable *mt = trunk_get_memtable(spl, generation);
+   debug_assert(num_tuples <= TRUNK_MAX_INSERT_BATCH);
 
-   memtable_transition(mt, MEMTABLE_STATE_FINALIZED, MEMTABLE_STATE_COMPACTING);
-   mini_release(&mt->mini, NULL_KEY);
+   uint64 i = 0;
+   while (i < num_tuples) {
+      uint64 generation;
+      rc = trunk_memtable_begin_insert(spl, &generation);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
 
-   trunk_compacted_memtable *cmt =
-      trunk_get_compacted_memtable(spl, generation);
-   trunk_branch *new_branch = &cmt->branch;
-   ZERO_CONTENTS(new_branch);
+      // this call is safe because we hold the insert lock
+      memtable *mt    = trunk_get_memtable(spl, generation);
+      uint64    start = i;
+      do {
+         rc = memtable_insert(spl->mt_ctxt,
+                              mt,
+                              spl->heap_id,
+                              tuple_keys[i],
+                              msgs[i],
+                              &log_generations[i]);
+         if (!SUCCESS(rc)) {
+            break;
+         }
+         log_generations[i] =
+            trunk_log_generation(generation, log_generations[i]);
+         i++;
+      } while (i < num_tuples && !memtable_is_full(&spl->cfg.mt_cfg, mt));
+
+      if (spl->cfg.use_log && start < i) {
+         int crappy_rc = log_write_batch(spl->log,
+                                         i - start,
+                                         &tuple_keys[start],
+                                         &msgs[start],
+                                         &log_generations[start]);
+         if (crappy_rc != 0) {
+            rc = STATUS_IO_ERROR;
+         }
+      }
+
+      memtable_end_insert(spl->mt_ctxt);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+   }
+
+   return rc;
+}
+
+/*
+ * Compacts the memtable with generation generation and builds its filter.
+ * Returns a pointer to the memtable.
+ */
+static memtable *
+trunk_memtable_compact_and_build_filter(trunk_handle  *spl,
+                                        uint64         generation,
+                                        const threadid tid)
+{
+   timestamp comp_start = platform_get_timestamp();
+
+   memtable *mt = trunk_get_memtable(spl, generation);
+
+   memtable_transition(mt, MEMTABLE_STATE_FINALIZED, MEMTABLE_STATE_COMPACTING);
+   mini_release(&mt->mini, NULL_KEY);
+
+   trunk_compacted_memtable *cmt =
+      trunk_get_compacted_memtable(spl, generation);
+   trunk_branch *new_branch = &cmt->branch;
+   ZERO_CONTENTS(new_branch);
 
    uint64         memtable_root_addr = mt->root_addr;
    btree_iterator btree_itor;
@@ -3470,6 +4020,12 @@ trunk_memtable_compact_and_build_filter(trunk_handle  *spl,
                    pack_status.r);
 
    platform_assert(req.num_tuples <= spl->cfg.max_tuples_per_node);
+   platform_trace(memtable_compact,
+                  generation,
+                  memtable_root_addr,
+                  req.root_addr,
+                  req.num_tuples,
+                  req.key_bytes + req.message_bytes);
    if (spl->cfg.use_stats) {
       spl->stats[tid].root_compaction_pack_time_ns +=
          platform_timestamp_elapsed(pack_start);
@@ -3477,10 +4033,15 @@ trunk_memtable_compact_and_build_filter(trunk_handle  *spl,
       if (req.num_tuples > spl->stats[tid].root_compaction_max_tuples) {
          spl->stats[tid].root_compaction_max_tuples = req.num_tuples;
       }
+      spl->stats[tid].root_compaction_kv_bytes +=
+         req.key_bytes + req.message_bytes;
+      spl->stats[tid].root_compaction_bytes_written +=
+         req.num_extents * trunk_extent_size(&spl->cfg);
    }
    trunk_memtable_iterator_deinit(spl, &btree_itor, FALSE, FALSE);
 
    new_branch->root_addr = req.root_addr;
+   new_branch->epoch     = trunk_memtable_epoch(spl, generation);
 
    platform_assert(req.num_tuples > 0);
    uint64 filter_build_start;
@@ -3666,6 +4227,7 @@ trunk_memtable_incorporate_and_flush(trunk_handle  *spl,
    uint64     old_root_addr; // unused
    trunk_claim_and_copy_root(spl, &new_root, &old_root_addr);
    platform_assert(trunk_has_vacancy(spl, &new_root, 1));
+   platform_trace(memtable_incorporate_begin, generation, new_root.addr);
 
    platform_stream_handle stream;
    platform_status        rc = trunk_open_log_stream_if_enabled(spl, &stream);
@@ -3730,8 +4292,14 @@ trunk_memtable_incorporate_and_flush(trunk_handle  *spl,
    memtable_increment_to_generation_retired(spl->mt_ctxt, generation);
 
    // Switch in the new root and release all locks
+   uint64 new_root_addr   = new_root.addr;
+   uint16 new_root_height = trunk_node_height(&new_root);
    trunk_update_claimed_root_and_unlock(spl, &new_root);
    memtable_unblock_lookups(spl->mt_ctxt);
+   platform_trace(memtable_incorporate_end,
+                  generation,
+                  new_root_addr,
+                  new_root_height);
 
    // Enqueue the filter building task.
    trunk_log_stream_if_enabled(
@@ -4056,7 +4624,12 @@ trunk_prepare_build_filter(trunk_handle             *spl,
          uint64 pos = trunk_process_generation_to_pos(
             spl, compact_req, pdata->generation);
          platform_assert(pos != TRUNK_MAX_PIVOTS);
+         // Held until the filter is rebuilt, as trunk_delete_range may
+         // drop the pivot's reference meanwhile
          filter_scratch->old_filter[pos] = pdata->filter;
+         if (pdata->filter.addr != 0) {
+            trunk_inc_filter(spl, &filter_scratch->old_filter[pos]);
+         }
          filter_scratch->value[pos] =
             trunk_pivot_whole_branch_count(spl, node, pdata);
          filter_scratch->should_build[pos] = TRUE;
@@ -4117,9 +4690,7 @@ trunk_build_filters(trunk_handle             *spl,
       uint32 *fp_arr           = filter_scratch->fp_arr + fp_start;
       uint32  num_fingerprints = fp_end - fp_start;
       if (num_fingerprints == 0) {
-         if (old_filter.addr != 0) {
-            trunk_inc_filter(spl, &old_filter);
-         }
+         // Keeps the reference taken by trunk_prepare_build_filter
          filter_scratch->filter[pos] = old_filter;
          continue;
       }
@@ -4134,6 +4705,12 @@ trunk_build_filters(trunk_handle             *spl,
                                               num_fingerprints,
                                               value);
       platform_assert(SUCCESS(rc));
+      platform_trace(trunk_build_filter,
+                     compact_req->addr,
+                     compact_req->height,
+                     new_filter.addr,
+                     num_fingerprints);
+      trunk_dec_filter(spl, &old_filter);
 
       filter_scratch->filter[pos]       = new_filter;
       filter_scratch->should_build[pos] = FALSE;
@@ -4648,6 +5225,12 @@ trunk_flush(trunk_handle     *spl,
                    "Flush failed: %lu %lu\n",
                    parent->addr,
                    new_child.addr);
+   platform_trace(trunk_flush_begin,
+                  parent->addr,
+                  new_child.addr,
+                  trunk_node_height(parent),
+                  pdata->num_tuples_whole + pdata->num_tuples_bundle,
+                  pdata->num_kv_bytes_whole + pdata->num_kv_bytes_bundle);
 
    if ((!is_space_rec && pdata->srq_idx != -1)
        && spl->cfg.reclaim_threshold != UINT64_MAX)
@@ -4667,6 +5250,11 @@ trunk_flush(trunk_handle     *spl,
          spl->stats[tid].flush_wait_time_ns[trunk_node_height(parent)] +=
             platform_timestamp_elapsed(wait_start);
       }
+      const uint16 height = trunk_node_height(parent);
+      spl->stats[tid].flush_tuples[height] +=
+         pdata->num_tuples_whole + pdata->num_tuples_bundle;
+      spl->stats[tid].flush_kv_bytes[height] +=
+         pdata->num_kv_bytes_whole + pdata->num_kv_bytes_bundle;
       flush_start = platform_get_timestamp();
    }
 
@@ -4695,6 +5283,7 @@ trunk_flush(trunk_handle     *spl,
          platform_free(spl->heap_id, req);
          uint16 child_idx = trunk_pdata_to_pivot_index(spl, parent, pdata);
          trunk_split_leaf(spl, parent, &new_child, child_idx);
+         platform_trace(trunk_flush_end, parent->addr, STATUS_OK.r);
          return STATUS_OK;
       } else {
          uint64 child_idx = trunk_pdata_to_pivot_index(spl, parent, pdata);
@@ -4732,6 +5321,7 @@ trunk_flush(trunk_handle     *spl,
          }
       }
    }
+   platform_trace(trunk_flush_end, parent->addr, rc.r);
    return rc;
 }
 
@@ -5114,11 +5704,12 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    trunk_node_get(spl->cc, req->addr, &node);
 
    // timers for stats if enabled
-   uint64 compaction_start, pack_start;
+   uint64 compaction_start, pack_start, io_wait_start;
    uint16 height = trunk_node_height(&node);
    if (spl->cfg.use_stats) {
       tid              = platform_get_tid();
       compaction_start = platform_get_timestamp();
+      io_wait_start    = trunk_io_wait_ns(spl, tid);
       spl->stats[tid].compactions[height]++;
    }
 
@@ -5138,10 +5729,10 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
          spl, trunk_max_key(spl, &node), key_buffer_key(&req->end_key)));
 
    /*
-    * 2. The bundle may have been completely flushed, if so abort
+    * 2. The bundle may have been completely flushed (or, in a leaf, dropped
+    *    by trunk_delete_range), if so abort
     */
    if (!trunk_bundle_live(spl, &node, req->bundle_no)) {
-      debug_assert(height != 0);
       trunk_node_unget(spl->cc, &node);
       trunk_default_log_if_enabled(
          spl,
@@ -5163,6 +5754,18 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    uint16 bundle_start_branch = trunk_bundle_start_branch(spl, &node, bundle);
    uint16 bundle_end_branch   = trunk_bundle_end_branch(spl, &node, bundle);
    uint16 num_branches        = trunk_bundle_branch_count(spl, &node, bundle);
+   platform_trace(trunk_compact_bundle_begin,
+                  req->addr,
+                  height,
+                  req->bundle_no,
+                  num_branches);
+   if (spl->cfg.use_stats) {
+      uint64 input_tuples, input_kv_bytes;
+      trunk_bundle_live_tuple_counts(
+         spl, &node, req->bundle_no, &input_tuples, &input_kv_bytes);
+      spl->stats[tid].compaction_input_tuples[height] += input_tuples;
+      spl->stats[tid].compaction_input_kv_bytes[height] += input_kv_bytes;
+   }
 
    /*
     * Update and delete messages need to be kept around until/unless they have
@@ -5197,6 +5800,8 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    platform_assert(num_branches <= ARRAY_SIZE(scratch->skip_itor));
    trunk_btree_skiperator *skip_itor_arr = scratch->skip_itor;
    iterator              **itor_arr      = scratch->itor_arr;
+   uint64                 *epoch_arr     = scratch->epoch_arr;
+   uint64                  epoch         = 0;
 
    save_pivots_to_compact_bundle_scratch(spl, &node, scratch);
 
@@ -5212,7 +5817,9 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
                                   &node,
                                   branch_no,
                                   scratch->saved_pivot_keys);
-      itor_arr[tree_offset] = &skip_itor_arr[tree_offset].super;
+      itor_arr[tree_offset]  = &skip_itor_arr[tree_offset].super;
+      epoch_arr[tree_offset] = skip_itor_arr[tree_offset].branch.epoch;
+      epoch = MAX(epoch, epoch_arr[tree_offset]);
       tree_offset++;
    }
    trunk_log_node_if_enabled(&stream, spl, &node);
@@ -5226,12 +5833,18 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
     * 7. Perform compaction
     */
    merge_iterator *merge_itor;
-   rc = merge_iterator_create(spl->heap_id,
-                              spl->cfg.data_cfg,
-                              num_branches,
-                              itor_arr,
-                              merge_mode,
-                              &merge_itor);
+   rc = merge_iterator_create_with_range_deletes(
+      spl->heap_id,
+      spl->cfg.data_cfg,
+      num_branches,
+      itor_arr,
+      epoch_arr,
+      trunk_range_delete_cover_virtual,
+      spl,
+      spl->vlog != NULL ? trunk_value_log_drop_virtual : NULL,
+      spl,
+      merge_mode,
+      &merge_itor);
    platform_assert_status_ok(rc);
    btree_pack_req pack_req;
    rc = trunk_btree_pack_req_init(spl, &merge_itor->super, &pack_req);
@@ -5263,11 +5876,17 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
    if (spl->cfg.use_stats) {
       spl->stats[tid].compaction_pack_time_ns[height] +=
          platform_timestamp_elapsed(pack_start);
+      spl->stats[tid].compaction_bytes_written[height] +=
+         pack_req.num_extents * trunk_extent_size(&spl->cfg);
+      spl->stats[tid].compaction_io_wait_ns[height] +=
+         trunk_io_wait_ns(spl, tid) - io_wait_start;
    }
 
    trunk_branch new_branch;
    new_branch.root_addr     = pack_req.root_addr;
+   new_branch.epoch         = epoch;
    uint64 num_tuples        = pack_req.num_tuples;
+   uint64 num_kv_bytes      = pack_req.key_bytes + pack_req.message_bytes;
    req->fp_arr              = pack_req.fingerprint_arr;
    pack_req.fingerprint_arr = NULL;
    btree_pack_req_deinit(&pack_req, spl->heap_id);
@@ -5280,6 +5899,7 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
          spl->stats[tid].compactions_empty[height]++;
       }
       spl->stats[tid].compaction_tuples[height] += num_tuples;
+      spl->stats[tid].compaction_output_kv_bytes[height] += num_kv_bytes;
       if (num_tuples > spl->stats[tid].compaction_max_tuples[height]) {
          spl->stats[tid].compaction_max_tuples[height] = num_tuples;
       }
@@ -5358,9 +5978,9 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
 
       } else {
          /*
-          * 11b. ...unless node is internal and bundle has been flushed
+          * 11b. ...unless node is internal and bundle has been flushed, or
+          *      the bundle has been dropped by trunk_delete_range
           */
-         platform_assert(height != 0);
          trunk_log_stream_if_enabled(
             spl, &stream, "compact_bundle discarded flushed %lu\n", node.addr);
       }
@@ -5438,6 +6058,12 @@ trunk_compact_bundle(void *arg, void *scratch_buf)
       task_enqueue(
          spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters, req, TRUE);
    }
+   platform_trace(trunk_compact_bundle_end,
+                  height,
+                  new_branch.root_addr,
+                  num_tuples,
+                  num_kv_bytes,
+                  num_replacements);
 out:
    trunk_log_stream_if_enabled(spl, &stream, "\n");
    trunk_close_log_stream_if_enabled(spl, &stream);
@@ -5541,6 +6167,13 @@ trunk_split_index(trunk_handle             *spl,
    platform_assert(SUCCESS(rc));
    trunk_pivot_recount_num_tuples_and_kv_bytes(spl, parent, pivot_no);
    trunk_pivot_recount_num_tuples_and_kv_bytes(spl, parent, pivot_no + 1);
+   platform_trace(trunk_split_index,
+                  parent->addr,
+                  left_node->addr,
+                  right_addr,
+                  height,
+                  target_num_children,
+                  right_num_children);
 
    trunk_log_stream_if_enabled(
       spl, &stream, "----------------------------------------\n");
@@ -5850,6 +6483,12 @@ trunk_split_leaf(trunk_handle *spl,
                    num_leaves,
                    trunk_num_pivot_keys(spl, parent),
                    spl->cfg.max_pivot_keys);
+   platform_trace(trunk_split_leaf,
+                  parent->addr,
+                  leaf->addr,
+                  num_tuples,
+                  kv_bytes,
+                  num_leaves);
 
    /*
     * 3. Clear old bundles from leaf and put all branches in a new bundle
@@ -6011,6 +6650,8 @@ trunk_split_leaf(trunk_handle *spl,
    if (spl->cfg.use_stats) {
       // Doesn't include the original leaf
       spl->stats[tid].leaf_splits_leaves_created += num_leaves - 1;
+      spl->stats[tid].leaf_split_tuples += num_tuples;
+      spl->stats[tid].leaf_split_kv_bytes += kv_bytes;
       uint64 split_time = platform_timestamp_elapsed(split_start);
       spl->stats[tid].leaf_split_time_ns += split_time;
       platform_timestamp_elapsed(split_start);
@@ -6073,8 +6714,10 @@ platform_status
 trunk_range_iterator_next(iterator *itor);
 platform_status
 trunk_range_iterator_prev(iterator *itor);
-void
-trunk_range_iterator_deinit(trunk_range_iterator *range_itor);
+platform_status
+trunk_range_iterator_seek(iterator *itor, key seek_key, comparison seek_type);
+static void
+trunk_range_iterator_release(trunk_range_iterator *range_itor);
 
 const static iterator_ops trunk_range_iterator_ops = {
    .curr     = trunk_range_iterator_curr,
@@ -6082,28 +6725,49 @@ const static iterator_ops trunk_range_iterator_ops = {
    .can_next = trunk_range_iterator_can_next,
    .next     = trunk_range_iterator_next,
    .prev     = trunk_range_iterator_prev,
+   .seek     = trunk_range_iterator_seek,
 };
 
-platform_status
-trunk_range_iterator_init(trunk_handle         *spl,
-                          trunk_range_iterator *range_itor,
-                          key                   min_key,
-                          key                   max_key,
-                          key                   start_key,
-                          comparison            start_type,
-                          uint64                num_tuples)
+/*
+ * merge_cover_fn of a range iterator
+ */
+static uint64
+trunk_range_iterator_cover(void *arg, key target)
+{
+   trunk_range_iterator *range_itor = (trunk_range_iterator *)arg;
+   return trunk_range_delete_cover(
+      range_itor->spl, target, range_itor->num_range_deletes);
+}
+
+/*
+ * Builds the iterator over the leaf containing start_key, in the live tree
+ * or, if snapshot_root_addr is non-zero, in the tree below that snapshot
+ * root (see trunk_snapshot_create). A snapshot iterator has no memtable
+ * branches, and sees only the first num_range_deletes range deletes.
+ */
+static platform_status
+trunk_range_iterator_init_internal(trunk_handle         *spl,
+                                   trunk_range_iterator *range_itor,
+                                   uint64                snapshot_root_addr,
+                                   uint64                num_range_deletes,
+                                   key                   min_key,
+                                   key                   max_key,
+                                   key                   start_key,
+                                   comparison            start_type,
+                                   uint64                num_tuples)
 {
    debug_assert(!key_is_null(min_key));
    debug_assert(!key_is_null(max_key));
    debug_assert(!key_is_null(start_key));
 
-   range_itor->spl          = spl;
-   range_itor->super.ops    = &trunk_range_iterator_ops;
-   range_itor->num_branches = 0;
-   range_itor->num_tuples   = num_tuples;
-   range_itor->merge_itor   = NULL;
-   range_itor->can_prev     = TRUE;
-   range_itor->can_next     = TRUE;
+   range_itor->spl                = spl;
+   range_itor->snapshot_root_addr = snapshot_root_addr;
+   range_itor->super.ops          = &trunk_range_iterator_ops;
+   range_itor->num_branches       = 0;
+   range_itor->num_tuples         = num_tuples;
+   range_itor->merge_itor         = NULL;
+   range_itor->can_prev           = TRUE;
+   range_itor->can_next           = TRUE;
 
    if (trunk_key_compare(spl, min_key, start_key) > 0) {
       // in bounds, start at min
@@ -6122,12 +6786,17 @@ trunk_range_iterator_init(trunk_handle         *spl,
 
    // grab the lookup lock
    memtable_begin_lookup(spl->mt_ctxt);
+   range_itor->num_range_deletes = snapshot_root_addr != 0
+                                      ? num_range_deletes
+                                      : trunk_num_range_deletes(spl);
 
-   // memtables
+   // memtables, of which a snapshot has none
    ZERO_ARRAY(range_itor->branch);
    // Note this iteration is in descending generation order
    range_itor->memtable_start_gen = memtable_generation(spl->mt_ctxt);
-   range_itor->memtable_end_gen   = memtable_generation_retired(spl->mt_ctxt);
+   range_itor->memtable_end_gen =
+      snapshot_root_addr != 0 ? range_itor->memtable_start_gen
+                              : memtable_generation_retired(spl->mt_ctxt);
    range_itor->num_memtable_branches =
       range_itor->memtable_start_gen - range_itor->memtable_end_gen;
    for (uint64 mt_gen = range_itor->memtable_start_gen;
@@ -6153,12 +6822,17 @@ trunk_range_iterator_init(trunk_handle         *spl,
       }
 
       range_itor->branch[range_itor->num_branches].root_addr = root_addr;
+      range_itor->branch[range_itor->num_branches].epoch =
+         trunk_memtable_epoch(spl, mt_gen);
 
       range_itor->num_branches++;
    }
 
    trunk_node node;
-   trunk_node_get(spl->cc, spl->root_addr, &node);
+   trunk_node_get(spl->cc,
+                  snapshot_root_addr != 0 ? snapshot_root_addr
+                                          : spl->root_addr,
+                  &node);
    memtable_end_lookup(spl->mt_ctxt);
 
    // index btrees
@@ -6234,6 +6908,7 @@ trunk_range_iterator_init(trunk_handle         *spl,
 
    trunk_node_unget(spl->cc, &node);
 
+   uint64 num_live_branches = 0;
    for (uint64 i = 0; i < range_itor->num_branches; i++) {
       uint64          branch_no  = range_itor->num_branches - i - 1;
       btree_iterator *btree_itor = &range_itor->btree_itor[branch_no];
@@ -6266,15 +6941,34 @@ trunk_range_iterator_init(trunk_handle         *spl,
             is_live,
             FALSE);
       }
-      range_itor->itor[i] = &btree_itor->super;
-   }
 
-   platform_status rc = merge_iterator_create(spl->heap_id,
-                                              spl->cfg.data_cfg,
-                                              range_itor->num_branches,
-                                              range_itor->itor,
-                                              MERGE_FULL,
-                                              &range_itor->merge_itor);
+      /*
+       * A branch with no tuples in [local_min, local_max) cannot contribute
+       * to this leaf's range, so leave it out of the merge. With a tight
+       * max_key this prunes most branches of a short scan.
+       */
+      iterator *itor = &btree_itor->super;
+      if (iterator_can_curr(itor) || iterator_can_prev(itor)
+          || iterator_can_next(itor))
+      {
+         range_itor->itor[num_live_branches]  = itor;
+         range_itor->epoch[num_live_branches] = branch->epoch;
+         num_live_branches++;
+      }
+   }
+
+   platform_status rc = merge_iterator_create_with_range_deletes(
+      spl->heap_id,
+      spl->cfg.data_cfg,
+      num_live_branches,
+      range_itor->itor,
+      range_itor->epoch,
+      trunk_range_iterator_cover,
+      range_itor,
+      NULL,
+      NULL,
+      MERGE_FULL,
+      &range_itor->merge_itor);
    if (!SUCCESS(rc)) {
       return rc;
    }
@@ -6287,14 +6981,16 @@ trunk_range_iterator_init(trunk_handle         *spl,
     */
    if (!in_range && start_type >= greater_than) {
       if (trunk_key_compare(spl, local_max, max_key) < 0) {
-         trunk_range_iterator_deinit(range_itor);
-         rc = trunk_range_iterator_init(spl,
-                                        range_itor,
-                                        min_key,
-                                        max_key,
-                                        local_max,
-                                        start_type,
-                                        range_itor->num_tuples);
+         trunk_range_iterator_release(range_itor);
+         rc = trunk_range_iterator_init_internal(spl,
+                                                 range_itor,
+                                                 snapshot_root_addr,
+                                                 num_range_deletes,
+                                                 min_key,
+                                                 max_key,
+                                                 local_max,
+                                                 start_type,
+                                                 range_itor->num_tuples);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6306,14 +7002,16 @@ trunk_range_iterator_init(trunk_handle         *spl,
    }
    if (!in_range && start_type <= less_than_or_equal) {
       if (trunk_key_compare(spl, local_min, min_key) > 0) {
-         trunk_range_iterator_deinit(range_itor);
-         rc = trunk_range_iterator_init(spl,
-                                        range_itor,
-                                        min_key,
-                                        max_key,
-                                        local_min,
-                                        start_type,
-                                        range_itor->num_tuples);
+         trunk_range_iterator_release(range_itor);
+         rc = trunk_range_iterator_init_internal(spl,
+                                                 range_itor,
+                                                 snapshot_root_addr,
+                                                 num_range_deletes,
+                                                 min_key,
+                                                 max_key,
+                                                 local_min,
+                                                 start_type,
+                                                 range_itor->num_tuples);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6326,16 +7024,116 @@ trunk_range_iterator_init(trunk_handle         *spl,
    return rc;
 }
 
+/*
+ * The value log must not free what the iterator refers to until it is
+ * deinitialized.
+ */
+static void
+trunk_range_iterator_begin_read(trunk_handle         *spl,
+                                trunk_range_iterator *range_itor)
+{
+   range_itor->spl = spl;
+   if (spl->vlog != NULL) {
+      value_log_begin_read(spl->vlog);
+      writable_buffer_init(&range_itor->value, spl->heap_id);
+      ZERO_STRUCT(range_itor->value_ref);
+   }
+}
+
+platform_status
+trunk_range_iterator_init(trunk_handle         *spl,
+                          trunk_range_iterator *range_itor,
+                          key                   min_key,
+                          key                   max_key,
+                          key                   start_key,
+                          comparison            start_type,
+                          uint64                num_tuples)
+{
+   timestamp ts = 0;
+   if (spl->cfg.use_stats) {
+      ts = platform_get_timestamp();
+   }
+
+   trunk_range_iterator_begin_read(spl, range_itor);
+   platform_status rc = trunk_range_iterator_init_internal(spl,
+                                                           range_itor,
+                                                           0,
+                                                           0,
+                                                           min_key,
+                                                           max_key,
+                                                           start_key,
+                                                           start_type,
+                                                           num_tuples);
+   if (!SUCCESS(rc)) {
+      trunk_range_iterator_deinit(range_itor);
+      return rc;
+   }
+   trunk_record_latency(spl, TRUNK_LATENCY_ITERATOR_INIT, ts);
+   return rc;
+}
+
+/*
+ * Iterate over the tree as pinned by trunk_snapshot_create. The snapshot
+ * must outlive the iterator.
+ */
+platform_status
+trunk_range_iterator_init_snapshot(trunk_handle         *spl,
+                                   trunk_range_iterator *range_itor,
+                                   uint64                snapshot_root_addr,
+                                   uint64                num_range_deletes,
+                                   key                   min_key,
+                                   key                   max_key,
+                                   key                   start_key,
+                                   comparison            start_type,
+                                   uint64                num_tuples)
+{
+   debug_assert(snapshot_root_addr != 0);
+   timestamp ts = 0;
+   if (spl->cfg.use_stats) {
+      ts = platform_get_timestamp();
+   }
+
+   trunk_range_iterator_begin_read(spl, range_itor);
+   platform_status rc = trunk_range_iterator_init_internal(spl,
+                                                           range_itor,
+                                                           snapshot_root_addr,
+                                                           num_range_deletes,
+                                                           min_key,
+                                                           max_key,
+                                                           start_key,
+                                                           start_type,
+                                                           num_tuples);
+   if (!SUCCESS(rc)) {
+      trunk_range_iterator_deinit(range_itor);
+      return rc;
+   }
+   trunk_record_latency(spl, TRUNK_LATENCY_ITERATOR_INIT, ts);
+   return rc;
+}
+
 void
 trunk_range_iterator_curr(iterator *itor, key *curr_key, message *data)
 {
    debug_assert(itor != NULL);
    trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
    iterator_curr(&range_itor->merge_itor->super, curr_key, data);
+   if (message_class(*data) == MESSAGE_TYPE_INSERT_INDIRECT) {
+      value_log_ref ref = value_log_message_ref(*data);
+      if (ref.addr != range_itor->value_ref.addr
+          || ref.id != range_itor->value_ref.id)
+      {
+         platform_status rc = value_log_read(
+            range_itor->spl->vlog, &ref, &range_itor->value);
+         platform_assert_status_ok(rc);
+         range_itor->value_ref = ref;
+      }
+      *data = message_create(MESSAGE_TYPE_INSERT,
+                             writable_buffer_to_slice(&range_itor->value));
+   }
 }
 
-platform_status
-trunk_range_iterator_next(iterator *itor)
+static platform_status
+trunk_range_iterator_next_internal(iterator *itor)
 {
    trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
    debug_assert(range_itor != NULL);
@@ -6374,14 +7172,17 @@ trunk_range_iterator_next(iterator *itor)
       // if there is more data to get, rebuild the iterator for next leaf
       if (trunk_key_compare(range_itor->spl, local_max_key, max_key) < 0) {
          uint64 temp_tuples = range_itor->num_tuples;
-         trunk_range_iterator_deinit(range_itor);
-         rc = trunk_range_iterator_init(range_itor->spl,
-                                        range_itor,
-                                        min_key,
-                                        max_key,
-                                        local_max_key,
-                                        greater_than_or_equal,
-                                        temp_tuples);
+         trunk_range_iterator_release(range_itor);
+         rc = trunk_range_iterator_init_internal(
+            range_itor->spl,
+            range_itor,
+            range_itor->snapshot_root_addr,
+            range_itor->num_range_deletes,
+            min_key,
+            max_key,
+            local_max_key,
+            greater_than_or_equal,
+            temp_tuples);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6393,6 +7194,23 @@ trunk_range_iterator_next(iterator *itor)
    return STATUS_OK;
 }
 
+platform_status
+trunk_range_iterator_next(iterator *itor)
+{
+   trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
+   trunk_handle         *spl        = range_itor->spl;
+   timestamp             ts         = 0;
+   if (spl->cfg.use_stats) {
+      ts = platform_get_timestamp();
+   }
+
+   platform_status rc = trunk_range_iterator_next_internal(itor);
+   if (SUCCESS(rc)) {
+      trunk_record_latency(spl, TRUNK_LATENCY_ITERATOR_NEXT, ts);
+   }
+   return rc;
+}
+
 platform_status
 trunk_range_iterator_prev(iterator *itor)
 {
@@ -6432,14 +7250,17 @@ trunk_range_iterator_prev(iterator *itor)
 
       // if there is more data to get, rebuild the iterator for prev leaf
       if (trunk_key_compare(range_itor->spl, local_min_key, min_key) > 0) {
-         trunk_range_iterator_deinit(range_itor);
-         rc = trunk_range_iterator_init(range_itor->spl,
-                                        range_itor,
-                                        min_key,
-                                        max_key,
-                                        local_min_key,
-                                        less_than,
-                                        range_itor->num_tuples);
+         trunk_range_iterator_release(range_itor);
+         rc = trunk_range_iterator_init_internal(
+            range_itor->spl,
+            range_itor,
+            range_itor->snapshot_root_addr,
+            range_itor->num_range_deletes,
+            min_key,
+            max_key,
+            local_min_key,
+            less_than,
+            range_itor->num_tuples);
          if (!SUCCESS(rc)) {
             return rc;
          }
@@ -6451,6 +7272,87 @@ trunk_range_iterator_prev(iterator *itor)
    return STATUS_OK;
 }
 
+/*
+ * Reposition the range iterator at seek_key, clamped to [min_key, max_key].
+ *
+ * When a forward seek lands inside the current leaf's [local_min, local_max)
+ * the branches already gathered for that leaf cover it, so the merge iterator
+ * (and the btree iterators under it) are seeked in place. Otherwise the
+ * iterator is rebuilt for the leaf containing seek_key.
+ */
+platform_status
+trunk_range_iterator_seek(iterator *itor, key seek_key, comparison seek_type)
+{
+   trunk_range_iterator *range_itor = (trunk_range_iterator *)itor;
+   debug_assert(range_itor != NULL);
+   debug_assert(!key_is_null(seek_key));
+   trunk_handle   *spl = range_itor->spl;
+   platform_status rc;
+
+   KEY_CREATE_LOCAL_COPY(
+      rc, min_key, spl->heap_id, key_buffer_key(&range_itor->min_key));
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   KEY_CREATE_LOCAL_COPY(
+      rc, max_key, spl->heap_id, key_buffer_key(&range_itor->max_key));
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   if (trunk_key_compare(spl, min_key, seek_key) > 0) {
+      seek_key = min_key;
+   }
+   if (trunk_key_compare(spl, max_key, seek_key) < 0) {
+      seek_key = max_key;
+   }
+
+   key local_min = key_buffer_key(&range_itor->local_min_key);
+   key local_max = key_buffer_key(&range_itor->local_max_key);
+   if (seek_type >= greater_than && range_itor->merge_itor != NULL
+       && trunk_key_compare(spl, local_min, seek_key) <= 0
+       && trunk_key_compare(spl, seek_key, local_max) < 0)
+   {
+      rc = iterator_seek(&range_itor->merge_itor->super, seek_key, seek_type);
+      if (!SUCCESS(rc)) {
+         return rc;
+      }
+      range_itor->can_prev = TRUE;
+      range_itor->can_next = TRUE;
+      if (iterator_can_curr(&range_itor->merge_itor->super)) {
+         return STATUS_OK;
+      }
+
+      // the rest of this leaf is empty, so move on as next would
+      if (trunk_key_compare(spl, local_max, max_key) >= 0) {
+         range_itor->can_next = FALSE;
+         range_itor->can_prev =
+            iterator_can_prev(&range_itor->merge_itor->super);
+         return STATUS_OK;
+      }
+      seek_key  = local_max;
+      seek_type = greater_than_or_equal;
+   }
+
+   KEY_CREATE_LOCAL_COPY(rc, start_key, spl->heap_id, seek_key);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   uint64 num_tuples         = range_itor->num_tuples;
+   uint64 snapshot_root_addr = range_itor->snapshot_root_addr;
+   uint64 num_range_deletes  = range_itor->num_range_deletes;
+   trunk_range_iterator_release(range_itor);
+   return trunk_range_iterator_init_internal(spl,
+                                             range_itor,
+                                             snapshot_root_addr,
+                                             num_range_deletes,
+                                             min_key,
+                                             max_key,
+                                             start_key,
+                                             seek_type,
+                                             num_tuples);
+}
+
 bool32
 trunk_range_iterator_can_prev(iterator *itor)
 {
@@ -6469,8 +7371,12 @@ trunk_range_iterator_can_next(iterator *itor)
    return range_itor->can_next;
 }
 
-void
-trunk_range_iterator_deinit(trunk_range_iterator *range_itor)
+/*
+ * Releases the branches of the leaf the iterator is on, which
+ * trunk_range_iterator_init_internal then moves to another.
+ */
+static void
+trunk_range_iterator_release(trunk_range_iterator *range_itor)
 {
    trunk_handle *spl = range_itor->spl;
    if (range_itor->merge_itor != NULL) {
@@ -6494,6 +7400,17 @@ trunk_range_iterator_deinit(trunk_range_iterator *range_itor)
    }
 }
 
+void
+trunk_range_iterator_deinit(trunk_range_iterator *range_itor)
+{
+   trunk_handle *spl = range_itor->spl;
+   trunk_range_iterator_release(range_itor);
+   if (spl->vlog != NULL) {
+      writable_buffer_deinit(&range_itor->value);
+      value_log_end_read(spl->vlog);
+   }
+}
+
 /*
  * Given a node addr and pivot generation, find the pivot with that generation
  * among the node and its split descendents
@@ -6683,107 +7600,449 @@ trunk_insert(trunk_handle *spl, key tuple_key, message data)
    if (message_class(data) == MESSAGE_TYPE_DELETE) {
       data = DELETE_MESSAGE;
    }
+   message_type class    = message_class(data);
+   uint64       kv_bytes = key_length(tuple_key) + message_length(data);
 
-   platform_status rc = trunk_memtable_insert(spl, tuple_key, data);
+   platform_status rc;
+   value_log_ref   ref;
+   if (spl->vlog != NULL) {
+      if (class == MESSAGE_TYPE_UPDATE) {
+         return STATUS_NOTSUP;
+      }
+      trunk_value_log_get(spl);
+      rc = trunk_value_log_separate(spl, tuple_key, &data, &ref);
+      if (SUCCESS(rc)) {
+         rc = trunk_memtable_insert(spl, tuple_key, data);
+      }
+      trunk_value_log_unget(spl);
+   } else {
+      rc = trunk_memtable_insert(spl, tuple_key, data);
+   }
    if (!SUCCESS(rc)) {
       goto out;
    }
 
    task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+   if (spl->vlog != NULL && value_log_gc_requested(spl->vlog)) {
+      // the insert is in, whatever becomes of the collection
+      trunk_value_log_gc(spl, FALSE);
+   }
 
    if (spl->cfg.use_stats) {
-      switch (message_class(data)) {
+      spl->stats[tid].user_kv_bytes += kv_bytes;
+      trunk_latency_type type;
+      switch (class) {
          case MESSAGE_TYPE_INSERT:
             spl->stats[tid].insertions++;
-            platform_histo_insert(spl->stats[tid].insert_latency_histo,
-                                  platform_timestamp_elapsed(ts));
+            type = TRUNK_LATENCY_INSERT;
             break;
          case MESSAGE_TYPE_UPDATE:
             spl->stats[tid].updates++;
-            platform_histo_insert(spl->stats[tid].update_latency_histo,
-                                  platform_timestamp_elapsed(ts));
+            type = TRUNK_LATENCY_UPDATE;
             break;
          case MESSAGE_TYPE_DELETE:
             spl->stats[tid].deletions++;
-            platform_histo_insert(spl->stats[tid].delete_latency_histo,
-                                  platform_timestamp_elapsed(ts));
+            type = TRUNK_LATENCY_DELETE;
             break;
          default:
             platform_assert(0);
       }
+      trunk_record_latency(spl, type, ts);
    }
 
 out:
    return rc;
 }
 
-bool32
-trunk_filter_lookup(trunk_handle      *spl,
-                    trunk_node        *node,
-                    routing_filter    *filter,
-                    routing_config    *cfg,
-                    uint16             start_branch,
-                    key                target,
-                    merge_accumulator *data)
+/*
+ * Inserts num_tuples tuples, amortizing the memtable locking and log appends
+ * across the batch. The batch is not atomic: on error, a prefix of the
+ * tuples may have been inserted.
+ */
+platform_status
+trunk_insert_batch(trunk_handle  *spl,
+                   uint64         num_tuples,
+                   const key     *tuple_keys,
+                   const message *data)
 {
-   uint16   height;
-   threadid tid;
-   if (spl->cfg.use_stats) {
-      tid    = platform_get_tid();
-      height = trunk_node_height(node);
-   }
+   message msgs[TRUNK_MAX_INSERT_BATCH];
 
-   uint64          found_values;
-   platform_status rc =
-      routing_filter_lookup(spl->cc, cfg, filter, target, &found_values);
-   platform_assert_status_ok(rc);
-   if (spl->cfg.use_stats) {
-      spl->stats[tid].filter_lookups[height]++;
+   if (TRUNK_MAX_INSERT_BATCH < num_tuples) {
+      return STATUS_BAD_PARAM;
    }
-   uint16 next_value =
-      routing_filter_get_next_value(found_values, ROUTING_NOT_FOUND);
-   while (next_value != ROUTING_NOT_FOUND) {
-      uint16 branch_no = trunk_add_branch_number(spl, start_branch, next_value);
-      trunk_branch   *branch = trunk_get_branch(spl, node, branch_no);
-      bool32          local_found;
-      platform_status rc;
-      rc =
-         trunk_btree_lookup_and_merge(spl, branch, target, data, &local_found);
-      platform_assert_status_ok(rc);
-      if (spl->cfg.use_stats) {
-         spl->stats[tid].branch_lookups[height]++;
+
+   for (uint64 i = 0; i < num_tuples; i++) {
+      if (trunk_max_key_size(spl) < key_length(tuple_keys[i])) {
+         return STATUS_BAD_PARAM;
       }
-      if (local_found) {
-         message msg = merge_accumulator_to_message(data);
-         if (message_is_definitive(msg)) {
-            return FALSE;
-         }
-      } else if (spl->cfg.use_stats) {
-         spl->stats[tid].filter_false_positives[height]++;
+      msgs[i] = data[i];
+      if (message_class(msgs[i]) == MESSAGE_TYPE_DELETE) {
+         msgs[i] = DELETE_MESSAGE;
+      }
+      if (spl->vlog != NULL && message_class(msgs[i]) == MESSAGE_TYPE_UPDATE) {
+         return STATUS_NOTSUP;
       }
-      next_value = routing_filter_get_next_value(found_values, next_value);
    }
-   return TRUE;
-}
 
-bool32
-trunk_compacted_subbundle_lookup(trunk_handle      *spl,
-                                 trunk_node        *node,
-                                 trunk_subbundle   *sb,
-                                 key                target,
-                                 merge_accumulator *data)
-{
-   debug_assert(sb->state == SB_STATE_COMPACTED);
-   debug_assert(trunk_subbundle_branch_count(spl, node, sb) == 1);
-   uint16   height;
-   threadid tid;
+   platform_status rc;
+   if (spl->vlog != NULL) {
+      value_log_ref refs[TRUNK_MAX_INSERT_BATCH];
+      message       stored[TRUNK_MAX_INSERT_BATCH];
+      trunk_value_log_get(spl);
+      rc = STATUS_OK;
+      for (uint64 i = 0; i < num_tuples && SUCCESS(rc); i++) {
+         stored[i] = msgs[i];
+         rc = trunk_value_log_separate(
+            spl, tuple_keys[i], &stored[i], &refs[i]);
+      }
+      if (SUCCESS(rc)) {
+         rc = trunk_memtable_insert_batch(spl, num_tuples, tuple_keys, stored);
+      }
+      trunk_value_log_unget(spl);
+   } else {
+      rc = trunk_memtable_insert_batch(spl, num_tuples, tuple_keys, msgs);
+   }
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   task_perform_one_if_needed(spl->ts, spl->cfg.queue_scale_percent);
+   if (spl->vlog != NULL && value_log_gc_requested(spl->vlog)) {
+      // the batch is in, whatever becomes of the collection
+      trunk_value_log_gc(spl, FALSE);
+   }
+
    if (spl->cfg.use_stats) {
-      tid    = platform_get_tid();
-      height = trunk_node_height(node);
+      const threadid tid = platform_get_tid();
+      for (uint64 i = 0; i < num_tuples; i++) {
+         spl->stats[tid].user_kv_bytes +=
+            key_length(tuple_keys[i]) + message_length(msgs[i]);
+         switch (message_class(msgs[i])) {
+            case MESSAGE_TYPE_INSERT:
+               spl->stats[tid].insertions++;
+               break;
+            case MESSAGE_TYPE_UPDATE:
+               spl->stats[tid].updates++;
+               break;
+            case MESSAGE_TYPE_DELETE:
+               spl->stats[tid].deletions++;
+               break;
+            default:
+               platform_assert(0);
+         }
+      }
    }
 
-   uint16 filter_count = trunk_subbundle_filter_count(spl, node, sb);
-   for (uint16 filter_no = 0; filter_no != filter_count; filter_no++) {
+   return rc;
+}
+
+/*
+ * Makes the calling thread's inserts so far durable, see log_commit(). Only
+ * tables with a log can make inserts durable before they are unmounted.
+ */
+platform_status
+trunk_log_commit(trunk_handle *spl, log_durability durability)
+{
+   if (!spl->cfg.use_log) {
+      return durability == LOG_DURABILITY_NONE ? STATUS_OK : STATUS_BAD_PARAM;
+   }
+
+   // Keeps a checkpoint from replacing the log while it is being committed
+   memtable_begin_insert(spl->mt_ctxt);
+   bool32          log_is_new = spl->checkpoint_prev_log != NULL;
+   platform_status rc         = log_commit(spl->log, durability);
+   memtable_end_insert(spl->mt_ctxt);
+
+   if (SUCCESS(rc) && log_is_new && durability != LOG_DURABILITY_NONE) {
+      // The super block on disk refers to the new log once the checkpoint
+      // that started it completes
+      platform_mutex_lock(&spl->checkpoint_lock);
+      platform_mutex_unlock(&spl->checkpoint_lock);
+   }
+   return rc;
+}
+
+/*
+ * Returns TRUE if every branch live for the pivot is older than the range
+ * delete with the given epoch.
+ */
+static inline bool32
+trunk_pivot_older_than(trunk_handle     *spl,
+                       trunk_node       *node,
+                       trunk_pivot_data *pdata,
+                       uint64            epoch)
+{
+   for (uint16 branch_no = pdata->start_branch;
+        branch_no != trunk_end_branch(spl, node);
+        branch_no = trunk_add_branch_number(spl, branch_no, 1))
+   {
+      if (trunk_get_branch(spl, node, branch_no)->epoch >= epoch) {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+/*
+ * Clears from node, a fresh copy of old_node, every pivot within
+ * [start_key, end_key) whose branches are all covered by the range delete
+ * with the given epoch, and does likewise in the children whose key range
+ * meets it. The references the cleared pivots held are dropped from the old
+ * copies, which are write locked top down so no reader still uses them.
+ *
+ * Both nodes are write locked by the caller.
+ */
+static void
+trunk_drop_range_in_node(trunk_handle *spl,
+                         trunk_node   *node,
+                         trunk_node   *old_node,
+                         key           start_key,
+                         key           end_key,
+                         uint64        epoch)
+{
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      key pivot_min = trunk_get_pivot(spl, node, pivot_no);
+      key pivot_max = trunk_get_pivot(spl, node, pivot_no + 1);
+      if (trunk_key_compare(spl, pivot_max, start_key) <= 0) {
+         continue;
+      }
+      if (trunk_key_compare(spl, end_key, pivot_min) <= 0) {
+         break;
+      }
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+
+      if (!trunk_node_is_leaf(node)) {
+         trunk_node old_child;
+         trunk_node_get(spl->cc, pdata->addr, &old_child);
+         trunk_node_claim(spl->cc, &old_child);
+         trunk_node_lock(spl->cc, &old_child);
+         trunk_node child;
+         trunk_node_copy(spl, &old_child, &child);
+         pdata->addr = child.addr;
+         trunk_drop_range_in_node(
+            spl, &child, &old_child, start_key, end_key, epoch);
+         trunk_node_unlock(spl->cc, &child);
+         trunk_node_unclaim(spl->cc, &child);
+         trunk_node_unget(spl->cc, &child);
+         trunk_node_unlock(spl->cc, &old_child);
+         trunk_node_unclaim(spl->cc, &old_child);
+         trunk_node_unget(spl->cc, &old_child);
+      }
+
+      if (trunk_key_compare(spl, start_key, pivot_min) > 0
+          || trunk_key_compare(spl, pivot_max, end_key) > 0
+          || pdata->start_branch == trunk_end_branch(spl, node)
+          || !trunk_pivot_older_than(spl, node, pdata, epoch))
+      {
+         continue;
+      }
+
+      trunk_pivot_data *old_pdata =
+         trunk_get_pivot_data(spl, old_node, pivot_no);
+      for (uint16 branch_no = old_pdata->start_branch;
+           branch_no != trunk_end_branch(spl, old_node);
+           branch_no = trunk_add_branch_number(spl, branch_no, 1))
+      {
+         trunk_branch *branch = trunk_get_branch(spl, old_node, branch_no);
+         trunk_zap_branch_range(
+            spl, branch, pivot_min, pivot_max, PAGE_TYPE_BRANCH);
+      }
+      trunk_dec_filter(spl, &old_pdata->filter);
+
+      if (pdata->srq_idx != -1 && spl->cfg.reclaim_threshold != UINT64_MAX) {
+         srq_delete(&spl->srq, pdata->srq_idx);
+         srq_print(&spl->srq);
+      }
+      trunk_pivot_clear(spl, node, pdata);
+   }
+}
+
+/*
+ * Gives back the space of the data the range delete with the given epoch
+ * covers in whole pivots, without rewriting any of it. See
+ * trunk_drop_range_in_node.
+ */
+static void
+trunk_drop_range(trunk_handle *spl, key start_key, key end_key, uint64 epoch)
+{
+   trunk_node root;
+   uint64     old_root_addr;
+   trunk_claim_and_copy_root(spl, &root, &old_root_addr);
+   // Note we still hold a writelock on the new root
+   trunk_update_claimed_root(spl, &root);
+
+   trunk_node old_root;
+   trunk_node_get(spl->cc, old_root_addr, &old_root);
+   trunk_node_claim(spl->cc, &old_root);
+   trunk_node_lock(spl->cc, &old_root);
+
+   trunk_drop_range_in_node(spl, &root, &old_root, start_key, end_key, epoch);
+   debug_assert(trunk_verify_node(spl, &root));
+
+   trunk_node_unlock(spl->cc, &old_root);
+   trunk_node_unclaim(spl->cc, &old_root);
+   trunk_node_unget(spl->cc, &old_root);
+   trunk_node_unlock(spl->cc, &root);
+   trunk_node_unclaim(spl->cc, &root);
+   trunk_node_unget(spl->cc, &root);
+}
+
+/*
+ * Deletes every key in [start_key, end_key), see "Range deletes" above.
+ *
+ * The range delete is numbered and the live memtable closed off while
+ * inserts are blocked, so every insert is either older than the range
+ * delete, in an older memtable, or newer, in the memtable it was numbered
+ * for. It is logged likewise, and made durable by trunk_log_commit.
+ *
+ * The pivots of the trunk wholly within the range are then cleared at once,
+ * giving their space back, and the rest of the covered data is dropped as
+ * compactions rewrite it.
+ *
+ * Returns STATUS_NO_SPACE once the table holds max_range_deletes of them.
+ */
+platform_status
+trunk_delete_range(trunk_handle *spl, key start_key, key end_key)
+{
+   if (trunk_max_key_size(spl) < key_length(start_key)
+       || trunk_max_key_size(spl) < key_length(end_key))
+   {
+      return STATUS_BAD_PARAM;
+   }
+   if (trunk_key_compare(spl, start_key, end_key) >= 0) {
+      return STATUS_OK;
+   }
+
+   trunk_value_log_get(spl);
+   platform_mutex_lock(&spl->range_delete_lock);
+   uint64 idx = spl->num_range_deletes;
+   if (idx == spl->max_range_deletes) {
+      platform_mutex_unlock(&spl->range_delete_lock);
+      trunk_value_log_unget(spl);
+      return STATUS_NO_SPACE;
+   }
+
+   uint64 generation;
+   memtable_block_inserts(spl->mt_ctxt);
+   platform_status rc = memtable_try_rotate_blocked(spl->mt_ctxt, &generation);
+   while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      // The next memtable is still being incorporated
+      memtable_unblock_inserts(spl->mt_ctxt);
+      task_perform_one_if_needed(spl->ts, 0);
+      memtable_block_inserts(spl->mt_ctxt);
+      rc = memtable_try_rotate_blocked(spl->mt_ctxt, &generation);
+   }
+   platform_assert_status_ok(rc);
+
+   if (spl->cfg.use_log) {
+      message msg =
+         message_create(MESSAGE_TYPE_RANGE_DELETE, key_slice(end_key));
+      if (log_write(spl->log,
+                    start_key,
+                    msg,
+                    trunk_log_generation(generation, 0))
+          != 0)
+      {
+         memtable_unblock_inserts(spl->mt_ctxt);
+         platform_mutex_unlock(&spl->range_delete_lock);
+         trunk_value_log_unget(spl);
+         return STATUS_IO_ERROR;
+      }
+   }
+
+   trunk_range_delete_hdr *hdr = trunk_get_range_delete(spl, idx);
+   hdr->start_length           = key_length(start_key);
+   hdr->end_length             = key_length(end_key);
+   memmove(hdr + 1, key_data(start_key), key_length(start_key));
+   memmove((char *)(hdr + 1) + trunk_max_key_size(spl),
+           key_data(end_key),
+           key_length(end_key));
+   spl->range_delete_generation[idx] = generation;
+   __atomic_store_n(&spl->num_range_deletes, idx + 1, __ATOMIC_RELEASE);
+   memtable_unblock_inserts(spl->mt_ctxt);
+
+   trunk_range_delete_write(spl, idx);
+   platform_mutex_unlock(&spl->range_delete_lock);
+   trunk_value_log_unget(spl);
+
+   trunk_drop_range(spl, start_key, end_key, idx + 1);
+   return STATUS_OK;
+}
+
+bool32
+trunk_filter_lookup(trunk_handle      *spl,
+                    trunk_node        *node,
+                    routing_filter    *filter,
+                    routing_config    *cfg,
+                    uint16             start_branch,
+                    key                target,
+                    uint64             cover_epoch,
+                    merge_accumulator *data)
+{
+   uint16   height;
+   threadid tid;
+   if (spl->cfg.use_stats) {
+      tid    = platform_get_tid();
+      height = trunk_node_height(node);
+   }
+
+   uint64          found_values;
+   platform_status rc =
+      routing_filter_lookup(spl->cc, cfg, filter, target, &found_values);
+   platform_assert_status_ok(rc);
+   if (spl->cfg.use_stats) {
+      spl->stats[tid].filter_lookups[height]++;
+   }
+   uint16 next_value =
+      routing_filter_get_next_value(found_values, ROUTING_NOT_FOUND);
+   while (next_value != ROUTING_NOT_FOUND) {
+      uint16 branch_no = trunk_add_branch_number(spl, start_branch, next_value);
+      trunk_branch *branch = trunk_get_branch(spl, node, branch_no);
+      if (branch->epoch < cover_epoch) {
+         trunk_merge_range_delete(spl, target, data);
+         return FALSE;
+      }
+      bool32          local_found;
+      platform_status rc;
+      rc =
+         trunk_btree_lookup_and_merge(spl, branch, target, data, &local_found);
+      platform_assert_status_ok(rc);
+      if (spl->cfg.use_stats) {
+         spl->stats[tid].branch_lookups[height]++;
+      }
+      if (local_found) {
+         message msg = merge_accumulator_to_message(data);
+         if (message_is_definitive(msg)) {
+            return FALSE;
+         }
+      } else if (spl->cfg.use_stats) {
+         spl->stats[tid].filter_false_positives[height]++;
+      }
+      next_value = routing_filter_get_next_value(found_values, next_value);
+   }
+   return TRUE;
+}
+
+bool32
+trunk_compacted_subbundle_lookup(trunk_handle      *spl,
+                                 trunk_node        *node,
+                                 trunk_subbundle   *sb,
+                                 key                target,
+                                 uint64             cover_epoch,
+                                 merge_accumulator *data)
+{
+   debug_assert(sb->state == SB_STATE_COMPACTED);
+   debug_assert(trunk_subbundle_branch_count(spl, node, sb) == 1);
+   uint16   height;
+   threadid tid;
+   if (spl->cfg.use_stats) {
+      tid    = platform_get_tid();
+      height = trunk_node_height(node);
+   }
+
+   uint16 filter_count = trunk_subbundle_filter_count(spl, node, sb);
+   for (uint16 filter_no = 0; filter_no != filter_count; filter_no++) {
       if (spl->cfg.use_stats) {
          spl->stats[tid].filter_lookups[height]++;
       }
@@ -6794,8 +8053,12 @@ trunk_compacted_subbundle_lookup(trunk_handle      *spl,
          spl->cc, &spl->cfg.filter_cfg, filter, target, &found_values);
       platform_assert_status_ok(rc);
       if (found_values) {
-         uint16          branch_no = sb->start_branch;
-         trunk_branch   *branch    = trunk_get_branch(spl, node, branch_no);
+         uint16        branch_no = sb->start_branch;
+         trunk_branch *branch    = trunk_get_branch(spl, node, branch_no);
+         if (branch->epoch < cover_epoch) {
+            trunk_merge_range_delete(spl, target, data);
+            return FALSE;
+         }
          bool32          local_found;
          platform_status rc;
          rc = trunk_btree_lookup_and_merge(
@@ -6818,146 +8081,1133 @@ trunk_compacted_subbundle_lookup(trunk_handle      *spl,
    return TRUE;
 }
 
-bool32
-trunk_bundle_lookup(trunk_handle      *spl,
-                    trunk_node        *node,
-                    trunk_bundle      *bundle,
-                    key                target,
-                    merge_accumulator *data)
-{
-   uint16 sb_count = trunk_bundle_subbundle_count(spl, node, bundle);
-   for (uint16 sb_off = 0; sb_off != sb_count; sb_off++) {
-      uint16 sb_no = trunk_subtract_subbundle_number(
-         spl, bundle->end_subbundle, sb_off + 1);
-      trunk_subbundle *sb = trunk_get_subbundle(spl, node, sb_no);
-      bool32           should_continue;
-      if (sb->state == SB_STATE_COMPACTED) {
-         should_continue =
-            trunk_compacted_subbundle_lookup(spl, node, sb, target, data);
+bool32
+trunk_bundle_lookup(trunk_handle      *spl,
+                    trunk_node        *node,
+                    trunk_bundle      *bundle,
+                    key                target,
+                    uint64             cover_epoch,
+                    merge_accumulator *data)
+{
+   uint16 sb_count = trunk_bundle_subbundle_count(spl, node, bundle);
+   for (uint16 sb_off = 0; sb_off != sb_count; sb_off++) {
+      uint16 sb_no = trunk_subtract_subbundle_number(
+         spl, bundle->end_subbundle, sb_off + 1);
+      trunk_subbundle *sb = trunk_get_subbundle(spl, node, sb_no);
+      bool32           should_continue;
+      if (sb->state == SB_STATE_COMPACTED) {
+         should_continue = trunk_compacted_subbundle_lookup(
+            spl, node, sb, target, cover_epoch, data);
+      } else {
+         routing_filter *filter = trunk_subbundle_filter(spl, node, sb, 0);
+         routing_config *cfg    = &spl->cfg.filter_cfg;
+         debug_assert(filter->addr != 0);
+         should_continue = trunk_filter_lookup(spl,
+                                               node,
+                                               filter,
+                                               cfg,
+                                               sb->start_branch,
+                                               target,
+                                               cover_epoch,
+                                               data);
+      }
+      if (!should_continue) {
+         return should_continue;
+      }
+   }
+   return TRUE;
+}
+
+bool32
+trunk_pivot_lookup(trunk_handle      *spl,
+                   trunk_node        *node,
+                   trunk_pivot_data  *pdata,
+                   key                target,
+                   uint64             cover_epoch,
+                   merge_accumulator *data)
+{
+   // first check in bundles
+   uint16 num_bundles = trunk_pivot_bundle_count(spl, node, pdata);
+   for (uint16 bundle_off = 0; bundle_off != num_bundles; bundle_off++) {
+      uint16 bundle_no = trunk_subtract_bundle_number(
+         spl, trunk_end_bundle(spl, node), bundle_off + 1);
+      debug_assert(trunk_bundle_live(spl, node, bundle_no));
+      trunk_bundle *bundle = trunk_get_bundle(spl, node, bundle_no);
+      bool32        should_continue =
+         trunk_bundle_lookup(spl, node, bundle, target, cover_epoch, data);
+      if (!should_continue) {
+         return should_continue;
+      }
+   }
+
+   routing_config *cfg = &spl->cfg.filter_cfg;
+   return trunk_filter_lookup(spl,
+                              node,
+                              &pdata->filter,
+                              cfg,
+                              pdata->start_branch,
+                              target,
+                              cover_epoch,
+                              data);
+}
+
+/*
+ * Look up target in the trunk tree below node, accumulating into result.
+ * The messages in branches older than cover_epoch are deleted by a range
+ * delete. Releases node.
+ */
+static void
+trunk_lookup_in_tree(trunk_handle      *spl,
+                     trunk_node        *root,
+                     key                target,
+                     uint64             cover_epoch,
+                     merge_accumulator *result)
+{
+   trunk_node node = *root;
+
+   // look in index nodes
+   uint16 height = trunk_node_height(&node);
+   for (uint16 h = height; h > 0; h--) {
+      uint16 pivot_no =
+         trunk_find_pivot(spl, &node, target, less_than_or_equal);
+      debug_assert(pivot_no < trunk_num_children(spl, &node));
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
+      bool32            should_continue =
+         trunk_pivot_lookup(spl, &node, pdata, target, cover_epoch, result);
+      if (!should_continue) {
+         goto found_final_answer_early;
+      }
+      trunk_node child;
+      trunk_node_get(spl->cc, pdata->addr, &child);
+      trunk_node_unget(spl->cc, &node);
+      node = child;
+   }
+
+   // look in leaf
+   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
+   bool32            should_continue =
+      trunk_pivot_lookup(spl, &node, pdata, target, cover_epoch, result);
+   if (!should_continue) {
+      goto found_final_answer_early;
+   }
+
+   debug_assert(merge_accumulator_is_null(result)
+                || merge_accumulator_message_class(result)
+                      == MESSAGE_TYPE_UPDATE);
+   if (!merge_accumulator_is_null(result)) {
+      data_merge_tuples_final(spl->cfg.data_cfg, target, result);
+   }
+found_final_answer_early:
+   trunk_node_unget(spl->cc, &node);
+}
+
+/*
+ * Looks target up as trunk_lookup does, leaving deletes and messages with
+ * their value in the value log in result.
+ */
+static void
+trunk_lookup_unresolved(trunk_handle      *spl,
+                        key                target,
+                        merge_accumulator *result)
+{
+   // look in memtables
+
+   // 1. get read lock on lookup lock
+   //     --- 2. for [mt_no = mt->generation..mt->gen_to_incorp]
+   // 2. for gen = mt->generation; mt[gen % ...].gen == gen; gen --;
+   //                also handles switch to READY ^^^^^
+
+   merge_accumulator_set_to_null(result);
+
+   memtable_begin_lookup(spl->mt_ctxt);
+   uint64 mt_gen_start = memtable_generation(spl->mt_ctxt);
+   uint64 mt_gen_end   = memtable_generation_retired(spl->mt_ctxt);
+   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
+   uint64 cover_epoch =
+      trunk_range_delete_cover(spl, target, trunk_num_range_deletes(spl));
+
+   for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
+      if (cover_epoch != 0 && trunk_memtable_epoch(spl, mt_gen) < cover_epoch)
+      {
+         trunk_merge_range_delete(spl, target, result);
+         memtable_end_lookup(spl->mt_ctxt);
+         goto found_final_answer_early;
+      }
+      platform_status rc;
+      rc = trunk_memtable_lookup(spl, mt_gen, target, result);
+      platform_assert_status_ok(rc);
+      if (merge_accumulator_is_definitive(result)) {
+         // release memtable lookup lock
+         memtable_end_lookup(spl->mt_ctxt);
+         goto found_final_answer_early;
+      }
+   }
+
+   trunk_node node;
+   trunk_root_get(spl, &node);
+
+   // release memtable lookup lock
+   memtable_end_lookup(spl->mt_ctxt);
+
+   trunk_lookup_in_tree(spl, &node, target, cover_epoch, result);
+
+found_final_answer_early:
+   return;
+}
+
+// If any change is made in here, please make similar change in
+// trunk_lookup_async
+platform_status
+trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result)
+{
+   timestamp ts = 0;
+   if (spl->cfg.use_stats) {
+      ts = platform_get_timestamp();
+   }
+
+   if (spl->vlog != NULL) {
+      value_log_begin_read(spl->vlog);
+   }
+
+   trunk_lookup_unresolved(spl, target, result);
+
+   if (spl->cfg.use_stats) {
+      threadid tid = platform_get_tid();
+      if (!merge_accumulator_is_null(result)) {
+         spl->stats[tid].lookups_found++;
+      } else {
+         spl->stats[tid].lookups_not_found++;
+      }
+   }
+
+   /* Normalize DELETE messages to return a null merge_accumulator */
+   if (!merge_accumulator_is_null(result)
+       && merge_accumulator_message_class(result) == MESSAGE_TYPE_DELETE)
+   {
+      merge_accumulator_set_to_null(result);
+   }
+
+   platform_status rc = STATUS_OK;
+   if (spl->vlog != NULL) {
+      rc = trunk_value_log_resolve(spl, result);
+      value_log_end_read(spl->vlog);
+   }
+
+   trunk_record_latency(spl, TRUNK_LATENCY_LOOKUP, ts);
+   return rc;
+}
+
+/*
+ * Copies the value of the record at ref to the head of the value log, if
+ * it is still the value of tuple_key, and inserts the new ref.
+ */
+static platform_status
+trunk_value_log_copy(trunk_handle        *spl,
+                     key                  tuple_key,
+                     const value_log_ref *ref,
+                     merge_accumulator   *result)
+{
+   platform_batch_rwlock_get(&spl->value_log_lock, TRUNK_VALUE_LOG_LOCK_IDX);
+   platform_batch_rwlock_claim_loop(&spl->value_log_lock,
+                                    TRUNK_VALUE_LOG_LOCK_IDX);
+   platform_batch_rwlock_lock(&spl->value_log_lock, TRUNK_VALUE_LOG_LOCK_IDX);
+
+   platform_status rc = STATUS_OK;
+   trunk_lookup_unresolved(spl, tuple_key, result);
+   if (!merge_accumulator_is_null(result)
+       && merge_accumulator_message_class(result)
+             == MESSAGE_TYPE_INSERT_INDIRECT)
+   {
+      value_log_ref curr =
+         value_log_message_ref(merge_accumulator_to_message(result));
+      if (curr.addr == ref->addr && curr.id == ref->id) {
+         rc = trunk_value_log_resolve(spl, result);
+         if (SUCCESS(rc)) {
+            value_log_ref new_ref;
+            message       msg = merge_accumulator_to_message(result);
+            rc = trunk_value_log_separate(spl, tuple_key, &msg, &new_ref);
+            if (SUCCESS(rc)) {
+               rc = trunk_memtable_insert(spl, tuple_key, msg);
+            }
+         }
+      }
+   }
+
+   platform_batch_rwlock_full_unlock(&spl->value_log_lock,
+                                     TRUNK_VALUE_LOG_LOCK_IDX);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_value_log_gc --
+ *
+ *      Collects the extents of the value log with enough garbage, or with
+ *      all every extent but the head: the values the table still refers to
+ *      are copied to the head, and the extents retired, to be freed once no
+ *      reader or snapshot can refer to them. Runs on the inserting thread
+ *      when a compaction finds an extent with enough garbage.
+ *
+ * Results:
+ *      STATUS_OK, or the error that stopped the collection.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+trunk_value_log_gc(trunk_handle *spl, bool32 all)
+{
+   value_log *vlog = spl->vlog;
+   if (vlog == NULL) {
+      return STATUS_OK;
+   }
+
+   uint64 *slots = TYPED_ARRAY_MALLOC(spl->heap_id, slots, 2 * vlog->max_slots);
+   if (slots == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   key_buffer        tuple_key;
+   merge_accumulator result;
+   key_buffer_init(&tuple_key, spl->heap_id);
+   merge_accumulator_init(&result, spl->heap_id);
+
+   // One collection at a time, and none while a checkpoint writes the
+   // directory
+   platform_mutex_lock(&spl->checkpoint_lock);
+   value_log_reclaim(vlog);
+   platform_status rc  = STATUS_OK;
+   uint64          num = value_log_gc_candidates(vlog, all, slots);
+   for (uint64 i = 0; i < num && SUCCESS(rc); i++) {
+      uint64 used   = value_log_extent_used(vlog, slots[i]);
+      uint64 offset = 0;
+      while (offset < used && SUCCESS(rc)) {
+         value_log_ref ref;
+         rc = value_log_read_record(vlog, slots[i], &offset, &tuple_key, &ref);
+         if (SUCCESS(rc)) {
+            rc = trunk_value_log_copy(
+               spl, key_buffer_key(&tuple_key), &ref, &result);
+         }
+      }
+      if (SUCCESS(rc)) {
+         value_log_retire(vlog, slots[i]);
+      }
+   }
+   value_log_reclaim(vlog);
+   platform_mutex_unlock(&spl->checkpoint_lock);
+
+   merge_accumulator_deinit(&result);
+   key_buffer_deinit(&tuple_key);
+   platform_free(spl->heap_id, slots);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Snapshots
+ *
+ * Trunk nodes are copied on write and never deallocated while the trunk is
+ * mounted, so an old root still describes the tree as it was when that root
+ * was current. What an old root does not keep alive are the branches and
+ * filters it points to: once its nodes have been replaced, compactions
+ * release those references.
+ *
+ * A snapshot therefore takes its own reference on every branch range and
+ * filter reachable from its root, exactly the set trunk_node_destroy drops,
+ * and releases them when it is released. Compactions carry on as usual;
+ * what they replace simply stays allocated until the snapshot goes away.
+ *
+ * Memtables are not pinned: creating a snapshot rotates the live memtable
+ * and waits for all older memtables to be incorporated, so the root alone
+ * covers everything inserted before the call.
+ *-----------------------------------------------------------------------------
+ */
+
+static inline void
+trunk_node_inc_refs(trunk_handle *spl, trunk_node *node)
+{
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+      if (pdata->filter.addr != 0) {
+         trunk_inc_filter(spl, &pdata->filter);
+      }
+      for (uint16 branch_no = pdata->start_branch;
+           branch_no != trunk_end_branch(spl, node);
+           branch_no = trunk_add_branch_number(spl, branch_no, 1))
+      {
+         trunk_branch *branch    = trunk_get_branch(spl, node, branch_no);
+         key           start_key = trunk_get_pivot(spl, node, pivot_no);
+         key           end_key   = trunk_get_pivot(spl, node, pivot_no + 1);
+
+         trunk_inc_branch_range(spl, branch, start_key, end_key);
+      }
+   }
+   uint16 start_filter = trunk_start_sb_filter(spl, node);
+   uint16 end_filter   = trunk_end_sb_filter(spl, node);
+   for (uint16 filter_no = start_filter; filter_no != end_filter; filter_no++) {
+      routing_filter *filter = trunk_get_sb_filter(spl, node, filter_no);
+      if (filter->addr != 0) {
+         trunk_inc_filter(spl, filter);
+      }
+   }
+}
+
+/*
+ * Inverse of trunk_node_inc_refs. Also drops the references a node holds
+ * when the trunk is destroyed.
+ */
+static inline void
+trunk_node_dec_refs(trunk_handle *spl, trunk_node *node)
+{
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+      if (pdata->filter.addr != 0) {
+         trunk_dec_filter(spl, &pdata->filter);
+      }
+      for (uint16 branch_no = pdata->start_branch;
+           branch_no != trunk_end_branch(spl, node);
+           branch_no = trunk_add_branch_number(spl, branch_no, 1))
+      {
+         trunk_branch *branch    = trunk_get_branch(spl, node, branch_no);
+         key           start_key = trunk_get_pivot(spl, node, pivot_no);
+         key           end_key   = trunk_get_pivot(spl, node, pivot_no + 1);
+
+         trunk_zap_branch_range(
+            spl, branch, start_key, end_key, PAGE_TYPE_BRANCH);
+      }
+   }
+   uint16 start_filter = trunk_start_sb_filter(spl, node);
+   uint16 end_filter   = trunk_end_sb_filter(spl, node);
+   for (uint16 filter_no = start_filter; filter_no != end_filter; filter_no++) {
+      routing_filter *filter = trunk_get_sb_filter(spl, node, filter_no);
+      trunk_dec_filter(spl, filter);
+   }
+}
+
+/*
+ * Takes references for the subtree below node, top down. The caller holds a
+ * read lock on the subtree's root throughout, and garbage collection of a
+ * replaced path write-locks it hand-over-hand from the old root, so none of
+ * these references can be released before we have taken ours.
+ */
+static void
+trunk_snapshot_inc_ref_subtree(trunk_handle *spl, trunk_node *node)
+{
+   trunk_node_inc_refs(spl, node);
+   if (trunk_node_is_leaf(node)) {
+      return;
+   }
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+      trunk_node        child;
+      trunk_node_get(spl->cc, pdata->addr, &child);
+      trunk_snapshot_inc_ref_subtree(spl, &child);
+      trunk_node_unget(spl->cc, &child);
+   }
+}
+
+static bool32
+trunk_snapshot_dec_ref_node(trunk_handle *spl, uint64 addr, void *arg)
+{
+   trunk_node node;
+   trunk_node_get(spl->cc, addr, &node);
+   trunk_node_dec_refs(spl, &node);
+   trunk_node_unget(spl->cc, &node);
+   return TRUE;
+}
+
+/*
+ * Closes off the live memtable and waits until it and every memtable before
+ * it have been incorporated into the trunk.
+ */
+static platform_status
+trunk_incorporate_memtables(trunk_handle *spl)
+{
+   // Close off the live memtable, so it will be incorporated into the root
+   uint64          generation;
+   platform_status rc = memtable_try_rotate(spl->mt_ctxt, &generation);
+   while (STATUS_IS_EQ(rc, STATUS_BUSY)) {
+      // Memtable isn't ready, do a task if available; may be required to
+      // incorporate memtable that we're waiting on
+      task_perform_one_if_needed(spl->ts, 0);
+      rc = memtable_try_rotate(spl->mt_ctxt, &generation);
+   }
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   // Wait for every generation before it to be incorporated
+   uint64 wait = 1;
+   while (TRUE) {
+      memtable_begin_lookup(spl->mt_ctxt);
+      uint64 generation_retired = memtable_generation_retired(spl->mt_ctxt);
+      memtable_end_lookup(spl->mt_ctxt);
+      if (generation_retired + 1 >= generation) {
+         break;
+      }
+      rc = task_perform_one(spl->ts);
+      if (STATUS_IS_EQ(rc, STATUS_TIMEDOUT)) {
+         platform_sleep_ns(wait);
+         wait = wait > 2048 ? wait : 2 * wait;
+      }
+   }
+   return STATUS_OK;
+}
+
+/*
+ * Pin a point-in-time view of the trunk. Every insert that completed before
+ * the call is visible through *root_addr, nothing after it is. Likewise only
+ * the first *num_range_deletes range deletes apply to the snapshot.
+ *
+ * Not supported with space reclamation enabled, which compacts nodes in
+ * place rather than copying them.
+ */
+platform_status
+trunk_snapshot_create(trunk_handle *spl,
+                      uint64       *root_addr,
+                      uint64       *num_range_deletes)
+{
+   if (spl->cfg.reclaim_threshold != UINT64_MAX) {
+      return STATUS_NOTSUP;
+   }
+
+   // Keeps the value log from freeing what the snapshot refers to
+   if (spl->vlog != NULL) {
+      value_log_pin(spl->vlog);
+   }
+
+   platform_status rc = trunk_incorporate_memtables(spl);
+   if (!SUCCESS(rc)) {
+      if (spl->vlog != NULL) {
+         value_log_unpin(spl->vlog);
+      }
+      return rc;
+   }
+
+   // No compaction may have applied a range delete the snapshot does not see
+   trunk_node root;
+   platform_mutex_lock(&spl->range_delete_lock);
+   *num_range_deletes = spl->num_range_deletes;
+   trunk_root_get(spl, &root);
+   platform_mutex_unlock(&spl->range_delete_lock);
+   trunk_snapshot_inc_ref_subtree(spl, &root);
+   *root_addr = root.addr;
+   trunk_node_unget(spl->cc, &root);
+   return STATUS_OK;
+}
+
+void
+trunk_snapshot_release(trunk_handle *spl, uint64 root_addr)
+{
+   trunk_for_each_subtree(spl, root_addr, trunk_snapshot_dec_ref_node, NULL);
+   if (spl->vlog != NULL) {
+      value_log_unpin(spl->vlog);
+   }
+}
+
+/*
+ * Makes every insert that completed before the call durable without
+ * unmounting, while inserts and lookups go on. After a crash, trunk_mount
+ * recovers the latest checkpoint and replays only the log written since.
+ *
+ * 1. Starts a new log. The super block on disk still refers to the previous
+ *    one until step 5, so commits to the new log wait for the checkpoint.
+ * 2. Incorporates every memtable written to the previous log.
+ * 3. Blocks inserts and waits for the flushes and compactions under way to
+ *    finish, as pending work is not persisted. Then captures the root, the
+ *    number of range deletes, the tail of the trunk mini allocator and an
+ *    image of the ref counts, before any memtable or log extent is
+ *    allocated, and writes the directory of the value log. The root is then
+ *    pinned like a snapshot, so its extents are not freed before they are
+ *    written.
+ * 4. Writes ref counts covering both the previous and the new image, then
+ *    every dirty page.
+ * 5. Writes a super block referring to the captured state and the new log,
+ *    then the exact ref counts.
+ * 6. Releases the pin and the logs the previous super block referred to.
+ *
+ * Not supported with space reclamation enabled, as for snapshots.
+ */
+platform_status
+trunk_checkpoint(trunk_handle *spl)
+{
+   if (spl->cfg.reclaim_threshold != UINT64_MAX) {
+      return STATUS_NOTSUP;
+   }
+
+   platform_mutex_lock(&spl->checkpoint_lock);
+
+   if (spl->cfg.use_log) {
+      log_handle *log = log_create(spl->cc, spl->cfg.log_cfg, spl->heap_id);
+      memtable_block_inserts(spl->mt_ctxt);
+      spl->checkpoint_prev_log = spl->log;
+      spl->log                 = log;
+      memtable_unblock_inserts(spl->mt_ctxt);
+   }
+
+   platform_status rc = trunk_incorporate_memtables(spl);
+   platform_assert_status_ok(rc);
+
+   /*
+    * A memtable rotated just before inserts were blocked may not have been
+    * enqueued for incorporation yet, so wait for it too.
+    */
+   memtable_block_inserts(spl->mt_ctxt);
+   do {
+      rc = task_perform_until_quiescent(spl->ts);
+      platform_assert_status_ok(rc);
+   } while (memtable_generation_retired(spl->mt_ctxt) + 1
+            != memtable_generation(spl->mt_ctxt));
+
+   trunk_checkpoint_state state;
+   trunk_node             root;
+   state.log_replay_generation = memtable_generation(spl->mt_ctxt);
+   state.num_range_deletes     = spl->num_range_deletes;
+   trunk_root_get(spl, &root);
+   state.root_addr = root.addr;
+   mini_unkeyed_tail_position(
+      &spl->mini, &state.meta_tail, &state.meta_tail_num_entries);
+   if (spl->vlog != NULL) {
+      value_log_checkpoint_begin(spl->vlog, &state.value_log);
+   } else {
+      ZERO_STRUCT(state.value_log);
+   }
+   rc = allocator_checkpoint_capture(spl->al);
+   if (spl->vlog != NULL) {
+      value_log_checkpoint_end(spl->vlog);
+   }
+   memtable_unblock_inserts(spl->mt_ctxt);
+   platform_assert_status_ok(rc);
+
+   trunk_snapshot_inc_ref_subtree(spl, &root);
+   trunk_node_unget(spl->cc, &root);
+
+   rc = allocator_checkpoint_prepare(spl->al);
+   platform_assert_status_ok(rc);
+   cache_flush_online(spl->cc);
+   rc = cache_device_sync(spl->cc);
+   platform_assert_status_ok(rc);
+
+   trunk_set_super_block(spl, &state, FALSE, FALSE);
+   rc = cache_device_sync(spl->cc);
+   platform_assert_status_ok(rc);
+   rc = allocator_checkpoint_commit(spl->al);
+   platform_assert_status_ok(rc);
+
+   trunk_for_each_subtree(
+      spl, state.root_addr, trunk_snapshot_dec_ref_node, NULL);
+   if (spl->checkpoint_prev_log != NULL) {
+      shard_log_zap((shard_log *)spl->checkpoint_prev_log);
+      platform_free(spl->heap_id, spl->checkpoint_prev_log);
+      spl->checkpoint_prev_log = NULL;
+   }
+   shard_log_release_extents(spl->cc,
+                             spl->heap_id,
+                             spl->replayed_log_extents,
+                             spl->num_replayed_log_extents);
+   spl->replayed_log_extents     = NULL;
+   spl->num_replayed_log_extents = 0;
+
+   platform_mutex_unlock(&spl->checkpoint_lock);
+   return STATUS_OK;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * Bulk load
+ *
+ * trunk_bulk_load builds the trunk of an empty table bottom up from a sorted
+ * stream, writing each tuple once. The stream is cut into runs of about
+ * target_leaf_kv_bytes, each packed straight into the single whole branch of
+ * a new leaf, whose filter is built from the fingerprints btree_pack
+ * returns. Index nodes of up to fanout children are then stacked over the
+ * leaves, and the new trunk is switched in with its root, so readers see
+ * either none or all of it.
+ *-----------------------------------------------------------------------------
+ */
+
+/*
+ * Feeds btree_pack the tuples of one run, up to max_tuples or about
+ * max_kv_bytes of them, and checks that the stream is in strictly increasing
+ * key order. Only steps forward, as btree_pack does.
+ */
+typedef struct trunk_bulk_load_run_iterator {
+   iterator      super;
+   trunk_handle *spl;
+   iterator     *source;
+   key_buffer    prev_key;
+   uint64        max_tuples;
+   uint64        max_kv_bytes;
+   uint64        num_tuples;
+   uint64        kv_bytes;
+} trunk_bulk_load_run_iterator;
+
+static void
+trunk_bulk_load_run_iterator_curr(iterator *itor, key *curr_key, message *msg)
+{
+   trunk_bulk_load_run_iterator *run_itor =
+      (trunk_bulk_load_run_iterator *)itor;
+   iterator_curr(run_itor->source, curr_key, msg);
+}
+
+static bool32
+trunk_bulk_load_run_iterator_can_next(iterator *itor)
+{
+   trunk_bulk_load_run_iterator *run_itor =
+      (trunk_bulk_load_run_iterator *)itor;
+   return run_itor->num_tuples < run_itor->max_tuples
+          && run_itor->kv_bytes < run_itor->max_kv_bytes
+          && iterator_can_next(run_itor->source);
+}
+
+static platform_status
+trunk_bulk_load_run_iterator_next(iterator *itor)
+{
+   trunk_bulk_load_run_iterator *run_itor =
+      (trunk_bulk_load_run_iterator *)itor;
+   trunk_handle *spl = run_itor->spl;
+
+   key     curr_key;
+   message msg;
+   iterator_curr(run_itor->source, &curr_key, &msg);
+   run_itor->num_tuples++;
+   run_itor->kv_bytes += key_length(curr_key) + message_length(msg);
+   platform_status rc = key_buffer_copy_key(&run_itor->prev_key, curr_key);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   rc = iterator_next(run_itor->source);
+   if (!SUCCESS(rc) || !iterator_can_next(run_itor->source)) {
+      return rc;
+   }
+   iterator_curr(run_itor->source, &curr_key, &msg);
+   if (trunk_max_key_size(spl) < key_length(curr_key)
+       || trunk_key_compare(spl, key_buffer_key(&run_itor->prev_key), curr_key)
+             >= 0)
+   {
+      return STATUS_BAD_PARAM;
+   }
+   return STATUS_OK;
+}
+
+const static iterator_ops trunk_bulk_load_run_iterator_ops = {
+   .curr     = trunk_bulk_load_run_iterator_curr,
+   .can_next = trunk_bulk_load_run_iterator_can_next,
+   .next     = trunk_bulk_load_run_iterator_next,
+};
+
+/*
+ * Returns TRUE if the table holds nothing: no memtable has taken an insert
+ * since the last one was incorporated, and the trunk is still the single
+ * empty leaf trunk_create builds.
+ */
+static bool32
+trunk_is_empty(trunk_handle *spl, trunk_node *root)
+{
+   if (!memtable_is_empty(spl->mt_ctxt)
+       || memtable_generation_retired(spl->mt_ctxt) + 1
+             != memtable_generation(spl->mt_ctxt)
+       || trunk_node_height(root) != 1 || trunk_num_children(spl, root) != 1
+       || trunk_branch_count(spl, root) != 0)
+   {
+      return FALSE;
+   }
+   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, root, 0);
+   trunk_node        leaf;
+   trunk_node_get(spl->cc, pdata->addr, &leaf);
+   bool32 is_empty = trunk_branch_count(spl, &leaf) == 0;
+   trunk_node_unget(spl->cc, &leaf);
+   return is_empty;
+}
+
+/*
+ * Builds a leaf for [min_key, max_key) whose only branch is the one req
+ * packed, as a whole branch with the given filter. Returns its address.
+ */
+static uint64
+trunk_bulk_load_build_leaf(trunk_handle   *spl,
+                           key             min_key,
+                           key             max_key,
+                           btree_pack_req *req,
+                           routing_filter *filter)
+{
+   trunk_node leaf;
+   trunk_alloc(spl->cc, &spl->mini, 0, &leaf);
+   memset(leaf.hdr, 0, trunk_page_size(&spl->cfg));
+   trunk_set_initial_pivots(spl, &leaf);
+   trunk_inc_pivot_generation(spl, &leaf);
+   trunk_set_pivot(spl, &leaf, 1, max_key);
+   trunk_set_pivot(spl, &leaf, 0, min_key);
+
+   trunk_branch *branch = trunk_get_new_branch(spl, &leaf);
+   branch->root_addr    = req->root_addr;
+   branch->epoch        = trunk_num_range_deletes(spl);
+   trunk_reset_start_frac_branch(spl, &leaf);
+
+   trunk_pivot_data *pdata   = trunk_get_pivot_data(spl, &leaf, 0);
+   pdata->filter             = *filter;
+   pdata->num_tuples_whole   = req->num_tuples;
+   pdata->num_kv_bytes_whole = req->key_bytes + req->message_bytes;
+
+   debug_assert(trunk_verify_node(spl, &leaf));
+   uint64 addr = leaf.addr;
+   trunk_node_unlock(spl->cc, &leaf);
+   trunk_node_unclaim(spl->cc, &leaf);
+   trunk_node_unget(spl->cc, &leaf);
+   return addr;
+}
+
+/*
+ * Sets up node, write locked by the caller, as an index node of the given
+ * height over the num_children nodes at child_addr, in key order.
+ */
+static void
+trunk_bulk_load_init_index(trunk_handle *spl,
+                           trunk_node   *node,
+                           uint16        height,
+                           const uint64 *child_addr,
+                           uint64        num_children)
+{
+   debug_assert(num_children != 0 && num_children <= spl->cfg.fanout);
+   memset(node->hdr, 0, trunk_page_size(&spl->cfg));
+   node->hdr->height = height;
+   trunk_set_initial_pivots(spl, node);
+   trunk_inc_pivot_generation(spl, node);
+
+   for (uint64 child_no = 0; child_no < num_children; child_no++) {
+      trunk_node child;
+      trunk_node_get(spl->cc, child_addr[child_no], &child);
+      debug_assert(trunk_node_height(&child) + 1 == height);
+      if (child_no == 0) {
+         trunk_set_pivot_data_new_root(spl, node, child.addr);
+         trunk_set_pivot(spl, node, 0, trunk_min_key(spl, &child));
       } else {
-         routing_filter *filter = trunk_subbundle_filter(spl, node, sb, 0);
-         routing_config *cfg    = &spl->cfg.filter_cfg;
-         debug_assert(filter->addr != 0);
-         should_continue = trunk_filter_lookup(
-            spl, node, filter, cfg, sb->start_branch, target, data);
+         platform_status rc = trunk_add_pivot(spl, node, &child, child_no);
+         platform_assert_status_ok(rc);
       }
-      if (!should_continue) {
-         return should_continue;
+      if (child_no + 1 == num_children) {
+         trunk_set_pivot(spl, node, num_children, trunk_max_key(spl, &child));
       }
+      trunk_node_unget(spl->cc, &child);
    }
-   return TRUE;
 }
 
-bool32
-trunk_pivot_lookup(trunk_handle      *spl,
-                   trunk_node        *node,
-                   trunk_pivot_data  *pdata,
-                   key                target,
-                   merge_accumulator *data)
+/*
+ * Drops the references held by the subtrees at the num_nodes addresses in
+ * addr, built by a bulk load which did not complete.
+ */
+static void
+trunk_bulk_load_abort(trunk_handle *spl, const uint64 *addr, uint64 num_nodes)
 {
-   // first check in bundles
-   uint16 num_bundles = trunk_pivot_bundle_count(spl, node, pdata);
-   for (uint16 bundle_off = 0; bundle_off != num_bundles; bundle_off++) {
-      uint16 bundle_no = trunk_subtract_bundle_number(
-         spl, trunk_end_bundle(spl, node), bundle_off + 1);
-      debug_assert(trunk_bundle_live(spl, node, bundle_no));
-      trunk_bundle *bundle = trunk_get_bundle(spl, node, bundle_no);
-      bool32        should_continue =
-         trunk_bundle_lookup(spl, node, bundle, target, data);
-      if (!should_continue) {
-         return should_continue;
-      }
+   for (uint64 node_no = 0; node_no < num_nodes; node_no++) {
+      trunk_for_each_subtree(
+         spl, addr[node_no], trunk_snapshot_dec_ref_node, NULL);
    }
-
-   routing_config *cfg = &spl->cfg.filter_cfg;
-   return trunk_filter_lookup(
-      spl, node, &pdata->filter, cfg, pdata->start_branch, target, data);
 }
 
-// If any change is made in here, please make similar change in
-// trunk_lookup_async
+/*
+ * Loads the tuples of itor, which must be in strictly increasing key order,
+ * into an empty table. See "Bulk load" above.
+ *
+ * Returns STATUS_INVALID_STATE if the table is not empty, STATUS_BAD_PARAM
+ * if the keys are out of order or too long, or the error itor returned. The
+ * table is left unchanged on error.
+ *
+ * Must not run concurrently with other writes. The tuples are not logged;
+ * they persist with the next checkpoint or unmount.
+ */
 platform_status
-trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result)
+trunk_bulk_load(trunk_handle *spl, iterator *itor)
 {
-   // look in memtables
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   bool32 is_empty = trunk_is_empty(spl, &root);
+   trunk_node_unget(spl->cc, &root);
+   if (!is_empty) {
+      return STATUS_INVALID_STATE;
+   }
+   if (!iterator_can_next(itor)) {
+      return STATUS_OK;
+   }
+   key     first_key;
+   message msg;
+   iterator_curr(itor, &first_key, &msg);
+   if (trunk_max_key_size(spl) < key_length(first_key)) {
+      return STATUS_BAD_PARAM;
+   }
 
-   // 1. get read lock on lookup lock
-   //     --- 2. for [mt_no = mt->generation..mt->gen_to_incorp]
-   // 2. for gen = mt->generation; mt[gen % ...].gen == gen; gen --;
-   //                also handles switch to READY ^^^^^
+   trunk_bulk_load_run_iterator run_itor = {
+      .super  = {.ops = &trunk_bulk_load_run_iterator_ops},
+      .spl    = spl,
+      .source       = itor,
+      .max_tuples   = spl->cfg.max_tuples_per_node,
+      .max_kv_bytes = spl->cfg.target_leaf_kv_bytes,
+   };
+   key_buffer_init(&run_itor.prev_key, spl->heap_id);
+   key_buffer min_key, max_key;
+   key_buffer_init_from_key(&min_key, spl->heap_id, NEGATIVE_INFINITY_KEY);
+   key_buffer_init(&max_key, spl->heap_id);
+   writable_buffer nodes;
+   writable_buffer_init(&nodes, spl->heap_id);
 
-   merge_accumulator_set_to_null(result);
+   /*
+    * 1. Pack the leaves, each of which starts at the first key of its run,
+    *    except for the first, which covers all smaller keys too.
+    */
+   platform_status rc = STATUS_OK;
+   while (iterator_can_next(itor)) {
+      run_itor.num_tuples = 0;
+      run_itor.kv_bytes   = 0;
+      btree_pack_req req;
+      rc = btree_pack_req_init(&req,
+                               spl->cc,
+                               &spl->cfg.btree_cfg,
+                               &run_itor.super,
+                               spl->cfg.max_tuples_per_node,
+                               spl->cfg.filter_cfg.hash,
+                               spl->cfg.filter_cfg.seed,
+                               spl->heap_id);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+      rc = btree_pack(&req);
+      if (!SUCCESS(rc)) {
+         btree_pack_req_deinit(&req, spl->heap_id);
+         break;
+      }
+      platform_assert(req.num_tuples > 0);
 
-   memtable_begin_lookup(spl->mt_ctxt);
-   bool32 found_in_memtable = FALSE;
-   uint64 mt_gen_start      = memtable_generation(spl->mt_ctxt);
-   uint64 mt_gen_end        = memtable_generation_retired(spl->mt_ctxt);
-   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
+      if (iterator_can_next(itor)) {
+         key next_key;
+         iterator_curr(itor, &next_key, &msg);
+         rc = key_buffer_copy_key(&max_key, next_key);
+      } else {
+         rc = key_buffer_copy_key(&max_key, POSITIVE_INFINITY_KEY);
+      }
+      platform_assert_status_ok(rc);
 
-   for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
-      platform_status rc;
-      rc = trunk_memtable_lookup(spl, mt_gen, target, result);
+      routing_filter empty_filter = {0};
+      routing_filter filter;
+      rc = routing_filter_add(spl->cc,
+                              &spl->cfg.filter_cfg,
+                              &empty_filter,
+                              &filter,
+                              req.fingerprint_arr,
+                              req.num_tuples,
+                              0);
+      platform_assert_status_ok(rc);
+
+      uint64 leaf_addr = trunk_bulk_load_build_leaf(spl,
+                                                    key_buffer_key(&min_key),
+                                                    key_buffer_key(&max_key),
+                                                    &req,
+                                                    &filter);
+      writable_buffer_append(&nodes, sizeof(leaf_addr), &leaf_addr);
+      btree_pack_req_deinit(&req, spl->heap_id);
+
+      rc = key_buffer_copy_key(&min_key, key_buffer_key(&max_key));
       platform_assert_status_ok(rc);
-      if (merge_accumulator_is_definitive(result)) {
-         found_in_memtable = TRUE;
-         goto found_final_answer_early;
-      }
    }
+   key_buffer_deinit(&run_itor.prev_key);
+   key_buffer_deinit(&min_key);
+   key_buffer_deinit(&max_key);
 
-   trunk_node node;
-   trunk_root_get(spl, &node);
+   uint64 *addr      = writable_buffer_data(&nodes);
+   uint64  num_nodes = writable_buffer_length(&nodes) / sizeof(uint64);
+   if (!SUCCESS(rc)) {
+      goto abort;
+   }
 
-   // release memtable lookup lock
-   memtable_end_lookup(spl->mt_ctxt);
+   /*
+    * 2. Stack index nodes over them, spreading the children evenly, until
+    *    the root can take them all.
+    */
+   uint16 height = 0;
+   while (num_nodes > spl->cfg.fanout) {
+      height++;
+      uint64 num_parents = (num_nodes + spl->cfg.fanout - 1) / spl->cfg.fanout;
+      for (uint64 parent_no = 0; parent_no < num_parents; parent_no++) {
+         uint64     start = parent_no * num_nodes / num_parents;
+         uint64     end   = (parent_no + 1) * num_nodes / num_parents;
+         trunk_node parent;
+         trunk_alloc(spl->cc, &spl->mini, height, &parent);
+         trunk_bulk_load_init_index(
+            spl, &parent, height, &addr[start], end - start);
+         debug_assert(trunk_verify_node(spl, &parent));
+         // The parents are written over the front of the array in place
+         addr[parent_no] = parent.addr;
+         trunk_node_unlock(spl->cc, &parent);
+         trunk_node_unclaim(spl->cc, &parent);
+         trunk_node_unget(spl->cc, &parent);
+      }
+      num_nodes = num_parents;
+   }
 
-   // look in index nodes
-   uint16 height = trunk_node_height(&node);
-   for (uint16 h = height; h > 0; h--) {
-      uint16 pivot_no =
-         trunk_find_pivot(spl, &node, target, less_than_or_equal);
-      debug_assert(pivot_no < trunk_num_children(spl, &node));
-      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
-      bool32            should_continue =
-         trunk_pivot_lookup(spl, &node, pdata, target, result);
-      if (!should_continue) {
-         goto found_final_answer_early;
-      }
-      trunk_node child;
-      trunk_node_get(spl->cc, pdata->addr, &child);
-      trunk_node_unget(spl->cc, &node);
-      node = child;
+   /*
+    * 3. Switch in a root over the top level, unless a write got in first.
+    */
+   uint64 old_root_addr;
+   trunk_claim_and_copy_root(spl, &root, &old_root_addr);
+   is_empty = trunk_is_empty(spl, &root);
+   if (is_empty) {
+      trunk_bulk_load_init_index(spl, &root, height + 1, addr, num_nodes);
+      debug_assert(trunk_verify_node(spl, &root));
+   }
+   trunk_update_claimed_root_and_unlock(spl, &root);
+   if (!is_empty) {
+      rc = STATUS_INVALID_STATE;
+      goto abort;
    }
 
-   // look in leaf
-   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
-   bool32            should_continue =
-      trunk_pivot_lookup(spl, &node, pdata, target, result);
-   if (!should_continue) {
-      goto found_final_answer_early;
+   writable_buffer_deinit(&nodes);
+   return STATUS_OK;
+
+abort:
+   trunk_bulk_load_abort(spl, addr, num_nodes);
+   writable_buffer_deinit(&nodes);
+   return rc;
+}
+
+/*
+ * Adds one packed run to a copy of the root as a new compacted bundle, the
+ * way a memtable is incorporated, and switches the copy in. The branch takes
+ * the current range delete epoch, so the run is newer than every write and
+ * range delete before it.
+ */
+static void
+trunk_ingest_run(trunk_handle *spl, btree_pack_req *pack_req)
+{
+   trunk_compact_bundle_req *req = TYPED_ZALLOC(spl->heap_id, req);
+   req->spl                      = spl;
+   req->type                     = TRUNK_COMPACTION_TYPE_MEMTABLE;
+   req->fp_arr =
+      TYPED_ARRAY_MALLOC(spl->heap_id, req->fp_arr, pack_req->num_tuples);
+   memmove(req->fp_arr,
+           pack_req->fingerprint_arr,
+           pack_req->num_tuples * sizeof(uint32));
+
+   routing_filter empty_filter = {0};
+   routing_filter filter;
+   platform_status rc = routing_filter_add(spl->cc,
+                                           &spl->cfg.filter_cfg,
+                                           &empty_filter,
+                                           &filter,
+                                           pack_req->fingerprint_arr,
+                                           pack_req->num_tuples,
+                                           0);
+   platform_assert_status_ok(rc);
+
+   trunk_branch branch = {
+      .root_addr = pack_req->root_addr,
+      .epoch     = trunk_num_range_deletes(spl),
+   };
+
+   trunk_node new_root;
+   uint64     old_root_addr; // unused
+   trunk_claim_and_copy_root(spl, &new_root, &old_root_addr);
+   platform_assert(trunk_has_vacancy(spl, &new_root, 1));
+   trunk_install_new_compacted_subbundle(
+      spl, &new_root, &branch, &filter, req);
+   while (trunk_node_is_full(spl, &new_root)) {
+      trunk_flush_fullest(spl, &new_root);
+   }
+   if (trunk_needs_split(spl, &new_root)) {
+      trunk_split_root(spl, &new_root);
    }
+   trunk_update_claimed_root_and_unlock(spl, &new_root);
 
-   debug_assert(merge_accumulator_is_null(result)
-                || merge_accumulator_message_class(result)
-                      == MESSAGE_TYPE_UPDATE);
-   if (!merge_accumulator_is_null(result)) {
-      data_merge_tuples_final(spl->cfg.data_cfg, target, result);
+   task_enqueue(
+      spl->ts, TASK_TYPE_NORMAL, trunk_bundle_build_filters, req, TRUE);
+}
+
+/*
+ * Ingests the tuples itor yields, in strictly increasing key order. An empty
+ * table is bulk loaded (see trunk_bulk_load). Otherwise the memtables are
+ * incorporated first, and the stream is then cut into memtable-sized runs,
+ * each packed into a branch and added to the root like a memtable, so the
+ * ingested tuples are newer than every earlier write.
+ *
+ * Returns STATUS_BAD_PARAM if the keys are out of order or too long, or the
+ * error itor returned. Into a table that is not empty, the runs before the
+ * failing one remain ingested.
+ *
+ * Must not run concurrently with other writes. The tuples are not logged;
+ * they persist with the next checkpoint or unmount.
+ */
+platform_status
+trunk_ingest(trunk_handle *spl, iterator *itor)
+{
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   bool32 is_empty = trunk_is_empty(spl, &root);
+   trunk_node_unget(spl->cc, &root);
+   if (is_empty) {
+      return trunk_bulk_load(spl, itor);
    }
-found_final_answer_early:
 
-   if (found_in_memtable) {
-      // release memtable lookup lock
-      memtable_end_lookup(spl->mt_ctxt);
-   } else {
-      trunk_node_unget(spl->cc, &node);
+   platform_status rc = trunk_incorporate_memtables(spl);
+   if (!SUCCESS(rc) || !iterator_can_next(itor)) {
+      return rc;
    }
-   if (spl->cfg.use_stats) {
-      threadid tid = platform_get_tid();
-      if (!merge_accumulator_is_null(result)) {
-         spl->stats[tid].lookups_found++;
-      } else {
-         spl->stats[tid].lookups_not_found++;
+   key     first_key;
+   message msg;
+   iterator_curr(itor, &first_key, &msg);
+   if (trunk_max_key_size(spl) < key_length(first_key)) {
+      return STATUS_BAD_PARAM;
+   }
+
+   trunk_bulk_load_run_iterator run_itor = {
+      .super        = {.ops = &trunk_bulk_load_run_iterator_ops},
+      .spl          = spl,
+      .source       = itor,
+      .max_tuples   = spl->cfg.max_tuples_per_node,
+      .max_kv_bytes = spl->cfg.max_kv_bytes_per_node / spl->cfg.fanout,
+   };
+   key_buffer_init(&run_itor.prev_key, spl->heap_id);
+   while (iterator_can_next(itor)) {
+      run_itor.num_tuples = 0;
+      run_itor.kv_bytes   = 0;
+      btree_pack_req req;
+      rc = btree_pack_req_init(&req,
+                               spl->cc,
+                               &spl->cfg.btree_cfg,
+                               &run_itor.super,
+                               spl->cfg.max_tuples_per_node,
+                               spl->cfg.filter_cfg.hash,
+                               spl->cfg.filter_cfg.seed,
+                               spl->heap_id);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+      rc = btree_pack(&req);
+      if (SUCCESS(rc)) {
+         platform_assert(req.num_tuples > 0);
+         trunk_ingest_run(spl, &req);
+      }
+      btree_pack_req_deinit(&req, spl->heap_id);
+      if (!SUCCESS(rc)) {
+         break;
       }
    }
+   key_buffer_deinit(&run_itor.prev_key);
+   return rc;
+}
+
+platform_status
+trunk_snapshot_lookup(trunk_handle      *spl,
+                      uint64             root_addr,
+                      uint64             num_range_deletes,
+                      key                target,
+                      merge_accumulator *result)
+{
+   merge_accumulator_set_to_null(result);
+
+   uint64 cover_epoch =
+      trunk_range_delete_cover(spl, target, num_range_deletes);
+   trunk_node node;
+   trunk_node_get(spl->cc, root_addr, &node);
+   trunk_lookup_in_tree(spl, &node, target, cover_epoch, result);
 
    /* Normalize DELETE messages to return a null merge_accumulator */
    if (!merge_accumulator_is_null(result)
@@ -6966,6 +9216,10 @@ found_final_answer_early:
       merge_accumulator_set_to_null(result);
    }
 
+   // The snapshot pins the value log
+   if (spl->vlog != NULL) {
+      return trunk_value_log_resolve(spl, result);
+   }
    return STATUS_OK;
 }
 
@@ -7105,6 +9359,9 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
          case async_state_start:
          {
             merge_accumulator_set_to_null(result);
+            if (spl->vlog != NULL) {
+               value_log_begin_read(spl->vlog);
+            }
             trunk_async_set_state(ctxt, async_state_lookup_memtable);
             // fallthrough
          }
@@ -7113,60 +9370,43 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
             memtable_begin_lookup(spl->mt_ctxt);
             uint64 mt_gen_start = memtable_generation(spl->mt_ctxt);
             uint64 mt_gen_end   = memtable_generation_retired(spl->mt_ctxt);
+            ctxt->cover_epoch   = trunk_range_delete_cover(
+               spl, target, trunk_num_range_deletes(spl));
             for (uint64 mt_gen = mt_gen_start; mt_gen != mt_gen_end; mt_gen--) {
-               platform_status rc;
-               rc = trunk_memtable_lookup(spl, mt_gen, target, result);
-               platform_assert_status_ok(rc);
-               if (merge_accumulator_is_definitive(result)) {
-                  trunk_async_set_state(ctxt,
-                                        async_state_found_final_answer_early);
-                  memtable_end_lookup(spl->mt_ctxt);
-                  break;
-               }
-            }
-            if (ctxt->state == async_state_found_final_answer_early) {
-               break;
-            }
-            // fallthrough
-         }
-         case async_state_get_root_reentrant:
-         {
-            cache_ctxt_init(
-               spl->cc, trunk_async_callback, NULL, &ctxt->cache_ctxt);
-            res = trunk_node_get_async(spl->cc, spl->root_addr, ctxt);
-            switch (res) {
-               case async_locked:
-               case async_no_reqs:
-                  //            platform_default_log("%s:%d tid %2lu: ctxt %p is
-                  //            retry\n",
-                  //                         __FILE__, __LINE__,
-                  //                         platform_get_tid(), ctxt);
-                  /*
-                   * Ctxt remains at same state. The invocation is done, but
-                   * the request isn't; and caller will re-invoke me.
-                   */
-                  done = TRUE;
-                  break;
-               case async_io_started:
-                  //            platform_default_log("%s:%d tid %2lu: ctxt %p is
-                  //            io_started\n",
-                  //                         __FILE__, __LINE__,
-                  //                         platform_get_tid(), ctxt);
-                  // Invocation is done; request isn't. Callback will move
-                  // state.
-                  done = TRUE;
-                  break;
-               case async_success:
-                  ctxt->was_async = FALSE;
-                  trunk_async_set_state(ctxt, async_state_trunk_node_lookup);
-                  ctxt->trunk_node.page = ctxt->cache_ctxt.page;
-                  ctxt->trunk_node.hdr =
-                     (trunk_hdr *)(ctxt->cache_ctxt.page->data);
+               if (ctxt->cover_epoch != 0
+                   && trunk_memtable_epoch(spl, mt_gen) < ctxt->cover_epoch)
+               {
+                  trunk_merge_range_delete(spl, target, result);
+               } else {
+                  platform_status rc;
+                  rc = trunk_memtable_lookup(spl, mt_gen, target, result);
+                  platform_assert_status_ok(rc);
+               }
+               if (merge_accumulator_is_definitive(result)) {
+                  trunk_async_set_state(ctxt,
+                                        async_state_found_final_answer_early);
                   memtable_end_lookup(spl->mt_ctxt);
                   break;
-               default:
-                  platform_assert(0);
+               }
+            }
+            if (ctxt->state == async_state_found_final_answer_early) {
+               break;
             }
+            // fallthrough
+         }
+         case async_state_get_root_reentrant:
+         {
+            /*
+             * The root is fetched synchronously, as trunk_lookup() does. The
+             * memtable lookup lock must be held until we have the root, and
+             * it cannot be held across an async IO: it is a per-thread lock,
+             * and other lookups in flight on this thread need it too. The
+             * root is almost always cached, so this rarely blocks.
+             */
+            trunk_root_get(spl, node);
+            memtable_end_lookup(spl->mt_ctxt);
+            ctxt->was_async = FALSE;
+            trunk_async_set_state(ctxt, async_state_trunk_node_lookup);
             break;
          }
          case async_state_trunk_node_lookup:
@@ -7327,6 +9567,14 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
                   platform_assert(0);
             }
             ctxt->branch = trunk_get_branch(spl, node, branch_no);
+            if (ctxt->branch->epoch < ctxt->cover_epoch) {
+               trunk_merge_range_delete(spl, target, result);
+               trunk_async_set_state(ctxt,
+                                     async_state_found_final_answer_early);
+               trunk_node_unget(spl->cc, &ctxt->trunk_node);
+               ZERO_CONTENTS(&ctxt->trunk_node);
+               break;
+            }
             btree_ctxt_init(&ctxt->btree_ctxt,
                             &ctxt->cache_ctxt,
                             trunk_btree_async_callback);
@@ -7514,64 +9762,589 @@ trunk_lookup_async(trunk_handle      *spl,    // IN
             if (!merge_accumulator_is_null(result)) {
                message_type type = merge_accumulator_message_class(result);
                debug_assert(type == MESSAGE_TYPE_DELETE
-                            || type == MESSAGE_TYPE_INSERT);
+                            || type == MESSAGE_TYPE_INSERT
+                            || type == MESSAGE_TYPE_INSERT_INDIRECT);
                if (type == MESSAGE_TYPE_DELETE) {
                   merge_accumulator_set_to_null(result);
                }
             }
+            if (spl->vlog != NULL) {
+               // the value is read synchronously
+               platform_status rc = trunk_value_log_resolve(spl, result);
+               platform_assert_status_ok(rc);
+               value_log_end_read(spl->vlog);
+            }
+
+            res  = async_success;
+            done = TRUE;
+            break;
+         }
+         default:
+            platform_assert(0);
+      }
+   } while (!done);
+#if TRUNK_DEBUG
+   cache_enable_sync_get(spl->cc, TRUE);
+#endif
+
+   return res;
+}
+
+
+platform_status
+trunk_range(trunk_handle  *spl,
+            key            start_key,
+            uint64         num_tuples,
+            tuple_function func,
+            void          *arg)
+{
+   trunk_range_iterator *range_itor =
+      TYPED_MALLOC(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   platform_status rc = trunk_range_iterator_init(spl,
+                                                  range_itor,
+                                                  start_key,
+                                                  POSITIVE_INFINITY_KEY,
+                                                  start_key,
+                                                  greater_than_or_equal,
+                                                  num_tuples);
+   if (!SUCCESS(rc)) {
+      goto free_range_itor;
+   }
+
+   for (int i = 0; i < num_tuples && iterator_can_next(&range_itor->super); i++)
+   {
+      key     curr_key;
+      message data;
+      iterator_curr(&range_itor->super, &curr_key, &data);
+      func(curr_key, data, arg);
+      rc = iterator_next(&range_itor->super);
+      if (!SUCCESS(rc)) {
+         goto destroy_range_itor;
+      }
+   }
+
+destroy_range_itor:
+   trunk_range_iterator_deinit(range_itor);
+free_range_itor:
+   platform_free(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_range_scan --
+ *
+ *      Calls func on each tuple in [min_key, max_key), in order, from within
+ *      the merge loop of a range iterator. Tuples whose key filter rejects
+ *      (filter may be NULL) are skipped before their value is resolved from
+ *      the value log. The scan stops early when func returns FALSE.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+trunk_range_scan(trunk_handle       *spl,
+                 key                 min_key,
+                 key                 max_key,
+                 trunk_key_filter_fn filter,
+                 trunk_scan_fn       func,
+                 void               *arg)
+{
+   trunk_range_iterator *range_itor =
+      TYPED_MALLOC(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   if (range_itor == NULL) {
+      return STATUS_NO_MEMORY;
+   }
+   platform_status rc = trunk_range_iterator_init(spl,
+                                                  range_itor,
+                                                  min_key,
+                                                  max_key,
+                                                  min_key,
+                                                  greater_than_or_equal,
+                                                  UINT64_MAX);
+   if (!SUCCESS(rc)) {
+      goto free_range_itor;
+   }
+
+   while (iterator_can_next(&range_itor->super)) {
+      key     curr_key;
+      message data;
+      iterator_curr(&range_itor->merge_itor->super, &curr_key, &data);
+      if (filter == NULL || filter(curr_key, arg)) {
+         if (message_class(data) == MESSAGE_TYPE_INSERT_INDIRECT) {
+            trunk_range_iterator_curr(&range_itor->super, &curr_key, &data);
+         }
+         if (!func(curr_key, data, arg)) {
+            break;
+         }
+      }
+      rc = iterator_next(&range_itor->super);
+      if (!SUCCESS(rc)) {
+         break;
+      }
+   }
+
+   trunk_range_iterator_deinit(range_itor);
+free_range_itor:
+   platform_free(PROCESS_PRIVATE_HEAP_ID, range_itor);
+   return rc;
+}
+
+/*
+ * Adds the estimate of the tuples of the pivot in [start_key, end_key) held
+ * by node itself to *estimate: its statistics if the range holds the whole
+ * pivot, otherwise rough btree counts of its branches.
+ */
+static void
+trunk_pivot_approximate_size(trunk_handle        *spl,
+                             trunk_node          *node,
+                             uint16               pivot_no,
+                             key                  start_key,
+                             key                  end_key,
+                             trunk_size_estimate *estimate)
+{
+   key pivot_min = trunk_get_pivot(spl, node, pivot_no);
+   key pivot_max = trunk_get_pivot(spl, node, pivot_no + 1);
+   if (trunk_key_compare(spl, start_key, pivot_min) <= 0
+       && trunk_key_compare(spl, pivot_max, end_key) <= 0)
+   {
+      estimate->num_tuples += trunk_pivot_num_tuples(spl, node, pivot_no);
+      estimate->num_kv_bytes += trunk_pivot_kv_bytes(spl, node, pivot_no);
+      return;
+   }
+
+   key min_key =
+      trunk_key_compare(spl, start_key, pivot_min) <= 0 ? pivot_min : start_key;
+   key max_key =
+      trunk_key_compare(spl, pivot_max, end_key) <= 0 ? pivot_max : end_key;
+   trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+   for (uint16 branch_no = pdata->start_branch;
+        branch_no != trunk_end_branch(spl, node);
+        branch_no = trunk_add_branch_number(spl, branch_no, 1))
+   {
+      trunk_branch     *branch = trunk_get_branch(spl, node, branch_no);
+      btree_pivot_stats stats;
+      btree_count_in_range(spl->cc,
+                           trunk_btree_config(spl),
+                           branch->root_addr,
+                           min_key,
+                           max_key,
+                           &stats);
+      estimate->num_tuples += stats.num_kvs;
+      estimate->num_kv_bytes += stats.key_bytes + stats.message_bytes;
+   }
+}
+
+/*
+ * Returns TRUE if the pivot of node shares keys with [start_key, end_key).
+ */
+static inline bool32
+trunk_pivot_in_range(trunk_handle *spl,
+                     trunk_node   *node,
+                     uint16        pivot_no,
+                     key           start_key,
+                     key           end_key)
+{
+   key pivot_min = trunk_get_pivot(spl, node, pivot_no);
+   key pivot_max = trunk_get_pivot(spl, node, pivot_no + 1);
+   return trunk_key_compare(spl, start_key, pivot_max) < 0
+          && trunk_key_compare(spl, pivot_min, end_key) < 0;
+}
+
+/*
+ * Adds the estimate of the tuples of node and its descendants in
+ * [start_key, end_key) to *estimate. Releases node.
+ */
+static void
+trunk_approximate_size_in_node(trunk_handle        *spl,
+                               trunk_node          *node,
+                               key                  start_key,
+                               key                  end_key,
+                               trunk_size_estimate *estimate)
+{
+   uint16 num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      if (!trunk_pivot_in_range(spl, node, pivot_no, start_key, end_key)) {
+         continue;
+      }
+      trunk_pivot_approximate_size(
+         spl, node, pivot_no, start_key, end_key, estimate);
+      if (!trunk_node_is_leaf(node)) {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+         trunk_node        child;
+         trunk_node_get(spl->cc, pdata->addr, &child);
+         trunk_approximate_size_in_node(
+            spl, &child, start_key, end_key, estimate);
+      }
+   }
+   trunk_node_unget(spl->cc, node);
+}
+
+/*
+ * Counts the tuples of the memtable with root root_addr in
+ * [start_key, end_key) by iterating over them.
+ */
+static void
+trunk_approximate_size_in_memtable(trunk_handle        *spl,
+                                   uint64               root_addr,
+                                   key                  start_key,
+                                   key                  end_key,
+                                   trunk_size_estimate *estimate)
+{
+   btree_iterator btree_itor;
+   iterator      *itor = &btree_itor.super;
+   trunk_memtable_iterator_init(spl,
+                                &btree_itor,
+                                root_addr,
+                                start_key,
+                                end_key,
+                                start_key,
+                                greater_than_or_equal,
+                                FALSE,
+                                FALSE);
+   while (iterator_can_next(itor)) {
+      key     curr_key;
+      message msg;
+      iterator_curr(itor, &curr_key, &msg);
+      estimate->num_tuples++;
+      estimate->num_kv_bytes += key_length(curr_key) + message_length(msg);
+      platform_status rc = iterator_next(itor);
+      platform_assert_status_ok(rc);
+   }
+   btree_iterator_deinit(&btree_itor);
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_approximate_size --
+ *
+ *      Estimates the number of tuples in [start_key, end_key) and the bytes
+ *      of their keys and messages, from the pivot statistics of the trunk
+ *      nodes over the range. Only the trunk nodes over the range and the
+ *      btree paths to its ends are read, so the cost grows with the number
+ *      of trunk leaves the range spans, not with the tuples in it.
+ *
+ *      Every version of a key is counted, as are deletes, and tuples hidden
+ *      by a range delete until compactions drop them. With include_memtables,
+ *      the memtables are counted too: compacted ones with btree counts, the
+ *      others by iterating over the range in them, which costs about as much
+ *      as a scan of it.
+ *-----------------------------------------------------------------------------
+ */
+void
+trunk_approximate_size(trunk_handle        *spl,
+                       key                  start_key,
+                       key                  end_key,
+                       bool32               include_memtables,
+                       trunk_size_estimate *estimate)
+{
+   ZERO_CONTENTS(estimate);
+   if (trunk_key_compare(spl, end_key, start_key) <= 0) {
+      return;
+   }
+
+   uint64 root_addr[TRUNK_NUM_MEMTABLES];
+   bool32 compacted[TRUNK_NUM_MEMTABLES];
+   uint64 num_memtables = 0;
+
+   // hold references to the memtables, as a range iterator does
+   memtable_begin_lookup(spl->mt_ctxt);
+   uint64 mt_gen_start = memtable_generation(spl->mt_ctxt);
+   uint64 mt_gen_end   = memtable_generation_retired(spl->mt_ctxt);
+   platform_assert(mt_gen_start - mt_gen_end <= TRUNK_NUM_MEMTABLES);
+   for (uint64 mt_gen = mt_gen_start;
+        include_memtables && mt_gen != mt_gen_end;
+        mt_gen--)
+   {
+      root_addr[num_memtables] = trunk_memtable_root_addr_for_lookup(
+         spl, mt_gen, &compacted[num_memtables]);
+      if (compacted[num_memtables]) {
+         btree_block_dec_ref(
+            spl->cc, &spl->cfg.btree_cfg, root_addr[num_memtables]);
+      } else {
+         trunk_memtable_inc_ref(spl, mt_gen);
+      }
+      num_memtables++;
+   }
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   memtable_end_lookup(spl->mt_ctxt);
+
+   trunk_approximate_size_in_node(spl, &root, start_key, end_key, estimate);
+
+   for (uint64 i = 0; i < num_memtables; i++) {
+      if (compacted[i]) {
+         btree_pivot_stats stats;
+         btree_count_in_range(spl->cc,
+                              trunk_btree_config(spl),
+                              root_addr[i],
+                              start_key,
+                              end_key,
+                              &stats);
+         estimate->num_tuples += stats.num_kvs;
+         estimate->num_kv_bytes += stats.key_bytes + stats.message_bytes;
+         btree_unblock_dec_ref(spl->cc, &spl->cfg.btree_cfg, root_addr[i]);
+      } else {
+         trunk_approximate_size_in_memtable(
+            spl, root_addr[i], start_key, end_key, estimate);
+         trunk_memtable_dec_ref(spl, mt_gen_start - i);
+      }
+   }
+}
+
+typedef struct trunk_split_state {
+   key         start_key;
+   key         end_key;
+   uint64      num_parts;
+   uint64      total;  // estimated tuples in the range
+   uint64      seen;   // estimated tuples before the current leaf
+   key_buffer *split_keys;
+   uint64      num_split_keys;
+} trunk_split_state;
+
+/*
+ * Walks node and its descendants in key order, adding a split key at the
+ * start of the leaf nearest to each multiple of 1/num_parts of the tuples
+ * in the range. Tuples in index nodes are counted at the start of the
+ * subtrees they will be flushed to. Releases node.
+ */
+static platform_status
+trunk_split_range_in_node(trunk_handle      *spl,
+                          trunk_node        *node,
+                          trunk_split_state *state)
+{
+   platform_status rc           = STATUS_OK;
+   uint16          num_children = trunk_num_children(spl, node);
+   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
+      if (!trunk_pivot_in_range(
+             spl, node, pivot_no, state->start_key, state->end_key))
+      {
+         continue;
+      }
+      trunk_size_estimate estimate = {0};
+      trunk_pivot_approximate_size(
+         spl, node, pivot_no, state->start_key, state->end_key, &estimate);
+
+      // split before the leaf if its start is the closer end to the target
+      key pivot_min = trunk_get_pivot(spl, node, pivot_no);
+      if (trunk_node_is_leaf(node)
+          && state->num_split_keys + 1 < state->num_parts
+          && 2 * (state->num_split_keys + 1) * state->total
+                <= (2 * state->seen + estimate.num_tuples) * state->num_parts
+          && trunk_key_compare(spl, state->start_key, pivot_min) < 0)
+      {
+         rc = key_buffer_init_from_key(
+            &state->split_keys[state->num_split_keys], spl->heap_id, pivot_min);
+         if (!SUCCESS(rc)) {
+            key_buffer_deinit(&state->split_keys[state->num_split_keys]);
+            break;
+         }
+         state->num_split_keys++;
+      }
+      state->seen += estimate.num_tuples;
+
+      if (!trunk_node_is_leaf(node)) {
+         trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
+         trunk_node        child;
+         trunk_node_get(spl->cc, pdata->addr, &child);
+         rc = trunk_split_range_in_node(spl, &child, state);
+         if (!SUCCESS(rc)) {
+            break;
+         }
+      }
+   }
+   trunk_node_unget(spl->cc, node);
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * trunk_split_range --
+ *
+ *      Divides [start_key, end_key) into at most num_parts ranges holding
+ *      about as many tuples each, by the pivot statistics of the trunk (see
+ *      trunk_approximate_size), and initializes split_keys[0..*num_split_keys)
+ *      with the keys between them, in increasing order.
+ *
+ *      Splits fall on the boundaries of trunk leaves, so there are fewer parts
+ *      when the range spans fewer leaves, and none when the trunk holds none
+ *      of its tuples. The caller deinitializes the split keys.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+trunk_split_range(trunk_handle *spl,
+                  key           start_key,
+                  key           end_key,
+                  uint64        num_parts,
+                  key_buffer   *split_keys,
+                  uint64       *num_split_keys)
+{
+   *num_split_keys = 0;
+   if (num_parts < 2 || trunk_key_compare(spl, end_key, start_key) <= 0) {
+      return STATUS_OK;
+   }
+
+   trunk_size_estimate estimate;
+   trunk_approximate_size(spl, start_key, end_key, FALSE, &estimate);
+   if (estimate.num_tuples == 0) {
+      return STATUS_OK;
+   }
+
+   trunk_split_state state = {.start_key  = start_key,
+                              .end_key    = end_key,
+                              .num_parts  = num_parts,
+                              .total      = estimate.num_tuples,
+                              .split_keys = split_keys};
+   trunk_node        root;
+   trunk_root_get(spl, &root);
+   platform_status rc = trunk_split_range_in_node(spl, &root, &state);
+   if (!SUCCESS(rc)) {
+      for (uint64 i = 0; i < state.num_split_keys; i++) {
+         key_buffer_deinit(&split_keys[i]);
+      }
+      return rc;
+   }
+   *num_split_keys = state.num_split_keys;
+   return STATUS_OK;
+}
+
+/*
+ * Flushes the pivots within [start_key, end_key) of the nodes at the given
+ * height under node into their children, or compacts the leaves there if the
+ * height is 0. A pivot whose child has no room for its branches is skipped.
+ * The nodes on the way down are copied, as by trunk_drop_range_in_node.
+ *
+ * The node is a fresh copy, write locked by the caller, which also holds a
+ * claim on the trunk root lock.
+ */
+static void
+trunk_compact_range_in_node(trunk_handle *spl,
+                            trunk_node   *node,
+                            key           start_key,
+                            key           end_key,
+                            uint16        height)
+{
+   if (trunk_node_is_leaf(node)) {
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, 0);
+      if (trunk_pivot_branch_count(spl, node, pdata) == 0) {
+         return;
+      }
+      if (pdata->srq_idx != -1 && spl->cfg.reclaim_threshold != UINT64_MAX) {
+         srq_delete(&spl->srq, pdata->srq_idx);
+         srq_print(&spl->srq);
+         pdata->srq_idx = -1;
+      }
+      platform_status rc = trunk_compact_leaf(spl, node);
+      platform_assert_status_ok(rc);
+      return;
+   }
+
+   // Flushes may split children, so the children are counted every iteration
+   for (uint16 pivot_no = 0; pivot_no < trunk_num_children(spl, node);
+        pivot_no++) {
+      key pivot_min = trunk_get_pivot(spl, node, pivot_no);
+      key pivot_max = trunk_get_pivot(spl, node, pivot_no + 1);
+      if (trunk_key_compare(spl, pivot_max, start_key) <= 0) {
+         continue;
+      }
+      if (trunk_key_compare(spl, end_key, pivot_min) <= 0) {
+         break;
+      }
+      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, node, pivot_no);
 
-            res  = async_success;
-            done = TRUE;
-            break;
-         }
-         default:
-            platform_assert(0);
+      if (height < trunk_node_height(node)) {
+         trunk_node child;
+         trunk_copy_node_and_add_to_parent(spl, node, pdata, &child);
+         trunk_compact_range_in_node(spl, &child, start_key, end_key, height);
+         trunk_node_unlock(spl->cc, &child);
+         trunk_node_unclaim(spl->cc, &child);
+         trunk_node_unget(spl->cc, &child);
+         continue;
       }
-   } while (!done);
-#if TRUNK_DEBUG
-   cache_enable_sync_get(spl->cc, TRUE);
-#endif
 
-   return res;
+      if (trunk_pivot_branch_count(spl, node, pdata) == 0) {
+         continue;
+      }
+      trunk_node child;
+      trunk_node_get(spl->cc, pdata->addr, &child);
+      bool32 room = trunk_room_to_flush(spl, node, &child, pdata);
+      trunk_node_unget(spl->cc, &child);
+      if (room) {
+         platform_status rc = trunk_flush(spl, node, pdata, FALSE);
+         platform_assert_status_ok(rc);
+      }
+   }
 }
 
-
+/*
+ * Compacts [start_key, end_key) at the given height of the trunk, after
+ * incorporating the memtables: the nodes at that height flush their pivots
+ * within the range into their children, or, at height 0, the leaves
+ * overlapping the range are compacted into a single branch each. With
+ * TRUNK_COMPACT_ALL_HEIGHTS, every height is compacted from the root down,
+ * waiting for the compactions of each before the next, so the children have
+ * room for the flushes and the range ends up in compacted leaves.
+ *
+ * Returns once the compactions of the last height are enqueued, see
+ * trunk_compact_wait.
+ */
 platform_status
-trunk_range(trunk_handle  *spl,
-            key            start_key,
-            uint64         num_tuples,
-            tuple_function func,
-            void          *arg)
+trunk_compact_range(trunk_handle *spl,
+                    key           start_key,
+                    key           end_key,
+                    uint64        height)
 {
-   trunk_range_iterator *range_itor =
-      TYPED_MALLOC(PROCESS_PRIVATE_HEAP_ID, range_itor);
-   platform_status rc = trunk_range_iterator_init(spl,
-                                                  range_itor,
-                                                  start_key,
-                                                  POSITIVE_INFINITY_KEY,
-                                                  start_key,
-                                                  greater_than_or_equal,
-                                                  num_tuples);
+   if (trunk_max_key_size(spl) < key_length(start_key)
+       || trunk_max_key_size(spl) < key_length(end_key))
+   {
+      return STATUS_BAD_PARAM;
+   }
+   if (trunk_key_compare(spl, start_key, end_key) >= 0) {
+      return STATUS_OK;
+   }
+
+   platform_status rc = trunk_incorporate_memtables(spl);
    if (!SUCCESS(rc)) {
-      goto destroy_range_itor;
+      return rc;
    }
 
-   for (int i = 0; i < num_tuples && iterator_can_next(&range_itor->super); i++)
-   {
-      key     curr_key;
-      message data;
-      iterator_curr(&range_itor->super, &curr_key, &data);
-      func(curr_key, data, arg);
-      rc = iterator_next(&range_itor->super);
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   uint64 root_height = trunk_node_height(&root);
+   trunk_node_unget(spl->cc, &root);
+   bool32 all_heights = height == TRUNK_COMPACT_ALL_HEIGHTS;
+   if (all_heights) {
+      height = root_height;
+   } else if (root_height < height) {
+      return STATUS_OK;
+   }
+
+   while (TRUE) {
+      uint64 old_root_addr; // unused
+      trunk_claim_and_copy_root(spl, &root, &old_root_addr);
+      trunk_compact_range_in_node(spl, &root, start_key, end_key, height);
+      if (trunk_needs_split(spl, &root)) {
+         trunk_split_root(spl, &root);
+      }
+      trunk_update_claimed_root_and_unlock(spl, &root);
+
+      if (!all_heights || height == 0) {
+         return STATUS_OK;
+      }
+      rc = trunk_compact_wait(spl);
       if (!SUCCESS(rc)) {
-         goto destroy_range_itor;
+         return rc;
       }
+      height--;
    }
+}
 
-destroy_range_itor:
-   trunk_range_iterator_deinit(range_itor);
-   platform_free(PROCESS_PRIVATE_HEAP_ID, range_itor);
-   return rc;
+/*
+ * Waits for every flush and compaction enqueued so far, performing them on
+ * the calling thread if there are no background threads.
+ */
+platform_status
+trunk_compact_wait(trunk_handle *spl)
+{
+   return task_perform_until_quiescent(spl->ts);
 }
 
 
@@ -7602,15 +10375,18 @@ trunk_create(trunk_config     *cfg,
    spl->ts      = ts;
 
    platform_batch_rwlock_init(&spl->trunk_root_lock);
+   platform_status rc = platform_mutex_init(
+      &spl->checkpoint_lock, platform_get_module_id(), hid);
+   platform_assert_status_ok(rc);
 
    srq_init(&spl->srq, platform_get_module_id(), hid);
 
    // get a free node for the root
    //    we don't use the mini allocator for this, since the root doesn't
    //    maintain constant height
-   uint64          root_addr;
-   platform_status rc = allocator_alloc(spl->al, &root_addr, PAGE_TYPE_TRUNK);
-   spl->root_addr     = root_addr;
+   uint64 root_addr;
+   rc             = allocator_alloc(spl->al, &root_addr, PAGE_TYPE_TRUNK);
+   spl->root_addr = root_addr;
    platform_assert_status_ok(rc);
    trunk_node root;
    root.addr = spl->root_addr;
@@ -7637,13 +10413,29 @@ trunk_create(trunk_config     *cfg,
    spl->mt_ctxt            = memtable_context_create(
       spl->heap_id, cc, mt_cfg, trunk_memtable_flush_virtual, spl);
 
+   rc = trunk_range_deletes_init(spl, 0, 0);
+   platform_assert_status_ok(rc);
+
+   // set up the value log
+   platform_batch_rwlock_init(&spl->value_log_lock);
+   if (spl->cfg.value_log_threshold != 0) {
+      spl->vlog = TYPED_MALLOC(spl->heap_id, spl->vlog);
+      platform_assert(spl->vlog != NULL);
+      rc = value_log_create(spl->vlog,
+                            cc,
+                            al,
+                            spl->heap_id,
+                            trunk_value_log_threshold(&spl->cfg));
+      platform_assert_status_ok(rc);
+   }
+
    // set up the log
    if (spl->cfg.use_log) {
       spl->log = log_create(cc, spl->cfg.log_cfg, spl->heap_id);
    }
 
    // ALEX: For now we assume an init means destroying any present super blocks
-   trunk_set_super_block(spl, FALSE, FALSE, TRUE);
+   trunk_set_super_block(spl, NULL, FALSE, TRUE);
 
    // set up the initial leaf
    trunk_node leaf;
@@ -7668,29 +10460,234 @@ trunk_create(trunk_config     *cfg,
    if (spl->cfg.use_stats) {
       spl->stats = TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, MAX_THREADS);
       platform_assert(spl->stats);
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
-         platform_status rc;
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].insert_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].update_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].delete_latency_histo);
-         platform_assert_status_ok(rc);
-      }
    }
 
    return spl;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ * Log replay
+ *
+ *      When a table with a log was not unmounted cleanly, its super block
+ *      still holds the root it was mounted with (kept intact on disk, see
+ *      rc_allocator_retain_persisted) and the log of everything inserted
+ *      since. trunk_mount re-inserts the log entries, sorted by memtable
+ *      generation, from TRUNK_LOG_REPLAY_THREADS threads. Each thread takes
+ *      the keys which hash to it, so the messages for any one key are
+ *      re-inserted in their original order.
+ *
+ *      The range deletes in the log are made again before anything is
+ *      re-inserted, and the messages they deleted, those of older memtable
+ *      generations for the keys they cover, are skipped.
+ *-----------------------------------------------------------------------------
+ */
+typedef struct trunk_logged_range_delete {
+   key    start_key;
+   key    end_key;
+   uint64 generation;
+} trunk_logged_range_delete;
+
+typedef struct trunk_log_replay_arg {
+   trunk_handle              *spl;
+   shard_log_iterator        *itor;
+   uint64                     first_generation;
+   trunk_logged_range_delete *range_deletes;
+   uint64                     num_range_deletes;
+   uint64                     thread_no;
+   uint64                     num_threads;
+   platform_status            rc;
+} trunk_log_replay_arg;
+
+static bool32
+trunk_log_replay_is_range_deleted(trunk_log_replay_arg *replay_arg,
+                                  key                   tuple_key,
+                                  uint64                generation)
+{
+   trunk_handle *spl = replay_arg->spl;
+   for (uint64 i = 0; i < replay_arg->num_range_deletes; i++) {
+      trunk_logged_range_delete *rd = &replay_arg->range_deletes[i];
+      if (generation < rd->generation
+          && trunk_key_compare(spl, rd->start_key, tuple_key) <= 0
+          && trunk_key_compare(spl, tuple_key, rd->end_key) < 0)
+      {
+         return TRUE;
+      }
+   }
+   return FALSE;
+}
+
+static void
+trunk_log_replay_thread(void *arg)
+{
+   trunk_log_replay_arg *replay_arg = (trunk_log_replay_arg *)arg;
+   trunk_handle         *spl        = replay_arg->spl;
+   data_config          *data_cfg   = spl->cfg.data_cfg;
+
+   // A private cursor over the shared, sorted entries
+   shard_log_iterator itor  = *replay_arg->itor;
+   iterator          *itorh = &itor.super;
+
+   replay_arg->rc = STATUS_OK;
+   while (iterator_can_curr(itorh)) {
+      uint64 generation = trunk_log_memtable_generation(
+         shard_log_iterator_curr_generation(&itor));
+      if (replay_arg->first_generation <= generation) {
+         key     tuple_key;
+         message msg;
+         iterator_curr(itorh, &tuple_key, &msg);
+         uint32 hash = data_cfg->key_hash(
+            key_data(tuple_key), key_length(tuple_key), HASH_SEED);
+         if (hash % replay_arg->num_threads == replay_arg->thread_no
+             && message_class(msg) != MESSAGE_TYPE_RANGE_DELETE
+             && !trunk_log_replay_is_range_deleted(
+                replay_arg, tuple_key, generation))
+         {
+            replay_arg->rc = trunk_insert(spl, tuple_key, msg);
+            if (!SUCCESS(replay_arg->rc)) {
+               return;
+            }
+         }
+      }
+      replay_arg->rc = iterator_next(itorh);
+      if (!SUCCESS(replay_arg->rc)) {
+         return;
+      }
+   }
+}
+
+/*
+ * Makes the range deletes in the log again, and returns them.
+ */
+static platform_status
+trunk_replay_range_deletes(trunk_handle               *spl,
+                           shard_log_iterator         *log_itor,
+                           uint64                      first_generation,
+                           trunk_logged_range_delete **range_deletes,
+                           uint64                     *num_range_deletes)
+{
+   *range_deletes     = NULL;
+   *num_range_deletes = 0;
+
+   // Count them, then collect and make them
+   for (uint64 pass = 0; pass < 2; pass++) {
+      shard_log_iterator itor  = *log_itor;
+      iterator          *itorh = &itor.super;
+      uint64             count = 0;
+      while (iterator_can_curr(itorh)) {
+         uint64 generation = trunk_log_memtable_generation(
+            shard_log_iterator_curr_generation(&itor));
+         key     start_key;
+         message msg;
+         iterator_curr(itorh, &start_key, &msg);
+         if (first_generation <= generation
+             && message_class(msg) == MESSAGE_TYPE_RANGE_DELETE)
+         {
+            if (*range_deletes != NULL) {
+               trunk_logged_range_delete *rd = &(*range_deletes)[count];
+               rd->start_key  = start_key;
+               rd->end_key    = key_create_from_slice(message_slice(msg));
+               rd->generation = generation;
+               platform_status rc =
+                  trunk_delete_range(spl, rd->start_key, rd->end_key);
+               if (!SUCCESS(rc)) {
+                  return rc;
+               }
+            }
+            count++;
+         }
+         platform_status rc = iterator_next(itorh);
+         if (!SUCCESS(rc)) {
+            return rc;
+         }
+      }
+
+      if (count == 0) {
+         break;
+      }
+      if (*range_deletes == NULL) {
+         *range_deletes =
+            TYPED_ARRAY_ZALLOC(spl->heap_id, *range_deletes, count);
+         if (*range_deletes == NULL) {
+            return STATUS_NO_MEMORY;
+         }
+      }
+      *num_range_deletes = count;
+   }
+   return STATUS_OK;
+}
+
+static platform_status
+trunk_replay_log(trunk_handle *spl,
+                 uint64        log_addr,
+                 uint64        log_magic,
+                 uint64        first_generation)
+{
+   shard_log_config  *log_cfg = (shard_log_config *)spl->cfg.log_cfg;
+   shard_log_iterator itor;
+   platform_status    rc = shard_log_iterator_init(
+      spl->cc, log_cfg, spl->heap_id, log_addr, log_magic, &itor);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+
+   trunk_logged_range_delete *range_deletes;
+   uint64                     num_range_deletes;
+   rc = trunk_replay_range_deletes(
+      spl, &itor, first_generation, &range_deletes, &num_range_deletes);
+   if (!SUCCESS(rc)) {
+      if (range_deletes != NULL) {
+         platform_free(spl->heap_id, range_deletes);
+      }
+      shard_log_iterator_deinit(spl->heap_id, &itor);
+      return rc;
+   }
+
+   trunk_log_replay_arg args[TRUNK_LOG_REPLAY_THREADS];
+   platform_thread      threads[TRUNK_LOG_REPLAY_THREADS];
+   bool32               started[TRUNK_LOG_REPLAY_THREADS] = {FALSE};
+   for (uint64 i = 0; i < TRUNK_LOG_REPLAY_THREADS; i++) {
+      args[i] = (trunk_log_replay_arg){
+         .spl               = spl,
+         .itor              = &itor,
+         .first_generation  = first_generation,
+         .range_deletes     = range_deletes,
+         .num_range_deletes = num_range_deletes,
+         .thread_no         = i,
+         .num_threads       = TRUNK_LOG_REPLAY_THREADS};
+      if (i != 0) {
+         platform_status thread_rc =
+            task_thread_create("splinter-log-replay",
+                               trunk_log_replay_thread,
+                               &args[i],
+                               trunk_get_scratch_size(),
+                               spl->ts,
+                               spl->heap_id,
+                               &threads[i]);
+         started[i] = SUCCESS(thread_rc);
+      }
+   }
+
+   // Partitions without a thread of their own are replayed here
+   for (uint64 i = 0; i < TRUNK_LOG_REPLAY_THREADS; i++) {
+      if (started[i]) {
+         platform_thread_join(threads[i]);
+      } else {
+         trunk_log_replay_thread(&args[i]);
+      }
+      if (SUCCESS(rc)) {
+         rc = args[i].rc;
+      }
+   }
+
+   platform_default_log("Replayed %lu log entries\n", itor.num_entries);
+   if (range_deletes != NULL) {
+      platform_free(spl->heap_id, range_deletes);
+   }
+   shard_log_iterator_deinit(spl->heap_id, &itor);
+   return rc;
+}
+
 /*
  * Open (mount) an existing splinter database
  */
@@ -7717,20 +10714,53 @@ trunk_mount(trunk_config     *cfg,
 
    platform_batch_rwlock_init(&spl->trunk_root_lock);
 
-   // find the unmounted super block
-   spl->root_addr                      = 0;
-   uint64             meta_tail        = 0;
-   uint64             latest_timestamp = 0;
+   // find the unmounted super block, or a checkpointed one, or, with a log,
+   // the mounted one
+   spl->root_addr                           = 0;
+   uint64             meta_tail             = 0;
+   uint64             meta_tail_num_entries = 0;
+   uint64             latest_timestamp      = 0;
+   uint64             replay_log_addr       = 0;
+   uint64             replay_log_magic      = 0;
+   uint64             replay_log_gen        = 0;
+   uint64             range_delete_addr     = 0;
+   uint64             num_range_deletes     = 0;
+   value_log_super    vlog_super            = {0};
    page_handle       *super_page;
    trunk_super_block *super = trunk_get_super_block_if_valid(spl, &super_page);
    if (super != NULL) {
-      if (super->unmounted && super->timestamp > latest_timestamp) {
-         spl->root_addr   = super->root_addr;
-         meta_tail        = super->meta_tail;
-         latest_timestamp = super->timestamp;
+      bool32 can_replay = spl->cfg.use_log && super->log_addr != 0;
+      if ((super->unmounted || super->checkpointed || can_replay)
+          && super->timestamp > latest_timestamp)
+      {
+         spl->root_addr        = super->root_addr;
+         meta_tail             = super->meta_tail;
+         meta_tail_num_entries = super->meta_tail_num_entries;
+         latest_timestamp      = super->timestamp;
+         range_delete_addr     = super->range_delete_addr;
+         num_range_deletes     = super->num_range_deletes;
+         vlog_super            = super->value_log;
+         spl->recovered        = !super->unmounted;
+         if (!super->unmounted && can_replay) {
+            replay_log_addr  = super->log_addr;
+            replay_log_magic = super->log_magic;
+            replay_log_gen   = super->log_replay_generation;
+         }
       }
       trunk_release_super_block(spl, super_page);
    }
+   // A crashed table is only recoverable once its root is on disk
+   if (spl->recovered
+       && allocator_get_refcount(
+             al,
+             allocator_config_extent_base_addr(allocator_get_config(al),
+                                               spl->root_addr))
+             == 0)
+   {
+      platform_error_log("SplinterDB was not closed since it was created."
+                         " Cannot recover from log.\n");
+      spl->root_addr = 0;
+   }
    if (spl->root_addr == 0) {
       platform_error_log(
          "SplinterDB device's root_addr=%lu, trunk super_block=%p."
@@ -7743,8 +10773,59 @@ trunk_mount(trunk_config     *cfg,
       platform_free(hid, spl);
       return (trunk_handle *)NULL;
    }
+   if (vlog_super.dir_addr[0] != 0 && spl->cfg.use_log) {
+      platform_error_log("SplinterDB device has a value log,"
+                         " which cannot be used with a log.\n");
+      platform_free(hid, spl);
+      return (trunk_handle *)NULL;
+   }
    uint64 meta_head = spl->root_addr + trunk_page_size(&spl->cfg);
 
+   // Forget the trunk extents allocated after the super block was written,
+   // which are free in the ref counts on disk
+   if (spl->recovered) {
+      mini_unkeyed_truncate(
+         cc, PAGE_TYPE_TRUNK, meta_tail, meta_tail_num_entries);
+   }
+
+   // The log's extents must be claimed before anything else is allocated.
+   if (replay_log_addr != 0) {
+      platform_status rc =
+         shard_log_claim_extents(cc,
+                                 (shard_log_config *)spl->cfg.log_cfg,
+                                 hid,
+                                 replay_log_addr,
+                                 replay_log_magic,
+                                 &spl->replayed_log_extents,
+                                 &spl->num_replayed_log_extents);
+      if (!SUCCESS(rc)) {
+         platform_error_log("Failed to claim log extents: %s\n",
+                            platform_status_to_string(rc));
+         platform_free(hid, spl);
+         return (trunk_handle *)NULL;
+      }
+      spl->log_replayed = TRUE;
+   }
+
+   platform_status rc = platform_mutex_init(
+      &spl->checkpoint_lock, platform_get_module_id(), hid);
+   platform_assert_status_ok(rc);
+   rc = trunk_range_deletes_init(spl, range_delete_addr, num_range_deletes);
+   platform_assert_status_ok(rc);
+
+   platform_batch_rwlock_init(&spl->value_log_lock);
+   if (vlog_super.dir_addr[0] != 0 || spl->cfg.value_log_threshold != 0) {
+      spl->vlog = TYPED_MALLOC(spl->heap_id, spl->vlog);
+      platform_assert(spl->vlog != NULL);
+      uint64 threshold = trunk_value_log_threshold(&spl->cfg);
+      if (vlog_super.dir_addr[0] != 0) {
+         rc = value_log_mount(spl->vlog, cc, al, hid, threshold, &vlog_super);
+      } else {
+         rc = value_log_create(spl->vlog, cc, al, hid, threshold);
+      }
+      platform_assert_status_ok(rc);
+   }
+
    memtable_config *mt_cfg = &spl->cfg.mt_cfg;
    spl->mt_ctxt            = memtable_context_create(
       spl->heap_id, cc, mt_cfg, trunk_memtable_flush_virtual, spl);
@@ -7762,29 +10843,22 @@ trunk_mount(trunk_config     *cfg,
       spl->log = log_create(cc, spl->cfg.log_cfg, spl->heap_id);
    }
 
-   trunk_set_super_block(spl, FALSE, FALSE, FALSE);
-
    if (spl->cfg.use_stats) {
       spl->stats = TYPED_ARRAY_ZALLOC(spl->heap_id, spl->stats, MAX_THREADS);
       platform_assert(spl->stats);
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
-         platform_status rc;
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].insert_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].update_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[i].delete_latency_histo);
-         platform_assert_status_ok(rc);
-      }
+   }
+
+   if (spl->log_replayed) {
+      /*
+       * The super block keeps pointing at the old root and log, so a crash
+       * during replay just replays again. The caller makes the replayed
+       * state durable by unmounting.
+       */
+      platform_status rc = trunk_replay_log(
+         spl, replay_log_addr, replay_log_magic, replay_log_gen);
+      platform_assert_status_ok(rc);
+   } else if (!spl->recovered) {
+      trunk_set_super_block(spl, NULL, FALSE, FALSE);
    }
    return spl;
 }
@@ -7816,14 +10890,22 @@ trunk_prepare_for_shutdown(trunk_handle *spl)
    // destroy memtable context (and its memtables)
    memtable_context_destroy(spl->heap_id, spl->mt_ctxt);
 
-   // release the log
+   // release the log, which is no longer needed once the memtables are in
+   // the trunk
    if (spl->cfg.use_log) {
+      shard_log_zap((shard_log *)spl->log);
       platform_free(spl->heap_id, spl->log);
+      spl->log = NULL;
    }
 
    // release the trunk mini allocator
    mini_release(&spl->mini, NULL_KEY);
 
+   // free the retired extents of the value log and write its directory
+   if (spl->vlog != NULL) {
+      value_log_shutdown(spl->vlog);
+   }
+
    // flush all dirty pages in the cache
    cache_flush(spl->cc);
 }
@@ -7835,31 +10917,7 @@ trunk_node_destroy(trunk_handle *spl, uint64 addr, void *arg)
    trunk_node_get(spl->cc, addr, &node);
    trunk_node_claim(spl->cc, &node);
    trunk_node_lock(spl->cc, &node);
-   uint16 num_children = trunk_num_children(spl, &node);
-   for (uint16 pivot_no = 0; pivot_no < num_children; pivot_no++) {
-      trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
-      if (pdata->filter.addr != 0) {
-         trunk_dec_filter(spl, &pdata->filter);
-      }
-      for (uint16 branch_no = pdata->start_branch;
-           branch_no != trunk_end_branch(spl, &node);
-           branch_no = trunk_add_branch_number(spl, branch_no, 1))
-      {
-         trunk_branch *branch    = trunk_get_branch(spl, &node, branch_no);
-         key           start_key = trunk_get_pivot(spl, &node, pivot_no);
-         key           end_key   = trunk_get_pivot(spl, &node, pivot_no + 1);
-
-         trunk_zap_branch_range(
-            spl, branch, start_key, end_key, PAGE_TYPE_BRANCH);
-      }
-   }
-   uint16 start_filter = trunk_start_sb_filter(spl, &node);
-   uint16 end_filter   = trunk_end_sb_filter(spl, &node);
-   for (uint16 filter_no = start_filter; filter_no != end_filter; filter_no++) {
-      routing_filter *filter = trunk_get_sb_filter(spl, &node, filter_no);
-      trunk_dec_filter(spl, filter);
-   }
-
+   trunk_node_dec_refs(spl, &node);
    trunk_node_unlock(spl->cc, &node);
    trunk_node_unclaim(spl->cc, &node);
    trunk_node_unget(spl->cc, &node);
@@ -7874,20 +10932,22 @@ trunk_destroy(trunk_handle *spl)
 {
    srq_deinit(&spl->srq);
    trunk_prepare_for_shutdown(spl);
+   shard_log_release_extents(spl->cc,
+                             spl->heap_id,
+                             spl->replayed_log_extents,
+                             spl->num_replayed_log_extents);
    trunk_for_each_node(spl, trunk_node_destroy, NULL);
    mini_unkeyed_dec_ref(spl->cc, spl->mini.meta_head, PAGE_TYPE_TRUNK, FALSE);
    // clear out this splinter table from the meta page.
    allocator_remove_super_addr(spl->al, spl->id);
+   platform_mutex_destroy(&spl->checkpoint_lock);
+   trunk_range_deletes_deinit(spl, TRUE);
+   if (spl->vlog != NULL) {
+      value_log_destroy(spl->vlog);
+      platform_free(spl->heap_id, spl->vlog);
+   }
 
    if (spl->cfg.use_stats) {
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].insert_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].update_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].delete_latency_histo);
-      }
       platform_free(spl->heap_id, spl->stats);
    }
    platform_free(spl->heap_id, spl);
@@ -7903,16 +10963,19 @@ trunk_unmount(trunk_handle **spl_in)
    trunk_handle *spl = *spl_in;
    srq_deinit(&spl->srq);
    trunk_prepare_for_shutdown(spl);
-   trunk_set_super_block(spl, FALSE, TRUE, FALSE);
+   trunk_set_super_block(spl, NULL, TRUE, FALSE);
+   // The replayed log is no longer referenced by the super block
+   shard_log_release_extents(spl->cc,
+                             spl->heap_id,
+                             spl->replayed_log_extents,
+                             spl->num_replayed_log_extents);
+   platform_mutex_destroy(&spl->checkpoint_lock);
+   trunk_range_deletes_deinit(spl, FALSE);
+   if (spl->vlog != NULL) {
+      value_log_unmount(spl->vlog);
+      platform_free(spl->heap_id, spl->vlog);
+   }
    if (spl->cfg.use_stats) {
-      for (uint64 i = 0; i < MAX_THREADS; i++) {
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].insert_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].update_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[i].delete_latency_histo);
-      }
       platform_free(spl->heap_id, spl->stats);
    }
    platform_free(spl->heap_id, spl);
@@ -8456,13 +11519,26 @@ trunk_print_space_use(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle,
                 "Space used by level: trunk_tree_height=%d\n",
                 trunk_tree_height(spl));
+   uint64 total_bytes = 0;
    for (uint16 i = 0; i <= trunk_tree_height(spl); i++) {
       platform_log(log_handle,
                    "%u: %lu bytes (%s)\n",
                    i,
                    bytes_used_by_level[i],
                    size_str(bytes_used_by_level[i]));
+      total_bytes += bytes_used_by_level[i];
    }
+
+   /*
+    * Tuples are only fully merged once they reach the leaves, so the space
+    * used by the leaves stands in for the live data.
+    */
+   fraction space_amp = bytes_used_by_level[0] == 0
+                           ? zero_fraction
+                           : init_fraction(total_bytes, bytes_used_by_level[0]);
+   platform_log(log_handle,
+                "space amplification: " FRACTION_FMT(0, 2) "\n",
+                FRACTION_ARGS(space_amp));
    platform_log(log_handle, "\n");
 }
 
@@ -8775,7 +11851,125 @@ trunk_print_super_block(platform_log_handle *log_handle, trunk_handle *spl)
    trunk_release_super_block(spl, super_page);
 }
 
+/*
+ * Sums the per-thread counters reported by splinterdb_stats_get() into
+ * stats, without locks, so counters being updated meanwhile may be read
+ * just before or after the update. The maxima are left out.
+ */
+void
+trunk_get_stats(trunk_handle *spl, trunk_stats *stats)
+{
+   ZERO_CONTENTS(stats);
+   if (!spl->cfg.use_stats) {
+      return;
+   }
+
+   for (threadid thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
+      const trunk_stats *thr = &spl->stats[thr_i];
+      stats->insertions += thr->insertions;
+      stats->updates += thr->updates;
+      stats->deletions += thr->deletions;
+      stats->user_kv_bytes += thr->user_kv_bytes;
+      stats->lookups_found += thr->lookups_found;
+      stats->lookups_not_found += thr->lookups_not_found;
+
+      stats->memtable_flushes += thr->memtable_flushes;
+      stats->memtable_flush_time_ns += thr->memtable_flush_time_ns;
+      stats->memtable_flush_wait_time_ns += thr->memtable_flush_wait_time_ns;
+
+      for (uint64 h = 0; h < TRUNK_MAX_HEIGHT; h++) {
+         stats->count_flushes[h] += thr->count_flushes[h];
+         stats->full_flushes[h] += thr->full_flushes[h];
+         stats->flush_time_ns[h] += thr->flush_time_ns[h];
+         stats->flush_tuples[h] += thr->flush_tuples[h];
+         stats->flush_kv_bytes[h] += thr->flush_kv_bytes[h];
+         stats->compactions[h] += thr->compactions[h];
+         stats->compaction_tuples[h] += thr->compaction_tuples[h];
+         stats->compaction_time_ns[h] += thr->compaction_time_ns[h];
+         stats->compaction_pack_time_ns[h] += thr->compaction_pack_time_ns[h];
+         stats->compaction_input_tuples[h] += thr->compaction_input_tuples[h];
+         stats->compaction_input_kv_bytes[h] +=
+            thr->compaction_input_kv_bytes[h];
+         stats->compaction_output_kv_bytes[h] +=
+            thr->compaction_output_kv_bytes[h];
+         stats->compaction_bytes_written[h] +=
+            thr->compaction_bytes_written[h];
+         stats->compaction_io_wait_ns[h] += thr->compaction_io_wait_ns[h];
+         stats->filter_time_ns[h] += thr->filter_time_ns[h];
+         stats->filter_lookups[h] += thr->filter_lookups[h];
+         stats->filter_false_positives[h] += thr->filter_false_positives[h];
+         stats->branch_lookups[h] += thr->branch_lookups[h];
+      }
+      stats->root_count_flushes += thr->root_count_flushes;
+      stats->root_full_flushes += thr->root_full_flushes;
+      stats->root_flush_time_ns += thr->root_flush_time_ns;
+      stats->root_compactions += thr->root_compactions;
+      stats->root_compaction_tuples += thr->root_compaction_tuples;
+      stats->root_compaction_time_ns += thr->root_compaction_time_ns;
+      stats->root_compaction_pack_time_ns += thr->root_compaction_pack_time_ns;
+      stats->root_compaction_kv_bytes += thr->root_compaction_kv_bytes;
+      stats->root_compaction_bytes_written +=
+         thr->root_compaction_bytes_written;
+      stats->root_filter_time_ns += thr->root_filter_time_ns;
+
+      stats->index_splits += thr->index_splits;
+      stats->leaf_splits += thr->leaf_splits;
+      stats->leaf_split_tuples += thr->leaf_split_tuples;
+      stats->leaf_split_kv_bytes += thr->leaf_split_kv_bytes;
+
+      for (uint64 i = 0; i < NUM_TRUNK_LATENCY_TYPES; i++) {
+         latency_histo_merge(&stats->latency[i], &thr->latency[i]);
+      }
+   }
+}
+
+uint64
+trunk_height(trunk_handle *spl)
+{
+   trunk_node root;
+   trunk_root_get(spl, &root);
+   uint64 height = trunk_node_height(&root);
+   trunk_node_unget(spl->cc, &root);
+   return height;
+}
+
+static const char *trunk_latency_type_names[NUM_TRUNK_LATENCY_TYPES] = {
+   [TRUNK_LATENCY_INSERT]         = "insert",
+   [TRUNK_LATENCY_UPDATE]         = "update",
+   [TRUNK_LATENCY_DELETE]         = "delete",
+   [TRUNK_LATENCY_MEMTABLE_STALL] = "memtable stall",
+   [TRUNK_LATENCY_LOOKUP]         = "lookup",
+   [TRUNK_LATENCY_ITERATOR_INIT]  = "iterator init",
+   [TRUNK_LATENCY_ITERATOR_NEXT]  = "iterator next",
+};
+
 // clang-format off
+static void
+trunk_print_latency_stats(platform_log_handle *log_handle,
+                          trunk_stats         *global,
+                          trunk_latency_type   first,
+                          trunk_latency_type   last)
+{
+   platform_log(log_handle, "Latency Statistics (ns)\n");
+   platform_log(log_handle, "------------------------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "operation      |      count |       mean |        p50 |        p90 |        p99 |      p99.9 |        max |\n");
+   platform_log(log_handle, "---------------|------------|------------|------------|------------|------------|------------|------------|\n");
+   for (trunk_latency_type type = first; type <= last; type++) {
+      const latency_histo *histo = &global->latency[type];
+      platform_log(log_handle, "%-14s | %10lu | %10lu | %10lu | %10lu | %10lu | %10lu | %10lu |\n",
+                   trunk_latency_type_names[type],
+                   histo->num,
+                   latency_histo_mean(histo),
+                   latency_histo_percentile(histo, 50, 100),
+                   latency_histo_percentile(histo, 90, 100),
+                   latency_histo_percentile(histo, 99, 100),
+                   latency_histo_percentile(histo, 999, 1000),
+                   histo->max_ns);
+   }
+   platform_log(log_handle, "------------------------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "\n");
+}
+
 void
 trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
 {
@@ -8802,27 +11996,10 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
       return;
    }
 
-   platform_histo_handle insert_lat_accum, update_lat_accum, delete_lat_accum;
-   platform_histo_create(spl->heap_id,
-                         LATENCYHISTO_SIZE + 1,
-                         latency_histo_buckets,
-                         &insert_lat_accum);
-   platform_histo_create(spl->heap_id,
-                         LATENCYHISTO_SIZE + 1,
-                         latency_histo_buckets,
-                         &update_lat_accum);
-   platform_histo_create(spl->heap_id,
-                         LATENCYHISTO_SIZE + 1,
-                         latency_histo_buckets,
-                         &delete_lat_accum);
-
    for (thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
-      platform_histo_merge_in(insert_lat_accum,
-                              spl->stats[thr_i].insert_latency_histo);
-      platform_histo_merge_in(update_lat_accum,
-                              spl->stats[thr_i].update_latency_histo);
-      platform_histo_merge_in(delete_lat_accum,
-                              spl->stats[thr_i].delete_latency_histo);
+      for (trunk_latency_type type = TRUNK_LATENCY_INSERT; type <= TRUNK_LATENCY_MEMTABLE_STALL; type++) {
+         latency_histo_merge(&global->latency[type], &spl->stats[thr_i].latency[type]);
+      }
       for (h = 0; h <= height; h++) {
          global->flush_wait_time_ns[h]               += spl->stats[thr_i].flush_wait_time_ns[h];
          global->flush_time_ns[h]                    += spl->stats[thr_i].flush_time_ns[h];
@@ -8833,6 +12010,8 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
          }
          global->full_flushes[h]                     += spl->stats[thr_i].full_flushes[h];
          global->count_flushes[h]                    += spl->stats[thr_i].count_flushes[h];
+         global->flush_tuples[h]                     += spl->stats[thr_i].flush_tuples[h];
+         global->flush_kv_bytes[h]                   += spl->stats[thr_i].flush_kv_bytes[h];
 
          global->compactions[h]                      += spl->stats[thr_i].compactions[h];
          global->compactions_aborted_flushed[h]      += spl->stats[thr_i].compactions_aborted_flushed[h];
@@ -8847,26 +12026,16 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
          global->compaction_time_ns[h]               += spl->stats[thr_i].compaction_time_ns[h];
          global->compaction_time_wasted_ns[h]        += spl->stats[thr_i].compaction_time_wasted_ns[h];
          global->compaction_pack_time_ns[h]          += spl->stats[thr_i].compaction_pack_time_ns[h];
+         global->compaction_input_tuples[h]          += spl->stats[thr_i].compaction_input_tuples[h];
+         global->compaction_input_kv_bytes[h]        += spl->stats[thr_i].compaction_input_kv_bytes[h];
+         global->compaction_output_kv_bytes[h]       += spl->stats[thr_i].compaction_output_kv_bytes[h];
+         global->compaction_bytes_written[h]         += spl->stats[thr_i].compaction_bytes_written[h];
+         global->compaction_io_wait_ns[h]            += spl->stats[thr_i].compaction_io_wait_ns[h];
          if (spl->stats[thr_i].compaction_time_max_ns[h] >
              global->compaction_time_max_ns[h]) {
             global->compaction_time_max_ns[h] =
                spl->stats[thr_i].compaction_time_max_ns[h];
          }
-         global->root_compactions                    += spl->stats[thr_i].root_compactions;
-         global->root_compaction_pack_time_ns        += spl->stats[thr_i].root_compaction_pack_time_ns;
-         global->root_compaction_tuples              += spl->stats[thr_i].root_compaction_tuples;
-         if (spl->stats[thr_i].root_compaction_max_tuples >
-               global->root_compaction_max_tuples) {
-            global->root_compaction_max_tuples =
-               spl->stats[thr_i].root_compaction_max_tuples;
-         }
-         global->root_compaction_time_ns             += spl->stats[thr_i].root_compaction_time_ns;
-         if (spl->stats[thr_i].root_compaction_time_max_ns >
-               global->root_compaction_time_max_ns) {
-            global->root_compaction_time_max_ns =
-               spl->stats[thr_i].root_compaction_time_max_ns;
-         }
-
          global->filters_built[h]                    += spl->stats[thr_i].filters_built[h];
          global->filter_tuples[h]                    += spl->stats[thr_i].filter_tuples[h];
          global->filter_time_ns[h]                   += spl->stats[thr_i].filter_time_ns[h];
@@ -8879,6 +12048,7 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
       global->insertions                  += spl->stats[thr_i].insertions;
       global->updates                     += spl->stats[thr_i].updates;
       global->deletions                   += spl->stats[thr_i].deletions;
+      global->user_kv_bytes               += spl->stats[thr_i].user_kv_bytes;
       global->discarded_deletes           += spl->stats[thr_i].discarded_deletes;
 
       global->memtable_flushes            += spl->stats[thr_i].memtable_flushes;
@@ -8890,6 +12060,22 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
             spl->stats[thr_i].memtable_flush_time_max_ns;
       }
       global->memtable_flush_root_full    += spl->stats[thr_i].memtable_flush_root_full;
+      global->root_compactions            += spl->stats[thr_i].root_compactions;
+      global->root_compaction_pack_time_ns += spl->stats[thr_i].root_compaction_pack_time_ns;
+      global->root_compaction_tuples      += spl->stats[thr_i].root_compaction_tuples;
+      if (spl->stats[thr_i].root_compaction_max_tuples >
+            global->root_compaction_max_tuples) {
+         global->root_compaction_max_tuples =
+            spl->stats[thr_i].root_compaction_max_tuples;
+      }
+      global->root_compaction_time_ns     += spl->stats[thr_i].root_compaction_time_ns;
+      if (spl->stats[thr_i].root_compaction_time_max_ns >
+            global->root_compaction_time_max_ns) {
+         global->root_compaction_time_max_ns =
+            spl->stats[thr_i].root_compaction_time_max_ns;
+      }
+      global->root_compaction_kv_bytes    += spl->stats[thr_i].root_compaction_kv_bytes;
+      global->root_compaction_bytes_written += spl->stats[thr_i].root_compaction_bytes_written;
       global->root_full_flushes           += spl->stats[thr_i].root_full_flushes;
       global->root_count_flushes          += spl->stats[thr_i].root_count_flushes;
       global->root_flush_time_ns          += spl->stats[thr_i].root_flush_time_ns;
@@ -8904,6 +12090,8 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
       global->leaf_splits                 += spl->stats[thr_i].leaf_splits;
       global->leaf_splits_leaves_created  += spl->stats[thr_i].leaf_splits_leaves_created;
       global->leaf_split_time_ns          += spl->stats[thr_i].leaf_split_time_ns;
+      global->leaf_split_tuples           += spl->stats[thr_i].leaf_split_tuples;
+      global->leaf_split_kv_bytes         += spl->stats[thr_i].leaf_split_kv_bytes;
       if (spl->stats[thr_i].leaf_split_max_time_ns >
             global->leaf_split_max_time_ns) {
          global->leaf_split_max_time_ns =
@@ -8936,14 +12124,11 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle, "------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "\n");
 
-   platform_log(log_handle, "Latency Histogram Statistics\n");
-   platform_histo_print(insert_lat_accum, "Insert Latency Histogram (ns):", log_handle);
-   platform_histo_print(update_lat_accum, "Update Latency Histogram (ns):", log_handle);
-   platform_histo_print(delete_lat_accum, "Delete Latency Histogram (ns):", log_handle);
-   platform_histo_destroy(spl->heap_id, &insert_lat_accum);
-   platform_histo_destroy(spl->heap_id, &update_lat_accum);
-   platform_histo_destroy(spl->heap_id, &delete_lat_accum);
+   trunk_print_latency_stats(log_handle, global, TRUNK_LATENCY_INSERT, TRUNK_LATENCY_MEMTABLE_STALL);
 
+   if (spl->cfg.use_log && spl->log) {
+      shard_log_print_commit_stats(log_handle, (shard_log *)spl->log);
+   }
 
    platform_log(log_handle, "Flush Statistics\n");
    platform_log(log_handle, "---------------------------------------------------------------------------------------------------------\n");
@@ -9016,6 +12201,42 @@ trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle, "------------------------------------------------------------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "\n");
 
+   // Write amplification is relative to the kv bytes inserted, by height
+   uint64   bytes_written = global->root_compaction_bytes_written;
+   fraction write_amp     = global->user_kv_bytes == 0 ? zero_fraction
+      : init_fraction(global->root_compaction_bytes_written, global->user_kv_bytes);
+   platform_log(log_handle, "Compaction Volume Statistics\n");
+   platform_log(log_handle, "---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "  height | flushed tuples | flushed kv bytes | input tuples | input kv bytes | output tuples | output kv bytes | bytes written | merge time (ns) | io wait (ns) | filter time (ns) | write amp |\n");
+   platform_log(log_handle, "---------|----------------|------------------|--------------|----------------|---------------|-----------------|---------------|-----------------|--------------|------------------|-----------|\n");
+   platform_log(log_handle, "memtable | %14lu | %16lu | %12lu | %14lu | %13lu | %15lu | %13lu | %15lu | %12lu | %16lu | "FRACTION_FMT(9, 2)" |\n",
+         0UL, 0UL, global->root_compaction_tuples, global->root_compaction_kv_bytes,
+         global->root_compaction_tuples, global->root_compaction_kv_bytes,
+         global->root_compaction_bytes_written, global->root_compaction_pack_time_ns,
+         0UL, global->root_filter_time_ns, FRACTION_ARGS(write_amp));
+   for (h = 0; h <= height; h++) {
+      rev_h = height - h;
+      bytes_written += global->compaction_bytes_written[rev_h];
+      write_amp = global->user_kv_bytes == 0 ? zero_fraction
+         : init_fraction(global->compaction_bytes_written[rev_h], global->user_kv_bytes);
+      platform_log(log_handle, "%8u | %14lu | %16lu | %12lu | %14lu | %13lu | %15lu | %13lu | %15lu | %12lu | %16lu | "FRACTION_FMT(9, 2)" |\n",
+            rev_h, global->flush_tuples[rev_h], global->flush_kv_bytes[rev_h],
+            global->compaction_input_tuples[rev_h], global->compaction_input_kv_bytes[rev_h],
+            global->compaction_tuples[rev_h], global->compaction_output_kv_bytes[rev_h],
+            global->compaction_bytes_written[rev_h], global->compaction_pack_time_ns[rev_h],
+            global->compaction_io_wait_ns[rev_h], global->filter_time_ns[rev_h],
+            FRACTION_ARGS(write_amp));
+   }
+   platform_log(log_handle, "---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+   write_amp = global->user_kv_bytes == 0 ? zero_fraction
+      : init_fraction(bytes_written, global->user_kv_bytes);
+   platform_log(log_handle, "| user kv bytes:        %12lu\n", global->user_kv_bytes);
+   platform_log(log_handle, "| branch bytes written: %12lu\n", bytes_written);
+   platform_log(log_handle, "| write amplification:  "FRACTION_FMT(12, 2)"\n", FRACTION_ARGS(write_amp));
+   platform_log(log_handle, "| leaf split tuples:    %12lu (%lu kv bytes)\n", global->leaf_split_tuples, global->leaf_split_kv_bytes);
+   platform_log(log_handle, "---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------\n");
+   platform_log(log_handle, "\n");
+
    if (global->leaf_splits == 0) {
       avg_leaves_created = zero_fraction;
    } else {
@@ -9128,6 +12349,9 @@ trunk_print_lookup_stats(platform_log_handle *log_handle, trunk_handle *spl)
       }
       global->lookups_found     += spl->stats[thr_i].lookups_found;
       global->lookups_not_found += spl->stats[thr_i].lookups_not_found;
+      for (trunk_latency_type type = TRUNK_LATENCY_LOOKUP; type <= TRUNK_LATENCY_ITERATOR_NEXT; type++) {
+         latency_histo_merge(&global->latency[type], &spl->stats[thr_i].latency[type]);
+      }
    }
    lookups = global->lookups_found + global->lookups_not_found;
 
@@ -9140,6 +12364,8 @@ trunk_print_lookup_stats(platform_log_handle *log_handle, trunk_handle *spl)
    platform_log(log_handle, "-----------------------------------------------------------------------------------\n");
    platform_log(log_handle, "\n");
 
+   trunk_print_latency_stats(log_handle, global, TRUNK_LATENCY_LOOKUP, TRUNK_LATENCY_ITERATOR_NEXT);
+
    platform_log(log_handle, "Filter/Branch Statistics\n");
    platform_log(log_handle, "-------------------------------------------------------------------------------------\n");
    platform_log(log_handle, "height   | avg filter lookups | avg false pos | false pos rate | avg branch lookups |\n");
@@ -9243,7 +12469,7 @@ trunk_print_lookup(trunk_handle        *spl,
       debug_assert(pivot_no < trunk_num_children(spl, &node));
       trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, pivot_no);
       merge_accumulator_set_to_null(&data);
-      trunk_pivot_lookup(spl, &node, pdata, target, &data);
+      trunk_pivot_lookup(spl, &node, pdata, target, 0, &data);
       if (!merge_accumulator_is_null(&data)) {
          char key_str[128];
          char message_str[128];
@@ -9296,7 +12522,7 @@ trunk_print_lookup(trunk_handle        *spl,
    trunk_print_locked_node(Platform_default_log_handle, spl, &node);
    trunk_pivot_data *pdata = trunk_get_pivot_data(spl, &node, 0);
    merge_accumulator_set_to_null(&data);
-   trunk_pivot_lookup(spl, &node, pdata, target, &data);
+   trunk_pivot_lookup(spl, &node, pdata, target, 0, &data);
    if (!merge_accumulator_is_null(&data)) {
       char key_str[128];
       char message_str[128];
@@ -9348,33 +12574,7 @@ void
 trunk_reset_stats(trunk_handle *spl)
 {
    if (spl->cfg.use_stats) {
-      for (threadid thr_i = 0; thr_i < MAX_THREADS; thr_i++) {
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[thr_i].insert_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[thr_i].update_latency_histo);
-         platform_histo_destroy(spl->heap_id,
-                                &spl->stats[thr_i].delete_latency_histo);
-
-         memset(&spl->stats[thr_i], 0, sizeof(spl->stats[thr_i]));
-
-         platform_status rc;
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[thr_i].insert_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[thr_i].update_latency_histo);
-         platform_assert_status_ok(rc);
-         rc = platform_histo_create(spl->heap_id,
-                                    LATENCYHISTO_SIZE + 1,
-                                    latency_histo_buckets,
-                                    &spl->stats[thr_i].delete_latency_histo);
-         platform_assert_status_ok(rc);
-      }
+      memset(spl->stats, 0, MAX_THREADS * sizeof(spl->stats[0]));
    }
 }
 
@@ -9532,6 +12732,7 @@ trunk_config_init(trunk_config        *trunk_cfg,
                   uint64               filter_index_size,
                   uint64               reclaim_threshold,
                   uint64               queue_scale_percent,
+                  uint64               value_log_threshold,
                   bool32               use_log,
                   bool32               use_stats,
                   bool32               verbose_logging,
@@ -9554,6 +12755,7 @@ trunk_config_init(trunk_config        *trunk_cfg,
    trunk_cfg->max_branches_per_node   = max_branches_per_node;
    trunk_cfg->reclaim_threshold       = reclaim_threshold;
    trunk_cfg->queue_scale_percent     = queue_scale_percent;
+   trunk_cfg->value_log_threshold     = value_log_threshold;
    trunk_cfg->use_log                 = use_log;
    trunk_cfg->use_stats               = use_stats;
    trunk_cfg->verbose_logging_enabled = verbose_logging;
@@ -19,6 +19,8 @@
 #include "allocator.h"
 #include "log.h"
 #include "srq.h"
+#include "value_log.h"
+#include "latency_histo.h"
 
 /*
  * Max height of the Trunk Tree; Limited for convenience to allow for static
@@ -43,6 +45,12 @@ _Static_assert(TRUNK_MAX_HEIGHT == MINI_MAX_BATCHES,
  */
 #define TRUNK_RANGE_ITOR_MAX_BRANCHES 256
 
+/*
+ * Upper-bound on the number of tuples in one trunk_insert_batch() call.
+ * Bounds the per-batch bookkeeping, which lives on the stack.
+ */
+#define TRUNK_MAX_INSERT_BATCH 64
+
 
 /*
  *----------------------------------------------------------------------
@@ -64,6 +72,8 @@ typedef struct trunk_config {
                                 // free space < threshold
    uint64 queue_scale_percent;  // Governs when inserters perform bg tasks.  See
                                 // task.h
+   uint64 value_log_threshold;  // values longer than this go to the value
+                                // log, 0 for none
    bool32          use_stats;   // stats
    memtable_config mt_cfg;
    btree_config    btree_cfg;
@@ -77,20 +87,37 @@ typedef struct trunk_config {
    platform_log_handle *log_handle;
 } trunk_config;
 
+/*
+ * Operations whose latencies trunk_stats keeps histograms of. A memtable
+ * stall is the time an insert waits for the next memtable to be ready.
+ */
+typedef enum trunk_latency_type {
+   TRUNK_LATENCY_INSERT,
+   TRUNK_LATENCY_UPDATE,
+   TRUNK_LATENCY_DELETE,
+   TRUNK_LATENCY_MEMTABLE_STALL,
+   TRUNK_LATENCY_LOOKUP,
+   TRUNK_LATENCY_ITERATOR_INIT,
+   TRUNK_LATENCY_ITERATOR_NEXT,
+   NUM_TRUNK_LATENCY_TYPES
+} trunk_latency_type;
+
 typedef struct trunk_stats {
    uint64 insertions;
    uint64 updates;
    uint64 deletions;
+   uint64 user_kv_bytes; // key and message bytes of the above
 
-   platform_histo_handle insert_latency_histo;
-   platform_histo_handle update_latency_histo;
-   platform_histo_handle delete_latency_histo;
+   latency_histo latency[NUM_TRUNK_LATENCY_TYPES];
 
    uint64 flush_wait_time_ns[TRUNK_MAX_HEIGHT];
    uint64 flush_time_ns[TRUNK_MAX_HEIGHT];
    uint64 flush_time_max_ns[TRUNK_MAX_HEIGHT];
    uint64 full_flushes[TRUNK_MAX_HEIGHT];
    uint64 count_flushes[TRUNK_MAX_HEIGHT];
+   // by height of the parent, including the root
+   uint64 flush_tuples[TRUNK_MAX_HEIGHT];
+   uint64 flush_kv_bytes[TRUNK_MAX_HEIGHT];
    uint64 memtable_flushes;
    uint64 memtable_flush_time_ns;
    uint64 memtable_flush_time_max_ns;
@@ -117,6 +144,11 @@ typedef struct trunk_stats {
    uint64 compaction_time_max_ns[TRUNK_MAX_HEIGHT];
    uint64 compaction_time_wasted_ns[TRUNK_MAX_HEIGHT];
    uint64 compaction_pack_time_ns[TRUNK_MAX_HEIGHT];
+   uint64 compaction_input_tuples[TRUNK_MAX_HEIGHT];
+   uint64 compaction_input_kv_bytes[TRUNK_MAX_HEIGHT];
+   uint64 compaction_output_kv_bytes[TRUNK_MAX_HEIGHT];
+   uint64 compaction_bytes_written[TRUNK_MAX_HEIGHT]; // extents allocated
+   uint64 compaction_io_wait_ns[TRUNK_MAX_HEIGHT];    // cache miss time
 
    uint64 root_compactions;
    uint64 root_compaction_pack_time_ns;
@@ -124,6 +156,8 @@ typedef struct trunk_stats {
    uint64 root_compaction_max_tuples;
    uint64 root_compaction_time_ns;
    uint64 root_compaction_time_max_ns;
+   uint64 root_compaction_kv_bytes;
+   uint64 root_compaction_bytes_written;
 
    uint64 discarded_deletes;
    uint64 index_splits;
@@ -131,6 +165,8 @@ typedef struct trunk_stats {
    uint64 leaf_splits_leaves_created;
    uint64 leaf_split_time_ns;
    uint64 leaf_split_max_time_ns;
+   uint64 leaf_split_tuples;
+   uint64 leaf_split_kv_bytes;
 
    uint64 single_leaf_splits;
    uint64 single_leaf_tuples;
@@ -159,6 +195,8 @@ typedef struct trunk_stats {
 // splinter refers to btrees as branches
 typedef struct trunk_branch {
    uint64 root_addr; // root address of point btree
+   uint64 epoch;     // range deletes older than the branch, see
+                     // trunk_delete_range()
 } trunk_branch;
 
 typedef struct trunk_handle             trunk_handle;
@@ -193,6 +231,31 @@ struct trunk_handle {
    log_handle    *log;
    mini_allocator mini;
 
+   // set when trunk_mount recovered a table which was not unmounted cleanly
+   bool32  recovered;
+   // set when trunk_mount replayed the log of a crashed table, whose extents
+   // are held until unmount or the next checkpoint
+   bool32  log_replayed;
+   uint64 *replayed_log_extents;
+   uint64  num_replayed_log_extents;
+
+   // checkpoints, see trunk_checkpoint()
+   platform_mutex checkpoint_lock;
+   // while a checkpoint replaces it, the log the super block on disk refers to
+   log_handle    *checkpoint_prev_log;
+
+   // range deletes, see trunk_delete_range()
+   platform_mutex  range_delete_lock;
+   uint64          range_delete_addr;
+   uint64          max_range_deletes;
+   volatile uint64 num_range_deletes;
+   char           *range_deletes;           // image of the extent
+   uint64         *range_delete_generation; // memtable generation of each
+
+   // value log, NULL if the table has none, see trunk_value_log_gc()
+   value_log            *vlog;
+   platform_batch_rwlock value_log_lock; // orders gc copies with inserts
+
    // memtables
    allocator_root_id id;
    memtable_context *mt_ctxt;
@@ -224,6 +287,8 @@ struct trunk_handle {
 typedef struct trunk_range_iterator {
    iterator        super;
    trunk_handle   *spl;
+   uint64          snapshot_root_addr; // 0 when reading the live tree
+   uint64          num_range_deletes;  // range deletes visible to it
    uint64          num_tuples;
    uint64          num_branches;
    uint64          num_memtable_branches;
@@ -242,6 +307,11 @@ typedef struct trunk_range_iterator {
 
    // used for merge iterator construction
    iterator *itor[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+   uint64    epoch[TRUNK_RANGE_ITOR_MAX_BRANCHES];
+
+   // the current value, when it is in the value log
+   writable_buffer value;
+   value_log_ref   value_ref;
 } trunk_range_iterator;
 
 
@@ -296,6 +366,8 @@ typedef struct trunk_async_ctxt {
    trunk_node        trunk_node; // Current trunk node
    uint16            height;     // height of trunk_node
 
+   uint64 cover_epoch; // epoch of the newest range delete covering the key
+
    uint16 sb_no;     // subbundle number (newest)
    uint16 end_sb_no; // subbundle number (oldest,
                      // exclusive
@@ -333,9 +405,48 @@ typedef struct trunk_async_ctxt {
 platform_status
 trunk_insert(trunk_handle *spl, key tuple_key, message data);
 
+platform_status
+trunk_insert_batch(trunk_handle  *spl,
+                   uint64         num_tuples,
+                   const key     *tuple_keys,
+                   const message *data);
+
+platform_status
+trunk_log_commit(trunk_handle *spl, log_durability durability);
+
+platform_status
+trunk_checkpoint(trunk_handle *spl);
+
+platform_status
+trunk_delete_range(trunk_handle *spl, key start_key, key end_key);
+
+platform_status
+trunk_bulk_load(trunk_handle *spl, iterator *itor);
+
+platform_status
+trunk_ingest(trunk_handle *spl, iterator *itor);
+
+platform_status
+trunk_value_log_gc(trunk_handle *spl, bool32 all);
+
 platform_status
 trunk_lookup(trunk_handle *spl, key target, merge_accumulator *result);
 
+platform_status
+trunk_snapshot_create(trunk_handle *spl,
+                      uint64       *root_addr,
+                      uint64       *num_range_deletes);
+
+void
+trunk_snapshot_release(trunk_handle *spl, uint64 root_addr);
+
+platform_status
+trunk_snapshot_lookup(trunk_handle      *spl,
+                      uint64             root_addr,
+                      uint64             num_range_deletes,
+                      key                target,
+                      merge_accumulator *result);
+
 static inline bool32
 trunk_lookup_found(merge_accumulator *result)
 {
@@ -355,6 +466,16 @@ trunk_range_iterator_init(trunk_handle         *spl,
                           key                   start_key,
                           comparison            start_type,
                           uint64                num_tuples);
+platform_status
+trunk_range_iterator_init_snapshot(trunk_handle         *spl,
+                                   trunk_range_iterator *range_itor,
+                                   uint64                snapshot_root_addr,
+                                   uint64                num_range_deletes,
+                                   key                   min_key,
+                                   key                   max_key,
+                                   key                   start_key,
+                                   comparison            start_type,
+                                   uint64                num_tuples);
 void
 trunk_range_iterator_deinit(trunk_range_iterator *range_itor);
 
@@ -366,6 +487,47 @@ trunk_range(trunk_handle  *spl,
             tuple_function func,
             void          *arg);
 
+typedef bool32 (*trunk_key_filter_fn)(key tuple_key, void *arg);
+typedef bool32 (*trunk_scan_fn)(key tuple_key, message value, void *arg);
+platform_status
+trunk_range_scan(trunk_handle       *spl,
+                 key                 min_key,
+                 key                 max_key,
+                 trunk_key_filter_fn filter,
+                 trunk_scan_fn       func,
+                 void               *arg);
+
+typedef struct trunk_size_estimate {
+   uint64 num_tuples;
+   uint64 num_kv_bytes;
+} trunk_size_estimate;
+
+void
+trunk_approximate_size(trunk_handle        *spl,
+                       key                  start_key,
+                       key                  end_key,
+                       bool32               include_memtables,
+                       trunk_size_estimate *estimate);
+
+platform_status
+trunk_split_range(trunk_handle *spl,
+                  key           start_key,
+                  key           end_key,
+                  uint64        num_parts,
+                  key_buffer   *split_keys,
+                  uint64       *num_split_keys);
+
+#define TRUNK_COMPACT_ALL_HEIGHTS UINT64_MAX
+
+platform_status
+trunk_compact_range(trunk_handle *spl,
+                    key           start_key,
+                    key           end_key,
+                    uint64        height);
+
+platform_status
+trunk_compact_wait(trunk_handle *spl);
+
 trunk_handle *
 trunk_create(trunk_config     *cfg,
              allocator        *al,
@@ -391,6 +553,10 @@ trunk_perform_tasks(trunk_handle *spl);
 void
 trunk_print_insertion_stats(platform_log_handle *log_handle, trunk_handle *spl);
 void
+trunk_get_stats(trunk_handle *spl, trunk_stats *stats);
+uint64
+trunk_height(trunk_handle *spl);
+void
 trunk_print_lookup_stats(platform_log_handle *log_handle, trunk_handle *spl);
 void
 trunk_reset_stats(trunk_handle *spl);
@@ -465,6 +631,7 @@ trunk_config_init(trunk_config        *trunk_cfg,
                   uint64               filter_index_size,
                   uint64               reclaim_threshold,
                   uint64               queue_scale_percent,
+                  uint64               value_log_threshold,
                   bool32               use_log,
                   bool32               use_stats,
                   bool32               verbose_logging,
@@ -0,0 +1,599 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ *-----------------------------------------------------------------------------
+ * value_log.c --
+ *
+ *     This file contains the implementation of the value log, see
+ *     value_log.h.
+ *
+ *     Records are appended to the head extent under the lock and are 8-byte
+ *     aligned. A record may span pages but not extents, so a value is at
+ *     most about an extent long.
+ *-----------------------------------------------------------------------------
+ */
+
+#include "platform.h"
+
+#include "value_log.h"
+
+#include "poison.h"
+
+/*
+ * ---------------------------------------------------------------
+ * Record header: Disk-resident structure, followed by the key and the value.
+ * Page Type == PAGE_TYPE_BLOB
+ * ---------------------------------------------------------------
+ */
+typedef struct ONDISK value_log_record_hdr {
+   uint64 id;
+   uint32 value_length;
+   uint16 key_length;
+   uint16 pad;
+} value_log_record_hdr;
+
+static inline uint64
+value_log_record_size(uint64 key_length, uint64 value_length)
+{
+   return ROUNDUP(sizeof(value_log_record_hdr) + key_length + value_length, 8);
+}
+
+static inline uint64
+value_log_max_retired(value_log *vlog)
+{
+   return 2 * vlog->max_slots;
+}
+
+/*
+ * Copies length bytes at addr out of the cache, across pages.
+ */
+static void
+value_log_copy_out(value_log *vlog, uint64 addr, void *dst, uint64 length)
+{
+   uint64 page_size = cache_page_size(vlog->cc);
+   char  *out       = dst;
+   while (length > 0) {
+      uint64       offset = addr % page_size;
+      uint64       n      = MIN(length, page_size - offset);
+      page_handle *page =
+         cache_get(vlog->cc, addr - offset, TRUE, PAGE_TYPE_BLOB);
+      memmove(out, page->data + offset, n);
+      cache_unget(vlog->cc, page);
+      out += n;
+      addr += n;
+      length -= n;
+   }
+}
+
+/*
+ * Copies length bytes to addr in the head extent, allocating each page in
+ * the cache when its first byte is written.
+ */
+static void
+value_log_copy_in(value_log *vlog, uint64 addr, const void *src, uint64 length)
+{
+   uint64      page_size = cache_page_size(vlog->cc);
+   const char *in        = src;
+   while (length > 0) {
+      uint64       offset = addr % page_size;
+      uint64       n      = MIN(length, page_size - offset);
+      page_handle *page;
+      if (offset == 0) {
+         page = cache_alloc(vlog->cc, addr, PAGE_TYPE_BLOB);
+         memset(page->data, 0, page_size);
+      } else {
+         uint64 wait = 1;
+         page = cache_get(vlog->cc, addr - offset, TRUE, PAGE_TYPE_BLOB);
+         while (!cache_try_claim(vlog->cc, page)) {
+            platform_sleep_ns(wait);
+            wait = wait > 2048 ? wait : 2 * wait;
+         }
+         cache_lock(vlog->cc, page);
+      }
+      memmove(page->data + offset, in, n);
+      cache_mark_dirty(vlog->cc, page);
+      cache_unlock(vlog->cc, page);
+      cache_unclaim(vlog->cc, page);
+      cache_unget(vlog->cc, page);
+      in += n;
+      addr += n;
+      length -= n;
+   }
+}
+
+static void
+value_log_free_extent(value_log *vlog, uint64 addr)
+{
+   uint8 ref = allocator_dec_ref(vlog->al, addr, PAGE_TYPE_BLOB);
+   platform_assert(ref == AL_NO_REFS);
+   cache_extent_discard(vlog->cc, addr, PAGE_TYPE_BLOB);
+   ref = allocator_dec_ref(vlog->al, addr, PAGE_TYPE_BLOB);
+   platform_assert(ref == AL_FREE);
+}
+
+/*
+ * Writes the directory to the extent the super block does not refer to,
+ * and switches the super block to it. Called with the lock held.
+ */
+static void
+value_log_write_dir(value_log *vlog)
+{
+   uint64 page_size = cache_page_size(vlog->cc);
+   uint64 dir_idx   = 1 - vlog->super.dir_idx;
+   uint64 addr      = vlog->super.dir_addr[dir_idx];
+   uint64 dir_size  = vlog->num_slots * sizeof(value_log_extent);
+
+   cache_extent_discard(vlog->cc, addr, PAGE_TYPE_BLOB);
+   for (uint64 offset = 0; offset < dir_size; offset += page_size) {
+      page_handle *page = cache_alloc(vlog->cc, addr + offset, PAGE_TYPE_BLOB);
+      memset(page->data, 0, page_size);
+      memmove(page->data,
+              (char *)vlog->dir + offset,
+              MIN(page_size, dir_size - offset));
+      cache_mark_dirty(vlog->cc, page);
+      cache_unlock(vlog->cc, page);
+      cache_unclaim(vlog->cc, page);
+      cache_unget(vlog->cc, page);
+   }
+
+   vlog->super.dir_idx   = dir_idx;
+   vlog->super.num_slots = vlog->num_slots;
+   vlog->super.next_id   = vlog->next_id;
+}
+
+/*
+ * Sets up the memory of a value log whose super is already set.
+ */
+static platform_status
+value_log_init(value_log       *vlog,
+               cache           *cc,
+               allocator       *al,
+               platform_heap_id hid,
+               uint64           threshold)
+{
+   vlog->cc        = cc;
+   vlog->al        = al;
+   vlog->heap_id   = hid;
+   vlog->threshold = threshold;
+   vlog->max_slots = cache_extent_size(cc) / sizeof(value_log_extent);
+   vlog->head_slot = vlog->max_slots;
+   vlog->num_slots = vlog->super.num_slots;
+   vlog->next_id   = vlog->super.next_id;
+   if (vlog->max_slots < vlog->num_slots) {
+      return STATUS_INVALID_STATE;
+   }
+
+   vlog->dir     = TYPED_ARRAY_ZALLOC(hid, vlog->dir, vlog->max_slots);
+   vlog->retired = TYPED_ARRAY_ZALLOC(
+      hid, vlog->retired, value_log_max_retired(vlog));
+   if (vlog->dir == NULL || vlog->retired == NULL) {
+      platform_free(hid, vlog->dir);
+      platform_free(hid, vlog->retired);
+      return STATUS_NO_MEMORY;
+   }
+
+   platform_status rc =
+      platform_mutex_init(&vlog->lock, platform_get_module_id(), hid);
+   if (!SUCCESS(rc)) {
+      platform_free(hid, vlog->dir);
+      platform_free(hid, vlog->retired);
+   }
+   return rc;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * value_log_create --
+ *
+ *      Creates an empty value log, allocating the extents of its directory.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+value_log_create(value_log       *vlog,
+                 cache           *cc,
+                 allocator       *al,
+                 platform_heap_id hid,
+                 uint64           threshold)
+{
+   ZERO_CONTENTS(vlog);
+   vlog->super.next_id = 1;
+   platform_status rc  = value_log_init(vlog, cc, al, hid, threshold);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   for (uint64 i = 0; i < ARRAY_SIZE(vlog->super.dir_addr); i++) {
+      uint64 addr;
+      rc                      = allocator_alloc(al, &addr, PAGE_TYPE_BLOB);
+      vlog->super.dir_addr[i] = addr;
+      if (!SUCCESS(rc)) {
+         if (i == 1) {
+            value_log_free_extent(vlog, vlog->super.dir_addr[0]);
+         }
+         value_log_unmount(vlog);
+         return rc;
+      }
+   }
+   return STATUS_OK;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * value_log_mount --
+ *
+ *      Loads the value log with the given super. The first append starts a
+ *      new head extent.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+value_log_mount(value_log             *vlog,
+                cache                 *cc,
+                allocator             *al,
+                platform_heap_id       hid,
+                uint64                 threshold,
+                const value_log_super *super)
+{
+   ZERO_CONTENTS(vlog);
+   vlog->super        = *super;
+   platform_status rc = value_log_init(vlog, cc, al, hid, threshold);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   value_log_copy_out(vlog,
+                      super->dir_addr[super->dir_idx],
+                      vlog->dir,
+                      vlog->num_slots * sizeof(value_log_extent));
+   return STATUS_OK;
+}
+
+/*
+ * Frees the retired extents, and writes the directory so that the super
+ * block can be written. No reader or snapshot may remain.
+ */
+void
+value_log_shutdown(value_log *vlog)
+{
+   platform_mutex_lock(&vlog->lock);
+   for (uint64 i = 0; i < vlog->num_retired; i++) {
+      value_log_free_extent(vlog, vlog->retired[i]);
+   }
+   vlog->num_retired = 0;
+   value_log_write_dir(vlog);
+   platform_mutex_unlock(&vlog->lock);
+}
+
+void
+value_log_unmount(value_log *vlog)
+{
+   platform_mutex_destroy(&vlog->lock);
+   platform_free(vlog->heap_id, vlog->dir);
+   platform_free(vlog->heap_id, vlog->retired);
+}
+
+/*
+ * Frees every extent of the value log and its memory.
+ */
+void
+value_log_destroy(value_log *vlog)
+{
+   for (uint64 slot = 0; slot < vlog->num_slots; slot++) {
+      if (vlog->dir[slot].addr != 0) {
+         value_log_free_extent(vlog, vlog->dir[slot].addr);
+      }
+   }
+   for (uint64 i = 0; i < vlog->num_retired; i++) {
+      value_log_free_extent(vlog, vlog->retired[i]);
+   }
+   for (uint64 i = 0; i < ARRAY_SIZE(vlog->super.dir_addr); i++) {
+      value_log_free_extent(vlog, vlog->super.dir_addr[i]);
+   }
+   value_log_unmount(vlog);
+}
+
+/*
+ * Starts a new head extent in a free slot. Called with the lock held.
+ */
+static platform_status
+value_log_new_head(value_log *vlog)
+{
+   uint64 slot = 0;
+   while (slot < vlog->num_slots && vlog->dir[slot].addr != 0) {
+      slot++;
+   }
+   if (slot == vlog->max_slots) {
+      return STATUS_NO_SPACE;
+   }
+
+   uint64          addr;
+   platform_status rc = allocator_alloc(vlog->al, &addr, PAGE_TYPE_BLOB);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   vlog->dir[slot] = (value_log_extent){.addr = addr};
+   vlog->num_slots = MAX(vlog->num_slots, slot + 1);
+   vlog->head_slot = slot;
+   return STATUS_OK;
+}
+
+/*
+ *-----------------------------------------------------------------------------
+ * value_log_append --
+ *
+ *      Appends a record of tuple_key and value to the head extent.
+ *
+ * Results:
+ *      STATUS_OK and the ref to the record, STATUS_BAD_PARAM if the record
+ *      would not fit in an extent, STATUS_NO_SPACE if the directory is full.
+ *-----------------------------------------------------------------------------
+ */
+platform_status
+value_log_append(value_log     *vlog,
+                 key            tuple_key,
+                 slice          value,
+                 value_log_ref *ref)
+{
+   uint64 extent_size = cache_extent_size(vlog->cc);
+   uint64 size =
+      value_log_record_size(key_length(tuple_key), slice_length(value));
+   if (extent_size < size) {
+      return STATUS_BAD_PARAM;
+   }
+
+   platform_mutex_lock(&vlog->lock);
+   if (vlog->head_slot == vlog->max_slots
+       || extent_size < vlog->dir[vlog->head_slot].used + size)
+   {
+      platform_status rc = value_log_new_head(vlog);
+      if (!SUCCESS(rc)) {
+         platform_mutex_unlock(&vlog->lock);
+         return rc;
+      }
+   }
+
+   value_log_extent    *head = &vlog->dir[vlog->head_slot];
+   uint64               addr = head->addr + head->used;
+   value_log_record_hdr hdr  = {
+       .id           = vlog->next_id++,
+       .value_length = slice_length(value),
+       .key_length   = key_length(tuple_key),
+   };
+   value_log_copy_in(vlog, addr, &hdr, sizeof(hdr));
+   value_log_copy_in(
+      vlog, addr + sizeof(hdr), key_data(tuple_key), key_length(tuple_key));
+   value_log_copy_in(vlog,
+                     addr + sizeof(hdr) + key_length(tuple_key),
+                     slice_data(value),
+                     slice_length(value));
+   head->used += size;
+
+   *ref = (value_log_ref){
+      .addr   = addr,
+      .id     = hdr.id,
+      .length = hdr.value_length,
+      .slot   = vlog->head_slot,
+   };
+   platform_mutex_unlock(&vlog->lock);
+   return STATUS_OK;
+}
+
+/*
+ * Reads the value ref refers to. The caller must be a reader.
+ */
+platform_status
+value_log_read(value_log           *vlog,
+               const value_log_ref *ref,
+               writable_buffer     *value)
+{
+   value_log_record_hdr hdr;
+   value_log_copy_out(vlog, ref->addr, &hdr, sizeof(hdr));
+   if (hdr.id != ref->id || hdr.value_length != ref->length) {
+      platform_error_log("value_log_read: bad record at %lu: id %lu length %u,"
+                         " expected id %lu length %u\n",
+                         ref->addr,
+                         hdr.id,
+                         hdr.value_length,
+                         ref->id,
+                         ref->length);
+      return STATUS_INVALID_STATE;
+   }
+
+   platform_status rc = writable_buffer_resize(value, ref->length);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   value_log_copy_out(vlog,
+                      ref->addr + sizeof(hdr) + hdr.key_length,
+                      writable_buffer_data(value),
+                      ref->length);
+   return STATUS_OK;
+}
+
+void
+value_log_pin(value_log *vlog)
+{
+   platform_mutex_lock(&vlog->lock);
+   vlog->num_pins++;
+   platform_mutex_unlock(&vlog->lock);
+}
+
+void
+value_log_unpin(value_log *vlog)
+{
+   platform_mutex_lock(&vlog->lock);
+   platform_assert(vlog->num_pins > 0);
+   vlog->num_pins--;
+   platform_mutex_unlock(&vlog->lock);
+}
+
+/*
+ * Counts the record msg refers to as garbage, for msg was dropped from the
+ * trunk, and requests garbage collection once its extent has enough.
+ */
+void
+value_log_note_garbage(value_log *vlog, key tuple_key, message msg)
+{
+   if (message_class(msg) != MESSAGE_TYPE_INSERT_INDIRECT) {
+      return;
+   }
+   value_log_ref ref = value_log_message_ref(msg);
+   uint64        extent_addr = allocator_config_extent_base_addr(
+      allocator_get_config(vlog->al), ref.addr);
+
+   platform_mutex_lock(&vlog->lock);
+   if (ref.slot < vlog->num_slots && vlog->dir[ref.slot].addr == extent_addr) {
+      value_log_extent *extent = &vlog->dir[ref.slot];
+      extent->garbage          = MIN(
+         extent->used,
+         extent->garbage
+            + value_log_record_size(key_length(tuple_key), ref.length));
+      if (ref.slot != vlog->head_slot
+          && VALUE_LOG_GC_GARBAGE_PERCENT * extent->used
+                <= 100 * extent->garbage)
+      {
+         __atomic_store_n(&vlog->gc_requested, TRUE, __ATOMIC_RELEASE);
+      }
+   }
+   platform_mutex_unlock(&vlog->lock);
+}
+
+/*
+ * Returns TRUE once after garbage collection was requested.
+ */
+bool32
+value_log_gc_requested(value_log *vlog)
+{
+   return __atomic_load_n(&vlog->gc_requested, __ATOMIC_ACQUIRE)
+          && __atomic_exchange_n(&vlog->gc_requested, FALSE, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Fills slots, of room for max_slots, with the extents to collect: those
+ * with enough garbage, or with all every one but the head. Returns how many.
+ */
+uint64
+value_log_gc_candidates(value_log *vlog, bool32 all, uint64 *slots)
+{
+   uint64 num = 0;
+   platform_mutex_lock(&vlog->lock);
+   uint64 room = value_log_max_retired(vlog) - vlog->num_retired;
+   for (uint64 slot = 0; slot < vlog->num_slots && num < room; slot++) {
+      value_log_extent *extent = &vlog->dir[slot];
+      if (extent->addr != 0 && slot != vlog->head_slot
+          && (all
+              || VALUE_LOG_GC_GARBAGE_PERCENT * extent->used
+                    <= 100 * extent->garbage))
+      {
+         slots[num++] = slot;
+      }
+   }
+   platform_mutex_unlock(&vlog->lock);
+   return num;
+}
+
+uint64
+value_log_extent_used(value_log *vlog, uint64 slot)
+{
+   platform_mutex_lock(&vlog->lock);
+   uint64 used = vlog->dir[slot].used;
+   platform_mutex_unlock(&vlog->lock);
+   return used;
+}
+
+/*
+ * Reads the key and the ref of the record at *offset in the extent in slot,
+ * and advances *offset to the next record.
+ */
+platform_status
+value_log_read_record(value_log     *vlog,
+                      uint64         slot,
+                      uint64        *offset,
+                      key_buffer    *tuple_key,
+                      value_log_ref *ref)
+{
+   platform_mutex_lock(&vlog->lock);
+   uint64 addr = vlog->dir[slot].addr + *offset;
+   platform_mutex_unlock(&vlog->lock);
+
+   value_log_record_hdr hdr;
+   value_log_copy_out(vlog, addr, &hdr, sizeof(hdr));
+   platform_status rc = key_buffer_resize(tuple_key, hdr.key_length);
+   if (!SUCCESS(rc)) {
+      return rc;
+   }
+   value_log_copy_out(
+      vlog, addr + sizeof(hdr), key_buffer_data(tuple_key), hdr.key_length);
+
+   *ref = (value_log_ref){
+      .addr   = addr,
+      .id     = hdr.id,
+      .length = hdr.value_length,
+      .slot   = slot,
+   };
+   *offset += value_log_record_size(hdr.key_length, hdr.value_length);
+   return STATUS_OK;
+}
+
+/*
+ * Removes the extent in slot, whose live records were copied, from the
+ * directory. It is freed by a later value_log_reclaim().
+ */
+void
+value_log_retire(value_log *vlog, uint64 slot)
+{
+   platform_mutex_lock(&vlog->lock);
+   debug_assert(slot != vlog->head_slot);
+   platform_assert(vlog->num_retired < value_log_max_retired(vlog));
+   vlog->retired[vlog->num_retired++] = vlog->dir[slot].addr;
+   ZERO_STRUCT(vlog->dir[slot]);
+   platform_mutex_unlock(&vlog->lock);
+}
+
+/*
+ * Frees the retired extents if no reader or snapshot could refer to them.
+ * Readers that start after an extent was retired find the refs of the
+ * copies, which are newer.
+ */
+void
+value_log_reclaim(value_log *vlog)
+{
+   platform_mutex_lock(&vlog->lock);
+   if (vlog->num_pins == 0
+       && __atomic_load_n(&vlog->num_readers, __ATOMIC_SEQ_CST) == 0)
+   {
+      for (uint64 i = 0; i < vlog->num_retired; i++) {
+         value_log_free_extent(vlog, vlog->retired[i]);
+      }
+      vlog->num_retired = 0;
+   }
+   platform_mutex_unlock(&vlog->lock);
+}
+
+/*
+ * Writes the directory for a checkpoint and returns the super for it. No
+ * extent is added to the log until value_log_checkpoint_end(), so the
+ * directory covers every extent the allocator captures in between.
+ */
+void
+value_log_checkpoint_begin(value_log *vlog, value_log_super *super)
+{
+   platform_mutex_lock(&vlog->lock);
+   value_log_write_dir(vlog);
+   *super = vlog->super;
+}
+
+void
+value_log_checkpoint_end(value_log *vlog)
+{
+   platform_mutex_unlock(&vlog->lock);
+}
+
+/*
+ * Returns the super of the directory as last written.
+ */
+void
+value_log_get_super(value_log *vlog, value_log_super *super)
+{
+   platform_mutex_lock(&vlog->lock);
+   *super = vlog->super;
+   platform_mutex_unlock(&vlog->lock);
+}
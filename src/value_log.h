@@ -0,0 +1,195 @@
+// Copyright 2018-2021 VMware, Inc.
+// SPDX-License-Identifier: Apache-2.0
+
+/*
+ * value_log.h --
+ *
+ *     This file contains the interface for the value log, which keeps large
+ *     values out of the trunk.
+ *
+ *     Values longer than the threshold are appended, with their key, to
+ *     extents of records, and the trunk stores a MESSAGE_TYPE_INSERT_INDIRECT
+ *     message holding a value_log_ref to the record instead. A directory
+ *     lists the extents with the bytes of records in each and the bytes of
+ *     those the trunk has dropped (garbage). The garbage collector copies the
+ *     live records of an extent with too much garbage to the head extent,
+ *     re-inserting their new refs, and then retires it; retired extents are
+ *     freed once no reader or snapshot can still refer to them.
+ */
+
+#pragma once
+
+#include "platform.h"
+#include "allocator.h"
+#include "cache.h"
+#include "util.h"
+#include "data_internal.h"
+
+/*
+ * An extent becomes a candidate for garbage collection once this percentage
+ * of its bytes is garbage.
+ */
+#define VALUE_LOG_GC_GARBAGE_PERCENT 50
+
+/*
+ * The payload of a MESSAGE_TYPE_INSERT_INDIRECT message.
+ */
+typedef struct ONDISK value_log_ref {
+   uint64 addr;   // of the record
+   uint64 id;     // of the record, unique over the life of the table
+   uint32 length; // of the value
+   uint32 slot;   // of the record's extent in the directory
+} value_log_ref;
+
+/*
+ * What the trunk super block keeps of the value log. The directory is
+ * written to the two extents in turn, so the one the super block on disk
+ * refers to is intact until the next super block is written.
+ */
+typedef struct ONDISK value_log_super {
+   uint64 dir_addr[2]; // 0 if the table has no value log
+   uint64 dir_idx;     // of the extent holding the directory
+   uint64 num_slots;
+   uint64 next_id;
+} value_log_super;
+
+/*
+ * ---------------------------------------------------------------
+ * Directory entry: Disk-resident structure.
+ * Page Type == PAGE_TYPE_BLOB
+ * ---------------------------------------------------------------
+ */
+typedef struct ONDISK value_log_extent {
+   uint64 addr;    // 0 if the slot is free
+   uint64 used;    // bytes of records appended
+   uint64 garbage; // bytes of records the trunk dropped
+} value_log_extent;
+
+typedef struct value_log {
+   cache           *cc;
+   allocator       *al;
+   platform_heap_id heap_id;
+   uint64           threshold; // values longer than this are separated
+
+   platform_mutex    lock;
+   value_log_super   super; // as last written
+   value_log_extent *dir;
+   uint64            num_slots; // slots in use or freed, at most max_slots
+   uint64            max_slots;
+   uint64            head_slot; // appended to, max_slots if none
+   uint64            next_id;
+   bool32            gc_requested;
+
+   // readers and snapshots, which keep retired extents from being freed
+   uint64  num_readers;
+   uint64  num_pins;
+   uint64 *retired;
+   uint64  num_retired;
+} value_log;
+
+platform_status
+value_log_create(value_log       *vlog,
+                 cache           *cc,
+                 allocator       *al,
+                 platform_heap_id hid,
+                 uint64           threshold);
+
+platform_status
+value_log_mount(value_log             *vlog,
+                cache                 *cc,
+                allocator             *al,
+                platform_heap_id       hid,
+                uint64                 threshold,
+                const value_log_super *super);
+
+void
+value_log_shutdown(value_log *vlog);
+
+void
+value_log_unmount(value_log *vlog);
+
+void
+value_log_destroy(value_log *vlog);
+
+static inline bool32
+value_log_should_separate(const value_log *vlog, uint64 value_length)
+{
+   return vlog->threshold < value_length;
+}
+
+platform_status
+value_log_append(value_log     *vlog,
+                 key            tuple_key,
+                 slice          value,
+                 value_log_ref *ref);
+
+platform_status
+value_log_read(value_log           *vlog,
+               const value_log_ref *ref,
+               writable_buffer     *value);
+
+static inline value_log_ref
+value_log_message_ref(message msg)
+{
+   debug_assert(message_class(msg) == MESSAGE_TYPE_INSERT_INDIRECT);
+   debug_assert(message_length(msg) == sizeof(value_log_ref));
+   value_log_ref ref;
+   memmove(&ref, message_data(msg), sizeof(ref));
+   return ref;
+}
+
+/*
+ * Readers bracket their use of refs with begin_read and end_read.
+ * Snapshots, whose trunks keep refs to retired extents, pin the log.
+ */
+static inline void
+value_log_begin_read(value_log *vlog)
+{
+   __atomic_fetch_add(&vlog->num_readers, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+value_log_end_read(value_log *vlog)
+{
+   __atomic_fetch_sub(&vlog->num_readers, 1, __ATOMIC_SEQ_CST);
+}
+
+void
+value_log_pin(value_log *vlog);
+
+void
+value_log_unpin(value_log *vlog);
+
+void
+value_log_note_garbage(value_log *vlog, key tuple_key, message msg);
+
+bool32
+value_log_gc_requested(value_log *vlog);
+
+uint64
+value_log_gc_candidates(value_log *vlog, bool32 all, uint64 *slots);
+
+platform_status
+value_log_read_record(value_log     *vlog,
+                      uint64         slot,
+                      uint64        *offset,
+                      key_buffer    *tuple_key,
+                      value_log_ref *ref);
+
+uint64
+value_log_extent_used(value_log *vlog, uint64 slot);
+
+void
+value_log_retire(value_log *vlog, uint64 slot);
+
+void
+value_log_reclaim(value_log *vlog);
+
+void
+value_log_checkpoint_begin(value_log *vlog, value_log_super *super);
+
+void
+value_log_checkpoint_end(value_log *vlog);
+
+void
+value_log_get_super(value_log *vlog, value_log_super *super);
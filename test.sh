@@ -825,6 +825,18 @@ function run_splinter_perf_tests() {
                                             --tree-size-gib 2 \
                                             --cache-capacity-mib 512
     rm db
+
+   # db_bench has no shared memory option; run it once, without.
+   if [ "$Use_shmem" = "" ]; then
+      run_with_timing "Quick db_bench run of all workloads" \
+           "$BINDIR"/db_bench --num 20000 \
+                              --threads 4 \
+                              --disk-size-mb 1024 \
+                              --benchmarks fillseq,fillrandom,overwrite,readrandom,readmissing,seekrandom,readwhilewriting,updaterandom,deleterandom \
+                              --db db \
+                              --output /dev/null
+      rm db
+   fi
 }
 
 # ##################################################################
@@ -27,6 +27,8 @@
 #include <stdlib.h> // Needed for system calls; e.g. free
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #include "splinterdb/splinterdb.h"
 #include "splinterdb/data.h"
@@ -38,6 +40,7 @@
 #include "ctest.h" // This is required for all test-case files.
 #include "btree.h" // for MAX_INLINE_MESSAGE_SIZE
 #include "config.h"
+#include "splinterdb_tests_private.h" // for splinterdb_get_allocator_handle
 
 #define TEST_MAX_KEY_SIZE 13
 
@@ -503,6 +506,459 @@ CTEST2(splinterdb_quick, test_splinterdb_iterator_with_startkey)
    }
 }
 
+/*
+ * Test case to exercise a bounded iterator over [start-key, end-key), with
+ * the range spanning tuples in both the trunk and the memtable. The iterator
+ * must stop before end-key going forwards and at start-key going backwards.
+ */
+CTEST2(splinterdb_quick, test_splinterdb_iterator_bounded)
+{
+   splinterdb_iterator *it = NULL;
+
+   // Keys [0, 50) end up in the trunk, [50, 100) stay in the memtable
+   int rc = insert_keys(data->kvsb, 0, 50, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, 50, 50, 1);
+   ASSERT_EQUAL(0, rc);
+
+   const int start_i                           = 40;
+   const int end_i                             = 60;
+   char      start_key[TEST_INSERT_KEY_LENGTH] = {0};
+   char      end_key[TEST_INSERT_KEY_LENGTH]   = {0};
+   snprintf(start_key, sizeof(start_key), key_fmt, start_i);
+   snprintf(end_key, sizeof(end_key), key_fmt, end_i);
+
+   rc = splinterdb_iterator_init_bounded(
+      data->kvsb,
+      &it,
+      slice_create(sizeof(start_key), start_key),
+      slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+
+   int i = start_i;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      rc = check_current_tuple(it, i);
+      ASSERT_EQUAL(0, rc);
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(end_i, i);
+   ASSERT_FALSE(splinterdb_iterator_can_next(it));
+
+   // Walk back down to start-key, and no further
+   ASSERT_TRUE(splinterdb_iterator_can_prev(it));
+   for (splinterdb_iterator_prev(it); splinterdb_iterator_valid(it);
+        splinterdb_iterator_prev(it))
+   {
+      i--;
+      rc = check_current_tuple(it, i);
+      ASSERT_EQUAL(0, rc);
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(start_i, i);
+   ASSERT_FALSE(splinterdb_iterator_can_prev(it));
+   splinterdb_iterator_deinit(it);
+
+   // An empty range yields nothing
+   rc = splinterdb_iterator_init_bounded(data->kvsb,
+                                         &it,
+                                         slice_create(sizeof(end_key), end_key),
+                                         slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   splinterdb_iterator_deinit(it);
+}
+
+/*
+ * Test case to exercise splinterdb_iterator_seek() forwards and backwards
+ * on a live iterator, over even keys spread across the trunk and memtable.
+ * Seeking to an odd key must land on the next even key.
+ */
+CTEST2(splinterdb_quick, test_splinterdb_iterator_seek)
+{
+   splinterdb_iterator *it = NULL;
+
+   // Even keys [0, 100) end up in the trunk, [100, 200) stay in the memtable
+   int rc = insert_keys(data->kvsb, 0, 50, 2);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, 100, 50, 2);
+   ASSERT_EQUAL(0, rc);
+
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+
+   const int seek_i[] = {10, 11, 150, 151, 3, 198, 0};
+   char      key[TEST_INSERT_KEY_LENGTH] = {0};
+   for (int s = 0; s < ARRAY_SIZE(seek_i); s++) {
+      snprintf(key, sizeof(key), key_fmt, seek_i[s]);
+      rc = splinterdb_iterator_seek(it, slice_create(sizeof(key), key));
+      ASSERT_EQUAL(0, rc);
+
+      // Scan a few keys from the seek position
+      int i = seek_i[s] + (seek_i[s] % 2);
+      for (int n = 0; n < 5 && i < 200; n++, i += 2) {
+         ASSERT_TRUE(splinterdb_iterator_valid(it));
+         rc = check_current_tuple(it, i);
+         ASSERT_EQUAL(0, rc);
+         splinterdb_iterator_next(it);
+      }
+   }
+
+   // Seeking past the last key leaves the iterator exhausted
+   snprintf(key, sizeof(key), key_fmt, 199);
+   rc = splinterdb_iterator_seek(it, slice_create(sizeof(key), key));
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+   ASSERT_FALSE(splinterdb_iterator_can_next(it));
+   ASSERT_TRUE(splinterdb_iterator_can_prev(it));
+
+   // NULL_SLICE goes back to the start
+   rc = splinterdb_iterator_seek(it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   rc = check_current_tuple(it, 0);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_iterator_deinit(it);
+
+   // Seeks on a bounded iterator are clamped to its range
+   char start_key[TEST_INSERT_KEY_LENGTH] = {0};
+   char end_key[TEST_INSERT_KEY_LENGTH]   = {0};
+   snprintf(start_key, sizeof(start_key), key_fmt, 40);
+   snprintf(end_key, sizeof(end_key), key_fmt, 60);
+   rc = splinterdb_iterator_init_bounded(
+      data->kvsb,
+      &it,
+      slice_create(sizeof(start_key), start_key),
+      slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+
+   snprintf(key, sizeof(key), key_fmt, 2);
+   rc = splinterdb_iterator_seek(it, slice_create(sizeof(key), key));
+   ASSERT_EQUAL(0, rc);
+   rc = check_current_tuple(it, 40);
+   ASSERT_EQUAL(0, rc);
+
+   snprintf(key, sizeof(key), key_fmt, 60);
+   rc = splinterdb_iterator_seek(it, slice_create(sizeof(key), key));
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+   splinterdb_iterator_deinit(it);
+}
+
+/*
+ * Test case to exercise splinterdb_iterator_next_batch(): batches are capped
+ * by tuple count and by buffer space, returned slices stay valid after the
+ * iterator moves on, and a buffer too small for one tuple yields ENOSPC.
+ */
+CTEST2(splinterdb_quick, test_splinterdb_iterator_next_batch)
+{
+   splinterdb_iterator *it = NULL;
+
+   const int num_keys = 100;
+   int       rc       = insert_keys(data->kvsb, 0, num_keys, 1);
+   ASSERT_EQUAL(0, rc);
+
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+
+   const uint64 tuple_size = TEST_INSERT_KEY_LENGTH + TEST_INSERT_VAL_LENGTH;
+   char buffer[16 * (TEST_INSERT_KEY_LENGTH + TEST_INSERT_VAL_LENGTH)];
+   slice        keys[16];
+   slice        values[16];
+   uint64       num_tuples;
+
+   // A buffer too small for the current tuple does not move the iterator
+   rc = splinterdb_iterator_next_batch(
+      it, 16, keys, values, buffer, tuple_size - 1, &num_tuples);
+   ASSERT_EQUAL(ENOSPC, rc);
+   ASSERT_EQUAL(0, num_tuples);
+   rc = check_current_tuple(it, 0);
+   ASSERT_EQUAL(0, rc);
+
+   // Alternate between count-limited (7) and space-limited (5) batches
+   int i = 0;
+   for (int b = 0; i < num_keys; b++) {
+      uint64 max_tuples  = b % 2 ? 16 : 7;
+      uint64 buffer_size = b % 2 ? 5 * tuple_size + 1 : sizeof(buffer);
+      rc                 = splinterdb_iterator_next_batch(
+         it, max_tuples, keys, values, buffer, buffer_size, &num_tuples);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(0 < num_tuples);
+      ASSERT_TRUE(num_tuples <= (b % 2 ? 5 : 7));
+
+      for (uint64 t = 0; t < num_tuples; t++, i++) {
+         char expected_key[TEST_INSERT_KEY_LENGTH] = {0};
+         char expected_val[TEST_INSERT_VAL_LENGTH] = {0};
+         snprintf(expected_key, sizeof(expected_key), key_fmt, i);
+         snprintf(expected_val, sizeof(expected_val), val_fmt, i);
+         ASSERT_EQUAL(TEST_INSERT_KEY_LENGTH, slice_length(keys[t]));
+         ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(values[t]));
+         ASSERT_EQUAL(0,
+                      memcmp(expected_key,
+                             slice_data(keys[t]),
+                             slice_length(keys[t])));
+         ASSERT_EQUAL(0,
+                      memcmp(expected_val,
+                             slice_data(values[t]),
+                             slice_length(values[t])));
+      }
+   }
+   ASSERT_EQUAL(num_keys, i);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+
+   // An exhausted iterator returns empty batches
+   rc = splinterdb_iterator_next_batch(
+      it, 16, keys, values, buffer, sizeof(buffer), &num_tuples);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(0, num_tuples);
+   splinterdb_iterator_deinit(it);
+}
+
+/*
+ * Test case to verify that lookups and iterators on a snapshot see the
+ * database as of snapshot creation, while the live database moves on.
+ */
+CTEST2(splinterdb_quick, test_splinterdb_snapshot)
+{
+   const int num_keys = 100;
+   int       rc       = insert_keys(data->kvsb, 0, num_keys, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_snapshot *snap = NULL;
+   rc                        = splinterdb_snapshot_create(data->kvsb, &snap);
+   ASSERT_EQUAL(0, rc);
+
+   // Delete key 0, overwrite key 2 and insert the odd keys
+   char  key[TEST_INSERT_KEY_LENGTH] = {0};
+   slice user_key                    = slice_create(sizeof(key), key);
+   snprintf(key, sizeof(key), key_fmt, 0);
+   rc = splinterdb_delete(data->kvsb, user_key);
+   ASSERT_EQUAL(0, rc);
+
+   const char *new_val = "overwritten";
+   snprintf(key, sizeof(key), key_fmt, 2);
+   rc = splinterdb_insert(
+      data->kvsb, user_key, slice_create(strlen(new_val), new_val));
+   ASSERT_EQUAL(0, rc);
+
+   rc = insert_keys(data->kvsb, 1, num_keys, 2);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   slice value;
+
+   // The snapshot still has key 0 and the old value of key 2
+   snprintf(key, sizeof(key), key_fmt, 0);
+   rc = splinterdb_snapshot_lookup(snap, user_key, &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(splinterdb_lookup_found(&result));
+   rc = splinterdb_lookup(data->kvsb, user_key, &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_lookup_found(&result));
+
+   snprintf(key, sizeof(key), key_fmt, 2);
+   rc = splinterdb_snapshot_lookup(snap, user_key, &result);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_lookup_result_value(&result, &value);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+
+   snprintf(key, sizeof(key), key_fmt, 1);
+   rc = splinterdb_snapshot_lookup(snap, user_key, &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_lookup_found(&result));
+   splinterdb_lookup_result_deinit(&result);
+
+   // A snapshot iterator sees exactly the even keys, with their old values
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_snapshot_iterator_init(snap, &it, NULL_SLICE, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int i = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      rc = check_current_tuple(it, 2 * i);
+      ASSERT_EQUAL(0, rc);
+      i++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys, i);
+   splinterdb_iterator_deinit(it);
+
+   // The live database sees the odd keys and not key 0
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   for (i = 0; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      i++;
+   }
+   ASSERT_EQUAL(2 * num_keys - 1, i);
+   splinterdb_iterator_deinit(it);
+
+   splinterdb_snapshot_release(snap);
+}
+
+/*
+ * Test case to verify that a range delete hides the keys in its range from
+ * lookups and iterators, but not from snapshots taken before it nor keys
+ * inserted after it, and that it survives close and reopen.
+ */
+CTEST2(splinterdb_quick, test_splinterdb_delete_range)
+{
+   const int num_keys  = 20000;
+   const int del_start = 5000;
+   const int del_end   = 15000;
+   int       rc        = insert_keys(data->kvsb, 0, num_keys, 1);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_snapshot *snap = NULL;
+   rc                        = splinterdb_snapshot_create(data->kvsb, &snap);
+   ASSERT_EQUAL(0, rc);
+
+   char  start_key[TEST_INSERT_KEY_LENGTH] = {0};
+   char  end_key[TEST_INSERT_KEY_LENGTH]   = {0};
+   char  key[TEST_INSERT_KEY_LENGTH]       = {0};
+   slice user_key                          = slice_create(sizeof(key), key);
+   snprintf(start_key, sizeof(start_key), key_fmt, del_start);
+   snprintf(end_key, sizeof(end_key), key_fmt, del_end);
+   rc = splinterdb_delete_range(data->kvsb,
+                                slice_create(sizeof(start_key), start_key),
+                                slice_create(sizeof(end_key), end_key));
+   ASSERT_EQUAL(0, rc);
+
+   // Re-insert one key of the range
+   rc = insert_keys(data->kvsb, del_start + 1, 1, 1);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int reopen = 0; reopen < 2; reopen++) {
+      for (int i = 0; i < num_keys; i += 100) {
+         for (int j = i; j < i + 2; j++) {
+            snprintf(key, sizeof(key), key_fmt, j);
+            rc = splinterdb_lookup(data->kvsb, user_key, &result);
+            ASSERT_EQUAL(0, rc);
+            bool32 deleted =
+               del_start <= j && j < del_end && j != del_start + 1;
+            ASSERT_EQUAL(!deleted, splinterdb_lookup_found(&result), "j=%d", j);
+         }
+      }
+
+      splinterdb_iterator *it = NULL;
+      rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+      ASSERT_EQUAL(0, rc);
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         int expected = i < del_start        ? i
+                        : i == del_start     ? del_start + 1
+                                             : i - del_start - 1 + del_end;
+         rc           = check_current_tuple(it, expected);
+         ASSERT_EQUAL(0, rc, "i=%d", i);
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(num_keys - (del_end - del_start) + 1, i);
+      splinterdb_iterator_deinit(it);
+
+      if (reopen == 0) {
+         // The snapshot predates the range delete
+         snprintf(key, sizeof(key), key_fmt, del_start);
+         rc = splinterdb_snapshot_lookup(snap, user_key, &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result));
+         rc = splinterdb_snapshot_iterator_init(
+            snap, &it, NULL_SLICE, NULL_SLICE);
+         ASSERT_EQUAL(0, rc);
+         i = 0;
+         for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+            i++;
+         }
+         ASSERT_EQUAL(num_keys, i);
+         splinterdb_iterator_deinit(it);
+         splinterdb_snapshot_release(snap);
+
+         splinterdb_lookup_result_deinit(&result);
+         splinterdb_close(&data->kvsb);
+         rc = splinterdb_open(&data->cfg, &data->kvsb);
+         ASSERT_EQUAL(0, rc);
+         splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify that a range delete over whole trunk pivots gives
+ * their space back at once, and leaves the keys around the range intact.
+ */
+CTEST2(splinterdb_quick, test_delete_range_frees_whole_pivots)
+{
+   const int num_keys  = 100000;
+   const int del_start = 10000;
+   const int del_end   = 90000;
+
+   // Small memtables and nodes, so the keys are flushed down to the leaves
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity     = MiB_TO_B(1);
+   data->cfg.fanout                = 4;
+   data->cfg.max_branches_per_node = 4;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char val[128] = {0};
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(
+         data->kvsb, slice_create(12, key), slice_create(sizeof(val), val));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   allocator *al = (allocator *)splinterdb_get_allocator_handle(data->kvsb);
+   uint64 in_use_before = allocator_in_use(al);
+
+   char start_key[16];
+   char end_key[16];
+   snprintf(start_key, sizeof(start_key), "%012d", del_start);
+   snprintf(end_key, sizeof(end_key), "%012d", del_end);
+   rc = splinterdb_delete_range(
+      data->kvsb, slice_create(12, start_key), slice_create(12, end_key));
+   ASSERT_EQUAL(0, rc);
+
+   // The pivots at either end straddle the range and keep their branches
+   uint64 in_use_after = allocator_in_use(al);
+   ASSERT_TRUE(in_use_after < in_use_before * 7 / 8,
+               "in_use_before=%lu in_use_after=%lu",
+               in_use_before,
+               in_use_after);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys; i += 97) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_lookup(data->kvsb, slice_create(12, key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 deleted = del_start <= i && i < del_end;
+      ASSERT_EQUAL(!deleted, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   int count = 0;
+   for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+      count++;
+   }
+   ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+   ASSERT_EQUAL(num_keys - (del_end - del_start), count);
+   splinterdb_iterator_deinit(it);
+}
+
 /*
  * Test case to exercise splinterdb iterator with a non-NULL but non-existent
  * start-key. The iterator just starts at the first key, if any, after the
@@ -728,6 +1184,1608 @@ CTEST2(splinterdb_quick, test_close_and_reopen)
    splinterdb_lookup_result_deinit(&result);
 }
 
+/*
+ * Test case to verify crash recovery from the log. A child process opens
+ * the database, inserts and deletes keys and exits without closing it. On
+ * re-open the log is replayed: only the tail of the log, in the page the
+ * child was still filling, may be lost.
+ */
+CTEST2(splinterdb_quick, test_log_replay_after_crash)
+{
+   const int num_base_keys  = 100;
+   const int num_crash_keys = 2000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, 0, num_base_keys, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char key[TEST_INSERT_KEY_LENGTH] = {0};
+   char val[TEST_INSERT_VAL_LENGTH] = {0};
+
+   pid_t pid = fork();
+   ASSERT_NOT_EQUAL(-1, pid);
+   if (pid == 0) {
+      // Don't use ASSERTs here, this is the child
+      if (splinterdb_open(&data->cfg, &data->kvsb)) {
+         _exit(1);
+      }
+      snprintf(key, sizeof(key), key_fmt, 0);
+      if (splinterdb_delete(data->kvsb, slice_create(sizeof(key), key))) {
+         _exit(1);
+      }
+      for (int i = num_base_keys; i < num_base_keys + num_crash_keys; i++) {
+         snprintf(key, sizeof(key), key_fmt, i);
+         snprintf(val, sizeof(val), val_fmt, i);
+         if (splinterdb_insert(data->kvsb,
+                               slice_create(sizeof(key), key),
+                               slice_create(sizeof(val), val)))
+         {
+            _exit(1);
+         }
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+
+   snprintf(key, sizeof(key), key_fmt, 0);
+   rc = splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_lookup_found(&result));
+
+   // The recovered keys are a prefix of those inserted
+   int num_recovered = 0;
+   for (int i = 1; i < num_base_keys + num_crash_keys; i++) {
+      snprintf(key, sizeof(key), key_fmt, i);
+      rc =
+         splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 found = splinterdb_lookup_found(&result);
+      if (i < num_base_keys) {
+         ASSERT_TRUE(found, "i=%d", i);
+      } else if (found) {
+         ASSERT_EQUAL(num_recovered, i - num_base_keys, "i=%d", i);
+         num_recovered++;
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+   ASSERT_TRUE(num_crash_keys / 2 < num_recovered);
+
+   // Recovery leaves a cleanly closable and re-openable database
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+/*
+ * Test case to verify that log replay re-applies a range delete: the keys it
+ * deleted stay deleted, and those inserted after it are recovered.
+ */
+CTEST2(splinterdb_quick, test_delete_range_log_replay_after_crash)
+{
+   const int num_keys  = 1000;
+   const int del_start = 200;
+   const int del_end   = 700;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char start_key[TEST_INSERT_KEY_LENGTH] = {0};
+   char end_key[TEST_INSERT_KEY_LENGTH]   = {0};
+   char key[TEST_INSERT_KEY_LENGTH]       = {0};
+   snprintf(start_key, sizeof(start_key), key_fmt, del_start);
+   snprintf(end_key, sizeof(end_key), key_fmt, del_end);
+
+   pid_t pid = fork();
+   ASSERT_NOT_EQUAL(-1, pid);
+   if (pid == 0) {
+      // Don't use ASSERTs here, this is the child
+      data->cfg.durability = SPLINTERDB_DURABILITY_SYNCED;
+      if (splinterdb_open(&data->cfg, &data->kvsb)) {
+         _exit(1);
+      }
+      if (insert_keys(data->kvsb, 0, num_keys, 1)) {
+         _exit(1);
+      }
+      if (splinterdb_delete_range(data->kvsb,
+                                  slice_create(sizeof(start_key), start_key),
+                                  slice_create(sizeof(end_key), end_key)))
+      {
+         _exit(1);
+      }
+      if (insert_keys(data->kvsb, del_start, 1, 1)) {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), key_fmt, i);
+      rc =
+         splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      bool32 deleted = del_start < i && i < del_end;
+      ASSERT_EQUAL(!deleted, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify that writes made with SPLINTERDB_DURABILITY_SYNCED all
+ * survive a crash, both as single inserts and as a write batch.
+ */
+CTEST2(splinterdb_quick, test_log_synced_writes_after_crash)
+{
+   const int num_base_keys  = 100;
+   const int num_crash_keys = 200;
+#define NUM_BATCH_KEYS 50
+   const int num_batch_keys = NUM_BATCH_KEYS;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   rc = insert_keys(data->kvsb, 0, num_base_keys, 1);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char key[TEST_INSERT_KEY_LENGTH] = {0};
+   char val[TEST_INSERT_VAL_LENGTH] = {0};
+
+   pid_t pid = fork();
+   ASSERT_NOT_EQUAL(-1, pid);
+   if (pid == 0) {
+      // Don't use ASSERTs here, this is the child
+      data->cfg.durability = SPLINTERDB_DURABILITY_SYNCED;
+      if (splinterdb_open(&data->cfg, &data->kvsb)) {
+         _exit(1);
+      }
+      if (insert_keys(data->kvsb, num_base_keys, num_crash_keys, 1)) {
+         _exit(1);
+      }
+
+      char batch_keys[NUM_BATCH_KEYS][TEST_INSERT_KEY_LENGTH];
+      splinterdb_write_batch_entry batch[NUM_BATCH_KEYS];
+      for (int i = 0; i < num_batch_keys; i++) {
+         snprintf(batch_keys[i],
+                  sizeof(batch_keys[i]),
+                  key_fmt,
+                  num_base_keys + num_crash_keys + i);
+         batch[i] = (splinterdb_write_batch_entry){
+            .op    = SPLINTERDB_WRITE_INSERT,
+            .key   = slice_create(sizeof(batch_keys[i]), batch_keys[i]),
+            .value = slice_create(sizeof(val), val)};
+      }
+      if (splinterdb_write_batch(data->kvsb, num_batch_keys, batch)) {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_base_keys + num_crash_keys + num_batch_keys; i++) {
+      snprintf(key, sizeof(key), key_fmt, i);
+      rc =
+         splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify that a table without a log recovers from a crash to its
+ * latest checkpoint, and that writes made after it are lost.
+ */
+CTEST2(splinterdb_quick, test_checkpoint_after_crash)
+{
+   const int num_ckpt_keys  = 20000;
+   const int num_crash_keys = 2000;
+
+   splinterdb_close(&data->kvsb);
+
+   char key[TEST_INSERT_KEY_LENGTH] = {0};
+
+   pid_t pid = fork();
+   ASSERT_NOT_EQUAL(-1, pid);
+   if (pid == 0) {
+      // Don't use ASSERTs here, this is the child
+      if (splinterdb_open(&data->cfg, &data->kvsb)
+          || insert_keys(data->kvsb, 0, num_ckpt_keys / 2, 1)
+          || splinterdb_checkpoint(data->kvsb)
+          || insert_keys(data->kvsb, num_ckpt_keys / 2, num_ckpt_keys / 2, 1)
+          || splinterdb_checkpoint(data->kvsb))
+      {
+         _exit(1);
+      }
+      snprintf(key, sizeof(key), key_fmt, 0);
+      if (splinterdb_delete(data->kvsb, slice_create(sizeof(key), key))
+          || insert_keys(data->kvsb, num_ckpt_keys, num_crash_keys, 1))
+      {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   int rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_ckpt_keys + num_crash_keys; i++) {
+      snprintf(key, sizeof(key), key_fmt, i);
+      rc =
+         splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(i < num_ckpt_keys,
+                   splinterdb_lookup_found(&result),
+                   "i=%d",
+                   i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   // Recovery leaves a cleanly closable and re-openable database
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+/*
+ * Test case to verify that a table with a log recovers from a crash to its
+ * latest checkpoint plus the log written since.
+ */
+CTEST2(splinterdb_quick, test_checkpoint_log_replay_after_crash)
+{
+   const int num_ckpt_keys  = 20000;
+   const int num_crash_keys = 2000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   splinterdb_close(&data->kvsb);
+
+   char key[TEST_INSERT_KEY_LENGTH] = {0};
+
+   pid_t pid = fork();
+   ASSERT_NOT_EQUAL(-1, pid);
+   if (pid == 0) {
+      // Don't use ASSERTs here, this is the child
+      if (splinterdb_open(&data->cfg, &data->kvsb)
+          || insert_keys(data->kvsb, 0, num_ckpt_keys, 1)
+          || splinterdb_checkpoint(data->kvsb))
+      {
+         _exit(1);
+      }
+      snprintf(key, sizeof(key), key_fmt, 0);
+      if (splinterdb_delete(data->kvsb, slice_create(sizeof(key), key))
+          || insert_keys(data->kvsb, num_ckpt_keys, num_crash_keys, 1)
+          || splinterdb_sync(data->kvsb, SPLINTERDB_DURABILITY_BUFFERED))
+      {
+         _exit(1);
+      }
+      _exit(0);
+   }
+   int status;
+   ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+   ASSERT_TRUE(WIFEXITED(status));
+   ASSERT_EQUAL(0, WEXITSTATUS(status));
+
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < num_ckpt_keys + num_crash_keys; i++) {
+      snprintf(key, sizeof(key), key_fmt, i);
+      rc =
+         splinterdb_lookup(data->kvsb, slice_create(sizeof(key), key), &result);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(i != 0, splinterdb_lookup_found(&result), "i=%d", i);
+   }
+   splinterdb_lookup_result_deinit(&result);
+}
+
+/*
+ * Test case to verify that durability is refused without a log.
+ */
+CTEST2(splinterdb_quick, test_durability_requires_log)
+{
+   ASSERT_EQUAL(0, splinterdb_sync(data->kvsb, SPLINTERDB_DURABILITY_NONE));
+   ASSERT_EQUAL(EINVAL,
+                splinterdb_sync(data->kvsb, SPLINTERDB_DURABILITY_SYNCED));
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.durability = SPLINTERDB_DURABILITY_BUFFERED;
+   int rc               = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   // Re-create, as teardown closes the table
+   data->cfg.durability = SPLINTERDB_DURABILITY_NONE;
+   rc                   = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+}
+
+/*
+ * Test case to verify that splinterdb_lookup_batch() returns the same
+ * results as individual lookups, with a cold cache so that lookups go
+ * through the async IO path. Includes keys that are not found and one
+ * key that is too large, which should only fail its own lookup.
+ */
+CTEST2(splinterdb_quick, test_lookup_batch)
+{
+   const int num_inserts = 500;
+   const int num_lookups = num_inserts + 100;
+
+   int rc = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+
+   // Close and re-open the database, so lookups must read from disk
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char(*key_data)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_lookups, TEST_INSERT_KEY_LENGTH);
+   slice                    *keys     = calloc(num_lookups, sizeof(*keys));
+   splinterdb_lookup_result *results  = calloc(num_lookups, sizeof(*results));
+   int                      *statuses = calloc(num_lookups, sizeof(*statuses));
+   ASSERT_TRUE(key_data && keys && results && statuses);
+
+   for (int i = 0; i < num_lookups; i++) {
+      snprintf(key_data[i], TEST_INSERT_KEY_LENGTH, key_fmt, i);
+      keys[i] = slice_create(TEST_INSERT_KEY_LENGTH, key_data[i]);
+      splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+   }
+
+   char too_large_key_data[TEST_MAX_KEY_SIZE + 1];
+   memset(too_large_key_data, 'a', sizeof(too_large_key_data));
+   const int bad_key = num_lookups / 2;
+   keys[bad_key] = slice_create(sizeof(too_large_key_data), too_large_key_data);
+
+   rc = splinterdb_lookup_batch(
+      data->kvsb, num_lookups, keys, results, statuses);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   for (int i = 0; i < num_lookups; i++) {
+      if (i == bad_key) {
+         ASSERT_EQUAL(EINVAL, statuses[i]);
+         continue;
+      }
+      ASSERT_EQUAL(0, statuses[i], "i=%d", i);
+      if (i >= num_inserts) {
+         ASSERT_FALSE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+         continue;
+      }
+      ASSERT_TRUE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+
+      char val[TEST_INSERT_VAL_LENGTH] = {0};
+      snprintf(val, sizeof(val), val_fmt, i);
+      slice value;
+      rc = splinterdb_lookup_result_value(&results[i], &value);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(sizeof(val), slice_length(value));
+      ASSERT_STREQN(val, slice_data(value), slice_length(value));
+   }
+
+   for (int i = 0; i < num_lookups; i++) {
+      splinterdb_lookup_result_deinit(&results[i]);
+   }
+   free(statuses);
+   free(results);
+   free(keys);
+   free(key_data);
+}
+
+/*
+ * Test case to verify splinterdb_write_batch(): a batch spanning several
+ * trunk-level chunks, with the log enabled, applies its inserts and deletes
+ * in order, and a batch with an invalid entry is rejected without effect.
+ */
+CTEST2(splinterdb_quick, test_write_batch)
+{
+   const int num_keys = 1000;
+
+   // Recreate with the log enabled, to exercise batched log appends
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_log = TRUE;
+   int rc            = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char(*key_data)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_keys, TEST_INSERT_KEY_LENGTH);
+   char(*val_data)[TEST_INSERT_VAL_LENGTH] =
+      calloc(num_keys, TEST_INSERT_VAL_LENGTH);
+   // Insert all keys, then delete every 3rd key, in the same batch
+   const int                     num_entries = num_keys + num_keys / 3 + 1;
+   splinterdb_write_batch_entry *entries =
+      calloc(num_entries, sizeof(*entries));
+   ASSERT_TRUE(key_data && val_data && entries);
+
+   int e = 0;
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key_data[i], TEST_INSERT_KEY_LENGTH, key_fmt, i);
+      snprintf(val_data[i], TEST_INSERT_VAL_LENGTH, val_fmt, i);
+      entries[e++] = (splinterdb_write_batch_entry){
+         .op    = SPLINTERDB_WRITE_INSERT,
+         .key   = slice_create(TEST_INSERT_KEY_LENGTH, key_data[i]),
+         .value = slice_create(TEST_INSERT_VAL_LENGTH, val_data[i])};
+   }
+   for (int i = 0; i < num_keys; i += 3) {
+      entries[e++] = (splinterdb_write_batch_entry){
+         .op  = SPLINTERDB_WRITE_DELETE,
+         .key = slice_create(TEST_INSERT_KEY_LENGTH, key_data[i])};
+   }
+   ASSERT_EQUAL(num_entries, e);
+
+   // An update without merge_tuples is invalid, so nothing is applied
+   entries[num_keys].op = SPLINTERDB_WRITE_UPDATE;
+   rc = splinterdb_write_batch(data->kvsb, num_entries, entries);
+   ASSERT_EQUAL(EINVAL, rc);
+   entries[num_keys].op = SPLINTERDB_WRITE_DELETE;
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   rc = splinterdb_lookup(data->kvsb, entries[1].key, &result);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_lookup_found(&result));
+
+   rc = splinterdb_write_batch(data->kvsb, num_entries, entries);
+   ASSERT_EQUAL(0, rc);
+
+   for (int i = 0; i < num_keys; i++) {
+      slice key = slice_create(TEST_INSERT_KEY_LENGTH, key_data[i]);
+      rc        = splinterdb_lookup(data->kvsb, key, &result);
+      ASSERT_EQUAL(0, rc);
+      if (i % 3 == 0) {
+         ASSERT_FALSE(splinterdb_lookup_found(&result), "i=%d", i);
+         continue;
+      }
+      ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+      slice value;
+      rc = splinterdb_lookup_result_value(&result, &value);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_EQUAL(TEST_INSERT_VAL_LENGTH, slice_length(value));
+      ASSERT_STREQN(val_data[i], slice_data(value), slice_length(value));
+   }
+
+   splinterdb_lookup_result_deinit(&result);
+   free(entries);
+   free(val_data);
+   free(key_data);
+}
+
+/*
+ * Callback for test_lookup_async: counts completed lookups that found
+ * their key.
+ */
+static void
+count_found_callback(slice key, splinterdb_lookup_result *result, void *arg)
+{
+   int *num_found = arg;
+   if (splinterdb_lookup_found(result)) {
+      (*num_found)++;
+   }
+}
+
+/*
+ * Test case to verify the async lookup API: lookups either complete
+ * immediately or are completed, with their callback called, by a later poll.
+ */
+CTEST2(splinterdb_quick, test_lookup_async)
+{
+   const int num_inserts  = 300;
+   const int max_inflight = 16;
+
+   int rc = insert_keys(data->kvsb, 0, num_inserts, 1);
+   ASSERT_EQUAL(0, rc);
+
+   // Close and re-open the database, so lookups must read from disk
+   splinterdb_close(&data->kvsb);
+   rc = splinterdb_open(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_async_poller *poller;
+   rc = splinterdb_async_poller_create(data->kvsb, max_inflight, &poller);
+   ASSERT_EQUAL(0, rc);
+
+   char(*key_data)[TEST_INSERT_KEY_LENGTH] =
+      calloc(num_inserts, TEST_INSERT_KEY_LENGTH);
+   splinterdb_lookup_result *results = calloc(num_inserts, sizeof(*results));
+   ASSERT_TRUE(key_data && results);
+
+   int num_found_now     = 0;
+   int num_found_later   = 0;
+   int num_ever_inflight = 0;
+   for (int i = 0; i < num_inserts; i++) {
+      snprintf(key_data[i], TEST_INSERT_KEY_LENGTH, key_fmt, i);
+      slice key = slice_create(TEST_INSERT_KEY_LENGTH, key_data[i]);
+      splinterdb_lookup_result_init(data->kvsb, &results[i], 0, NULL);
+
+      do {
+         rc = splinterdb_lookup_async(
+            poller, key, &results[i], count_found_callback, &num_found_later);
+         if (rc == EAGAIN) {
+            ASSERT_EQUAL(max_inflight, splinterdb_async_poll(poller));
+         }
+      } while (rc == EAGAIN);
+
+      if (rc == 0) {
+         ASSERT_TRUE(splinterdb_lookup_found(&results[i]), "i=%d", i);
+         num_found_now++;
+      } else {
+         ASSERT_EQUAL(EINPROGRESS, rc, "i=%d", i);
+         num_ever_inflight++;
+      }
+   }
+
+   while (splinterdb_async_poll(poller) > 0) {
+   }
+   splinterdb_async_poller_destroy(poller);
+
+   ASSERT_EQUAL(num_inserts, num_found_now + num_found_later);
+   ASSERT_EQUAL(num_ever_inflight, num_found_later);
+   // Cold cache: at least the first lookup must have had to read a page.
+   ASSERT_NOT_EQUAL(0, num_ever_inflight);
+
+   for (int i = 0; i < num_inserts; i++) {
+      splinterdb_lookup_result_deinit(&results[i]);
+   }
+   free(results);
+   free(key_data);
+}
+
+/*
+ * Record source for test_bulk_load: keys "%012d" of i = 0, 1, ... num_keys-1,
+ * each with a 100-byte value starting with i, except that key
+ * out_of_order_at, if not -1, repeats the key before it.
+ */
+typedef struct {
+   int  next;
+   int  num_keys;
+   int  out_of_order_at;
+   char key[16];
+   char value[100];
+} bulk_load_source;
+
+static int
+bulk_load_next(void *arg, slice *key, slice *value)
+{
+   bulk_load_source *src = arg;
+   if (src->next == src->num_keys) {
+      return ENOENT;
+   }
+   int i = src->next++;
+   if (i == src->out_of_order_at) {
+      i--;
+   }
+   snprintf(src->key, sizeof(src->key), "%012d", i);
+   memcpy(src->value, &i, sizeof(i));
+   *key   = slice_create(12, src->key);
+   *value = slice_create(sizeof(src->value), src->value);
+   return 0;
+}
+
+/*
+ * Test case to verify that a bulk load into an empty table, over many
+ * leaves and an index level, reads back like inserts would, and that a
+ * load into a non-empty table or of unsorted keys fails without effect.
+ */
+CTEST2(splinterdb_quick, test_bulk_load)
+{
+   const int num_keys = 100000;
+
+   // Small nodes, so the keys span many leaves and more than one level
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity     = MiB_TO_B(1);
+   data->cfg.fanout                = 4;
+   data->cfg.max_branches_per_node = 4;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   // A failed load gives back the space of what it built
+   allocator *al     = (allocator *)splinterdb_get_allocator_handle(data->kvsb);
+   uint64     in_use = allocator_in_use(al);
+
+   bulk_load_source src = {.num_keys = num_keys, .out_of_order_at = 50000};
+   rc = splinterdb_bulk_load(data->kvsb, bulk_load_next, &src);
+   ASSERT_EQUAL(EINVAL, rc);
+   ASSERT_EQUAL(in_use, allocator_in_use(al));
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(splinterdb_iterator_valid(it));
+   splinterdb_iterator_deinit(it);
+
+   src = (bulk_load_source){.num_keys = num_keys, .out_of_order_at = -1};
+   rc  = splinterdb_bulk_load(data->kvsb, bulk_load_next, &src);
+   ASSERT_EQUAL(0, rc);
+
+   src = (bulk_load_source){.num_keys = 1, .out_of_order_at = -1};
+   rc  = splinterdb_bulk_load(data->kvsb, bulk_load_next, &src);
+   ASSERT_EQUAL(EINVAL, rc);
+
+   // Writes after the load are newer than it, and flush into its leaves
+   char key[16];
+   int  value;
+   for (int i = 0; i < num_keys; i += 3) {
+      snprintf(key, sizeof(key), "%012d", i);
+      value   = -i;
+      slice v = slice_create(sizeof(value), &value);
+      rc      = splinterdb_insert(data->kvsb, slice_create(12, key), v);
+      ASSERT_EQUAL(0, rc);
+   }
+
+   for (int pass = 0; pass < 2; pass++) {
+      splinterdb_lookup_result result;
+      splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+      for (int i = 0; i < num_keys; i += 89) {
+         snprintf(key, sizeof(key), "%012d", i);
+         rc = splinterdb_lookup(data->kvsb, slice_create(12, key), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+         slice found;
+         rc = splinterdb_lookup_result_value(&result, &found);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(sizeof(value) <= slice_length(found));
+         memcpy(&value, slice_data(found), sizeof(value));
+         ASSERT_EQUAL(i % 3 == 0 ? -i : i, value, "i=%d", i);
+      }
+      splinterdb_lookup_result_deinit(&result);
+
+      rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+      ASSERT_EQUAL(0, rc);
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         slice k, v;
+         splinterdb_iterator_get_current(it, &k, &v);
+         snprintf(key, sizeof(key), "%012d", i);
+         ASSERT_EQUAL(0, memcmp(key, slice_data(k), 12), "i=%d", i);
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(num_keys, i);
+      splinterdb_iterator_deinit(it);
+
+      // The load persists across a clean close
+      splinterdb_close(&data->kvsb);
+      rc = splinterdb_open(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+   }
+}
+
+/*
+ * Test case to verify that an ingest file, written offline, ingests into an
+ * empty table and into one that holds data, where its records are newer than
+ * the earlier writes and older than the later ones.
+ */
+CTEST2(splinterdb_quick, test_ingest)
+{
+   const int   num_keys    = 100000;
+   const char *ingest_file = TEST_DB_NAME ".ingest";
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity     = MiB_TO_B(1);
+   data->cfg.fanout                = 4;
+   data->cfg.max_branches_per_node = 4;
+
+   splinterdb_ingest_writer *writer = NULL;
+   int rc = splinterdb_ingest_writer_create(&data->cfg, ingest_file, &writer);
+   ASSERT_EQUAL(0, rc);
+   bulk_load_source src = {.num_keys = num_keys, .out_of_order_at = -1};
+   slice            key, value;
+   while (bulk_load_next(&src, &key, &value) == 0) {
+      rc = splinterdb_ingest_writer_add(writer, key, value);
+      ASSERT_EQUAL(0, rc);
+   }
+   // The writer rejects a key that is not greater than the last one
+   rc = splinterdb_ingest_writer_add(writer, key, value);
+   ASSERT_EQUAL(EINVAL, rc);
+   rc = splinterdb_ingest_writer_finish(writer);
+   ASSERT_EQUAL(0, rc);
+
+   char kbuf[16];
+   int  v;
+   for (int empty = 1; empty >= 0; empty--) {
+      rc = splinterdb_create(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      rc = splinterdb_ingest(data->kvsb, TEST_DB_NAME ".no-such-file");
+      ASSERT_EQUAL(ENOENT, rc);
+      for (int i = 0; !empty && i < num_keys; i += 5) {
+         snprintf(kbuf, sizeof(kbuf), "%012d", i);
+         v  = -i;
+         rc = splinterdb_insert(
+            data->kvsb, slice_create(12, kbuf), slice_create(sizeof(v), &v));
+         ASSERT_EQUAL(0, rc);
+      }
+      rc = splinterdb_ingest(data->kvsb, ingest_file);
+      ASSERT_EQUAL(0, rc);
+      for (int i = 0; i < num_keys; i += 7) {
+         snprintf(kbuf, sizeof(kbuf), "%012d", i);
+         v  = -i;
+         rc = splinterdb_insert(
+            data->kvsb, slice_create(12, kbuf), slice_create(sizeof(v), &v));
+         ASSERT_EQUAL(0, rc);
+      }
+
+      splinterdb_lookup_result result;
+      splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+      for (int i = 0; i < num_keys; i += 13) {
+         snprintf(kbuf, sizeof(kbuf), "%012d", i);
+         rc = splinterdb_lookup(data->kvsb, slice_create(12, kbuf), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+         slice found;
+         rc = splinterdb_lookup_result_value(&result, &found);
+         ASSERT_EQUAL(0, rc);
+         memcpy(&v, slice_data(found), sizeof(v));
+         ASSERT_EQUAL(i % 7 == 0 ? -i : i, v, "empty=%d i=%d", empty, i);
+      }
+      splinterdb_lookup_result_deinit(&result);
+
+      splinterdb_iterator *it = NULL;
+      rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+      ASSERT_EQUAL(0, rc);
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         slice k, val;
+         splinterdb_iterator_get_current(it, &k, &val);
+         snprintf(kbuf, sizeof(kbuf), "%012d", i);
+         ASSERT_EQUAL(0, memcmp(kbuf, slice_data(k), 12), "i=%d", i);
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(num_keys, i);
+      splinterdb_iterator_deinit(it);
+
+      if (empty) {
+         splinterdb_close(&data->kvsb);
+      }
+   }
+   unlink(ingest_file);
+}
+
+typedef struct scan_sum {
+   int    stop_at;
+   uint64 num_filtered;
+   uint64 num_tuples;
+   uint64 sum;
+} scan_sum;
+
+// Skips odd keys
+static _Bool
+scan_sum_filter(void *arg, slice key)
+{
+   scan_sum   *state = arg;
+   const char *data  = slice_data(key);
+   state->num_filtered++;
+   return (data[slice_length(key) - 1] - '0') % 2 == 0;
+}
+
+static int
+scan_sum_tuple(void *arg, slice key, slice value)
+{
+   scan_sum *state = arg;
+   int       v;
+   memcpy(&v, slice_data(value), sizeof(v));
+   state->num_tuples++;
+   state->sum += v;
+   return v == state->stop_at ? ECANCELED : 0;
+}
+
+/*
+ * Test case to verify that a scan calls back on each tuple in its range,
+ * skips those the key filter rejects and stops when the callback asks.
+ */
+CTEST2(splinterdb_quick, test_scan)
+{
+   const int num_keys = 100000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity = MiB_TO_B(1);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char end[16];
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(
+         data->kvsb, slice_create(12, key), slice_create(sizeof(i), &i));
+      ASSERT_EQUAL(0, rc);
+   }
+   for (int i = 0; i < num_keys; i += 10) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_delete(data->kvsb, slice_create(12, key));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   scan_sum state = {.stop_at = -1};
+   rc = splinterdb_scan(
+      data->kvsb, NULL_SLICE, NULL_SLICE, NULL, scan_sum_tuple, &state);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_keys / 10 * 9, state.num_tuples);
+   uint64 sum = (uint64)num_keys * (num_keys - 1) / 2;
+   for (int i = 0; i < num_keys; i += 10) {
+      sum -= i;
+   }
+   ASSERT_EQUAL(sum, state.sum);
+
+   // Even keys in [1000, 2000), where keys ending in 0 are deleted
+   snprintf(key, sizeof(key), "%012d", 1000);
+   snprintf(end, sizeof(end), "%012d", 2000);
+   state = (scan_sum){.stop_at = -1};
+   rc    = splinterdb_scan(data->kvsb,
+                        slice_create(12, key),
+                        slice_create(12, end),
+                        scan_sum_filter,
+                        scan_sum_tuple,
+                        &state);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(900, state.num_filtered);
+   ASSERT_EQUAL(400, state.num_tuples);
+
+   // The callback stops the scan, and its return value is passed back
+   state = (scan_sum){.stop_at = 1501};
+   rc    = splinterdb_scan(data->kvsb,
+                        slice_create(12, key),
+                        NULL_SLICE,
+                        NULL,
+                        scan_sum_tuple,
+                        &state);
+   ASSERT_EQUAL(ECANCELED, rc);
+   ASSERT_EQUAL(451, state.num_tuples);
+}
+
+/*
+ * Test case to verify that a range splits into parts of about the same
+ * number of tuples, and that a parallel scan of them sees every tuple once.
+ */
+CTEST2(splinterdb_quick, test_parallel_scan)
+{
+#define NUM_PARTS 4
+   const int num_keys  = 100000;
+   const int num_parts = NUM_PARTS;
+
+   // Small nodes, so the keys span many leaves
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity     = MiB_TO_B(1);
+   data->cfg.fanout                = 4;
+   data->cfg.max_branches_per_node = 4;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   // A bulk load spreads the keys over leaves at once
+   bulk_load_source src = {.num_keys = num_keys, .out_of_order_at = -1};
+   rc = splinterdb_bulk_load(data->kvsb, bulk_load_next, &src);
+   ASSERT_EQUAL(0, rc);
+
+   slice  split_keys[NUM_PARTS - 1];
+   char   buffer[NUM_PARTS * 12];
+   uint64 num_split_keys;
+   rc = splinterdb_split_range(data->kvsb,
+                               NULL_SLICE,
+                               NULL_SLICE,
+                               num_parts,
+                               split_keys,
+                               buffer,
+                               12,
+                               &num_split_keys);
+   ASSERT_EQUAL(ENOSPC, rc);
+   rc = splinterdb_split_range(data->kvsb,
+                               NULL_SLICE,
+                               NULL_SLICE,
+                               num_parts,
+                               split_keys,
+                               buffer,
+                               sizeof(buffer),
+                               &num_split_keys);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_parts - 1, num_split_keys);
+   for (uint64 i = 0; i <= num_split_keys; i++) {
+      scan_sum state = {.stop_at = -1};
+      rc             = splinterdb_scan(data->kvsb,
+                           i == 0 ? NULL_SLICE : split_keys[i - 1],
+                           i == num_split_keys ? NULL_SLICE : split_keys[i],
+                           NULL,
+                           scan_sum_tuple,
+                           &state);
+      ASSERT_EQUAL(0, rc);
+      ASSERT_TRUE(num_keys / num_parts / 2 <= state.num_tuples
+                     && state.num_tuples <= num_keys / num_parts * 2,
+                  "part %lu has %lu tuples",
+                  i,
+                  state.num_tuples);
+   }
+
+   scan_sum states[NUM_PARTS];
+   void    *args[NUM_PARTS];
+   for (int i = 0; i < num_parts; i++) {
+      states[i] = (scan_sum){.stop_at = -1};
+      args[i]   = &states[i];
+   }
+   rc = splinterdb_parallel_scan(data->kvsb,
+                                 NULL_SLICE,
+                                 NULL_SLICE,
+                                 num_parts,
+                                 NULL,
+                                 scan_sum_tuple,
+                                 args);
+   ASSERT_EQUAL(0, rc);
+   uint64 num_tuples = 0;
+   uint64 sum        = 0;
+   for (int i = 0; i < num_parts; i++) {
+      ASSERT_NOT_EQUAL(0, states[i].num_tuples);
+      num_tuples += states[i].num_tuples;
+      sum += states[i].sum;
+   }
+   ASSERT_EQUAL(num_keys, num_tuples);
+   ASSERT_EQUAL((uint64)num_keys * (num_keys - 1) / 2, sum);
+
+   // A part that stops stops the scan
+   for (int i = 0; i < num_parts; i++) {
+      states[i] = (scan_sum){.stop_at = num_keys - 1};
+   }
+   rc = splinterdb_parallel_scan(data->kvsb,
+                                 NULL_SLICE,
+                                 NULL_SLICE,
+                                 num_parts,
+                                 NULL,
+                                 scan_sum_tuple,
+                                 args);
+   ASSERT_EQUAL(ECANCELED, rc);
+#undef NUM_PARTS
+}
+
+/*
+ * Looks up key in kvs and returns the int value found, or -1 if none.
+ */
+static int
+keyspace_lookup_int(splinterdb *kvs, const char *key)
+{
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(kvs, &result, 0, NULL);
+   int rc = splinterdb_lookup(kvs, slice_create(strlen(key), key), &result);
+   int v  = -1;
+   if (rc == 0 && splinterdb_lookup_found(&result)) {
+      slice value;
+      rc = splinterdb_lookup_result_value(&result, &value);
+      if (rc == 0) {
+         memcpy(&v, slice_data(value), sizeof(v));
+      }
+   }
+   splinterdb_lookup_result_deinit(&result);
+   return v;
+}
+
+/*
+ * Test case to verify that keyspaces keep their tuples apart from each other
+ * and from the default keyspace, across a close and reopen, and that a file
+ * holds as many as it has super blocks for.
+ */
+CTEST2(splinterdb_quick, test_keyspaces)
+{
+   data_config ks_data_cfg;
+   default_data_config_init(32, &ks_data_cfg);
+
+   // Room for the extents of every keyspace the file has super blocks for
+   splinterdb_close(&data->kvsb);
+   data->cfg.disk_size = GiB_TO_B(1);
+   int rc              = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb *ks_a = NULL;
+   splinterdb *ks_b = NULL;
+   rc = splinterdb_keyspace_create(data->kvsb, "a", &ks_data_cfg, &ks_a);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_keyspace_create(data->kvsb, "b", &ks_data_cfg, &ks_b);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(ks_a != ks_b);
+
+   splinterdb *ks = NULL;
+   rc = splinterdb_keyspace_create(data->kvsb, "a", &ks_data_cfg, &ks);
+   ASSERT_EQUAL(EEXIST, rc);
+   rc = splinterdb_keyspace_open(data->kvsb, "a", &ks_data_cfg, &ks);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(ks == ks_a);
+   rc = splinterdb_keyspace_open(data->kvsb, "c", &ks_data_cfg, &ks);
+   ASSERT_EQUAL(ENOENT, rc);
+   rc = splinterdb_keyspace_create(data->kvsb, "", &ks_data_cfg, &ks);
+   ASSERT_EQUAL(EINVAL, rc);
+   rc = splinterdb_keyspace_create(ks_a, "c", &ks_data_cfg, &ks);
+   ASSERT_EQUAL(EINVAL, rc);
+   rc = splinterdb_checkpoint(data->kvsb);
+   ASSERT_EQUAL(ENOTSUP, rc);
+
+   // The same keys, with a value per keyspace
+   const int   num_keys      = 1000;
+   splinterdb *keyspaces[3]  = {data->kvsb, ks_a, ks_b};
+   char        kbuf[16];
+   for (int k = 0; k < 3; k++) {
+      for (int i = 0; i < num_keys; i += k + 1) {
+         snprintf(kbuf, sizeof(kbuf), "%08d", i);
+         int v = k * num_keys + i;
+         rc    = splinterdb_insert(keyspaces[k],
+                                slice_create(strlen(kbuf), kbuf),
+                                slice_create(sizeof(v), &v));
+         ASSERT_EQUAL(0, rc);
+      }
+   }
+
+   for (int reopen = 0; reopen < 2; reopen++) {
+      for (int k = 0; k < 3; k++) {
+         for (int i = 0; i < num_keys; i += 7) {
+            snprintf(kbuf, sizeof(kbuf), "%08d", i);
+            int v = keyspace_lookup_int(keyspaces[k], kbuf);
+            ASSERT_EQUAL(i % (k + 1) == 0 ? k * num_keys + i : -1,
+                         v,
+                         "reopen=%d k=%d i=%d",
+                         reopen,
+                         k,
+                         i);
+         }
+         scan_sum state = {.stop_at = -1};
+         rc             = splinterdb_scan(
+            keyspaces[k], NULL_SLICE, NULL_SLICE, NULL, scan_sum_tuple, &state);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_EQUAL((num_keys + k) / (k + 1), state.num_tuples);
+      }
+
+      splinterdb_close(&data->kvsb);
+      rc = splinterdb_open(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+      rc = splinterdb_keyspace_open(data->kvsb, "a", &ks_data_cfg, &ks_a);
+      ASSERT_EQUAL(0, rc);
+      rc = splinterdb_keyspace_open(data->kvsb, "b", &ks_data_cfg, &ks_b);
+      ASSERT_EQUAL(0, rc);
+      keyspaces[0] = data->kvsb;
+      keyspaces[1] = ks_a;
+      keyspaces[2] = ks_b;
+   }
+
+   // The default keyspace and "a" and "b" take 3 of the super blocks
+   int num_created = 0;
+   do {
+      snprintf(kbuf, sizeof(kbuf), "ks%d", num_created);
+      rc = splinterdb_keyspace_create(data->kvsb, kbuf, &ks_data_cfg, &ks);
+   } while (rc == 0 && ++num_created < 100);
+   ASSERT_EQUAL(ENOSPC, rc);
+   ASSERT_EQUAL(27, num_created);
+
+   // ks_data_cfg goes out of scope
+   splinterdb_close(&data->kvsb);
+}
+
+/*
+ * Test case to verify that compacting a range, one level or all of them,
+ * keeps its data intact, and that a full compaction drops the overwritten
+ * and deleted tuples.
+ */
+CTEST2(splinterdb_quick, test_compact_range)
+{
+   const int num_keys = 100000;
+
+   // Small nodes, so the keys span many leaves and more than one level
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity     = MiB_TO_B(1);
+   data->cfg.fanout                = 4;
+   data->cfg.max_branches_per_node = 4;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   bulk_load_source src = {.num_keys = num_keys, .out_of_order_at = -1};
+   rc = splinterdb_bulk_load(data->kvsb, bulk_load_next, &src);
+   ASSERT_EQUAL(0, rc);
+
+   // Overwrite the even keys with short values and delete every third key
+   char   kbuf[16];
+   int    v;
+   uint64 num_live = 0;
+   uint64 sum      = 0;
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(kbuf, sizeof(kbuf), "%012d", i);
+      if (i % 3 == 0) {
+         rc = splinterdb_delete(data->kvsb, slice_create(12, kbuf));
+         ASSERT_EQUAL(0, rc);
+         continue;
+      }
+      v = i;
+      if (i % 2 == 0) {
+         v  = -i;
+         rc = splinterdb_insert(
+            data->kvsb, slice_create(12, kbuf), slice_create(sizeof(v), &v));
+         ASSERT_EQUAL(0, rc);
+      }
+      num_live++;
+      sum += v;
+   }
+
+   snprintf(kbuf, sizeof(kbuf), "%012d", num_keys / 2);
+   slice middle = slice_create(12, kbuf);
+   rc = splinterdb_compact_range(data->kvsb, middle, NULL_SLICE, 100);
+   ASSERT_EQUAL(0, rc);
+   for (uint64 level = 0; level < 3; level++) {
+      rc = splinterdb_compact_range(data->kvsb, NULL_SLICE, middle, level);
+      ASSERT_EQUAL(0, rc);
+   }
+   rc = splinterdb_compact_wait(data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   scan_sum state = {.stop_at = num_keys};
+   rc             = splinterdb_scan(
+      data->kvsb, NULL_SLICE, NULL_SLICE, NULL, scan_sum_tuple, &state);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_live, state.num_tuples);
+   ASSERT_EQUAL(sum, state.sum);
+
+   splinterdb_size_estimate before;
+   rc = splinterdb_approximate_size(
+      data->kvsb, NULL_SLICE, NULL_SLICE, FALSE, &before);
+   ASSERT_EQUAL(0, rc);
+   allocator *al     = (allocator *)splinterdb_get_allocator_handle(data->kvsb);
+   uint64     in_use = allocator_in_use(al);
+
+   rc = splinterdb_compact_range(
+      data->kvsb, NULL_SLICE, NULL_SLICE, SPLINTERDB_COMPACT_ALL_LEVELS);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_compact_wait(data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_size_estimate after;
+   rc = splinterdb_approximate_size(
+      data->kvsb, NULL_SLICE, NULL_SLICE, FALSE, &after);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(num_live < before.num_tuples);
+   ASSERT_EQUAL(num_live, after.num_tuples);
+   ASSERT_TRUE(allocator_in_use(al) < in_use);
+
+   state = (scan_sum){.stop_at = num_keys};
+   rc    = splinterdb_scan(
+      data->kvsb, NULL_SLICE, NULL_SLICE, NULL, scan_sum_tuple, &state);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_live, state.num_tuples);
+   ASSERT_EQUAL(sum, state.sum);
+
+   // Too long a key
+   char long_key[TEST_MAX_KEY_SIZE + 1] = {0};
+   rc = splinterdb_compact_range(data->kvsb,
+                                 slice_create(sizeof(long_key), long_key),
+                                 NULL_SLICE,
+                                 SPLINTERDB_COMPACT_ALL_LEVELS);
+   ASSERT_EQUAL(EINVAL, rc);
+}
+
+/*
+ * Test case to verify that splinterdb_stats_get() counts operations and the
+ * flushes, cache and disk use they lead to, and rejects unknown versions.
+ */
+CTEST2(splinterdb_quick, test_stats_get)
+{
+   const int num_keys = 50000;
+
+   splinterdb_stats stats = {.version = SPLINTERDB_STATS_VERSION};
+   int              rc    = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_FALSE(stats.stats_enabled);
+   ASSERT_EQUAL(0, stats.insertions);
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_stats         = TRUE;
+   data->cfg.memtable_capacity = MiB_TO_B(1);
+   rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char value[100];
+   memset(value, 'v', sizeof(value));
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(12, key),
+                             slice_create(sizeof(value), value));
+      ASSERT_EQUAL(0, rc);
+   }
+   for (int i = 0; i < 10; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_delete(data->kvsb, slice_create(12, key));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < 100; i++) {
+      snprintf(key, sizeof(key), "%012d", 2 * i * num_keys / 100);
+      rc = splinterdb_lookup(data->kvsb, slice_create(12, key), &result);
+      ASSERT_EQUAL(0, rc);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   stats = (splinterdb_stats){.version = SPLINTERDB_STATS_VERSION};
+   rc    = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(stats.stats_enabled);
+   ASSERT_EQUAL(num_keys, stats.insertions);
+   ASSERT_EQUAL(10, stats.deletions);
+   ASSERT_EQUAL(0, stats.updates);
+   ASSERT_EQUAL(100, stats.lookups_found + stats.lookups_not_found);
+   ASSERT_TRUE(stats.lookups_found >= 40 && stats.lookups_found <= 50);
+   ASSERT_TRUE(0 < stats.memtable_flushes);
+   ASSERT_TRUE(stats.tree_height < SPLINTERDB_STATS_MAX_HEIGHT);
+   ASSERT_TRUE(0 < stats.cache_hits);
+   ASSERT_TRUE(0 < stats.tasks_enqueued);
+   ASSERT_TRUE(0 < stats.disk_bytes_in_use);
+   ASSERT_TRUE(stats.disk_bytes_in_use <= stats.disk_capacity_bytes);
+   ASSERT_EQUAL(data->cfg.disk_size, stats.disk_capacity_bytes);
+
+   splinterdb_stats_reset(data->kvsb);
+   stats = (splinterdb_stats){.version = SPLINTERDB_STATS_VERSION};
+   rc    = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(0, stats.insertions);
+
+   stats.version = SPLINTERDB_STATS_VERSION + 1;
+   rc            = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(EINVAL, rc);
+}
+
+/*
+ * Test case to verify that splinterdb_stats_get() reports latency
+ * percentiles of each operation, and leaves them alone for callers of
+ * version 1 of the stats.
+ */
+CTEST2(splinterdb_quick, test_stats_latency)
+{
+   const int num_keys = 20000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_stats         = TRUE;
+   data->cfg.memtable_capacity = MiB_TO_B(1);
+   int rc                      = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char value[100];
+   memset(value, 'v', sizeof(value));
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(12, key),
+                             slice_create(sizeof(value), value));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_lookup_result result;
+   splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+   for (int i = 0; i < 100; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_lookup(data->kvsb, slice_create(12, key), &result);
+      ASSERT_EQUAL(0, rc);
+   }
+   splinterdb_lookup_result_deinit(&result);
+
+   splinterdb_iterator *it = NULL;
+   rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+   ASSERT_EQUAL(0, rc);
+   for (int i = 0; i < 10; i++) {
+      ASSERT_TRUE(splinterdb_iterator_valid(it));
+      splinterdb_iterator_next(it);
+   }
+   splinterdb_iterator_deinit(it);
+
+   splinterdb_stats stats = {.version = SPLINTERDB_STATS_VERSION};
+   rc                     = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+
+   const splinterdb_latency *insert =
+      &stats.latency[SPLINTERDB_LATENCY_INSERT];
+   ASSERT_EQUAL(num_keys, insert->count);
+   ASSERT_TRUE(0 < insert->p50_ns);
+   ASSERT_TRUE(insert->p50_ns <= insert->p90_ns);
+   ASSERT_TRUE(insert->p90_ns <= insert->p99_ns);
+   ASSERT_TRUE(insert->p99_ns <= insert->p999_ns);
+   ASSERT_TRUE(insert->p999_ns <= insert->max_ns);
+   ASSERT_TRUE(insert->mean_ns <= insert->max_ns);
+
+   ASSERT_EQUAL(100, stats.latency[SPLINTERDB_LATENCY_LOOKUP].count);
+   ASSERT_EQUAL(0, stats.latency[SPLINTERDB_LATENCY_DELETE].count);
+   ASSERT_EQUAL(1, stats.latency[SPLINTERDB_LATENCY_ITERATOR_INIT].count);
+   ASSERT_EQUAL(10, stats.latency[SPLINTERDB_LATENCY_ITERATOR_NEXT].count);
+   ASSERT_EQUAL(
+      stats.tasks_run_in_foreground,
+      stats.latency[SPLINTERDB_LATENCY_FG_MEMTABLE_TASK].count
+         + stats.latency[SPLINTERDB_LATENCY_FG_NORMAL_TASK].count);
+
+   // Version 1 of the struct ends before the latencies
+   memset(&stats, 0xff, sizeof(stats));
+   stats.version = 1;
+   rc            = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_keys, stats.insertions);
+   ASSERT_EQUAL(UINT64_MAX, stats.latency[SPLINTERDB_LATENCY_INSERT].count);
+
+   stats.version = 0;
+   rc            = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(EINVAL, rc);
+}
+
+/*
+ * Basic test case to check the data volumes kept by compactions, and the
+ * write amplification they come to.
+ */
+CTEST2(splinterdb_quick, test_stats_write_amplification)
+{
+   const int num_keys = 20000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.use_stats         = TRUE;
+   data->cfg.memtable_capacity = MiB_TO_B(1);
+   int rc                      = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char value[100];
+   memset(value, 'v', sizeof(value));
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(12, key),
+                             slice_create(sizeof(value), value));
+      ASSERT_EQUAL(0, rc);
+   }
+   rc = splinterdb_compact_range(
+      data->kvsb, NULL_SLICE, NULL_SLICE, SPLINTERDB_COMPACT_ALL_LEVELS);
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_compact_wait(data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   splinterdb_stats stats = {.version = SPLINTERDB_STATS_VERSION};
+   rc                     = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+
+   ASSERT_EQUAL(num_keys * (12 + sizeof(value)), stats.user_kv_bytes);
+   ASSERT_TRUE(0 < stats.memtable_compaction_kv_bytes);
+   ASSERT_TRUE(stats.memtable_compaction_kv_bytes <= stats.user_kv_bytes);
+   ASSERT_TRUE(0 < stats.memtable_compaction_bytes_written);
+
+   uint64 bytes_written = stats.memtable_compaction_bytes_written;
+   uint64 input_tuples  = 0;
+   for (int h = 0; h < SPLINTERDB_STATS_MAX_HEIGHT; h++) {
+      bytes_written += stats.compaction_bytes_written[h];
+      input_tuples += stats.compaction_input_tuples[h];
+      ASSERT_TRUE(stats.compaction_output_kv_bytes[h]
+                  <= stats.compaction_input_kv_bytes[h]);
+   }
+   ASSERT_TRUE(0 < input_tuples);
+   ASSERT_TRUE(0 < stats.write_amplification);
+   ASSERT_TRUE(stats.write_amplification * stats.user_kv_bytes
+               <= bytes_written + 1);
+
+   // Version 2 of the struct ends before the data volumes
+   memset(&stats, 0xff, sizeof(stats));
+   stats.version = 2;
+   rc            = splinterdb_stats_get(data->kvsb, &stats);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(num_keys, stats.insertions);
+   ASSERT_EQUAL(UINT64_MAX, stats.user_kv_bytes);
+
+   splinterdb_stats_print_space_use(data->kvsb);
+   splinterdb_stats_print_insertion(data->kvsb);
+}
+
+/*
+ * Test case to verify that size estimates are close to the number of tuples
+ * in a range, including those in memtables when asked to.
+ */
+CTEST2(splinterdb_quick, test_approximate_size)
+{
+   const int num_keys = 100000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity = MiB_TO_B(1);
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+
+   char key[16];
+   char end[16];
+   char value[100];
+   memset(value, 'v', sizeof(value));
+   for (int i = 0; i < num_keys; i++) {
+      snprintf(key, sizeof(key), "%012d", i);
+      rc = splinterdb_insert(data->kvsb,
+                             slice_create(12, key),
+                             slice_create(sizeof(value), value));
+      ASSERT_EQUAL(0, rc);
+   }
+
+   splinterdb_size_estimate estimate;
+   rc = splinterdb_approximate_size(
+      data->kvsb, NULL_SLICE, NULL_SLICE, TRUE, &estimate);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(num_keys * 9 / 10 <= estimate.num_tuples
+                  && estimate.num_tuples <= num_keys * 11 / 10,
+               "num_tuples=%lu",
+               estimate.num_tuples);
+   ASSERT_TRUE(estimate.num_tuples * (12 + sizeof(value)) / 2
+                  <= estimate.num_bytes,
+               "num_bytes=%lu",
+               estimate.num_bytes);
+
+   // A range within the table, which the memtables add little to
+   snprintf(key, sizeof(key), "%012d", num_keys / 4);
+   snprintf(end, sizeof(end), "%012d", num_keys * 3 / 4);
+   rc = splinterdb_approximate_size(data->kvsb,
+                                    slice_create(12, key),
+                                    slice_create(12, end),
+                                    FALSE,
+                                    &estimate);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(num_keys / 2 * 8 / 10 <= estimate.num_tuples
+                  && estimate.num_tuples <= num_keys / 2 * 12 / 10,
+               "num_tuples=%lu",
+               estimate.num_tuples);
+
+   // Tuples still in the memtable are only counted when asked for
+   snprintf(key, sizeof(key), "x");
+   rc = splinterdb_insert(data->kvsb,
+                          slice_create(1, key),
+                          slice_create(sizeof(value), value));
+   ASSERT_EQUAL(0, rc);
+   rc = splinterdb_approximate_size(
+      data->kvsb, slice_create(1, key), NULL_SLICE, FALSE, &estimate);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(0, estimate.num_tuples);
+   rc = splinterdb_approximate_size(
+      data->kvsb, slice_create(1, key), NULL_SLICE, TRUE, &estimate);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(1, estimate.num_tuples);
+   ASSERT_EQUAL(1 + sizeof(value), estimate.num_bytes);
+
+   // An empty range
+   rc = splinterdb_approximate_size(
+      data->kvsb, slice_create(1, key), slice_create(12, end), TRUE, &estimate);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_EQUAL(0, estimate.num_tuples);
+}
+
+/*
+ * Fills value with a pattern of i and round, so a lookup can tell which
+ * write it sees.
+ */
+static void
+value_log_fill(char *value, int length, int i, int round)
+{
+   for (int j = 0; j < length; j++) {
+      value[j] = (char)(i * 7 + j + round * 31);
+   }
+}
+
+/*
+ * Test case to verify that values over the value log threshold, including
+ * ones too long to be stored inline, read back through lookups and
+ * iterators, that the garbage collector gives back the space of overwritten
+ * values, and that the value log persists across a clean close.
+ */
+CTEST2(splinterdb_quick, test_value_log)
+{
+   const int num_keys  = 2000;
+   const int value_len = 3000;
+
+   splinterdb_close(&data->kvsb);
+   data->cfg.memtable_capacity   = MiB_TO_B(1);
+   data->cfg.value_log_threshold = 256;
+   int rc = splinterdb_create(&data->cfg, &data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(MAX_INLINE_MESSAGE_SIZE(LAIO_DEFAULT_PAGE_SIZE) < value_len);
+
+   char  key[16];
+   char *value    = TYPED_ARRAY_MALLOC(data->cfg.heap_id, value, value_len);
+   char *expected = TYPED_ARRAY_MALLOC(data->cfg.heap_id, expected, value_len);
+   ASSERT_TRUE(value != NULL && expected != NULL);
+   for (int round = 0; round < 2; round++) {
+      for (int i = 0; i < num_keys; i++) {
+         snprintf(key, sizeof(key), "%012d", i);
+         // Every third value is short enough to stay in the trunk
+         int len = i % 3 == 0 ? 100 : value_len;
+         value_log_fill(value, len, i, round);
+         rc = splinterdb_insert(
+            data->kvsb, slice_create(12, key), slice_create(len, value));
+         ASSERT_EQUAL(0, rc);
+      }
+   }
+
+   snprintf(key, sizeof(key), "%012d", 0);
+   rc = splinterdb_update(
+      data->kvsb, slice_create(12, key), slice_create(1, value));
+   ASSERT_EQUAL(ENOTSUP, rc);
+
+   allocator *al     = (allocator *)splinterdb_get_allocator_handle(data->kvsb);
+   uint64     in_use = allocator_in_use(al);
+   rc                = splinterdb_value_log_gc(data->kvsb);
+   ASSERT_EQUAL(0, rc);
+   ASSERT_TRUE(allocator_in_use(al) < in_use);
+
+   for (int pass = 0; pass < 2; pass++) {
+      splinterdb_lookup_result result;
+      splinterdb_lookup_result_init(data->kvsb, &result, 0, NULL);
+      for (int i = 0; i < num_keys; i += 7) {
+         snprintf(key, sizeof(key), "%012d", i);
+         rc = splinterdb_lookup(data->kvsb, slice_create(12, key), &result);
+         ASSERT_EQUAL(0, rc);
+         ASSERT_TRUE(splinterdb_lookup_found(&result), "i=%d", i);
+         slice found;
+         rc = splinterdb_lookup_result_value(&result, &found);
+         ASSERT_EQUAL(0, rc);
+         int len = i % 3 == 0 ? 100 : value_len;
+         value_log_fill(expected, len, i, 1);
+         ASSERT_EQUAL(len, slice_length(found), "i=%d", i);
+         ASSERT_EQUAL(0, memcmp(expected, slice_data(found), len), "i=%d", i);
+      }
+      splinterdb_lookup_result_deinit(&result);
+
+      splinterdb_iterator *it = NULL;
+      rc = splinterdb_iterator_init(data->kvsb, &it, NULL_SLICE);
+      ASSERT_EQUAL(0, rc);
+      int i = 0;
+      for (; splinterdb_iterator_valid(it); splinterdb_iterator_next(it)) {
+         slice k, v;
+         splinterdb_iterator_get_current(it, &k, &v);
+         snprintf(key, sizeof(key), "%012d", i);
+         ASSERT_EQUAL(0, memcmp(key, slice_data(k), 12), "i=%d", i);
+         int len = i % 3 == 0 ? 100 : value_len;
+         value_log_fill(expected, len, i, 1);
+         ASSERT_EQUAL(len, slice_length(v), "i=%d", i);
+         ASSERT_EQUAL(0, memcmp(expected, slice_data(v), len), "i=%d", i);
+         i++;
+      }
+      ASSERT_EQUAL(0, splinterdb_iterator_status(it));
+      ASSERT_EQUAL(num_keys, i);
+      splinterdb_iterator_deinit(it);
+
+      splinterdb_close(&data->kvsb);
+      rc = splinterdb_open(&data->cfg, &data->kvsb);
+      ASSERT_EQUAL(0, rc);
+   }
+   platform_free(data->cfg.heap_id, value);
+   platform_free(data->cfg.heap_id, expected);
+}
+
 /*
  * Regression test for bug where repeating a cycle of insert-close-reopen
  * causes a space leak and eventually hits an assertion
@@ -9,6 +9,7 @@
  * -----------------------------------------------------------------------------
  */
 #include "util.h"
+#include "latency_histo.h"
 #include "ctest.h" // This is required for all test-case files.
 
 static const char debug_hex_encode_sample_data[10] =
@@ -90,6 +91,50 @@ CTEST2(util, test_debug_hex_encode)
    ASSERT_EQUAL(0, rc, "When dst_len is too short by 1, it doesn't overflow. ");
 }
 
+/*
+ * Test that latency_histo buckets tile the latencies and that percentiles
+ * overestimate by less than a bucket's width.
+ */
+CTEST2(util, test_latency_histo)
+{
+   uint64 prev_bucket = 0;
+   for (uint64 ns = 0; ns < 1000000; ns++) {
+      uint64 bucket = latency_histo_bucket(ns);
+      ASSERT_TRUE(bucket == prev_bucket || bucket == prev_bucket + 1);
+      ASSERT_TRUE(ns <= latency_histo_bucket_max(bucket));
+      ASSERT_TRUE(latency_histo_bucket_max(bucket) <= ns + ns / 8);
+      if (0 < bucket) {
+         ASSERT_TRUE(latency_histo_bucket_max(bucket - 1) < ns);
+      }
+      prev_bucket = bucket;
+   }
+   ASSERT_EQUAL(LATENCY_HISTO_BUCKETS - 1, latency_histo_bucket(UINT64_MAX));
+
+   latency_histo histo;
+   ZERO_CONTENTS(&histo);
+   ASSERT_EQUAL(0, latency_histo_percentile(&histo, 99, 100));
+   for (uint64 ns = 1; ns <= 1000; ns++) {
+      latency_histo_record(&histo, ns);
+   }
+   ASSERT_EQUAL(1000, histo.num);
+   ASSERT_EQUAL(500, latency_histo_mean(&histo));
+   ASSERT_EQUAL(1000, histo.max_ns);
+
+   uint64 p50 = latency_histo_percentile(&histo, 50, 100);
+   ASSERT_TRUE(500 <= p50 && p50 <= 500 + 500 / 8);
+   uint64 p99 = latency_histo_percentile(&histo, 99, 100);
+   ASSERT_TRUE(990 <= p99 && p99 <= 1000);
+   ASSERT_EQUAL(1000, latency_histo_percentile(&histo, 1, 1));
+   ASSERT_EQUAL(1, latency_histo_percentile(&histo, 0, 1));
+
+   latency_histo merged;
+   ZERO_CONTENTS(&merged);
+   latency_histo_merge(&merged, &histo);
+   latency_histo_merge(&merged, &histo);
+   ASSERT_EQUAL(2000, merged.num);
+   ASSERT_EQUAL(p50, latency_histo_percentile(&merged, 50, 100));
+}
+
 static int
 check_one_debug_hex_encode(size_t      dst_len,
                            size_t      data_len,